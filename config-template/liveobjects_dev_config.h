@@ -47,4 +47,27 @@
 //#define LOM_JSON_BUF_SZ                      1024
 //#define LOM_JSON_BUF_USER_SZ                 200
 
+/* Linux platform */
+//#define LOC_FEATURE_MUTEX_STATS              0
+//#define LOC_BATCH_MAX_SAMPLES                32
+//#define LOC_BATCH_MAX_BYTES                  4096
+//#define LOC_BATCH_MAX_AGE_MS                 1000
+//#define LOC_AGGR_WINDOW_MS                   60000
+//#define LOC_SAMPLER_TASKS_MAX                8
+//#define LOC_SHMRING_CAPACITY                 1024
+//#define LOC_SHMRING_FIELDS_MAX               32
+//#define LOC_WORKERS_MAX                      8
+//#define LOC_WORKERS_QUEUE_SIZE               32
+//#define LOC_RSC_SINK_BUF_SZ                  (64 * 1024)
+//#define LOC_HTTP_DL_SAVE_SZ                  (256 * 1024)
+//#define LOC_HTTP_DL_TIMEOUT_S                30
+//#define LOC_HTTP_DL_BUF_SZ                   (64 * 1024)
+//#define LOC_HTTP_DL_CONN_MAX                 4
+//#define LOC_HTTP_DL_SEG_MAX                  8
+//#define LOC_HTTP_DL_SEG_MIN_SZ               (256 * 1024)
+//#define LOC_HTTP_DL_ACTIVE_MAX               4
+//#define LOC_FEATURE_HTTP_GZIP                0
+//#define LOC_FEATURE_RSC_DELTA                0
+//#define LOC_RSC_DELTA_BUF_SZ                 (16 * 1024)
+
 #endif /* __liveobjects_dev_config_H_ */
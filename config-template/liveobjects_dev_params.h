@@ -29,6 +29,16 @@
  /* 0 -> standard output, 1 -> syslog output /var/log/syslog */
  #define SYSLOG 0
 
+ /* 1 -> traces written by a background thread, 0 -> synchronous output */
+ //#define LOC_FEATURE_TRACE_ASYNC              1
+
+ /* 1 -> traces recorded in binary into LOC_TRACE_BIN_FILE (see script/lo_trace_decode.py) */
+ //#define LOC_FEATURE_TRACE_BINARY             0
+ //#define LOC_TRACE_BIN_FILE                   "lo_trace.bin"
+
+ /* Traces with a greater level are removed at compile time (1 error ... 6 debug verbose) */
+ //#define LOC_TRACE_LEVEL_FLOOR                6
+
  #if SECURITY_ENABLED
  /* If security is enabled to establish connection to the LiveObjects platform,*/
  /* include certificates file*/
@@ -15,6 +15,7 @@
  */
 
 #include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,6 +24,10 @@
 #include <unistd.h>
 
 #include "liveobjects_iotsoftbox_api.h"
+#include "liveobjects-sys/loc_cmdargs.h"
+#include "liveobjects-sys/loc_pubq.h"
+#include "liveobjects-sys/loc_wakeup.h"
+#include "liveobjects-sys/loc_workers.h"
 
 /* Default LiveObjects device settings : name space and device identifier*/
 #define LOC_CLIENT_DEV_NAME_SPACE            "LiveObjectsDomain"
@@ -54,8 +59,14 @@
 #define APPV_VERSION "LINUX BASIC SAMPLE V01.1"
 #define LOM_BUILD_TAG "BUILD LiveObjects IoT Basic 1.1"
 
+// Period of the simulated measures
+#define APPV_MEASURES_PERIOD_MS 5000
+
 uint8_t appv_log_level = DBG_DFT_MAIN_LOG_LEVEL;
 
+// Set by SIGINT/SIGTERM to leave the main loop
+static volatile sig_atomic_t appv_stop = 0;
+
 // ==========================================================
 //
 // Live Objects IoT Client object (using iotsoftbox-mqtt library)
@@ -145,7 +156,9 @@ LiveObjectsD_Param_t appv_set_param[] = {
 // Digital output to change the status of the RED LED
 int32_t app_led_user = 0;
 
-/// counter used to postpone the LED command response
+/// LED command waiting for its response : postponed by 'ticks' measures
+static pthread_mutex_t appv_led_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int16_t appv_led_cid = 0;
 static int cmd_cnt = 0;
 
 #define CMD_IDX_RESET 1
@@ -176,9 +189,60 @@ LiveObjectsD_Resource_t appv_set_resources[] = {
 };
 #define SET_RESOURCES_NB (sizeof(appv_set_resources) / sizeof(LiveObjectsD_Resource_t))
 
-// variables used to process the current resource transfer
-uint32_t appv_rsc_size = 0;
-uint32_t appv_rsc_offset = 0;
+// State of the transfer of each resource : the transfers of the resources
+// are independent, several of them can be in progress at the same time
+typedef struct {
+	uint32_t size;
+	uint32_t offset;
+} appv_rsc_xfer_t;
+
+appv_rsc_xfer_t appv_rsc_xfer[SET_RESOURCES_NB];
+
+// Transfer state of a resource (rsc_uref : 1 .. SET_RESOURCES_NB)
+#define RSC_XFER(rsc_ptr) (&appv_rsc_xfer[(rsc_ptr)->rsc_uref - 1])
+
+// ==========================================================
+// Publish requests : posted from any thread (or callback), the messages are
+// built and sent by the main loop (LO_pubq_drain), without contention on the
+// LiveObjects client mutexes
+
+static void appv_publish(LO_pubq_reqType_t type, int hdl) {
+	LO_pubq_req_t req = { type, hdl, 0, NULL };
+	if (LO_pubq_push(&req) == LO_PUBQ_WOULD_BLOCK)
+		printf("appv_publish: queue full, request %d(%d) dropped\r\n", type, hdl);
+}
+
+/// Called by LO_pubq_drain (main loop) with the publish requests
+static void appv_dispatch(const LO_pubq_req_t *req_ptr) {
+	switch (req_ptr->req_type) {
+	case LO_PUBQ_REQ_DATA:
+		LiveObjectsClient_PushData(req_ptr->req_hdl);
+		break;
+	case LO_PUBQ_REQ_STATUS:
+		// The client encodes and publishes the set of status attached by mqtt_start
+		LiveObjectsClient_PushStatus(req_ptr->req_hdl);
+		break;
+	default:
+		break;
+	}
+}
+
+/// Called by LO_pubq_drain (main loop) with the results of the commands run
+/// by the workers (see LO_workers_command / LO_workers_complete)
+static void appv_respond(const LO_pubq_req_t *req_ptr) {
+	static int32_t result;
+
+	if (req_ptr->req_type == LO_PUBQ_REQ_CMD_RSP) {
+		LiveObjectsD_Data_t rsp = { LOD_TYPE_INT32, "result", &result, 1 };
+		result = req_ptr->req_val;
+		printf("appv_respond: command cid=%d result=%d\r\n", req_ptr->req_hdl, result);
+		if (LiveObjectsClient_CommandResponse(req_ptr->req_hdl, &rsp, 1))
+			printf(" !!! ERROR to send the response of the command cid=%d\r\n", req_ptr->req_hdl);
+	} else if (req_ptr->req_type == LO_PUBQ_REQ_PARAM_RSP) {
+		const LiveObjectsD_Param_t *param_ptr = (const LiveObjectsD_Param_t *) req_ptr->req_ctx;
+		printf("appv_respond: param %s result=%d\r\n", param_ptr->parm_data.data_name, req_ptr->req_val);
+	}
+}
 
 // ==========================================================
 // IotSoftbox-mqtt callback functions (in 'C' api)
@@ -190,6 +254,7 @@ LiveObjectsD_ResourceRespCode_t main_cb_rsc_ntfy(uint8_t state, const LiveObject
 	printf("*** rsc_ntfy: ...\r\n");
 
 	if ((rsc_ptr) && (rsc_ptr->rsc_uref > 0) && (rsc_ptr->rsc_uref <= SET_RESOURCES_NB)) {
+		appv_rsc_xfer_t *xfer = RSC_XFER(rsc_ptr);
 		printf("***   user ref     = %d\r\n", rsc_ptr->rsc_uref);
 		printf("***   name         = %s\r\n", rsc_ptr->rsc_name);
 		printf("***   version_old  = %s\r\n", version_old);
@@ -211,13 +276,15 @@ LiveObjectsD_ResourceRespCode_t main_cb_rsc_ntfy(uint8_t state, const LiveObject
 				printf("***   state        = COMPLETED with error !!!!\r\n");
 				// Roll back ?
 			}
-			appv_rsc_offset = 0;
-			appv_rsc_size = 0;
+			xfer->offset = 0;
+			xfer->size = 0;
 
-			// Push Status (message has been updated or not)
-			LiveObjectsClient_PushStatus(appv_hdl_status);
+			// Push the status only when it may have changed (the message is
+			// written by the chunks, even if the transfer fails)
+			if (rsc_ptr->rsc_uref == RSC_IDX_MESSAGE)
+				appv_publish(LO_PUBQ_REQ_STATUS, appv_hdl_status);
 		} else {
-			appv_rsc_offset = 0;
+			xfer->offset = 0;
 			ret = RSC_RSP_ERR_NOT_AUTHORIZED;
 			switch (rsc_ptr->rsc_uref) {
 			case RSC_IDX_MESSAGE:
@@ -232,10 +299,10 @@ LiveObjectsD_ResourceRespCode_t main_cb_rsc_ntfy(uint8_t state, const LiveObject
 				break;
 			}
 			if (ret == RSC_RSP_OK) {
-				appv_rsc_size = size;
+				xfer->size = size;
 				printf("***   state        = START - ACCEPTED\r\n");
 			} else {
-				appv_rsc_size = 0;
+				xfer->size = 0;
 				printf("***   state        = START - REFUSED\r\n");
 			}
 		}
@@ -251,20 +318,26 @@ LiveObjectsD_ResourceRespCode_t main_cb_rsc_ntfy(uint8_t state, const LiveObject
  * to read data from current resource transfer.
  */
 int main_cb_rsc_data(const LiveObjectsD_Resource_t *rsc_ptr, uint32_t offset) {
+	appv_rsc_xfer_t *xfer;
 	int ret;
 
 	if (appv_log_level > 1)
 		printf("*** rsc_data: rsc[%d]='%s' offset=%"PRIu32" - data ready ...\r\n", rsc_ptr->rsc_uref, rsc_ptr->rsc_name,
 				offset);
 
+	if ((rsc_ptr->rsc_uref == 0) || (rsc_ptr->rsc_uref > SET_RESOURCES_NB))
+		return -1;
+	xfer = RSC_XFER(rsc_ptr);
+
 	if (rsc_ptr->rsc_uref == RSC_IDX_MESSAGE) {
-		char buf[40];
 		if (offset > (sizeof(appv_status_message) - 1)) {
 			printf("*** rsc_data: rsc[%d]='%s' offset=%"PRIu32" > %zu - OUT OF ARRAY\r\n", rsc_ptr->rsc_uref, rsc_ptr->rsc_name,
 					offset, sizeof(appv_status_message) - 1);
 			return -1;
 		}
-		ret = LiveObjectsClient_RscGetChunck(rsc_ptr, buf, sizeof(buf) - 1);
+		// Read directly into the message, as much as possible
+		int data_len = sizeof(appv_status_message) - offset - 1;
+		ret = LiveObjectsClient_RscGetChunck(rsc_ptr, &appv_status_message[offset], data_len);
 		if (ret > 0) {
 			if ((offset + ret) > (sizeof(appv_status_message) - 1)) {
 				printf("*** rsc_data: rsc[%"PRIu32"]='%s' offset=%"PRIu32" - read=%d => %"PRIu32" > "
@@ -272,11 +345,10 @@ int main_cb_rsc_data(const LiveObjectsD_Resource_t *rsc_ptr, uint32_t offset) {
 						sizeof(appv_status_message) - 1);
 				return -1;
 			}
-			appv_rsc_offset += ret;
-			memcpy(&appv_status_message[offset], buf, ret);
+			xfer->offset += ret;
 			appv_status_message[offset + ret] = 0;
-			printf("*** rsc_data: rsc[%d]='%s' offset=%"PRIu32" - read=%d/%zu '%s'\r\n", rsc_ptr->rsc_uref, rsc_ptr->rsc_name,
-					offset, ret, sizeof(buf) - 1, appv_status_message);
+			printf("*** rsc_data: rsc[%d]='%s' offset=%"PRIu32" - read=%d/%d '%s'\r\n", rsc_ptr->rsc_uref, rsc_ptr->rsc_name,
+					offset, ret, data_len, appv_status_message);
 		}
 	} else if (rsc_ptr->rsc_uref == RSC_IDX_IMAGE) {
 		if (offset > (sizeof(appv_rsc_image) - 1)) {
@@ -293,13 +365,13 @@ int main_cb_rsc_data(const LiveObjectsD_Resource_t *rsc_ptr, uint32_t offset) {
 						sizeof(appv_rsc_image) - 1);
 				return -1;
 			}
-			appv_rsc_offset += ret;
+			xfer->offset += ret;
 			if (appv_log_level > 0)
 				printf("*** rsc_data: rsc[%d]='%s' offset=%"PRIu32" - read=%d/%d - %"PRIu32"/%"PRIu32"\r\n", rsc_ptr->rsc_uref,
-						rsc_ptr->rsc_name, offset, ret, data_len, appv_rsc_offset, appv_rsc_size);
+						rsc_ptr->rsc_name, offset, ret, data_len, xfer->offset, xfer->size);
 		} else {
 			printf("*** rsc_data: rsc[%d]='%s' offset=%"PRIu32" - read error (%d) - %"PRIu32"/%"PRIu32"\r\n", rsc_ptr->rsc_uref,
-					rsc_ptr->rsc_name, offset, ret, appv_rsc_offset, appv_rsc_size);
+					rsc_ptr->rsc_name, offset, ret, xfer->offset, xfer->size);
 		}
 	} else {
 		ret = -1;
@@ -315,6 +387,12 @@ static int
 main_cmd_doSystemReset(LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk);
 static int main_cmd_doLED(LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk);
 
+/// Commands run by the worker thread, found by name (LO_workers_dispatch)
+static const LO_workers_cmd_t appv_cmd_handlers[] = {
+		{ "LED", main_cmd_doLED }
+};
+#define CMD_HANDLERS_NB (sizeof(appv_cmd_handlers) / sizeof(LO_workers_cmd_t))
+
 /// Called (by the LiveObjects thread) to perform an 'attached/registered'
 /// command
 int main_cb_command(LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk) {
@@ -342,13 +420,11 @@ int main_cb_command(LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk) {
 			ret = main_cmd_doSystemReset(pCmdReqBlk);
 			break;
 
-		case CMD_IDX_LED:  // LED
+		default:  // LED, ... : run by the worker thread, response pending
 			printf("main_callbackCommand: command[%d] %s\r\n", cmd_ptr->cmd_uref, cmd_ptr->cmd_name);
-			ret = main_cmd_doLED(pCmdReqBlk);
-			break;
-		default:
-			printf("main_callbackCommand: ERROR, unknown command %d\r\n", cmd_ptr->cmd_uref);
-			ret = -4;
+			ret = LO_workers_dispatch(pCmdReqBlk);
+			if (ret == -4)
+				printf("main_callbackCommand: ERROR, unknown command %d\r\n", cmd_ptr->cmd_uref);
 	}
 	return ret;
 }
@@ -372,44 +448,60 @@ static int main_cmd_doSystemReset(LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk
 }
 
 // ----------------------------------------------------------
-/// do a LED command
+/// do a LED command (in a worker thread)
 static int main_cmd_doLED(LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk) {
 	int ret;
-	// switch on the Red LED
-	app_led_user = 0;
+	int32_t cnt = 0;
+	int i;
 
-	if (pCmdReqBlk->hd.cmd_args_nb == 0) {
+	if (pCmdReqBlk->hd.cmd_args_nb == 0)
 		printf("main_cmd_doLED: No ARG\r\n");
-		app_led_user = !app_led_user;
-		ret = 1;  // Response OK
-		cmd_cnt = 0;
-	} else {
-		int i;
-		for (i = 0; i < pCmdReqBlk->hd.cmd_args_nb; i++) {
-			if (strncasecmp("ticks", pCmdReqBlk->args_array[i].arg_name, 5)
-					&& pCmdReqBlk->args_array[i].arg_type == 0) {
-				int cnt = atoi(pCmdReqBlk->args_array[i].arg_value);
-				if ((cnt >= 0) || (cnt <= 3)) {
-					cmd_cnt = cnt;
-				} else {
-					cmd_cnt = 0;
-				}
-				printf("main_cmd_doLED: cmd_cnt = %di (%d)\r\n", cmd_cnt, cnt);
+
+	for (i = 0; i < pCmdReqBlk->hd.cmd_args_nb; i++) {
+		LO_cmdarg_t arg;
+		if (LO_cmdarg_fromText(&arg, pCmdReqBlk->args_array[i].arg_name, pCmdReqBlk->args_array[i].arg_value))
+			continue;
+		if (LO_cmdarg_nameIs(&arg, "ticks")) {
+			// Number of measures before the response : 0 .. 3
+			if ((LO_cmdarg_toInt(&arg, &cnt)) || (cnt < 0) || (cnt > 3)) {
+				printf("main_cmd_doLED: invalid ticks '%.*s'\r\n", (int) arg.value.len, arg.value.ptr);
+				return -2;  // Response ERROR
 			}
+			printf("main_cmd_doLED: cmd_cnt = %d\r\n", cnt);
 		}
 	}
 
-	if (cmd_cnt == 0) {
+	pthread_mutex_lock(&appv_led_mutex);
+	if ((cnt == 0) || (appv_led_cid)) {
+		// switch the Red LED now
 		app_led_user = !app_led_user;
 		ret = 1;  // Response OK
 	} else {
-		LiveObjectsD_Command_t *cmd_ptr = (LiveObjectsD_Command_t *) (pCmdReqBlk->hd.cmd_ptr);
-		app_led_user = 0;
-		printf("main_cmd_doLED: ccid=%d (%d)\r\n", pCmdReqBlk->hd.cmd_cid, cmd_ptr->cmd_cid);
-		cmd_ptr->cmd_cid = pCmdReqBlk->hd.cmd_cid;
+		// response postponed : completed by appli_sched
+		printf("main_cmd_doLED: cid=%d pending for %d measures\r\n", pCmdReqBlk->hd.cmd_cid, cnt);
+		appv_led_cid = pCmdReqBlk->hd.cmd_cid;
+		cmd_cnt = cnt;
 		ret = 0;  // pending
 	}
-	return ret;  // response = OK
+	pthread_mutex_unlock(&appv_led_mutex);
+	return ret;
+}
+
+// ----------------------------------------------------------
+/// Complete the postponed LED command (main loop)
+static void main_cmd_ledTick(void) {
+	int16_t cid = 0;
+
+	pthread_mutex_lock(&appv_led_mutex);
+	if ((appv_led_cid) && (--cmd_cnt <= 0)) {
+		app_led_user = !app_led_user;
+		cid = appv_led_cid;
+		appv_led_cid = 0;
+	}
+	pthread_mutex_unlock(&appv_led_mutex);
+
+	if (cid)
+		LO_workers_complete(cid, 1);  // Response OK
 }
 
 // ----------------------------------------------------------
@@ -493,13 +585,15 @@ void appli_sched(void) {
 	appv_measures_volt += appv_measures_volt_grad;
 	appv_measures_temp += appv_measures_temp_grad;
 
+	main_cmd_ledTick();
+
 	if (appv_log_level > 2)
 		printf("thread_appli: %"PRIu32" - %s PUBLISH - volt=%2.2f temp=%d\r\n", loop_cnt,
 				appv_measures_enabled ? "DATA" : "NO", appv_measures_volt, appv_measures_temp);
 
 	if (appv_measures_enabled) {
-		printf("LiveObjectsClient_PushData...\n");
-		LiveObjectsClient_PushData(appv_hdl_data);
+		printf("appli_sched: publish DATA...\n");
+		appv_publish(LO_PUBQ_REQ_DATA, appv_hdl_data);
 		appv_measures_counter++;
 	}
 }
@@ -559,6 +653,15 @@ bool mqtt_start(void *ctx) {
 		printf("mqtt_start: LiveObjectsClient_AttachData -> OK\n");
 	}
 
+	// Start the worker running the LED command, its responses are sent
+	// by the main loop
+	// -----------------------------------------------------------------
+	LO_workers_setCommands(appv_cmd_handlers, CMD_HANDLERS_NB);
+	if (LO_workers_start(1)) {
+		printf(" !!! ERROR to start the worker thread !\r\n");
+	}
+	LO_workers_setResponder(appv_respond);
+
 	// Attach a set of commands to the LiveObjects Client instance
 	// -----------------------------------------------------------
 	ret = LiveObjectsClient_AttachCommands(appv_set_commands, SET_COMMANDS_NB, main_cb_command);
@@ -590,15 +693,26 @@ bool mqtt_start(void *ctx) {
 		return false;
 	}
 
-	ret = LiveObjectsClient_PushStatus(appv_hdl_status);
-	if (ret) {
-		printf("mqtt_start: ERROR returned by LiveObjectsClient_PushStatus\n");
-	}
+	appv_publish(LO_PUBQ_REQ_STATUS, appv_hdl_status);
 
 	printf("mqtt_start: OK\n");
 	return true;
 }
 
+// ----------------------------------------------------------
+
+static uint64_t main_now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void main_sig_stop(int sig) {
+	appv_stop = 1;
+	// Cut the wait of the main loop
+	LO_wakeup_signal();
+}
+
 // ----------------------------------------------------------
 /// Entry point to the program
 int main() {
@@ -608,12 +722,32 @@ int main() {
 	LiveObjectsClient_InitDbgTrace(DBG_DFT_MAIN_LOG_LEVEL);
 	LiveObjectsClient_SetDbgMsgDump(DBG_DFT_MSG_DUMP);
 
+	signal(SIGINT, main_sig_stop);
+	signal(SIGTERM, main_sig_stop);
+
 	if (mqtt_start(NULL)) {
-		while (1) {
-			appli_sched();
-			LiveObjectsClient_Cycle(5000);
+		uint64_t next_ms = main_now_ms();
+		while (!appv_stop) {
+			uint64_t now_ms = main_now_ms();
+			if (now_ms >= next_ms) {
+				appli_sched();
+				next_ms += APPV_MEASURES_PERIOD_MS;
+				now_ms = main_now_ms();
+				if (next_ms <= now_ms)
+					next_ms = now_ms + APPV_MEASURES_PERIOD_MS;
+			}
+			// Publish the requests posted since the last cycle
+			LO_pubq_drain(appv_dispatch);
+			// Idle until the next measure : a request posted by another thread
+			// (or a command response) wakes up the loop at once
+			LO_wakeup_arm();
+			LiveObjectsClient_Cycle((int) (next_ms - now_ms));
 		}
+		printf("Stopping LiveObject Client Example\n");
+		LO_workers_stop();
+		LiveObjectsClient_Stop();
 	}
 
+	LO_wakeup_close();
 	return ret;
 }
@@ -27,6 +27,7 @@
 
 /* LiveObjects api */
 #include "liveobjects_iotsoftbox_api.h"
+#include "liveobjects-sys/loc_pubq.h"
 
 /* Default LiveObjects device settings : name space and device identifier*/
 #define LOC_CLIENT_DEV_NAME_SPACE            "LiveObjectsDomain"
@@ -205,8 +206,9 @@ void appli_sched(void) {
 					appv_measures_enabled ? "DATA" : "NO", appv_measures_hum, appv_measures_temp);
 		}
 		if (appv_measures_enabled) {
-			printf("LiveObjectsClient_PushData...\n");
-			LiveObjectsClient_PushData(appv_hdl_data);
+			LO_pubq_req_t req = { LO_PUBQ_REQ_DATA, appv_hdl_data, 0, NULL };
+			printf("LO_pubq_push DATA...\n");
+			LO_pubq_push(&req);
 		}
 	}
 }
@@ -256,8 +258,9 @@ bool mqtt_start(void *ctx) {
 		return false;
 	}
 
-	if (LiveObjectsClient_PushStatus(appv_hdl_status)) {
-		printf("mqtt_start: ERROR returned by LiveObjectsClient_PushStatus\n");
+	LO_pubq_req_t req = { LO_PUBQ_REQ_STATUS, appv_hdl_status, 0, NULL };
+	if (LO_pubq_push(&req) < 0) {
+		printf("mqtt_start: ERROR returned by LO_pubq_push\n");
 	}
 
 	printf("mqtt_start: OK\n");
@@ -282,7 +285,8 @@ int main() {
 	if (ret == 0 && mqtt_start(NULL)) {
 		while (1) {
 			appli_sched();
-			/* Launch the cycle every 5 sec */
+			/* Publish the requests, then launch the cycle every 5 sec */
+			LO_pubq_drain(NULL);
 			LiveObjectsClient_Cycle(5000);
 		}
 	}
@@ -24,6 +24,10 @@
 #include <unistd.h>
 
 #include "liveobjects_iotsoftbox_api.h"
+#include "liveobjects-sys/loc_http_dl.h"
+#include "liveobjects-sys/loc_pubq.h"
+#include "liveobjects-sys/loc_rsc_delta.h"
+#include "liveobjects-sys/loc_rsc_sink.h"
 
 /* Default LiveObjects device settings : name space and device identifier*/
 #define LOC_CLIENT_DEV_NAME_SPACE            "LiveObjectsDomain"
@@ -81,18 +85,52 @@ LiveObjectsD_Data_t appv_set_status[] = {
 
 int appv_hdl_status = -1;
 
+// ----------------------------------------------------------
+// CONFIGURATION data
+//
+
+// Digest of the next firmware (MD5 or SHA-256 in hex), set with the resource
+// by the device management : the core does not give it to the notification
+// callback
+char appv_cfg_firmware_digest[65] = "";
+#define PARM_IDX_FIRMWARE_DIGEST 1
+
+// Url of a firmware downloaded by the device itself (see appv_firmware_dl_cycle)
+char appv_cfg_firmware_url[LO_HTTP_DL_URL_SZ] = "";
+#define PARM_IDX_FIRMWARE_URL 2
+
+/// Set of configuration parameters
+LiveObjectsD_Param_t appv_set_param[] = {
+		{ PARM_IDX_FIRMWARE_DIGEST, { LOD_TYPE_STRING_C, "firmware_digest", appv_cfg_firmware_digest, 1 } },
+		{ PARM_IDX_FIRMWARE_URL, { LOD_TYPE_STRING_C, "firmware_url", appv_cfg_firmware_url, 1 } }
+};
+#define SET_PARAM_NB (sizeof(appv_set_param) / sizeof(LiveObjectsD_Param_t))
+
 // ----------------------------------------------------------
 // RESOURCE data
 //
 
 char appv_rv_firmware[10] = "01.00";
-// 300 KBytes chunks
-char appv_rsc_firmware[300 * 1024] = "";
+// The firmware is written in newFirmware.deb as it is received
+LO_rsc_sink_t appv_rsc_firmware;
 #define RSC_IDX_FIRMWARE 1
+#define RSC_FIRMWARE_FILE "newFirmware.deb"
+// The installed firmware is kept, named by its version, to apply the next delta
+#define RSC_FIRMWARE_IMAGE "firmware_%s.deb"
+
+#if LOC_FEATURE_RSC_DELTA
+// The delta (bsdiff) from the installed firmware is applied as it is received,
+// into newFirmware.deb. Both resources share the version of the firmware.
+LO_rsc_delta_t appv_rsc_firmware_delta;
+#define RSC_IDX_FIRMWARE_DELTA 2
+#endif
 
 /// Set of resources
 LiveObjectsD_Resource_t appv_set_resources[] = {
-		{ RSC_IDX_FIRMWARE, "firmware",	appv_rv_firmware, sizeof(appv_rv_firmware) - 1 } // resource used to update appv_status_message
+		{ RSC_IDX_FIRMWARE, "firmware",	appv_rv_firmware, sizeof(appv_rv_firmware) - 1 }, // resource used to update appv_status_message
+#if LOC_FEATURE_RSC_DELTA
+		{ RSC_IDX_FIRMWARE_DELTA, "firmware_delta", appv_rv_firmware, sizeof(appv_rv_firmware) - 1 }
+#endif
 };
 #define SET_RESOURCES_NB (sizeof(appv_set_resources) / sizeof(LiveObjectsD_Resource_t))
 
@@ -100,6 +138,233 @@ LiveObjectsD_Resource_t appv_set_resources[] = {
 uint32_t appv_rsc_size = 0;
 uint32_t appv_rsc_offset = 0;
 
+// ----------------------------------------------------------
+// FIRMWARE download by url
+//
+// The firmware given by firmware_url is downloaded over HTTP into
+// newFirmware.deb (LO_http_dl_start), in the background. Its progress is saved
+// next to the file : an interrupted download is resumed with range requests,
+// by the next attempt or after a restart of the application (LiveObjects
+// sends firmware_url again).
+
+#define APPV_DL_IDLE        0 // No download
+#define APPV_DL_WAITING     1 // To be started (or retried) by the main loop
+#define APPV_DL_RUNNING     2
+#define APPV_DL_DONE        3 // Ended (appv_firmware_dl_ret), to be installed by the main loop
+
+// Number of attempts of an interrupted download
+#define APPV_DL_ATTEMPT_MAX 10
+
+int appv_firmware_dl_state = APPV_DL_IDLE;
+int appv_firmware_dl_ret = 0;
+int appv_firmware_dl_attempts = 0;
+pthread_mutex_t appv_firmware_dl_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// ==========================================================
+// Install newFirmware.deb, and keep it as the image of the new version (if it
+// is known). Return 0, or -1 if dpkg failed.
+int appv_firmware_install(const char *version_old, const char *version_new) {
+	char image[64];
+	FILE *fpRet = NULL;
+	int dpkgRet = -1;
+
+	system("dpkg -i " RSC_FIRMWARE_FILE "; echo $? > returnCode");
+
+	fpRet = fopen("returnCode", "r");
+	if (fpRet != NULL) {
+		if (fscanf(fpRet, "%d", &dpkgRet) != 1)
+			dpkgRet = -1;
+		fclose(fpRet);
+	}
+	unlink("returnCode");
+
+	if (dpkgRet != 0) { // Something went wrong when installing
+		unlink(RSC_FIRMWARE_FILE);
+		return -1;
+	}
+	if (version_new) {
+		snprintf(image, sizeof(image), RSC_FIRMWARE_IMAGE, version_new);
+		rename(RSC_FIRMWARE_FILE, image);
+	} else {
+		unlink(RSC_FIRMWARE_FILE);
+	}
+	snprintf(image, sizeof(image), RSC_FIRMWARE_IMAGE, version_old);
+	unlink(image);
+	return 0;
+}
+
+// ==========================================================
+// Expected digest of the firmware being received, from its length in hex.
+// Return 0 (or 1 if there is no digest), or -1 if it is invalid.
+int appv_firmware_digest(LO_rsc_digest_t *type) {
+	size_t len = strlen(appv_cfg_firmware_digest);
+
+	if (len == 0)
+		return 1;
+	if (len == 32)
+		*type = LO_RSC_DIGEST_MD5;
+	else if (len == 64)
+		*type = LO_RSC_DIGEST_SHA256;
+	else
+		return -1;
+	return 0;
+}
+
+// ==========================================================
+// Publish requests : the messages are built and sent by the main loop
+// (LO_pubq_drain)
+
+static void appv_publish(LO_pubq_reqType_t type, int hdl) {
+	LO_pubq_req_t req = { type, hdl, 0, NULL };
+	if (LO_pubq_push(&req) == LO_PUBQ_WOULD_BLOCK)
+		printf("appv_publish: queue full, request %d(%d) dropped\r\n", type, hdl);
+}
+
+// ==========================================================
+// State of the firmware download by url (and its result).
+int appv_firmware_dl_getState(int *ret) {
+	int state;
+
+	pthread_mutex_lock(&appv_firmware_dl_mutex);
+	state = appv_firmware_dl_state;
+	if (ret)
+		*ret = appv_firmware_dl_ret;
+	pthread_mutex_unlock(&appv_firmware_dl_mutex);
+	return state;
+}
+
+// ==========================================================
+// Change the state of the firmware download by url.
+void appv_firmware_dl_setState(int state) {
+	pthread_mutex_lock(&appv_firmware_dl_mutex);
+	appv_firmware_dl_state = state;
+	pthread_mutex_unlock(&appv_firmware_dl_mutex);
+}
+
+// ==========================================================
+// End of the firmware download by url (called by the download thread) : the
+// firmware is installed by the main loop.
+void appv_firmware_dl_done(void *ctx, const char *path, int ret) {
+	pthread_mutex_lock(&appv_firmware_dl_mutex);
+	appv_firmware_dl_ret = ret;
+	appv_firmware_dl_state = APPV_DL_DONE;
+	pthread_mutex_unlock(&appv_firmware_dl_mutex);
+}
+
+// ==========================================================
+// Start (or continue) the download of firmware_url, verified with
+// firmware_digest. The package is fetched over plain HTTP : the digest is
+// mandatory, otherwise anyone on the path could have any package installed.
+void appv_firmware_dl_start(void) {
+	LO_http_dl_opt_t opt = { LO_RSC_SINK_MMAP, LO_RSC_DIGEST_NONE, appv_cfg_firmware_digest, 0, 0, 0 };
+
+	if (appv_firmware_digest(&opt.digest)) {
+		printf("appv_firmware_dl: ERROR, firmware_digest '%s' is invalid or missing (mandatory)\r\n",
+				appv_cfg_firmware_digest);
+		snprintf(appv_status_message, sizeof(appv_status_message), "no digest: %s", appv_cfg_firmware_url);
+		appv_firmware_dl_setState(APPV_DL_IDLE);
+		appv_publish(LO_PUBQ_REQ_STATUS, appv_hdl_status);
+		return;
+	}
+	printf("appv_firmware_dl: %s (attempt %d)\r\n", appv_cfg_firmware_url, appv_firmware_dl_attempts + 1);
+	appv_firmware_dl_setState(APPV_DL_RUNNING);
+	if (LO_http_dl_start(appv_cfg_firmware_url, RSC_FIRMWARE_FILE, &opt, appv_firmware_dl_done, NULL)) {
+		printf("appv_firmware_dl: ERROR, download not started\r\n");
+		appv_firmware_dl_setState(APPV_DL_IDLE);
+	}
+}
+
+// ==========================================================
+// Called by the main loop : start the download of firmware_url, retry it, or
+// install the firmware once downloaded. The version of the firmware resource
+// is not changed (a delta needs the image of a known version).
+void appv_firmware_dl_cycle(void) {
+	int ret;
+	int state = appv_firmware_dl_getState(&ret);
+
+	if (state == APPV_DL_WAITING) {
+		if (appv_rsc_size == 0) // not during the transfer of a resource
+			appv_firmware_dl_start();
+		return;
+	}
+	if (state != APPV_DL_DONE)
+		return;
+
+	// Only a download verified with firmware_digest (see appv_firmware_dl_start) is installed
+	if (ret == 0) {
+		if (appv_firmware_install(appv_rv_firmware, NULL)) {
+			printf("appv_firmware_dl: ERROR While installing the new firmware\r\n");
+			snprintf(appv_status_message, sizeof(appv_status_message), "dpkg failed: %s", appv_cfg_firmware_url);
+		} else {
+			printf("appv_firmware_dl: New firmware installed\r\n");
+			snprintf(appv_status_message, sizeof(appv_status_message), "installed: %s", appv_cfg_firmware_url);
+		}
+	} else if ((ret == -1) && (++appv_firmware_dl_attempts < APPV_DL_ATTEMPT_MAX)) {
+		// Interrupted : continued by the next cycle
+		appv_firmware_dl_setState(APPV_DL_WAITING);
+		return;
+	} else {
+		printf("appv_firmware_dl: ERROR %d, download of %s failed\r\n", ret, appv_cfg_firmware_url);
+		snprintf(appv_status_message, sizeof(appv_status_message), "%s: %s",
+				(ret == LO_RSC_SINK_ERR_DIGEST) ? "invalid digest" : "download failed", appv_cfg_firmware_url);
+	}
+	appv_firmware_dl_setState(APPV_DL_IDLE);
+	appv_firmware_dl_attempts = 0;
+	appv_publish(LO_PUBQ_REQ_STATUS, appv_hdl_status);
+}
+
+// ==========================================================
+// Start of a resource transfer : open the file (or the delta), and set the
+// digest expected for the firmware.
+LiveObjectsD_ResourceRespCode_t appv_rsc_start(const LiveObjectsD_Resource_t *rsc_ptr, uint32_t size) {
+	LO_rsc_digest_t digest_type = LO_RSC_DIGEST_NONE;
+	int digest = appv_firmware_digest(&digest_type);
+
+	if (digest < 0) {
+		printf("***   invalid firmware_digest '%s'\r\n", appv_cfg_firmware_digest);
+		return RSC_RSP_ERR_INVALID_CHECKSUM;
+	}
+	// Both resources are written into newFirmware.deb
+	if (appv_firmware_dl_getState(NULL) != APPV_DL_IDLE) {
+		printf("***   firmware download by url in progress\r\n");
+		return RSC_RSP_ERR_NOT_AUTHORIZED;
+	}
+
+	switch (rsc_ptr->rsc_uref) {
+	case RSC_IDX_FIRMWARE:
+		if (LO_rsc_sink_open(&appv_rsc_firmware, RSC_FIRMWARE_FILE, size, LO_RSC_SINK_MMAP))
+			break;
+		// Verified as the chunks are received
+		if ((digest == 0)
+				&& (LO_rsc_sink_setDigest(&appv_rsc_firmware, digest_type, appv_cfg_firmware_digest))) {
+			LO_rsc_sink_close(&appv_rsc_firmware, 0);
+			return RSC_RSP_ERR_INVALID_CHECKSUM;
+		}
+		return RSC_RSP_OK;
+#if LOC_FEATURE_RSC_DELTA
+	case RSC_IDX_FIRMWARE_DELTA: {
+		// The delta applies to the image kept for the installed version. The
+		// digest of the new image is mandatory : only it tells that the delta
+		// was made from this image.
+		char image[64];
+		if (digest) {
+			printf("***   firmware_digest is mandatory for a delta\r\n");
+			return RSC_RSP_ERR_INVALID_CHECKSUM;
+		}
+		snprintf(image, sizeof(image), RSC_FIRMWARE_IMAGE, (const char *) rsc_ptr->rsc_version_ptr);
+		if (LO_rsc_delta_open(&appv_rsc_firmware_delta, image, RSC_FIRMWARE_FILE, LO_RSC_SINK_MMAP))
+			break;
+		if (LO_rsc_delta_setDigest(&appv_rsc_firmware_delta, digest_type, appv_cfg_firmware_digest)) {
+			LO_rsc_delta_close(&appv_rsc_firmware_delta, 0);
+			return RSC_RSP_ERR_INVALID_CHECKSUM;
+		}
+		return RSC_RSP_OK;
+	}
+#endif
+	}
+	return RSC_RSP_ERR_NOT_AUTHORIZED;
+}
+
 // ==========================================================
 // IotSoftbox-mqtt callback functions (in 'C' api)
 
@@ -126,24 +391,18 @@ LiveObjectsD_ResourceRespCode_t main_cb_rsc_ntfy(uint8_t state,
 				strncpy((char *) rsc_ptr->rsc_version_ptr, version_new,
 						rsc_ptr->rsc_version_sz);
 
-				if (rsc_ptr->rsc_uref == RSC_IDX_FIRMWARE) {
-					FILE *fpDeb = NULL;
-					fpDeb = fopen("newFirmware.deb", "a");
-					if (fpDeb != NULL) {
-						fwrite(appv_rsc_firmware, sizeof(char), size, fpDeb);
-						fclose(fpDeb);
+				int sink_ret = -1;
+				if (rsc_ptr->rsc_uref == RSC_IDX_FIRMWARE)
+					sink_ret = LO_rsc_sink_close(&appv_rsc_firmware, 1);
+#if LOC_FEATURE_RSC_DELTA
+				else if (rsc_ptr->rsc_uref == RSC_IDX_FIRMWARE_DELTA)
+					sink_ret = LO_rsc_delta_close(&appv_rsc_firmware_delta, 1);
+#endif
+				if (rsc_ptr->rsc_version_ptr == appv_rv_firmware) {
+					if (sink_ret == 0) {
 						printf("Deb creation done\n");
-						system("dpkg -i newFirmware.deb; echo $? > returnCode; rm -rf newFirmware.deb");
-
-						FILE *fpRet = NULL;
-						int dpkgRet;
-						fpRet = fopen("returnCode", "r");
-						fscanf(fpRet, "%d", &dpkgRet);
-						fclose(fpRet);
-
-						if (dpkgRet != 0) { // Something went wrong when installing
+						if (appv_firmware_install(version_old, version_new)) {
 							printf("ERROR While installing the new firmware\n");
-							system("rm -rf returnCode");
 							strncpy(appv_rv_firmware, version_old, sizeof(appv_rv_firmware));
 							ret = RSC_RSP_ERR_INTERNAL_ERROR;
 						} else {
@@ -153,28 +412,27 @@ LiveObjectsD_ResourceRespCode_t main_cb_rsc_ntfy(uint8_t state,
 					} else {
 						printf("ERROR While creating the deb\n");
 						strncpy(appv_rv_firmware, version_old, sizeof(appv_rv_firmware));
-						ret = RSC_RSP_ERR_INTERNAL_ERROR;
+						ret = (sink_ret == LO_RSC_SINK_ERR_DIGEST) ?
+								RSC_RSP_ERR_INVALID_CHECKSUM : RSC_RSP_ERR_INTERNAL_ERROR;
 					}
 				}
 			} else {
 				printf("***   state        = COMPLETED with error !!!!\r\n");
-				// Roll back ?
+				if (rsc_ptr->rsc_uref == RSC_IDX_FIRMWARE)
+					LO_rsc_sink_close(&appv_rsc_firmware, 0);
+#if LOC_FEATURE_RSC_DELTA
+				else if (rsc_ptr->rsc_uref == RSC_IDX_FIRMWARE_DELTA)
+					LO_rsc_delta_close(&appv_rsc_firmware_delta, 0);
+#endif
 			}
 			appv_rsc_offset = 0;
 			appv_rsc_size = 0;
 
-			// Push Status (message has been updated or not)
-			LiveObjectsClient_PushStatus(appv_hdl_status);
+			// Push Status (message has been updated or not) : sent by the main loop
+			appv_publish(LO_PUBQ_REQ_STATUS, appv_hdl_status);
 		} else {
 			appv_rsc_offset = 0;
-			ret = RSC_RSP_ERR_NOT_AUTHORIZED;
-			switch (rsc_ptr->rsc_uref) {
-			case RSC_IDX_FIRMWARE:
-				if (size < (sizeof(appv_rsc_firmware) - 1)) {
-					ret = RSC_RSP_OK;
-				}
-				break;
-			}
+			ret = appv_rsc_start(rsc_ptr, size);
 			if (ret == RSC_RSP_OK) {
 				appv_rsc_size = size;
 				printf("***   state        = START - ACCEPTED\r\n");
@@ -202,44 +460,61 @@ int main_cb_rsc_data(const LiveObjectsD_Resource_t *rsc_ptr, uint32_t offset) {
 		printf("*** rsc_data: rsc[%d]='%s' offset=%u - data ready ...\r\n",
 				rsc_ptr->rsc_uref, rsc_ptr->rsc_name, offset);
 
-	if (rsc_ptr->rsc_uref == RSC_IDX_FIRMWARE) {
-		if (offset > (sizeof(appv_rsc_firmware) - 1)) {
-			printf(
-					"*** rsc_data: rsc[%d]='%s' offset=%u > %u - OUT OF ARRAY\r\n",
-					rsc_ptr->rsc_uref, rsc_ptr->rsc_name, offset,
-					sizeof(appv_rsc_firmware) - 1);
-			return -1;
-		}
-		int data_len = sizeof(appv_rsc_firmware) - offset - 1;
-		ret = LiveObjectsClient_RscGetChunck(rsc_ptr,
-				&appv_rsc_firmware[offset], data_len);
-		if (ret > 0) {
-			if ((offset + ret) > (sizeof(appv_rsc_firmware) - 1)) {
-				printf("*** rsc_data: rsc[%d]='%s' offset=%u - read=%d => %u > "
-						"%u - OUT OF ARRAY\r\n", rsc_ptr->rsc_uref,
-						rsc_ptr->rsc_name, offset, ret, offset + ret,
-						sizeof(appv_rsc_firmware) - 1);
-				return -1;
-			}
-			appv_rsc_offset += ret;
-			if (appv_log_level > 0)
-				printf(
-						"*** rsc_data: rsc[%d]='%s' offset=%u - read=%d/%d - %u/%u\r\n",
-						rsc_ptr->rsc_uref, rsc_ptr->rsc_name, offset, ret,
-						data_len, appv_rsc_offset, appv_rsc_size);
-		} else {
+	if (rsc_ptr->rsc_uref == RSC_IDX_FIRMWARE)
+		ret = LO_rsc_sink_read(&appv_rsc_firmware, rsc_ptr, offset);
+#if LOC_FEATURE_RSC_DELTA
+	else if (rsc_ptr->rsc_uref == RSC_IDX_FIRMWARE_DELTA)
+		ret = LO_rsc_delta_read(&appv_rsc_firmware_delta, rsc_ptr, offset);
+#endif
+	else
+		return -1;
+
+	if (ret > 0) {
+		appv_rsc_offset += ret;
+		if (appv_log_level > 0)
 			printf(
-					"*** rsc_data: rsc[%d]='%s' offset=%u - read error (%d) - %u/%u\r\n",
+					"*** rsc_data: rsc[%d]='%s' offset=%u - read=%d - %u/%u\r\n",
 					rsc_ptr->rsc_uref, rsc_ptr->rsc_name, offset, ret,
 					appv_rsc_offset, appv_rsc_size);
-		}
 	} else {
-		ret = -1;
+		printf(
+				"*** rsc_data: rsc[%d]='%s' offset=%u - read error (%d) - %u/%u\r\n",
+				rsc_ptr->rsc_uref, rsc_ptr->rsc_name, offset, ret,
+				appv_rsc_offset, appv_rsc_size);
 	}
 
 	return ret;
 }
 
+/**
+ * Called (by the LiveObjects thread) to update a configuration parameter.
+ */
+int main_cb_param_udp(const LiveObjectsD_Param_t *param_ptr, const void *value, int len) {
+	if ((param_ptr) && (param_ptr->parm_uref == PARM_IDX_FIRMWARE_URL)) {
+		printf("update firmware_url = %.*s\r\n", len, (const char *) value);
+		if ((len >= (int) sizeof(appv_cfg_firmware_url)) || (appv_firmware_dl_getState(NULL) != APPV_DL_IDLE))
+			return -1;
+		memcpy(appv_cfg_firmware_url, value, len);
+		appv_cfg_firmware_url[len] = 0;
+		// Started by the main loop, once firmware_digest is also updated
+		if (len) {
+			appv_firmware_dl_attempts = 0;
+			appv_firmware_dl_setState(APPV_DL_WAITING);
+		}
+		return 0;
+	}
+	if ((param_ptr) && (param_ptr->parm_uref == PARM_IDX_FIRMWARE_DIGEST)) {
+		printf("update firmware_digest = %.*s\r\n", len, (const char *) value);
+		// Empty (no verification), MD5 or SHA-256
+		if ((len == 0) || (len == 32) || (len == 64)) {
+			memcpy(appv_cfg_firmware_digest, value, len);
+			appv_cfg_firmware_digest[len] = 0;
+			return 0;
+		}
+	}
+	return -1;
+}
+
 // ----------------------------------------------------------
 
 bool mqtt_start(void *ctx) {
@@ -269,6 +544,15 @@ bool mqtt_start(void *ctx) {
 		printf("mqtt_start: LiveObjectsClient_AttachResources -> OK\n");
 	}
 
+	// Attach my local Configuration Parameters to the LiveObjects Client instance
+	// ----------------------------------------------------------------------------
+	ret = LiveObjectsClient_AttachCfgParams(appv_set_param, SET_PARAM_NB, main_cb_param_udp);
+	if (ret) {
+		printf(" !!! ERROR (%d) to attach Config Parameters !\r\n", ret);
+	} else {
+		printf("mqtt_start: LiveObjectsClient_AttachCfgParams -> OK\n");
+	}
+
 	// Attach my local STATUS data to the LiveObjects Client instance
 	// --------------------------------------------------------------
 	appv_hdl_status = LiveObjectsClient_AttachStatus(appv_set_status,
@@ -295,10 +579,7 @@ bool mqtt_start(void *ctx) {
 		return false;
 	}
 
-	ret = LiveObjectsClient_PushStatus(appv_hdl_status);
-	if (ret) {
-		printf("mqtt_start: ERROR returned by LiveObjectsClient_PushStatus\n");
-	}
+	appv_publish(LO_PUBQ_REQ_STATUS, appv_hdl_status);
 
 	printf("mqtt_start: OK\n");
 	return true;
@@ -315,7 +596,10 @@ int main() {
 
 	if (mqtt_start(NULL)) {
 		while (1) {
+			// Publish the requests posted since the last cycle
+			LO_pubq_drain(NULL);
 			LiveObjectsClient_Cycle(5000);
+			appv_firmware_dl_cycle();
 		}
 	}
 
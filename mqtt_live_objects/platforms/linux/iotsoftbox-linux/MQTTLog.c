@@ -12,23 +12,92 @@
  * @file  MQTTLog.c
  * @brief Wrapper for MQTTPacket logs
  *        (see MQTTPacket/StackTrace.h)
+ *
+ * The entry/exit hooks record timestamped events into a ring buffer per
+ * thread, exported by LO_ftrace_export (see loc_ftrace.h).
  */
 
+#include "liveobjects-sys/loc_ftrace.h"
+
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+	const char *name;
+	uint64_t ts_ns;
+	char phase;                    /* 'B' : entry, 'E' : exit*/
+} LO_ftrace_event_t;
+
+typedef struct LO_ftrace_ring_s {
+	struct LO_ftrace_ring_s *next;
+	long tid;
+	uint32_t head;                 /* Number of recorded events*/
+	LO_ftrace_event_t events[LOC_FTRACE_RING_SZ];
+} LO_ftrace_ring_t;
+
+static uint8_t _ftrace_enabled = 0;
+static LO_ftrace_ring_t *_ftrace_rings = NULL;
+static pthread_mutex_t _ftrace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread LO_ftrace_ring_t *_ftrace_ring = NULL;
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+/* Ring of the calling thread (allocated at the first event, kept after the*/
+/* thread exit so that its events can still be exported).*/
+static LO_ftrace_ring_t * _LO_ftrace_ring(void) {
+	LO_ftrace_ring_t *ring = _ftrace_ring;
+	if (ring == NULL) {
+		ring = (LO_ftrace_ring_t *) calloc(1, sizeof(LO_ftrace_ring_t));
+		if (ring == NULL)
+			return NULL;
+		ring->tid = syscall(SYS_gettid);
+		pthread_mutex_lock(&_ftrace_mutex);
+		ring->next = _ftrace_rings;
+		_ftrace_rings = ring;
+		pthread_mutex_unlock(&_ftrace_mutex);
+		_ftrace_ring = ring;
+	}
+	return ring;
+}
 
-#define TR_OUPUT printf
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_ftrace_record(const char *name, char phase) {
+	LO_ftrace_ring_t *ring;
+	LO_ftrace_event_t *evt;
+	struct timespec ts;
+
+	if (!_ftrace_enabled)
+		return;
+	ring = _LO_ftrace_ring();
+	if (ring == NULL)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	evt = &ring->events[ring->head % LOC_FTRACE_RING_SZ];
+	evt->name = name;
+	evt->ts_ns = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	evt->phase = phase;
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/*=================================================================================*/
+/* MQTTPacket hooks*/
+/*---------------------------------------------------------------------------------*/
 
 void StackTrace_entry(const char *name, int line, int trace) {
-#ifdef TR_OUPUT
-	TR_OUPUT("MQTT_ENTRY:%s:%d\n", name, line);
-#endif
+	_LO_ftrace_record(name, 'B');
 }
 
 void StackTrace_exit(const char *name, int line, void *return_value, int trace) {
-#ifdef TR_OUPUT
-	TR_OUPUT("MQTT_EXIT :%s:%d: return=%d\n", name, line,
-			(return_value) ? *(int *) return_value : 0);
-#endif
+	_LO_ftrace_record(name, 'E');
 }
 
 #if 0
@@ -37,3 +106,68 @@ void StackTrace_printStack(FILE* dest) {
 char* StackTrace_get(unsigned long) {
 }
 #endif
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+void LO_ftrace_enable(uint8_t enable) {
+	_ftrace_enabled = enable;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_ftrace_clear(void) {
+	LO_ftrace_ring_t *ring;
+	pthread_mutex_lock(&_ftrace_mutex);
+	for (ring = _ftrace_rings; ring; ring = ring->next)
+		__atomic_store_n(&ring->head, 0, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&_ftrace_mutex);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_ftrace_export(const char *path) {
+	LO_ftrace_ring_t *ring;
+	FILE *fp;
+	int nb = 0;
+	long pid = getpid();
+
+	fp = fopen(path, "w");
+	if (fp == NULL)
+		return -1;
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+	pthread_mutex_lock(&_ftrace_mutex);
+	for (ring = _ftrace_rings; ring; ring = ring->next) {
+		uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		uint32_t idx = (head > LOC_FTRACE_RING_SZ) ? head - LOC_FTRACE_RING_SZ : 0;
+		uint32_t depth = 0;
+
+		/* Events may be overwritten by the thread while exporting :*/
+		/* skip the exits whose entry is no longer in the ring*/
+		for (; idx < head; idx++) {
+			const LO_ftrace_event_t *evt = &ring->events[idx % LOC_FTRACE_RING_SZ];
+			if (evt->phase == 'B') {
+				depth++;
+			} else if (depth) {
+				depth--;
+			} else {
+				continue;
+			}
+			fprintf(fp, "%s\n{\"name\":\"%s\",\"cat\":\"MQTTPacket\",\"ph\":\"%c\","
+					"\"ts\":%llu.%03u,\"pid\":%ld,\"tid\":%ld}", (nb) ? "," : "",
+					evt->name, evt->phase,
+					(unsigned long long) (evt->ts_ns / 1000),
+					(unsigned) (evt->ts_ns % 1000), pid, ring->tid);
+			nb++;
+		}
+	}
+	pthread_mutex_unlock(&_ftrace_mutex);
+
+	fprintf(fp, "\n]}\n");
+	if (fclose(fp))
+		return -1;
+	return nb;
+}
@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_aggr.c
+ * @brief Windowed aggregation of a set of data.
+ */
+
+#include "liveobjects-sys/loc_aggr.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "liveobjects-sys/loc_numfmt.h"
+#include "liveobjects-sys/loc_pubq.h"
+#include "liveobjects-sys/loc_trace.h"
+
+/* Maximum length of the statistics of a field : {"min":,"max":,"mean":,"count":,"last":}*/
+#define AGGR_STATS_SZ        (40 + 5 * LO_NUMFMT_BUF_SZ)
+
+typedef struct {
+	const LiveObjectsD_Data_t *data_ptr;
+	uint16_t key_off;               /* "name": in the keys*/
+	uint16_t key_len;
+	uint32_t count;
+	double min;
+	double max;
+	double sum;
+	double last;
+} LO_aggr_field_t;
+
+/* Summary of an ended window, published once the aggregation is unlocked, or
+ * posted to the publish queue (deferred mode). It does not refer to the
+ * aggregation, which can be destroyed meanwhile.*/
+typedef struct {
+	LO_aggr_publishCb_t publish_cb;
+	void *publish_ctx;
+	uint32_t msg_len;
+	uint32_t samples;
+	char msg[];
+} LO_aggr_summary_t;
+
+struct LO_aggr_s {
+	pthread_mutex_t mutex;
+	LO_aggr_publishCb_t publish_cb;
+	void *publish_ctx;
+	uint32_t window_ms;
+	uint8_t deferred;
+	uint64_t end_ms;                /* Monotonic end of the current window*/
+	uint32_t samples;
+	const char *prefix;
+	const char *suffix;
+	uint32_t prefix_len;
+	uint32_t suffix_len;
+	uint32_t msg_sz;
+	char *keys;
+	uint16_t field_nb;
+	LO_aggr_field_t fields[];
+};
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+
+static uint64_t _LO_aggr_monoMs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static uint64_t _LO_aggr_realMs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Current value of a numeric field, or -1 if the type is not supported.*/
+static int _LO_aggr_value(const LiveObjectsD_Data_t *data_ptr, double *val) {
+	const void *ptr = data_ptr->data_value;
+	switch (data_ptr->data_type) {
+	case LOD_TYPE_INT32:
+		*val = *(const int32_t *) ptr;
+		return 0;
+	case LOD_TYPE_INT16:
+		*val = *(const int16_t *) ptr;
+		return 0;
+	case LOD_TYPE_INT8:
+		*val = *(const int8_t *) ptr;
+		return 0;
+	case LOD_TYPE_UINT32:
+		*val = *(const uint32_t *) ptr;
+		return 0;
+	case LOD_TYPE_UINT16:
+		*val = *(const uint16_t *) ptr;
+		return 0;
+	case LOD_TYPE_UINT8:
+	case LOD_TYPE_BOOL:
+		*val = *(const uint8_t *) ptr;
+		return 0;
+	case LOD_TYPE_FLOAT:
+		*val = *(const float *) ptr;
+		return 0;
+	case LOD_TYPE_DOUBLE:
+		*val = *(const double *) ptr;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Append the tag and a value (formatted as the type of the field if exact).*/
+static char * _LO_aggr_putValue(char *pc, const char *tag, const LO_aggr_field_t *field, double val,
+		uint8_t exact) {
+	int len = strlen(tag);
+
+	memcpy(pc, tag, len);
+	pc += len;
+	if (field->data_ptr->data_type == LOD_TYPE_FLOAT)
+		len = LO_numfmt_float(pc, (float) val);
+	else if ((field->data_ptr->data_type == LOD_TYPE_DOUBLE) || (!exact))
+		len = LO_numfmt_double(pc, val);
+	else
+		len = LO_numfmt_i64(pc, (int64_t) val);
+	if (len == 0) {
+		memcpy(pc, "null", 4);
+		len = 4;
+	}
+	return pc + len;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Encode the summary of the current window (locked) into a new message, and*/
+/* reset the accumulators. The summary is NULL for an empty window.*/
+static int _LO_aggr_summary(LO_aggr_t *aggr, LO_aggr_summary_t **sum_ptr) {
+	LO_aggr_summary_t *sum;
+	char *pc;
+	uint16_t i;
+
+	*sum_ptr = NULL;
+	if (aggr->samples == 0)
+		return 0;
+
+	sum = (LO_aggr_summary_t *) malloc(sizeof(LO_aggr_summary_t) + aggr->msg_sz);
+	if (sum == NULL) {
+		LOTRACE_WARN("LO_aggr: summary of %u samples lost", aggr->samples);
+		aggr->samples = 0;
+		for (i = 0; i < aggr->field_nb; i++)
+			aggr->fields[i].count = 0;
+		return -1;
+	}
+	sum->publish_cb = aggr->publish_cb;
+	sum->publish_ctx = aggr->publish_ctx;
+	sum->samples = aggr->samples;
+	aggr->samples = 0;
+	pc = sum->msg;
+	memcpy(pc, aggr->prefix, aggr->prefix_len);
+	pc += aggr->prefix_len;
+	*pc++ = '{';
+	for (i = 0; i < aggr->field_nb; i++) {
+		LO_aggr_field_t *field = &aggr->fields[i];
+		if (field->count == 0)
+			continue;
+		if (pc[-1] != '{')
+			*pc++ = ',';
+		memcpy(pc, aggr->keys + field->key_off, field->key_len);
+		pc += field->key_len;
+		pc = _LO_aggr_putValue(pc, "{\"min\":", field, field->min, 1);
+		pc = _LO_aggr_putValue(pc, ",\"max\":", field, field->max, 1);
+		pc = _LO_aggr_putValue(pc, ",\"mean\":", field, field->sum / field->count, 0);
+		pc += sprintf(pc, ",\"count\":%u", field->count);
+		pc = _LO_aggr_putValue(pc, ",\"last\":", field, field->last, 1);
+		*pc++ = '}';
+		field->count = 0;
+	}
+	*pc++ = '}';
+	memcpy(pc, aggr->suffix, aggr->suffix_len + 1);
+	pc += aggr->suffix_len;
+	sum->msg_len = pc - sum->msg;
+	*sum_ptr = sum;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Give a summary to the publish callback and release it.*/
+static int _LO_aggr_give(LO_aggr_summary_t *sum) {
+	int ret = sum->publish_cb(sum->publish_ctx, sum->msg, sum->msg_len, sum->samples);
+
+	if (ret)
+		LOTRACE_WARN("LO_aggr: summary of %u samples lost", sum->samples);
+	free(sum);
+	return (ret) ? -1 : 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Publish a summary (unlocked), or post it to the publish queue (deferred mode).*/
+static int _LO_aggr_publish(LO_aggr_t *aggr, LO_aggr_summary_t *sum) {
+	LO_pubq_req_t req = { LO_PUBQ_REQ_AGGR, 0, 0, sum };
+
+	if (sum == NULL)
+		return 0;
+	if (!aggr->deferred)
+		return _LO_aggr_give(sum);
+	if (LO_pubq_push(&req) < 0) {
+		LOTRACE_WARN("LO_aggr: publish queue full, summary of %u samples lost", sum->samples);
+		free(sum);
+		return -1;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* End the window if it is elapsed (locked), and move to the window of now.*/
+static void _LO_aggr_roll(LO_aggr_t *aggr, uint64_t now, LO_aggr_summary_t **sum_ptr) {
+	*sum_ptr = NULL;
+	if (now < aggr->end_ms)
+		return;
+	_LO_aggr_summary(aggr, sum_ptr);
+	/* Tumbling windows : the empty ones are skipped*/
+	aggr->end_ms += ((now - aggr->end_ms) / aggr->window_ms + 1) * aggr->window_ms;
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+LO_aggr_t *LO_aggr_create(const LiveObjectsD_Data_t *data_set, int32_t data_nb,
+		const LO_aggr_cfg_t *cfg_ptr, LO_aggr_publishCb_t publish_cb, void *publish_ctx) {
+	LO_aggr_t *aggr;
+	uint32_t keys_sz = 0;
+	uint16_t field_nb = 0;
+	int32_t i;
+	char *pc;
+
+	if ((publish_cb == NULL) || (data_set == NULL))
+		return NULL;
+
+	/* Numeric fields, and worst case size of their escaped names*/
+	for (i = 0; i < data_nb; i++) {
+		double val;
+		if ((data_set[i].data_name == NULL) || (_LO_aggr_value(&data_set[i], &val)))
+			continue;
+		keys_sz += 6 * strlen(data_set[i].data_name) + 3;
+		field_nb++;
+	}
+	if ((field_nb == 0) || (keys_sz > UINT16_MAX)) {
+		LOTRACE_ERR("LO_aggr_create: no numeric field");
+		return NULL;
+	}
+
+	aggr = (LO_aggr_t *) calloc(1, sizeof(LO_aggr_t) + field_nb * sizeof(LO_aggr_field_t));
+	if (aggr == NULL)
+		return NULL;
+	aggr->window_ms = (cfg_ptr) ? cfg_ptr->window_ms : 0;
+	aggr->deferred = (cfg_ptr) ? cfg_ptr->deferred : 0;
+	aggr->prefix = (cfg_ptr) ? cfg_ptr->prefix : NULL;
+	aggr->suffix = (cfg_ptr) ? cfg_ptr->suffix : NULL;
+	if (aggr->window_ms == 0)
+		aggr->window_ms = LOC_AGGR_WINDOW_MS;
+	if (aggr->prefix == NULL)
+		aggr->prefix = "";
+	if (aggr->suffix == NULL)
+		aggr->suffix = "";
+	aggr->prefix_len = strlen(aggr->prefix);
+	aggr->suffix_len = strlen(aggr->suffix);
+
+	aggr->keys = (char *) malloc(keys_sz);
+	aggr->msg_sz = aggr->prefix_len + aggr->suffix_len + 3 + keys_sz + field_nb * (AGGR_STATS_SZ + 1);
+	if (aggr->keys == NULL) {
+		free(aggr);
+		return NULL;
+	}
+
+	/* "name": of each field (escaped)*/
+	pc = aggr->keys;
+	for (i = 0; i < data_nb; i++) {
+		LO_aggr_field_t *field = &aggr->fields[aggr->field_nb];
+		const char *name = data_set[i].data_name;
+		double val;
+		if ((name == NULL) || (_LO_aggr_value(&data_set[i], &val)))
+			continue;
+		field->data_ptr = &data_set[i];
+		field->key_off = pc - aggr->keys;
+		*pc++ = '"';
+		for (; *name; name++) {
+			unsigned char cc = (unsigned char) *name;
+			if ((cc == '"') || (cc == '\\')) {
+				*pc++ = '\\';
+				*pc++ = cc;
+			} else if (cc < 0x20) {
+				pc += sprintf(pc, "\\u%04x", cc);
+			} else {
+				*pc++ = cc;
+			}
+		}
+		*pc++ = '"';
+		*pc++ = ':';
+		field->key_len = pc - aggr->keys - field->key_off;
+		aggr->field_nb++;
+	}
+
+	aggr->publish_cb = publish_cb;
+	aggr->publish_ctx = publish_ctx;
+	aggr->end_ms = _LO_aggr_monoMs() + aggr->window_ms;
+	pthread_mutex_init(&aggr->mutex, NULL);
+	return aggr;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_aggr_destroy(LO_aggr_t *aggr) {
+	if (aggr) {
+		LO_aggr_summary_t *sum;
+		pthread_mutex_lock(&aggr->mutex);
+		_LO_aggr_summary(aggr, &sum);
+		pthread_mutex_unlock(&aggr->mutex);
+		_LO_aggr_publish(aggr, sum);
+		pthread_mutex_destroy(&aggr->mutex);
+		free(aggr->keys);
+		free(aggr);
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_aggr_add(LO_aggr_t *aggr) {
+	return LO_aggr_addAt(aggr, 0);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_aggr_addAt(LO_aggr_t *aggr, uint64_t ts_ms) {
+	uint64_t now = _LO_aggr_monoMs();
+	LO_aggr_summary_t *sum;
+	uint8_t folded = 0;
+	uint16_t i;
+	int ret;
+
+	/* Monotonic time of the sample : it ends the window which was elapsed*/
+	/* when it was taken (a sample from the future is taken now)*/
+	if (ts_ms) {
+		uint64_t real = _LO_aggr_realMs();
+		if ((ts_ms < real) && (real - ts_ms < now))
+			now -= real - ts_ms;
+	}
+
+	pthread_mutex_lock(&aggr->mutex);
+	_LO_aggr_roll(aggr, now, &sum);
+	for (i = 0; i < aggr->field_nb; i++) {
+		LO_aggr_field_t *field = &aggr->fields[i];
+		double val;
+		_LO_aggr_value(field->data_ptr, &val);
+		if (val != val)
+			continue;
+		if (field->count++ == 0) {
+			field->min = val;
+			field->max = val;
+			field->sum = 0;
+		} else if (val < field->min) {
+			field->min = val;
+		} else if (val > field->max) {
+			field->max = val;
+		}
+		field->sum += val;
+		field->last = val;
+		folded = 1;
+	}
+	/* A sample without any value (all NaN) is not counted*/
+	if (folded)
+		aggr->samples++;
+	ret = (int) aggr->samples;
+	pthread_mutex_unlock(&aggr->mutex);
+	_LO_aggr_publish(aggr, sum);
+	return ret;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int32_t LO_aggr_poll(LO_aggr_t *aggr) {
+	uint64_t now = _LO_aggr_monoMs();
+	LO_aggr_summary_t *sum;
+	int32_t ret;
+
+	pthread_mutex_lock(&aggr->mutex);
+	_LO_aggr_roll(aggr, now, &sum);
+	ret = (int32_t) (aggr->end_ms - now);
+	pthread_mutex_unlock(&aggr->mutex);
+	_LO_aggr_publish(aggr, sum);
+	return ret;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_aggr_flush(LO_aggr_t *aggr) {
+	LO_aggr_summary_t *sum;
+	int ret;
+
+	pthread_mutex_lock(&aggr->mutex);
+	ret = _LO_aggr_summary(aggr, &sum);
+	aggr->end_ms = _LO_aggr_monoMs() + aggr->window_ms;
+	pthread_mutex_unlock(&aggr->mutex);
+	if (_LO_aggr_publish(aggr, sum))
+		ret = -1;
+	return ret;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_aggr_publishReq(const LO_pubq_req_t *req_ptr) {
+	if (req_ptr->req_ctx)
+		_LO_aggr_give((LO_aggr_summary_t *) req_ptr->req_ctx);
+}
@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_batch.c
+ * @brief Batched publishing of a set of data.
+ */
+
+#include "liveobjects-sys/loc_batch.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "liveobjects-sys/loc_json_tpl.h"
+#include "liveobjects-sys/loc_pubq.h"
+#include "liveobjects-sys/loc_trace.h"
+
+/* Length of "YYYY-MM-DDTHH:MM:SS"*/
+#define BATCH_DATE_LEN       19
+
+/* CBOR : room for the head of the array of samples, written at the flush*/
+#define BATCH_CBOR_HEAD_SZ   5
+
+/* Buffer of a batch message. In the deferred mode, a full buffer is posted to
+ * the publish queue and released by LO_batch_publishReq (the batch continues
+ * in a new one) : it does not refer to the batch, which can be destroyed meanwhile.*/
+typedef struct {
+	LO_batch_flushCb_t flush_cb;
+	void *flush_ctx;
+	const char *msg;                /* Message in buf*/
+	uint32_t msg_len;
+	uint32_t samples;
+	char buf[];
+} LO_batch_buf_t;
+
+struct LO_batch_s {
+	pthread_mutex_t mutex;
+	LO_json_tpl_t *tpl;             /* Values of a sample : {...}}*/
+	const LiveObjectsD_Data_t *data_set;
+	int32_t data_nb;
+	LO_payload_enc_t encoding;
+	LO_batch_flushCb_t flush_cb;
+	void *flush_ctx;
+	uint8_t deferred;
+	uint32_t max_samples;
+	uint32_t max_bytes;
+	uint32_t max_age_ms;
+	const char *suffix;
+	uint32_t suffix_len;
+	uint32_t prefix_len;
+	uint32_t samples;
+	uint32_t len;                   /* Message length, without the suffix*/
+	uint64_t first_ms;              /* Monotonic time of the first sample*/
+	time_t date_sec;                /* Second of the cached date*/
+	char date[BATCH_DATE_LEN + 1];
+	LO_batch_buf_t *buf;
+	char *msg;                      /* buf->buf*/
+};
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+
+static uint64_t _LO_batch_monoMs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* CBOR : append a sample {"ts":ms,"v":{...}}. Return 0, or -1 if there is not enough room.*/
+static int _LO_batch_appendCbor(LO_batch_t *batch, const struct timespec *ts) {
+	LO_cbor_enc_t enc;
+	int len;
+
+	LO_cbor_init(&enc, (uint8_t *) batch->msg + batch->len, batch->max_bytes - batch->len, NULL, NULL);
+	LO_cbor_putMap(&enc, 2);
+	LO_cbor_putText(&enc, "ts", 2);
+	LO_cbor_putUint(&enc, (uint64_t) ts->tv_sec * 1000 + ts->tv_nsec / 1000000);
+	LO_cbor_putText(&enc, "v", 1);
+	LO_cbor_putDataSet(&enc, batch->data_set, batch->data_nb, batch->encoding);
+	len = LO_cbor_finish(&enc);
+	if (len < 0)
+		return -1;
+	batch->len += len;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Append a sample taken at ts. Return 0, or -1 if there is not enough room.*/
+static int _LO_batch_append(LO_batch_t *batch, const struct timespec *ts) {
+	char *pc = batch->msg + batch->len;
+	char *end = batch->msg + batch->max_bytes - batch->suffix_len;
+	int len;
+
+	if (batch->encoding != LO_PAYLOAD_JSON) {
+		if (_LO_batch_appendCbor(batch, ts))
+			return -1;
+		if (batch->samples++ == 0)
+			batch->first_ms = _LO_batch_monoMs();
+		return 0;
+	}
+	if (ts->tv_sec != batch->date_sec) {
+		struct tm tm;
+		gmtime_r(&ts->tv_sec, &tm);
+		strftime(batch->date, sizeof(batch->date), "%Y-%m-%dT%H:%M:%S", &tm);
+		batch->date_sec = ts->tv_sec;
+	}
+
+	/* ,{"ts":"YYYY-MM-DDTHH:MM:SS.mmmZ","v":*/
+	if (pc + BATCH_DATE_LEN + 20 > end)
+		return -1;
+	if (batch->samples)
+		*pc++ = ',';
+	memcpy(pc, "{\"ts\":\"", 7);
+	pc += 7;
+	memcpy(pc, batch->date, BATCH_DATE_LEN);
+	pc += BATCH_DATE_LEN;
+	pc += sprintf(pc, ".%03uZ\",\"v\":", (unsigned) (ts->tv_nsec / 1000000));
+
+	len = LO_json_tpl_encode(batch->tpl, pc, end - pc + 1);
+	if (len < 0)
+		return -1;
+	pc += len;
+
+	if (batch->samples++ == 0)
+		batch->first_ms = _LO_batch_monoMs();
+	batch->len = pc - batch->msg;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Deferred mode : post the message to the publish queue (locked), and continue*/
+/* in a new buffer. Return 0, or -1 if the samples are kept.*/
+static int _LO_batch_post(LO_batch_t *batch, const char *msg, uint32_t len) {
+	LO_batch_buf_t *buf = batch->buf;
+	LO_batch_buf_t *next = (LO_batch_buf_t *) malloc(sizeof(LO_batch_buf_t) + batch->max_bytes + 1);
+	LO_pubq_req_t req = { LO_PUBQ_REQ_BATCH, 0, 0, buf };
+
+	if (next == NULL)
+		return -1;
+	memcpy(next->buf, buf->buf, batch->prefix_len);
+	buf->flush_cb = batch->flush_cb;
+	buf->flush_ctx = batch->flush_ctx;
+	buf->msg = msg;
+	buf->msg_len = len;
+	buf->samples = batch->samples;
+	if (LO_pubq_push(&req) < 0) {
+		free(next);
+		return -1;
+	}
+	batch->buf = next;
+	batch->msg = next->buf;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Flush the batch (locked).*/
+static int _LO_batch_flush(LO_batch_t *batch) {
+	const char *msg = batch->msg;
+	uint32_t len;
+	int ret;
+
+	if (batch->samples == 0)
+		return 0;
+
+	if (batch->encoding != LO_PAYLOAD_JSON) {
+		/* Head of the array, just before the first sample*/
+		uint8_t head[BATCH_CBOR_HEAD_SZ];
+		LO_cbor_enc_t enc;
+		LO_cbor_init(&enc, head, sizeof(head), NULL, NULL);
+		LO_cbor_putArray(&enc, batch->samples);
+		len = (uint32_t) LO_cbor_finish(&enc);
+		msg = batch->msg + BATCH_CBOR_HEAD_SZ - len;
+		memcpy((char *) msg, head, len);
+		len = batch->len - (BATCH_CBOR_HEAD_SZ - len);
+	} else {
+		memcpy(batch->msg + batch->len, batch->suffix, batch->suffix_len + 1);
+		len = batch->len + batch->suffix_len;
+	}
+	if (batch->deferred)
+		ret = _LO_batch_post(batch, msg, len);
+	else
+		ret = batch->flush_cb(batch->flush_ctx, msg, len, batch->samples);
+	if (ret) {
+		LOTRACE_WARN("LO_batch: flush of %u samples (%u bytes) failed", batch->samples, len);
+		return -1;
+	}
+	batch->samples = 0;
+	batch->len = batch->prefix_len;
+	return 0;
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+LO_batch_t *LO_batch_create(const LiveObjectsD_Data_t *data_set, int32_t data_nb,
+		const LO_batch_cfg_t *cfg_ptr, LO_batch_flushCb_t flush_cb, void *flush_ctx) {
+	LO_batch_t *batch;
+	const char *prefix = NULL;
+
+	if (flush_cb == NULL)
+		return NULL;
+
+	batch = (LO_batch_t *) calloc(1, sizeof(LO_batch_t));
+	if (batch == NULL)
+		return NULL;
+
+	if (cfg_ptr) {
+		batch->max_samples = cfg_ptr->max_samples;
+		batch->max_bytes = cfg_ptr->max_bytes;
+		batch->max_age_ms = cfg_ptr->max_age_ms;
+		prefix = cfg_ptr->prefix;
+		batch->suffix = cfg_ptr->suffix;
+		batch->encoding = cfg_ptr->encoding;
+		batch->deferred = cfg_ptr->deferred;
+	}
+	if (batch->max_samples == 0)
+		batch->max_samples = LOC_BATCH_MAX_SAMPLES;
+	if (batch->max_bytes == 0)
+		batch->max_bytes = LOC_BATCH_MAX_BYTES;
+	if (batch->max_age_ms == 0)
+		batch->max_age_ms = LOC_BATCH_MAX_AGE_MS;
+	if (batch->encoding != LO_PAYLOAD_JSON) {
+		/* The prefix is the room for the head of the CBOR array*/
+		prefix = "\0\0\0\0\0";
+		batch->suffix = "";
+		batch->prefix_len = BATCH_CBOR_HEAD_SZ;
+	} else {
+		if (prefix == NULL)
+			prefix = "[";
+		if (batch->suffix == NULL)
+			batch->suffix = "]";
+		batch->prefix_len = strlen(prefix);
+	}
+	batch->suffix_len = strlen(batch->suffix);
+
+	if (batch->prefix_len + batch->suffix_len >= batch->max_bytes) {
+		LOTRACE_ERR("LO_batch_create: max_bytes %u too small", batch->max_bytes);
+		free(batch);
+		return NULL;
+	}
+
+	if (batch->encoding == LO_PAYLOAD_JSON)
+		batch->tpl = LO_json_tpl_create(NULL, data_set, data_nb, "}");
+	batch->data_set = data_set;
+	batch->data_nb = data_nb;
+	batch->buf = (LO_batch_buf_t *) malloc(sizeof(LO_batch_buf_t) + batch->max_bytes + 1);
+	if (((batch->tpl == NULL) && (batch->encoding == LO_PAYLOAD_JSON)) || (batch->buf == NULL)) {
+		LO_json_tpl_destroy(batch->tpl);
+		free(batch->buf);
+		free(batch);
+		return NULL;
+	}
+	batch->msg = batch->buf->buf;
+	memcpy(batch->msg, prefix, batch->prefix_len);
+	batch->len = batch->prefix_len;
+	batch->date_sec = -1;
+	batch->flush_cb = flush_cb;
+	batch->flush_ctx = flush_ctx;
+	pthread_mutex_init(&batch->mutex, NULL);
+	return batch;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_batch_destroy(LO_batch_t *batch) {
+	if (batch) {
+		pthread_mutex_lock(&batch->mutex);
+		_LO_batch_flush(batch);
+		pthread_mutex_unlock(&batch->mutex);
+		pthread_mutex_destroy(&batch->mutex);
+		LO_json_tpl_destroy(batch->tpl);
+		free(batch->buf);
+		free(batch);
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_batch_add(LO_batch_t *batch) {
+	return LO_batch_addAt(batch, 0);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_batch_addAt(LO_batch_t *batch, uint64_t ts_ms) {
+	struct timespec ts;
+	int ret;
+
+	if (ts_ms) {
+		ts.tv_sec = (time_t) (ts_ms / 1000);
+		ts.tv_nsec = (long) (ts_ms % 1000) * 1000000;
+	} else {
+		clock_gettime(CLOCK_REALTIME, &ts);
+	}
+
+	pthread_mutex_lock(&batch->mutex);
+	ret = _LO_batch_append(batch, &ts);
+	if ((ret) && (batch->samples) && (_LO_batch_flush(batch) == 0))
+		ret = _LO_batch_append(batch, &ts);
+	if (ret) {
+		LOTRACE_WARN("LO_batch_add: sample lost (%u samples pending)", batch->samples);
+		pthread_mutex_unlock(&batch->mutex);
+		return -1;
+	}
+	if ((batch->samples >= batch->max_samples)
+			|| (_LO_batch_monoMs() - batch->first_ms >= batch->max_age_ms))
+		_LO_batch_flush(batch);
+	ret = (int) batch->samples;
+	pthread_mutex_unlock(&batch->mutex);
+	return ret;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int32_t LO_batch_poll(LO_batch_t *batch) {
+	int32_t ret = -1;
+
+	pthread_mutex_lock(&batch->mutex);
+	if (batch->samples) {
+		uint64_t age = _LO_batch_monoMs() - batch->first_ms;
+		if ((age < batch->max_age_ms) || (_LO_batch_flush(batch)))
+			ret = (age < batch->max_age_ms) ? (int32_t) (batch->max_age_ms - age) : 0;
+	}
+	pthread_mutex_unlock(&batch->mutex);
+	return ret;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_batch_flush(LO_batch_t *batch) {
+	int ret;
+	pthread_mutex_lock(&batch->mutex);
+	ret = _LO_batch_flush(batch);
+	pthread_mutex_unlock(&batch->mutex);
+	return ret;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_batch_getFill(LO_batch_t *batch, LO_batch_fill_t *fill_ptr) {
+	uint32_t pct, val;
+
+	pthread_mutex_lock(&batch->mutex);
+	fill_ptr->samples = batch->samples;
+	fill_ptr->bytes = (batch->samples) ? batch->len + batch->suffix_len : 0;
+	fill_ptr->age_ms = (batch->samples) ? (uint32_t) (_LO_batch_monoMs() - batch->first_ms) : 0;
+
+	pct = (fill_ptr->samples * 100) / batch->max_samples;
+	val = (fill_ptr->bytes * 100) / batch->max_bytes;
+	if (val > pct)
+		pct = val;
+	val = (uint32_t) (((uint64_t) fill_ptr->age_ms * 100) / batch->max_age_ms);
+	if (val > pct)
+		pct = val;
+	fill_ptr->percent = (pct > 100) ? 100 : (uint8_t) pct;
+	pthread_mutex_unlock(&batch->mutex);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_batch_publishReq(const LO_pubq_req_t *req_ptr) {
+	LO_batch_buf_t *buf = (LO_batch_buf_t *) req_ptr->req_ctx;
+
+	if (buf == NULL)
+		return;
+	if (buf->flush_cb(buf->flush_ctx, buf->msg, buf->msg_len, buf->samples))
+		LOTRACE_WARN("LO_batch: batch of %u samples (%u bytes) lost", buf->samples, buf->msg_len);
+	free(buf);
+}
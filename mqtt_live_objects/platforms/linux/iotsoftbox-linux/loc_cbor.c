@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_cbor.c
+ * @brief Streaming CBOR encoder (RFC 7049) for binary data payloads.
+ */
+
+#include "liveobjects-sys/loc_cbor.h"
+
+#include <string.h>
+
+/* CBOR major types*/
+#define CBOR_MT_UINT        0x00
+#define CBOR_MT_NINT        0x20
+#define CBOR_MT_BYTES       0x40
+#define CBOR_MT_TEXT        0x60
+#define CBOR_MT_ARRAY       0x80
+#define CBOR_MT_MAP         0xA0
+#define CBOR_MT_SIMPLE      0xE0
+
+#define CBOR_FALSE          0xF4
+#define CBOR_TRUE           0xF5
+#define CBOR_NULL           0xF6
+#define CBOR_FLOAT16        0xF9
+#define CBOR_FLOAT32        0xFA
+#define CBOR_FLOAT64        0xFB
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+/* Give the buffer to the write callback.*/
+static int _LO_cbor_flush(LO_cbor_enc_t *enc) {
+	if ((enc->write_cb == NULL) || (enc->err))
+		return -1;
+	if (enc->len) {
+		if (enc->write_cb(enc->write_ctx, enc->buf, enc->len)) {
+			enc->err = 1;
+			return -1;
+		}
+		enc->flushed += enc->len;
+		enc->len = 0;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_cbor_write(LO_cbor_enc_t *enc, const void *data, uint32_t len) {
+	const uint8_t *pd = (const uint8_t *) data;
+
+	if (enc->len + len <= enc->buf_sz) {
+		memcpy(enc->buf + enc->len, pd, len);
+		enc->len += len;
+		return;
+	}
+	while ((len) && (!enc->err)) {
+		uint32_t n = enc->buf_sz - enc->len;
+		if (n == 0) {
+			if (_LO_cbor_flush(enc))
+				enc->err = 1;
+			continue;
+		}
+		if (n > len)
+			n = len;
+		memcpy(enc->buf + enc->len, pd, n);
+		enc->len += n;
+		pd += n;
+		len -= n;
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Initial byte and argument, on the smallest size.*/
+static void _LO_cbor_putHead(LO_cbor_enc_t *enc, uint8_t major, uint64_t val) {
+	uint8_t head[9];
+	uint32_t len;
+	int i;
+
+	if (val < 24) {
+		head[0] = major | (uint8_t) val;
+		len = 1;
+	} else {
+		if (val <= UINT8_MAX) {
+			head[0] = major | 24;
+			len = 2;
+		} else if (val <= UINT16_MAX) {
+			head[0] = major | 25;
+			len = 3;
+		} else if (val <= UINT32_MAX) {
+			head[0] = major | 26;
+			len = 5;
+		} else {
+			head[0] = major | 27;
+			len = 9;
+		}
+		/* Big endian*/
+		for (i = len - 1; i > 0; i--) {
+			head[i] = (uint8_t) val;
+			val >>= 8;
+		}
+	}
+	_LO_cbor_write(enc, head, len);
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Half precision encoding of a float, if it keeps the exact value.*/
+static int _LO_cbor_toHalf(float val, uint16_t *half) {
+	uint32_t bits, mant;
+	int exp;
+	uint16_t sign;
+
+	memcpy(&bits, &val, sizeof(bits));
+	sign = (uint16_t) ((bits >> 16) & 0x8000);
+	exp = (int) ((bits >> 23) & 0xFF) - 127;
+	mant = bits & 0x7FFFFF;
+
+	if (exp == 128) {
+		/* Infinity or NaN (canonical)*/
+		*half = (mant) ? 0x7E00 : (sign | 0x7C00);
+		return 1;
+	}
+	if ((exp == -127) && (mant == 0)) {
+		*half = sign;
+		return 1;
+	}
+	if ((exp >= -14) && (exp <= 15)) {
+		if (mant & 0x1FFF)
+			return 0;
+		*half = sign | (uint16_t) ((exp + 15) << 10) | (uint16_t) (mant >> 13);
+		return 1;
+	}
+	if ((exp >= -24) && (exp < -14)) {
+		/* Subnormal half : mant * 2^-24*/
+		uint32_t shift = (uint32_t) (13 + (-14 - exp));
+		mant |= 0x800000;
+		if (mant & ((1UL << shift) - 1))
+			return 0;
+		*half = sign | (uint16_t) (mant >> shift);
+		return 1;
+	}
+	return 0;
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+void LO_cbor_init(LO_cbor_enc_t *enc, uint8_t *buf, uint32_t buf_sz,
+		LO_cbor_writeCb_t write_cb, void *write_ctx) {
+	enc->buf = buf;
+	enc->buf_sz = buf_sz;
+	enc->len = 0;
+	enc->flushed = 0;
+	enc->write_cb = write_cb;
+	enc->write_ctx = write_ctx;
+	enc->err = ((buf == NULL) || (buf_sz == 0)) ? 1 : 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_cbor_putUint(LO_cbor_enc_t *enc, uint64_t val) {
+	_LO_cbor_putHead(enc, CBOR_MT_UINT, val);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_cbor_putInt(LO_cbor_enc_t *enc, int64_t val) {
+	if (val < 0)
+		_LO_cbor_putHead(enc, CBOR_MT_NINT, (uint64_t) (-1 - val));
+	else
+		_LO_cbor_putHead(enc, CBOR_MT_UINT, (uint64_t) val);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_cbor_putBool(LO_cbor_enc_t *enc, uint8_t val) {
+	uint8_t cc = (val) ? CBOR_TRUE : CBOR_FALSE;
+	_LO_cbor_write(enc, &cc, 1);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_cbor_putNull(LO_cbor_enc_t *enc) {
+	uint8_t cc = CBOR_NULL;
+	_LO_cbor_write(enc, &cc, 1);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_cbor_putDouble(LO_cbor_enc_t *enc, double val) {
+	uint8_t item[9];
+	float fval = (float) val;
+	uint16_t half;
+
+	if (((double) fval == val) || (val != val)) {
+		uint32_t bits;
+		if (_LO_cbor_toHalf(fval, &half)) {
+			item[0] = CBOR_FLOAT16;
+			item[1] = (uint8_t) (half >> 8);
+			item[2] = (uint8_t) half;
+			_LO_cbor_write(enc, item, 3);
+			return;
+		}
+		memcpy(&bits, &fval, sizeof(bits));
+		item[0] = CBOR_FLOAT32;
+		item[1] = (uint8_t) (bits >> 24);
+		item[2] = (uint8_t) (bits >> 16);
+		item[3] = (uint8_t) (bits >> 8);
+		item[4] = (uint8_t) bits;
+		_LO_cbor_write(enc, item, 5);
+	} else {
+		uint64_t bits;
+		int i;
+		memcpy(&bits, &val, sizeof(bits));
+		item[0] = CBOR_FLOAT64;
+		for (i = 8; i > 0; i--) {
+			item[i] = (uint8_t) bits;
+			bits >>= 8;
+		}
+		_LO_cbor_write(enc, item, 9);
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_cbor_putText(LO_cbor_enc_t *enc, const char *str, uint32_t len) {
+	_LO_cbor_putHead(enc, CBOR_MT_TEXT, len);
+	_LO_cbor_write(enc, str, len);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_cbor_putBytes(LO_cbor_enc_t *enc, const void *data, uint32_t len) {
+	_LO_cbor_putHead(enc, CBOR_MT_BYTES, len);
+	_LO_cbor_write(enc, data, len);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_cbor_putArray(LO_cbor_enc_t *enc, uint32_t nb) {
+	_LO_cbor_putHead(enc, CBOR_MT_ARRAY, nb);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_cbor_putMap(LO_cbor_enc_t *enc, uint32_t nb) {
+	_LO_cbor_putHead(enc, CBOR_MT_MAP, nb);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_cbor_putDataSet(LO_cbor_enc_t *enc, const LiveObjectsD_Data_t *data_set,
+		int32_t data_nb, LO_payload_enc_t enc_type) {
+	int32_t i;
+
+	if ((data_set == NULL) || (data_nb < 0)) {
+		enc->err = 1;
+		return;
+	}
+	LO_cbor_putMap(enc, (uint32_t) data_nb);
+	for (i = 0; i < data_nb; i++) {
+		const LiveObjectsD_Data_t *data_ptr = &data_set[i];
+		const void *value = data_ptr->data_value;
+
+		if (enc_type == LO_PAYLOAD_CBOR_IDX)
+			LO_cbor_putUint(enc, (uint64_t) i);
+		else
+			LO_cbor_putText(enc, data_ptr->data_name, strlen(data_ptr->data_name));
+
+		if (value == NULL) {
+			LO_cbor_putNull(enc);
+			continue;
+		}
+		switch (data_ptr->data_type) {
+		case LOD_TYPE_INT32:
+			LO_cbor_putInt(enc, *(const int32_t *) value);
+			break;
+		case LOD_TYPE_INT16:
+			LO_cbor_putInt(enc, *(const int16_t *) value);
+			break;
+		case LOD_TYPE_INT8:
+			LO_cbor_putInt(enc, *(const int8_t *) value);
+			break;
+		case LOD_TYPE_UINT32:
+			LO_cbor_putUint(enc, *(const uint32_t *) value);
+			break;
+		case LOD_TYPE_UINT16:
+			LO_cbor_putUint(enc, *(const uint16_t *) value);
+			break;
+		case LOD_TYPE_UINT8:
+			LO_cbor_putUint(enc, *(const uint8_t *) value);
+			break;
+		case LOD_TYPE_BOOL:
+			LO_cbor_putBool(enc, *(const uint8_t *) value);
+			break;
+		case LOD_TYPE_FLOAT:
+			LO_cbor_putDouble(enc, *(const float *) value);
+			break;
+		case LOD_TYPE_DOUBLE:
+			LO_cbor_putDouble(enc, *(const double *) value);
+			break;
+		case LOD_TYPE_STRING_C:
+			LO_cbor_putText(enc, (const char *) value, strlen((const char *) value));
+			break;
+		default:
+			LO_cbor_putNull(enc);
+			break;
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_cbor_finish(LO_cbor_enc_t *enc) {
+	if ((enc->write_cb) && (_LO_cbor_flush(enc)))
+		return -1;
+	if (enc->err)
+		return -1;
+	return (int) (enc->flushed + enc->len);
+}
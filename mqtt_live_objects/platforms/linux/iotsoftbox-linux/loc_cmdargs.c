@@ -0,0 +1,478 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_cmdargs.c
+ * @brief Zero-copy parsing of the arguments of a LiveObjects command.
+ */
+
+#include "liveobjects-sys/loc_cmdargs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Exact powers of ten in a double*/
+static const double _cmdargs_pow10[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+
+static const char * _LO_cmdargs_skipWs(const char *pc, const char *end) {
+	while ((pc < end) && ((*pc == ' ') || (*pc == '\t') || (*pc == '\n') || (*pc == '\r')))
+		pc++;
+	return pc;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* pc : after the opening quote. Return the closing quote, or NULL.*/
+static const char * _LO_cmdargs_scanStr(const char *pc, const char *end, uint8_t *escaped) {
+	*escaped = 0;
+	while (pc < end) {
+		const char *q = (const char *) memchr(pc, '"', end - pc);
+		const char *bs;
+		if (q == NULL)
+			return NULL;
+		/* Count the backslashes before the quote*/
+		bs = q;
+		while ((bs > pc) && (bs[-1] == '\\'))
+			bs--;
+		if (memchr(pc, '\\', q - pc))
+			*escaped = 1;
+		if (((q - bs) & 1) == 0)
+			return q;
+		pc = q + 1;
+	}
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Skip a nested object or array. pc : on the opening bracket.*/
+static const char * _LO_cmdargs_skipNested(const char *pc, const char *end) {
+	uint32_t depth = 0;
+	uint8_t escaped;
+
+	while (pc < end) {
+		switch (*pc) {
+		case '{':
+		case '[':
+			depth++;
+			break;
+		case '}':
+		case ']':
+			if (--depth == 0)
+				return pc + 1;
+			break;
+		case '"':
+			pc = _LO_cmdargs_scanStr(pc + 1, end, &escaped);
+			if (pc == NULL)
+				return NULL;
+			break;
+		default:
+			break;
+		}
+		pc++;
+	}
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Scan a value. Return the end of the value, or NULL if invalid.*/
+static const char * _LO_cmdargs_scanValue(const char *pc, const char *end, LO_cmdarg_t *arg_ptr) {
+	const char *start = pc;
+
+	arg_ptr->escaped = 0;
+	if (pc >= end)
+		return NULL;
+
+	switch (*pc) {
+	case '"':
+		pc = _LO_cmdargs_scanStr(pc + 1, end, &arg_ptr->escaped);
+		if (pc == NULL)
+			return NULL;
+		arg_ptr->type = LO_CMDARG_STRING;
+		arg_ptr->value.ptr = start + 1;
+		arg_ptr->value.len = pc - start - 1;
+		return pc + 1;
+
+	case '{':
+	case '[':
+		arg_ptr->type = (*pc == '{') ? LO_CMDARG_OBJECT : LO_CMDARG_ARRAY;
+		pc = _LO_cmdargs_skipNested(pc, end);
+		break;
+
+	case 't':
+	case 'f':
+	case 'n': {
+		const char *word = (*pc == 't') ? "true" : (*pc == 'f') ? "false" : "null";
+		uint32_t len = strlen(word);
+		if (((uint32_t) (end - pc) < len) || memcmp(pc, word, len))
+			return NULL;
+		arg_ptr->type = (*pc == 'n') ? LO_CMDARG_NULL : LO_CMDARG_BOOL;
+		pc += len;
+		break;
+	}
+
+	default:
+		if ((*pc != '-') && ((*pc < '0') || (*pc > '9')))
+			return NULL;
+		arg_ptr->type = LO_CMDARG_INT;
+		pc++;
+		while (pc < end) {
+			if ((*pc == '.') || (*pc == 'e') || (*pc == 'E') || (*pc == '+') || (*pc == '-'))
+				arg_ptr->type = LO_CMDARG_FLOAT;
+			else if ((*pc < '0') || (*pc > '9'))
+				break;
+			pc++;
+		}
+		break;
+	}
+	if (pc == NULL)
+		return NULL;
+	arg_ptr->value.ptr = start;
+	arg_ptr->value.len = pc - start;
+	return pc;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static int _LO_cmdargs_hex4(const char *pc, uint32_t *val) {
+	int i;
+	*val = 0;
+	for (i = 0; i < 4; i++) {
+		char cc = pc[i];
+		*val <<= 4;
+		if ((cc >= '0') && (cc <= '9'))
+			*val |= cc - '0';
+		else if ((cc >= 'a') && (cc <= 'f'))
+			*val |= cc - 'a' + 10;
+		else if ((cc >= 'A') && (cc <= 'F'))
+			*val |= cc - 'A' + 10;
+		else
+			return -1;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Scan the name of the next member, up to the start of its value.*/
+/* Return 1 (value_pc is set), 0 at the end of the object, -1 if invalid.*/
+static int _LO_cmdargs_nextName(LO_cmdargs_t *it, LO_cmdarg_t *arg_ptr, const char **value_pc) {
+	const char *pc = _LO_cmdargs_skipWs(it->pc, it->end);
+	const char *q;
+
+	if (pc >= it->end)
+		return -1;
+	if (*pc == '}') {
+		it->pc = pc;
+		return 0;
+	}
+	if (!it->first) {
+		if (*pc != ',')
+			return -1;
+		pc = _LO_cmdargs_skipWs(pc + 1, it->end);
+	}
+
+	/* "name"*/
+	if ((pc >= it->end) || (*pc != '"'))
+		return -1;
+	q = _LO_cmdargs_scanStr(pc + 1, it->end, &arg_ptr->escaped);
+	if (q == NULL)
+		return -1;
+	arg_ptr->name.ptr = pc + 1;
+	arg_ptr->name.len = q - pc - 1;
+
+	/* :*/
+	pc = _LO_cmdargs_skipWs(q + 1, it->end);
+	if ((pc >= it->end) || (*pc != ':'))
+		return -1;
+	*value_pc = _LO_cmdargs_skipWs(pc + 1, it->end);
+	it->first = 0;
+	return 1;
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+int LO_cmdargs_init(LO_cmdargs_t *it, const char *json, uint32_t len, const char *key) {
+	const char *end = json + len;
+	const char *pc = _LO_cmdargs_skipWs(json, end);
+
+	if ((pc >= end) || (*pc != '{'))
+		return -1;
+	it->pc = pc + 1;
+	it->end = end;
+	it->first = 1;
+
+	if (key) {
+		/* Iterate the members of the arguments object in place (single pass)*/
+		LO_cmdarg_t arg;
+		const char *value_pc;
+		while (_LO_cmdargs_nextName(it, &arg, &value_pc) > 0) {
+			if (LO_cmdarg_nameIs(&arg, key)) {
+				if ((value_pc >= end) || (*value_pc != '{'))
+					return -1;
+				it->pc = value_pc + 1;
+				it->first = 1;
+				return 0;
+			}
+			it->pc = _LO_cmdargs_scanValue(value_pc, end, &arg);
+			if (it->pc == NULL)
+				return -1;
+		}
+		return -1;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_cmdargs_next(LO_cmdargs_t *it, LO_cmdarg_t *arg_ptr) {
+	const char *pc;
+	int ret = _LO_cmdargs_nextName(it, arg_ptr, &pc);
+
+	if (ret <= 0)
+		return ret;
+	pc = _LO_cmdargs_scanValue(pc, it->end, arg_ptr);
+	if (pc == NULL)
+		return -1;
+	it->pc = pc;
+	return 1;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_cmdargs_find(const LO_cmdargs_t *it, const char *name, LO_cmdarg_t *arg_ptr) {
+	LO_cmdargs_t cur = *it;
+	int ret;
+
+	while ((ret = LO_cmdargs_next(&cur, arg_ptr)) > 0) {
+		if (LO_cmdarg_nameIs(arg_ptr, name))
+			return 1;
+	}
+	return ret;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_cmdarg_fromText(LO_cmdarg_t *arg_ptr, const char *name, const char *value) {
+	const char *end;
+	const char *pc;
+
+	if ((arg_ptr == NULL) || (name == NULL) || (value == NULL))
+		return -1;
+	arg_ptr->name.ptr = name;
+	arg_ptr->name.len = strlen(name);
+
+	end = value + strlen(value);
+	pc = _LO_cmdargs_scanValue(_LO_cmdargs_skipWs(value, end), end, arg_ptr);
+	if ((pc == NULL) || (_LO_cmdargs_skipWs(pc, end) != end)) {
+		/* Not a JSON value : the text itself*/
+		arg_ptr->type = LO_CMDARG_STRING;
+		arg_ptr->escaped = 0;
+		arg_ptr->value.ptr = value;
+		arg_ptr->value.len = end - value;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_cmdarg_nameIs(const LO_cmdarg_t *arg_ptr, const char *name) {
+	return (strlen(name) == arg_ptr->name.len) && !memcmp(arg_ptr->name.ptr, name, arg_ptr->name.len);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_cmdarg_toInt64(const LO_cmdarg_t *arg_ptr, int64_t *val_ptr) {
+	const char *pc = arg_ptr->value.ptr;
+	const char *end = pc + arg_ptr->value.len;
+	uint64_t val = 0;
+	uint8_t neg = 0;
+
+	if (arg_ptr->type != LO_CMDARG_INT)
+		return -1;
+	if (*pc == '-') {
+		neg = 1;
+		pc++;
+	}
+	if (pc == end)
+		return -1;
+	for (; pc < end; pc++) {
+		uint32_t d = *pc - '0';
+		if (val > (UINT64_MAX - d) / 10)
+			return -1;
+		val = val * 10 + d;
+	}
+	if (val > (uint64_t) INT64_MAX + neg)
+		return -1;
+	*val_ptr = (neg) ? (int64_t) (0 - val) : (int64_t) val;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_cmdarg_toInt(const LO_cmdarg_t *arg_ptr, int32_t *val_ptr) {
+	int64_t val;
+
+	if (arg_ptr->type == LO_CMDARG_BOOL) {
+		*val_ptr = (*arg_ptr->value.ptr == 't');
+		return 0;
+	}
+	if (LO_cmdarg_toInt64(arg_ptr, &val) || (val < INT32_MIN) || (val > INT32_MAX))
+		return -1;
+	*val_ptr = (int32_t) val;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_cmdarg_toDouble(const LO_cmdarg_t *arg_ptr, double *val_ptr) {
+	const char *pc = arg_ptr->value.ptr;
+	const char *end = pc + arg_ptr->value.len;
+	uint64_t mant = 0;
+	int32_t exp10 = 0, e = 0;
+	uint32_t digits = 0;
+	uint8_t neg = 0, eneg = 0;
+	char tmp[64];
+	char *last;
+
+	if ((arg_ptr->type != LO_CMDARG_INT) && (arg_ptr->type != LO_CMDARG_FLOAT))
+		return -1;
+
+	/* Fast path : mantissa exact in a double, and exact power of ten*/
+	if (*pc == '-') {
+		neg = 1;
+		pc++;
+	}
+	for (; (pc < end) && (*pc >= '0') && (*pc <= '9'); pc++, digits++)
+		mant = mant * 10 + (*pc - '0');
+	if ((pc < end) && (*pc == '.')) {
+		for (pc++; (pc < end) && (*pc >= '0') && (*pc <= '9'); pc++, digits++, exp10--)
+			mant = mant * 10 + (*pc - '0');
+	}
+	if ((pc < end) && ((*pc == 'e') || (*pc == 'E'))) {
+		pc++;
+		if ((pc < end) && ((*pc == '+') || (*pc == '-')))
+			eneg = (*pc++ == '-');
+		for (; (pc < end) && (*pc >= '0') && (*pc <= '9') && (e < 10000); pc++)
+			e = e * 10 + (*pc - '0');
+		exp10 += (eneg) ? -e : e;
+	}
+	if ((pc == end) && (digits) && (digits <= 15) && (exp10 >= -22) && (exp10 <= 22)) {
+		double val = (double) mant;
+		val = (exp10 < 0) ? val / _cmdargs_pow10[-exp10] : val * _cmdargs_pow10[exp10];
+		*val_ptr = (neg) ? -val : val;
+		return 0;
+	}
+
+	/* Slow path*/
+	if (arg_ptr->value.len >= sizeof(tmp))
+		return -1;
+	memcpy(tmp, arg_ptr->value.ptr, arg_ptr->value.len);
+	tmp[arg_ptr->value.len] = 0;
+	*val_ptr = strtod(tmp, &last);
+	return (*last == 0) ? 0 : -1;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_cmdarg_toBool(const LO_cmdarg_t *arg_ptr, uint8_t *val_ptr) {
+	int32_t val;
+	if (((arg_ptr->type != LO_CMDARG_BOOL) && (arg_ptr->type != LO_CMDARG_INT))
+			|| LO_cmdarg_toInt(arg_ptr, &val))
+		return -1;
+	*val_ptr = (val != 0);
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_cmdarg_toStr(const LO_cmdarg_t *arg_ptr, char *buf, uint32_t buf_sz) {
+	const char *pc = arg_ptr->value.ptr;
+	const char *end = pc + arg_ptr->value.len;
+	uint32_t len = 0;
+
+	if ((arg_ptr->type != LO_CMDARG_STRING) || (buf_sz == 0))
+		return -1;
+
+	if (!arg_ptr->escaped) {
+		if (arg_ptr->value.len >= buf_sz)
+			return -1;
+		memcpy(buf, pc, arg_ptr->value.len);
+		buf[arg_ptr->value.len] = 0;
+		return (int) arg_ptr->value.len;
+	}
+
+	while (pc < end) {
+		char utf8[4];
+		uint32_t n = 1;
+
+		if (*pc != '\\') {
+			utf8[0] = *pc++;
+		} else {
+			if (++pc >= end)
+				return -1;
+			switch (*pc++) {
+			case 'b': utf8[0] = '\b'; break;
+			case 'f': utf8[0] = '\f'; break;
+			case 'n': utf8[0] = '\n'; break;
+			case 'r': utf8[0] = '\r'; break;
+			case 't': utf8[0] = '\t'; break;
+			case 'u': {
+				uint32_t cp, lo;
+				if ((end - pc < 4) || _LO_cmdargs_hex4(pc, &cp))
+					return -1;
+				pc += 4;
+				/* Surrogate pair*/
+				if ((cp >= 0xD800) && (cp < 0xDC00) && (end - pc >= 6) && (pc[0] == '\\')
+						&& (pc[1] == 'u') && (_LO_cmdargs_hex4(pc + 2, &lo) == 0)
+						&& (lo >= 0xDC00) && (lo < 0xE000)) {
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+					pc += 6;
+				}
+				if (cp < 0x80) {
+					utf8[0] = (char) cp;
+				} else if (cp < 0x800) {
+					utf8[0] = (char) (0xC0 | (cp >> 6));
+					utf8[1] = (char) (0x80 | (cp & 0x3F));
+					n = 2;
+				} else if (cp < 0x10000) {
+					utf8[0] = (char) (0xE0 | (cp >> 12));
+					utf8[1] = (char) (0x80 | ((cp >> 6) & 0x3F));
+					utf8[2] = (char) (0x80 | (cp & 0x3F));
+					n = 3;
+				} else {
+					utf8[0] = (char) (0xF0 | (cp >> 18));
+					utf8[1] = (char) (0x80 | ((cp >> 12) & 0x3F));
+					utf8[2] = (char) (0x80 | ((cp >> 6) & 0x3F));
+					utf8[3] = (char) (0x80 | (cp & 0x3F));
+					n = 4;
+				}
+				break;
+			}
+			default:
+				/* \" \\ \/*/
+				utf8[0] = pc[-1];
+				break;
+			}
+		}
+		if (len + n >= buf_sz)
+			return -1;
+		memcpy(buf + len, utf8, n);
+		len += n;
+	}
+	buf[len] = 0;
+	return (int) len;
+}
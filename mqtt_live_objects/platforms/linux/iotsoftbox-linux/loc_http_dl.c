@@ -0,0 +1,961 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_http_dl.c
+ * @brief Resumable HTTP download of a resource into a file.
+ */
+
+#include "liveobjects-sys/loc_http_dl.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "iotsoftbox-core/loc_sock.h"
+#include "liveobjects-sys/loc_trace.h"
+#include "liveobjects-sys/socket_defs.h"
+
+#if LOC_FEATURE_HTTP_GZIP
+#include <zlib.h>
+#endif
+
+/** Connection to the HTTP server. */
+typedef struct {
+	socketHandle_t sock;
+	char host[128];
+	uint16_t port;
+	uint8_t reused;                /* Taken from the idle connections*/
+	uint8_t keep_alive;            /* Can be reused after the end of the body*/
+	uint64_t body_left;            /* Body bytes not yet given to the reader*/
+	uint32_t rd;                   /* Received bytes not yet given to the reader : buf[rd..wr[*/
+	uint32_t wr;
+	char buf[LOC_HTTP_DL_BUF_SZ];
+} LO_http_dl_conn_t;
+
+/** Target of the requests. */
+typedef struct {
+	char host[128];
+	uint16_t port;
+	const char *uri;
+	const char *validator;         /* If-Range (or NULL)*/
+	uint8_t gzip;                  /* Accept a compressed body*/
+} LO_http_dl_target_t;
+
+/** Response of the HTTP server. */
+typedef struct {
+	int status;
+	int64_t content_length;        /* -1 : not given*/
+	int64_t range_start;           /* Content-Range, -1 : not given*/
+	int64_t range_total;
+	int8_t encoding;               /* Content-Encoding : 0 identity, 1 gzip / deflate, -1 other*/
+	char etag[LO_HTTP_DL_TAG_SZ];
+	char last_modified[LO_HTTP_DL_TAG_SZ];
+} LO_http_dl_rsp_t;
+
+/** Segment of a segmented download. */
+typedef struct {
+	pthread_t thread;
+	uint8_t started;
+	const LO_http_dl_target_t *tgt;
+	LO_rsc_sink_t *sink;
+	LO_http_dl_conn_t *conn;       /* Connection already opened (first segment), or NULL*/
+	uint32_t start;
+	uint32_t len;
+	uint32_t done;                 /* Bytes received*/
+} LO_http_dl_seg_t;
+
+/** Download started by LO_http_dl_start. */
+typedef struct LO_http_dl_job_s {
+	struct LO_http_dl_job_s *next;
+	uint8_t running;
+	LO_http_dl_opt_t opt;
+	LO_http_dl_done_t done_cb;
+	void *ctx;
+	char digest_hex[2 * 32 + 1];
+	char url[LO_HTTP_DL_URL_SZ];
+	char path[LOC_RSC_SINK_PATH_SZ];
+} LO_http_dl_job_t;
+
+#if LOC_FEATURE_HTTP_GZIP
+/** Decoder of a compressed body. */
+typedef struct {
+	LO_http_dl_conn_t *conn;
+	z_stream zs;
+	uint8_t end;                   /* End of the compressed stream*/
+} LO_http_dl_gz_t;
+#endif
+
+#define LO_HTTP_DL_IDLE_NB        ((LOC_HTTP_DL_CONN_MAX) ? (LOC_HTTP_DL_CONN_MAX) : 1)
+
+static LO_http_dl_conn_t *_http_dl_idle[LO_HTTP_DL_IDLE_NB];
+static pthread_mutex_t _http_dl_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Started downloads (running, then waiting), protected by _http_dl_jobs_mutex*/
+static LO_http_dl_job_t *_http_dl_jobs = NULL;
+static int _http_dl_workers = 0;
+static pthread_mutex_t _http_dl_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _http_dl_jobs_cond = PTHREAD_COND_INITIALIZER;
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+/* Split "http://host[:port]/path". Return the path, or NULL if the url is invalid.*/
+static const char * _LO_http_dl_parseUrl(const char *url, char *host, size_t host_sz, uint16_t *port) {
+	const char *pc, *path;
+	size_t len;
+
+	if (strncmp(url, "http://", 7))
+		return NULL;
+	url += 7;
+	path = strchr(url, '/');
+	if (path == NULL)
+		path = url + strlen(url);
+	pc = memchr(url, ':', path - url);
+	len = ((pc) ? pc : path) - url;
+	if ((len == 0) || (len >= host_sz))
+		return NULL;
+	memcpy(host, url, len);
+	host[len] = 0;
+	*port = 80;
+	if (pc) {
+		unsigned long val = strtoul(pc + 1, NULL, 10);
+		if ((val == 0) || (val > UINT16_MAX))
+			return NULL;
+		*port = (uint16_t) val;
+	}
+	return (*path) ? path : "/";
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_http_dl_statePath(const char *path, char *state_path, size_t sz) {
+	snprintf(state_path, sz, "%s.state", path);
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Copy a header value, if it fits.*/
+static void _LO_http_dl_copyTag(char *tag, const char *val) {
+	size_t len = strlen(val);
+	if (len < LO_HTTP_DL_TAG_SZ)
+		memcpy(tag, val, len + 1);
+	else
+		tag[0] = 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Validator of the resource for If-Range (a weak ETag cannot be used), or NULL.*/
+static const char * _LO_http_dl_validator(const LO_http_dl_state_t *state) {
+	if ((state->etag[0]) && (strncmp(state->etag, "W/", 2)))
+		return state->etag;
+	if (state->last_modified[0])
+		return state->last_modified;
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Flush the received bytes, then save the state (written into a temporary*/
+/* file first, so that a crash leaves either the previous or the new state).*/
+static int _LO_http_dl_save(LO_rsc_sink_t *sink, const char *path, LO_http_dl_state_t *state) {
+	char state_path[LOC_RSC_SINK_PATH_SZ + 16];
+	char tmp_path[LOC_RSC_SINK_PATH_SZ + 24];
+	FILE *fp;
+
+	if (_LO_http_dl_validator(state) == NULL)
+		return -1;   /* cannot be validated when resumed*/
+	if (LO_rsc_sink_sync(sink))
+		return -1;
+	state->offset = sink->written;
+
+	_LO_http_dl_statePath(path, state_path, sizeof(state_path));
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", state_path);
+	fp = fopen(tmp_path, "w");
+	if (fp == NULL)
+		return -1;
+	fprintf(fp, "url=%s\nsize=%" PRIu32 "\noffset=%" PRIu32 "\netag=%s\nlast-modified=%s\n",
+			state->url, state->size, state->offset, state->etag, state->last_modified);
+	if ((fflush(fp)) || (fsync(fileno(fp)))) {
+		fclose(fp);
+		unlink(tmp_path);
+		return -1;
+	}
+	if ((fclose(fp)) || (rename(tmp_path, state_path))) {
+		unlink(tmp_path);
+		return -1;
+	}
+	LOTRACE_DBG1("LO_http_dl: %s - %" PRIu32 "/%" PRIu32 " saved", path, state->offset, state->size);
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_http_dl_removeState(const char *path) {
+	char state_path[LOC_RSC_SINK_PATH_SZ + 16];
+	_LO_http_dl_statePath(path, state_path, sizeof(state_path));
+	unlink(state_path);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_http_dl_free(LO_http_dl_conn_t *conn) {
+	if (conn->sock != SOCKETHANDLE_NULL)
+		LO_sock_disconnect(&conn->sock);
+	free(conn);
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Take an idle connection to the server, or open a new one.*/
+static LO_http_dl_conn_t * _LO_http_dl_acquire(const char *host, uint16_t port) {
+	LO_http_dl_conn_t *conn = NULL;
+	struct timeval tv;
+	int i;
+
+	pthread_mutex_lock(&_http_dl_mutex);
+	for (i = 0; i < LOC_HTTP_DL_CONN_MAX; i++) {
+		if ((_http_dl_idle[i]) && (_http_dl_idle[i]->port == port)
+				&& (!strcmp(_http_dl_idle[i]->host, host))) {
+			conn = _http_dl_idle[i];
+			_http_dl_idle[i] = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&_http_dl_mutex);
+	if (conn) {
+		conn->reused = 1;
+		return conn;
+	}
+
+	if (strlen(host) >= sizeof(conn->host))
+		return NULL;
+	conn = (LO_http_dl_conn_t *) malloc(sizeof(LO_http_dl_conn_t));
+	if (conn == NULL)
+		return NULL;
+	strcpy(conn->host, host);
+	conn->port = port;
+	conn->reused = 0;
+	conn->keep_alive = 0;
+	conn->body_left = 0;
+	conn->rd = conn->wr = 0;
+	if (LO_sock_connect(0, host, port, &conn->sock) || (conn->sock == SOCKETHANDLE_NULL)) {
+		conn->sock = SOCKETHANDLE_NULL;
+		_LO_http_dl_free(conn);
+		return NULL;
+	}
+	tv.tv_sec = LOC_HTTP_DL_TIMEOUT_S;
+	tv.tv_usec = 0;
+	setsockopt(conn->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	return conn;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Keep the connection for the next download if its response has been fully read.*/
+static void _LO_http_dl_release(LO_http_dl_conn_t *conn, uint8_t reusable) {
+	int i;
+
+	if ((reusable) && (conn->keep_alive) && (conn->body_left == 0) && (conn->rd == conn->wr)) {
+		pthread_mutex_lock(&_http_dl_mutex);
+		for (i = 0; i < LOC_HTTP_DL_CONN_MAX; i++) {
+			if (_http_dl_idle[i] == NULL) {
+				_http_dl_idle[i] = conn;
+				conn = NULL;
+				break;
+			}
+		}
+		pthread_mutex_unlock(&_http_dl_mutex);
+	}
+	if (conn)
+		_LO_http_dl_free(conn);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static int _LO_http_dl_recv(LO_http_dl_conn_t *conn, char *buf, uint32_t len) {
+	ssize_t n;
+	do {
+		n = recv(conn->sock, buf, len, 0);
+	} while ((n < 0) && (errno == EINTR));
+	if (n <= 0) {
+		if (n < 0)
+			LOTRACE_ERR("LO_http_dl: recv error, errno=%d", errno);
+		else
+			LOTRACE_ERR("LO_http_dl: connection closed by the server");
+		conn->keep_alive = 0;
+		return -1;
+	}
+	return (int) n;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Reader of the body : the received bytes are kept in the connection buffer*/
+/* only for the small reads, the large ones are received in place.*/
+static int _LO_http_dl_reader(void *ctx, char *buf, uint32_t len) {
+	LO_http_dl_conn_t *conn = (LO_http_dl_conn_t *) ctx;
+	int n;
+
+	if (len > conn->body_left)
+		len = (uint32_t) conn->body_left;
+	if (len == 0)
+		return -1;
+
+	if (conn->rd == conn->wr) {
+		if (len >= sizeof(conn->buf)) {
+			n = _LO_http_dl_recv(conn, buf, len);
+			if (n > 0)
+				conn->body_left -= n;
+			return n;
+		}
+		n = _LO_http_dl_recv(conn, conn->buf, (conn->body_left < sizeof(conn->buf)) ?
+				(uint32_t) conn->body_left : sizeof(conn->buf));
+		if (n < 0)
+			return -1;
+		conn->rd = 0;
+		conn->wr = (uint32_t) n;
+	}
+	if (len > conn->wr - conn->rd)
+		len = conn->wr - conn->rd;
+	memcpy(buf, conn->buf + conn->rd, len);
+	conn->rd += len;
+	conn->body_left -= len;
+	return len;
+}
+
+#if LOC_FEATURE_HTTP_GZIP
+/*---------------------------------------------------------------------------------*/
+/* Reader of a compressed body : the compressed bytes are received into the*/
+/* connection buffer, and inflated directly into the destination.*/
+static int _LO_http_dl_gzReader(void *ctx, char *buf, uint32_t len) {
+	LO_http_dl_gz_t *gz = (LO_http_dl_gz_t *) ctx;
+	LO_http_dl_conn_t *conn = gz->conn;
+
+	gz->zs.next_out = (Bytef *) buf;
+	gz->zs.avail_out = len;
+	while ((gz->zs.avail_out == len) && (!gz->end)) {
+		uint32_t avail;
+		int ret;
+		if (conn->rd == conn->wr) {
+			if (conn->body_left == 0) {
+				LOTRACE_ERR("LO_http_dl: truncated compressed body");
+				return -1;
+			}
+			ret = _LO_http_dl_recv(conn, conn->buf, (conn->body_left < sizeof(conn->buf)) ?
+					(uint32_t) conn->body_left : sizeof(conn->buf));
+			if (ret < 0)
+				return -1;
+			conn->rd = 0;
+			conn->wr = (uint32_t) ret;
+		}
+		avail = conn->wr - conn->rd;
+		gz->zs.next_in = (Bytef *) conn->buf + conn->rd;
+		gz->zs.avail_in = avail;
+		ret = inflate(&gz->zs, Z_NO_FLUSH);
+		conn->rd += avail - gz->zs.avail_in;
+		conn->body_left -= avail - gz->zs.avail_in;
+		if (ret == Z_STREAM_END) {
+			gz->end = 1;
+		} else if ((ret != Z_OK) && (ret != Z_BUF_ERROR)) {
+			LOTRACE_ERR("LO_http_dl: inflate error %d", ret);
+			conn->keep_alive = 0;
+			return -1;
+		}
+	}
+	return len - gz->zs.avail_out;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* The compressed stream must end with the last expected byte.*/
+static int _LO_http_dl_gzEnd(LO_http_dl_gz_t *gz) {
+	char extra;
+	return ((gz->end) || (_LO_http_dl_gzReader(gz, &extra, 1) == 0)) ? 0 : -1;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_http_dl_gzFree(LO_http_dl_gz_t *gz) {
+	if (gz) {
+		inflateEnd(&gz->zs);
+		free(gz);
+	}
+}
+#endif
+
+/*---------------------------------------------------------------------------------*/
+/* Receive and parse the status line and the headers.*/
+static int _LO_http_dl_readHeaders(LO_http_dl_conn_t *conn, LO_http_dl_rsp_t *rsp) {
+	char *end = NULL;
+	char *line, *next;
+	unsigned int minor;
+
+	memset(rsp, 0, sizeof(*rsp));
+	rsp->content_length = -1;
+	rsp->range_start = -1;
+	rsp->range_total = -1;
+
+	conn->rd = conn->wr = 0;
+	while (end == NULL) {
+		ssize_t n;
+		if (conn->wr >= sizeof(conn->buf) - 1) {
+			LOTRACE_ERR("LO_http_dl: headers too long");
+			return -1;
+		}
+		do {
+			n = recv(conn->sock, conn->buf + conn->wr, sizeof(conn->buf) - 1 - conn->wr, 0);
+		} while ((n < 0) && (errno == EINTR));
+		if (n <= 0) {
+			LOTRACE_ERR("LO_http_dl: no response, errno=%d", (n < 0) ? errno : 0);
+			return -1;
+		}
+		conn->buf[conn->wr + n] = 0;
+		end = strstr(conn->buf + ((conn->wr > 3) ? conn->wr - 3 : 0), "\r\n\r\n");
+		conn->wr += n;
+	}
+	*end = 0;
+	conn->rd = end + 4 - conn->buf;
+
+	line = conn->buf;
+	next = strstr(line, "\r\n");
+	if (next) {
+		*next = 0;
+		next += 2;
+	}
+	if (sscanf(line, "HTTP/1.%u %d", &minor, &rsp->status) != 2) {
+		LOTRACE_ERR("LO_http_dl: invalid status line '%s'", line);
+		return -1;
+	}
+	conn->keep_alive = (minor >= 1);
+	while ((line = next) != NULL) {
+		char *val;
+		next = strstr(line, "\r\n");
+		if (next) {
+			*next = 0;
+			next += 2;
+		}
+		val = strchr(line, ':');
+		if (val == NULL)
+			continue;
+		*val++ = 0;
+		val += strspn(val, " \t");
+
+		if (!strcasecmp(line, "Content-Length")) {
+			rsp->content_length = strtoll(val, NULL, 10);
+		} else if (!strcasecmp(line, "Content-Range")) {
+			unsigned long long start, last, total;
+			if (sscanf(val, "bytes %llu-%llu/%llu", &start, &last, &total) == 3) {
+				rsp->range_start = (int64_t) start;
+				rsp->range_total = (int64_t) total;
+			}
+		} else if (!strcasecmp(line, "ETag")) {
+			_LO_http_dl_copyTag(rsp->etag, val);
+		} else if (!strcasecmp(line, "Last-Modified")) {
+			_LO_http_dl_copyTag(rsp->last_modified, val);
+		} else if (!strcasecmp(line, "Connection")) {
+			conn->keep_alive = (strcasecmp(val, "close") != 0);
+		} else if (!strcasecmp(line, "Content-Encoding")) {
+			if ((!strcasecmp(val, "gzip")) || (!strcasecmp(val, "x-gzip")) || (!strcasecmp(val, "deflate")))
+				rsp->encoding = 1;
+			else if (strcasecmp(val, "identity"))
+				rsp->encoding = -1;
+		} else if (!strcasecmp(line, "Transfer-Encoding")) {
+			/* Only bodies with a Content-Length are supported*/
+			conn->keep_alive = 0;
+		}
+	}
+	conn->body_left = (rsp->content_length > 0) ? (uint64_t) rsp->content_length : 0;
+	if ((rsp->content_length < 0) || (conn->wr - conn->rd > conn->body_left))
+		conn->keep_alive = 0;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Send the request of the bytes [start, last] of the resource (start < 0 : the*/
+/* whole resource, last < 0 : up to the end).*/
+static int _LO_http_dl_request(LO_http_dl_conn_t *conn, const LO_http_dl_target_t *tgt,
+		int64_t start, int64_t last) {
+	char req[LO_HTTP_DL_URL_SZ + LO_HTTP_DL_TAG_SZ + 256];
+	int len;
+
+	len = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s", tgt->uri, tgt->host);
+	if (tgt->port != 80)
+		len += snprintf(req + len, sizeof(req) - len, ":%u", tgt->port);
+	len += snprintf(req + len, sizeof(req) - len, "\r\nConnection: %s\r\n",
+			(LOC_HTTP_DL_CONN_MAX) ? "keep-alive" : "close");
+	if (start >= 0) {
+		len += snprintf(req + len, sizeof(req) - len, "Range: bytes=%" PRIi64 "-", start);
+		if (last >= 0)
+			len += snprintf(req + len, sizeof(req) - len, "%" PRIi64, last);
+		len += snprintf(req + len, sizeof(req) - len, "\r\n");
+		if (tgt->validator)
+			len += snprintf(req + len, sizeof(req) - len, "If-Range: %s\r\n", tgt->validator);
+	}
+	if (tgt->gzip)
+		len += snprintf(req + len, sizeof(req) - len, "Accept-Encoding: gzip\r\n");
+	len += snprintf(req + len, sizeof(req) - len, "\r\n");
+	if (len >= (int) sizeof(req))
+		return -1;
+	return LO_sock_send(conn->sock, req);
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Send a request and receive the headers of its response.*/
+static LO_http_dl_conn_t * _LO_http_dl_open(const LO_http_dl_target_t *tgt, int64_t start, int64_t last,
+		LO_http_dl_rsp_t *rsp) {
+	LO_http_dl_conn_t *conn;
+
+	while (1) {
+		conn = _LO_http_dl_acquire(tgt->host, tgt->port);
+		if (conn == NULL)
+			return NULL;
+		if ((_LO_http_dl_request(conn, tgt, start, last) == 0)
+				&& (_LO_http_dl_readHeaders(conn, rsp) == 0))
+			return conn;
+		/* An idle connection may have been closed by the server : retry with a new one*/
+		if (!conn->reused) {
+			_LO_http_dl_release(conn, 0);
+			return NULL;
+		}
+		_LO_http_dl_release(conn, 0);
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Receive a segment of the resource (thread of a segmented download).*/
+static void * _LO_http_dl_segment(void *arg) {
+	LO_http_dl_seg_t *seg = (LO_http_dl_seg_t *) arg;
+	LO_http_dl_conn_t *conn = seg->conn;
+	LO_http_dl_rsp_t rsp;
+	uint8_t *buf = NULL;
+
+	if (conn == NULL) {
+		conn = _LO_http_dl_open(seg->tgt, seg->start, (int64_t) seg->start + seg->len - 1, &rsp);
+		if (conn == NULL)
+			return NULL;
+		if ((rsp.status != 206) || (rsp.range_start != seg->start)
+				|| (rsp.range_total != seg->sink->size)) {
+			LOTRACE_ERR("LO_http_dl: segment at %" PRIu32 " - unexpected status %d", seg->start, rsp.status);
+			_LO_http_dl_release(conn, 0);
+			return NULL;
+		}
+	}
+	if ((seg->sink->map == NULL) && ((buf = (uint8_t *) malloc(LOC_RSC_SINK_BUF_SZ)) == NULL)) {
+		_LO_http_dl_release(conn, 0);
+		return NULL;
+	}
+	while (seg->done < seg->len) {
+		int n = LO_rsc_sink_fillAt(seg->sink, seg->start + seg->done, seg->len - seg->done,
+				_LO_http_dl_reader, conn, buf);
+		if (n <= 0)
+			break;
+		seg->done += n;
+	}
+	free(buf);
+	_LO_http_dl_release(conn, (seg->done == seg->len));
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Receive the missing bytes as nb segments fetched concurrently, the first one*/
+/* on the connection of the first response (requested up to the end, and closed*/
+/* at the end of the segment). The received prefix of the file is then*/
+/* accounted (and added to the digest).*/
+static int _LO_http_dl_segmented(const LO_http_dl_target_t *tgt, LO_rsc_sink_t *sink,
+		LO_http_dl_conn_t *conn, int nb) {
+	LO_http_dl_seg_t segs[LOC_HTTP_DL_SEG_MAX];
+	uint32_t seg_len = (sink->size - sink->written) / nb;
+	uint32_t prefix;
+	int i;
+
+	memset(segs, 0, sizeof(segs));
+	for (i = 0; i < nb; i++) {
+		segs[i].tgt = tgt;
+		segs[i].sink = sink;
+		segs[i].start = sink->written + i * seg_len;
+		segs[i].len = (i == nb - 1) ? sink->size - segs[i].start : seg_len;
+	}
+	segs[0].conn = conn;
+
+	for (i = 1; i < nb; i++)
+		segs[i].started = (pthread_create(&segs[i].thread, NULL, _LO_http_dl_segment, &segs[i]) == 0);
+	_LO_http_dl_segment(&segs[0]);
+	for (i = 1; i < nb; i++) {
+		if (segs[i].started)
+			pthread_join(segs[i].thread, NULL);
+		else
+			_LO_http_dl_segment(&segs[i]);
+	}
+
+	prefix = sink->written;
+	for (i = 0; i < nb; i++) {
+		prefix += segs[i].done;
+		if (segs[i].done < segs[i].len)
+			break;
+	}
+	return LO_rsc_sink_advance(sink, prefix);
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Next waiting download (called with _http_dl_jobs_mutex locked).*/
+static LO_http_dl_job_t * _LO_http_dl_nextJob(void) {
+	LO_http_dl_job_t *job;
+	for (job = _http_dl_jobs; job; job = job->next) {
+		if (!job->running) {
+			job->running = 1;
+			return job;
+		}
+	}
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Worker : run downloads until there is no more waiting one.*/
+static void * _LO_http_dl_worker(void *arg) {
+	LO_http_dl_job_t *job = (LO_http_dl_job_t *) arg;
+
+	while (job) {
+		LO_http_dl_job_t **pp;
+		int ret = LO_http_dl_get(job->url, job->path, &job->opt);
+		if (job->done_cb)
+			job->done_cb(job->ctx, job->path, ret);
+
+		pthread_mutex_lock(&_http_dl_jobs_mutex);
+		for (pp = &_http_dl_jobs; *pp; pp = &(*pp)->next) {
+			if (*pp == job) {
+				*pp = job->next;
+				break;
+			}
+		}
+		free(job);
+		job = _LO_http_dl_nextJob();
+		if (job == NULL)
+			_http_dl_workers--;
+		pthread_cond_broadcast(&_http_dl_jobs_cond);
+		pthread_mutex_unlock(&_http_dl_jobs_mutex);
+	}
+	return NULL;
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+int LO_http_dl_getState(const char *path, LO_http_dl_state_t *state) {
+	char state_path[LOC_RSC_SINK_PATH_SZ + 16];
+	char line[LO_HTTP_DL_URL_SZ + 16];
+	FILE *fp;
+
+	if ((path == NULL) || (state == NULL))
+		return -1;
+	memset(state, 0, sizeof(*state));
+	_LO_http_dl_statePath(path, state_path, sizeof(state_path));
+	fp = fopen(state_path, "r");
+	if (fp == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), fp)) {
+		char *val = strchr(line, '=');
+		if (val == NULL)
+			continue;
+		*val++ = 0;
+		val[strcspn(val, "\n")] = 0;
+		if (!strcmp(line, "url") && (strlen(val) < sizeof(state->url)))
+			strcpy(state->url, val);
+		else if (!strcmp(line, "size"))
+			state->size = (uint32_t) strtoul(val, NULL, 10);
+		else if (!strcmp(line, "offset"))
+			state->offset = (uint32_t) strtoul(val, NULL, 10);
+		else if (!strcmp(line, "etag"))
+			_LO_http_dl_copyTag(state->etag, val);
+		else if (!strcmp(line, "last-modified"))
+			_LO_http_dl_copyTag(state->last_modified, val);
+	}
+	fclose(fp);
+	if ((state->url[0] == 0) || (state->offset == 0) || (state->offset > state->size)
+			|| (_LO_http_dl_validator(state) == NULL))
+		return -1;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_http_dl_cancel(const char *path) {
+	char part[LOC_RSC_SINK_PATH_SZ + 8];
+	if (path == NULL)
+		return;
+	snprintf(part, sizeof(part), "%s.part", path);
+	unlink(part);
+	_LO_http_dl_removeState(path);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_http_dl_get(const char *url, const char *path, const LO_http_dl_opt_t *opt) {
+	static const LO_http_dl_opt_t def_opt = { LO_RSC_SINK_FILE, LO_RSC_DIGEST_NONE, NULL, 0, 0, 0 };
+	LO_http_dl_state_t state;
+	LO_http_dl_target_t tgt;
+	LO_http_dl_rsp_t rsp;
+	LO_http_dl_conn_t *conn = NULL;
+	LO_rsc_sink_t *sink = NULL;
+	LO_rsc_sink_reader_t reader = _LO_http_dl_reader;
+	void *reader_ctx;
+#if LOC_FEATURE_HTTP_GZIP
+	LO_http_dl_gz_t *gz = NULL;
+#endif
+	uint32_t saved;
+	uint8_t reusable = 0;
+	int nb, ret = -1;
+
+	if ((url == NULL) || (path == NULL) || (strlen(url) >= sizeof(state.url)))
+		return -1;
+	tgt.uri = _LO_http_dl_parseUrl(url, tgt.host, sizeof(tgt.host), &tgt.port);
+	if (tgt.uri == NULL) {
+		LOTRACE_ERR("LO_http_dl_get: invalid url %s", url);
+		return -1;
+	}
+	if (opt == NULL)
+		opt = &def_opt;
+	nb = (opt->segments > LOC_HTTP_DL_SEG_MAX) ? LOC_HTTP_DL_SEG_MAX : opt->segments;
+
+	if ((LO_http_dl_getState(path, &state)) || (strcmp(state.url, url))) {
+		memset(&state, 0, sizeof(state));
+		strcpy(state.url, url);
+	}
+	tgt.validator = _LO_http_dl_validator(&state);
+	/* A compressed body is decoded from its beginning : the resumed and*/
+	/* segmented downloads are not compressed*/
+	tgt.gzip = (LOC_FEATURE_HTTP_GZIP) && (opt->gzip) && (opt->size) && (state.offset == 0) && (nb <= 1);
+
+	sink = (LO_rsc_sink_t *) calloc(1, sizeof(LO_rsc_sink_t));
+	if (sink == NULL)
+		return -1;
+	/* A segmented download starts with a range request, to know if the server supports it*/
+	conn = _LO_http_dl_open(&tgt, ((state.offset) || (nb > 1)) ? (int64_t) state.offset : -1, -1, &rsp);
+	if (conn == NULL)
+		goto exit;
+	if ((rsp.encoding) && ((rsp.encoding < 0) || (!tgt.gzip) || (rsp.status != 200))) {
+		LOTRACE_ERR("LO_http_dl_get: %s - unsupported Content-Encoding", url);
+		goto exit;
+	}
+
+	if ((rsp.status == 206) && (state.offset) && (rsp.range_start == state.offset)
+			&& (rsp.range_total == state.size)) {
+		if (LO_rsc_sink_reopen(sink, path, state.size, opt->mode, state.offset)) {
+			/* Partial file lost : restart from the beginning at the next call*/
+			LO_http_dl_cancel(path);
+			goto exit;
+		}
+		LOTRACE_INF("LO_http_dl_get: %s resumed at %" PRIu32 "/%" PRIu32, url, state.offset, state.size);
+	} else if ((rsp.status == 200) || ((rsp.status == 206) && (state.offset == 0) && (rsp.range_start == 0))) {
+		int64_t size = (rsp.status == 200) ? rsp.content_length : rsp.range_total;
+		if ((rsp.encoding) && (size >= 0))
+			size = opt->size;   /* size of the decoded resource*/
+		if ((size < 0) || (size > UINT32_MAX)) {
+			LOTRACE_ERR("LO_http_dl_get: %s - no valid Content-Length", url);
+			goto exit;
+		}
+		/* New download, or the resource has changed since the previous attempt*/
+		if (state.offset)
+			LOTRACE_WARN("LO_http_dl_get: %s has changed, restarted", url);
+		state.size = (uint32_t) size;
+		state.offset = 0;
+		/* The ETag of a compressed body is the one of its gzip representation,*/
+		/* not of the resource asked by a resume : only Last-Modified is kept*/
+		if (rsp.encoding)
+			state.etag[0] = 0;
+		else
+			strcpy(state.etag, rsp.etag);
+		strcpy(state.last_modified, rsp.last_modified);
+		tgt.validator = _LO_http_dl_validator(&state);
+		_LO_http_dl_removeState(path);
+		if (LO_rsc_sink_open(sink, path, state.size, opt->mode))
+			goto exit;
+	} else {
+		LOTRACE_ERR("LO_http_dl_get: %s - unexpected status %d", url, rsp.status);
+		if (state.offset)
+			LO_http_dl_cancel(path);
+		goto exit;
+	}
+
+	if ((opt->digest != LO_RSC_DIGEST_NONE)
+			&& (LO_rsc_sink_setDigest(sink, opt->digest, opt->digest_hex))) {
+		LOTRACE_ERR("LO_http_dl_get: invalid digest");
+		LO_rsc_sink_close(sink, (sink->written) ? LO_RSC_SINK_KEEP : 0);
+		goto exit;
+	}
+
+	reader_ctx = conn;
+#if LOC_FEATURE_HTTP_GZIP
+	if (rsp.encoding) {
+		gz = (LO_http_dl_gz_t *) calloc(1, sizeof(LO_http_dl_gz_t));
+		if ((gz == NULL) || (inflateInit2(&gz->zs, 32 + MAX_WBITS) != Z_OK)) {
+			free(gz);
+			gz = NULL;
+			LO_rsc_sink_close(sink, 0);
+			goto exit;
+		}
+		gz->conn = conn;
+		reader = _LO_http_dl_gzReader;
+		reader_ctx = gz;
+	}
+#endif
+
+	/* Segments only with a server supporting ranges, and a validator to request them*/
+	if ((rsp.status != 206) || (tgt.validator == NULL))
+		nb = 1;
+	while ((nb > 1) && ((sink->size - sink->written) / nb < LOC_HTTP_DL_SEG_MIN_SZ))
+		nb--;
+
+	if (nb > 1) {
+		LOTRACE_INF("LO_http_dl_get: %s - %" PRIu32 " bytes in %d segments", url,
+				sink->size - sink->written, nb);
+		ret = _LO_http_dl_segmented(&tgt, sink, conn, nb);
+		conn = NULL;
+	} else {
+		saved = sink->written;
+		while (sink->written < sink->size) {
+			ret = LO_rsc_sink_fill(sink, sink->written, reader, reader_ctx);
+			if (ret <= 0)
+				break;
+			if (sink->written - saved >= LOC_HTTP_DL_SAVE_SZ) {
+				_LO_http_dl_save(sink, path, &state);
+				saved = sink->written;
+			}
+		}
+	}
+
+#if LOC_FEATURE_HTTP_GZIP
+	if ((gz) && (sink->written == sink->size) && (_LO_http_dl_gzEnd(gz))) {
+		LOTRACE_ERR("LO_http_dl_get: %s - the decoded resource is not of %" PRIu32 " bytes", url, sink->size);
+		LO_rsc_sink_close(sink, 0);
+		_LO_http_dl_removeState(path);
+		ret = -1;
+		goto exit;
+	}
+#endif
+	if (sink->written == sink->size) {
+		reusable = 1;
+		ret = LO_rsc_sink_close(sink, 1);
+		_LO_http_dl_removeState(path);
+		if (ret == 0)
+			LOTRACE_INF("LO_http_dl_get: %s completed (%" PRIu32 " bytes)", path, state.size);
+	} else if (ret == LO_RSC_SINK_ERR_DIGEST) {
+		LO_rsc_sink_close(sink, 0);
+		_LO_http_dl_removeState(path);
+	} else {
+		ret = -1;
+		if ((sink->written) && (_LO_http_dl_save(sink, path, &state) == 0)) {
+			LO_rsc_sink_close(sink, LO_RSC_SINK_KEEP);
+			LOTRACE_WARN("LO_http_dl_get: %s interrupted at %" PRIu32 "/%" PRIu32,
+					url, state.offset, state.size);
+		} else {
+			LO_rsc_sink_close(sink, 0);
+		}
+	}
+
+exit:
+#if LOC_FEATURE_HTTP_GZIP
+	_LO_http_dl_gzFree(gz);
+#endif
+	if (conn)
+		_LO_http_dl_release(conn, reusable);
+	free(sink);
+	return ret;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_http_dl_start(const char *url, const char *path, const LO_http_dl_opt_t *opt,
+		LO_http_dl_done_t done_cb, void *ctx) {
+	LO_http_dl_job_t *job, **pp;
+	int ret = 0;
+
+	if ((url == NULL) || (path == NULL) || (strlen(url) >= sizeof(job->url))
+			|| (strlen(path) >= sizeof(job->path)))
+		return -1;
+	if ((opt) && (opt->digest != LO_RSC_DIGEST_NONE)
+			&& ((opt->digest_hex == NULL) || (strlen(opt->digest_hex) >= sizeof(job->digest_hex))))
+		return -1;
+
+	job = (LO_http_dl_job_t *) calloc(1, sizeof(LO_http_dl_job_t));
+	if (job == NULL)
+		return -1;
+	strcpy(job->url, url);
+	strcpy(job->path, path);
+	if (opt) {
+		job->opt = *opt;
+		if (opt->digest != LO_RSC_DIGEST_NONE) {
+			strcpy(job->digest_hex, opt->digest_hex);
+			job->opt.digest_hex = job->digest_hex;
+		}
+	}
+	job->done_cb = done_cb;
+	job->ctx = ctx;
+
+	pthread_mutex_lock(&_http_dl_jobs_mutex);
+	for (pp = &_http_dl_jobs; *pp; pp = &(*pp)->next) {
+		if (!strcmp((*pp)->path, path)) {
+			LOTRACE_ERR("LO_http_dl_start: %s is already being downloaded", path);
+			ret = -1;
+			break;
+		}
+	}
+	if (ret == 0) {
+		*pp = job;
+		if (_http_dl_workers < LOC_HTTP_DL_ACTIVE_MAX) {
+			pthread_attr_t attr;
+			pthread_t thread;
+			pthread_attr_init(&attr);
+			pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+			job->running = 1;
+			if (pthread_create(&thread, &attr, _LO_http_dl_worker, job) == 0) {
+				_http_dl_workers++;
+			} else if (_http_dl_workers) {
+				job->running = 0;   /* run by a current worker*/
+			} else {
+				*pp = NULL;
+				ret = -1;
+			}
+			pthread_attr_destroy(&attr);
+		}
+	}
+	pthread_mutex_unlock(&_http_dl_jobs_mutex);
+
+	if (ret)
+		free(job);
+	else
+		LOTRACE_INF("LO_http_dl_start: %s -> %s", url, path);
+	return ret;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_http_dl_wait(void) {
+	pthread_mutex_lock(&_http_dl_jobs_mutex);
+	while (_http_dl_jobs)
+		pthread_cond_wait(&_http_dl_jobs_cond, &_http_dl_jobs_mutex);
+	pthread_mutex_unlock(&_http_dl_jobs_mutex);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_http_dl_disconnect(void) {
+	int i;
+	pthread_mutex_lock(&_http_dl_mutex);
+	for (i = 0; i < LOC_HTTP_DL_CONN_MAX; i++) {
+		if (_http_dl_idle[i]) {
+			_LO_http_dl_free(_http_dl_idle[i]);
+			_http_dl_idle[i] = NULL;
+		}
+	}
+	pthread_mutex_unlock(&_http_dl_mutex);
+}
@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_json_tpl.c
+ * @brief Precompiled JSON templates for a set of LiveObjects data.
+ */
+
+#include "liveobjects-sys/loc_json_tpl.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "liveobjects-sys/loc_numfmt.h"
+#include "liveobjects-sys/loc_trace.h"
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+/* Size of a numeric value, 0 for a string, -1 if the type is not supported.*/
+static int _LO_json_tpl_rawSize(const LiveObjectsD_Data_t *data_ptr) {
+	switch (data_ptr->data_type) {
+	case LOD_TYPE_INT32:
+	case LOD_TYPE_UINT32:
+	case LOD_TYPE_FLOAT:
+		return 4;
+	case LOD_TYPE_INT16:
+	case LOD_TYPE_UINT16:
+		return 2;
+	case LOD_TYPE_INT8:
+	case LOD_TYPE_UINT8:
+	case LOD_TYPE_BOOL:
+		return 1;
+	case LOD_TYPE_DOUBLE:
+		return 8;
+	case LOD_TYPE_STRING_C:
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Append a JSON string (with quotes). Return the new end, or NULL if too small.*/
+static char * _LO_json_tpl_putStr(char *pc, const char *end, const char *str) {
+	if (pc >= end)
+		return NULL;
+	*pc++ = '"';
+	while (*str) {
+		unsigned char cc = (unsigned char) *str++;
+		if ((cc == '"') || (cc == '\\')) {
+			if (pc + 2 > end)
+				return NULL;
+			*pc++ = '\\';
+			*pc++ = cc;
+		} else if (cc < 0x20) {
+			if (pc + 6 > end)
+				return NULL;
+			pc += sprintf(pc, "\\u%04x", cc);
+		} else {
+			if (pc >= end)
+				return NULL;
+			*pc++ = cc;
+		}
+	}
+	if (pc >= end)
+		return NULL;
+	*pc++ = '"';
+	return pc;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Format the numeric value of a slot (from its raw copy).*/
+static void _LO_json_tpl_fmtValue(LO_json_tpl_slot_t *slot) {
+	const void *raw = slot->raw;
+	int len;
+
+	switch (slot->data_ptr->data_type) {
+	case LOD_TYPE_INT32:
+		len = LO_numfmt_i64(slot->val, *(const int32_t *) raw);
+		break;
+	case LOD_TYPE_INT16:
+		len = LO_numfmt_i64(slot->val, *(const int16_t *) raw);
+		break;
+	case LOD_TYPE_INT8:
+		len = LO_numfmt_i64(slot->val, *(const int8_t *) raw);
+		break;
+	case LOD_TYPE_UINT32:
+		len = LO_numfmt_u64(slot->val, *(const uint32_t *) raw);
+		break;
+	case LOD_TYPE_UINT16:
+		len = LO_numfmt_u64(slot->val, *(const uint16_t *) raw);
+		break;
+	case LOD_TYPE_UINT8:
+		len = LO_numfmt_u64(slot->val, *(const uint8_t *) raw);
+		break;
+	case LOD_TYPE_BOOL:
+		len = (*(const uint8_t *) raw) ? 4 : 5;
+		memcpy(slot->val, (*(const uint8_t *) raw) ? "true" : "false", len + 1);
+		break;
+	case LOD_TYPE_FLOAT:
+		len = LO_numfmt_float(slot->val, *(const float *) raw);
+		break;
+	case LOD_TYPE_DOUBLE:
+		len = LO_numfmt_double(slot->val, *(const double *) raw);
+		break;
+	default:
+		len = 0;
+		break;
+	}
+	/* Not a number (or not finite)*/
+	if (len == 0) {
+		memcpy(slot->val, "null", 5);
+		len = 4;
+	}
+	slot->val_len = (uint8_t) len;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Numeric value of a raw copy (deadband).*/
+static double _LO_json_tpl_toDouble(const LO_json_tpl_slot_t *slot, const void *raw) {
+	switch (slot->data_ptr->data_type) {
+	case LOD_TYPE_INT32:
+		return *(const int32_t *) raw;
+	case LOD_TYPE_INT16:
+		return *(const int16_t *) raw;
+	case LOD_TYPE_INT8:
+		return *(const int8_t *) raw;
+	case LOD_TYPE_UINT32:
+		return *(const uint32_t *) raw;
+	case LOD_TYPE_UINT16:
+		return *(const uint16_t *) raw;
+	case LOD_TYPE_UINT8:
+	case LOD_TYPE_BOOL:
+		return *(const uint8_t *) raw;
+	case LOD_TYPE_FLOAT:
+		return *(const float *) raw;
+	case LOD_TYPE_DOUBLE:
+		return *(const double *) raw;
+	default:
+		return 0;
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* FNV-1a hash of a string value.*/
+static uint32_t _LO_json_tpl_hash(const char *str) {
+	uint32_t hash = 2166136261U;
+	while (*str)
+		hash = (hash ^ (unsigned char) *str++) * 16777619U;
+	return hash;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Diff mode : check if the value of a slot has changed since it was sent.*/
+static uint8_t _LO_json_tpl_changed(LO_json_tpl_slot_t *slot) {
+	const void *value = slot->data_ptr->data_value;
+	double delta;
+
+	if (slot->raw_sz == 0) {
+		slot->hash = _LO_json_tpl_hash((const char *) value);
+		return (!slot->sent_valid) || (slot->hash != slot->sent_hash);
+	}
+	if (!slot->sent_valid)
+		return 1;
+	if (memcmp(slot->sent, value, slot->raw_sz) == 0)
+		return 0;
+	if (slot->deadband <= 0)
+		return 1;
+	/* Also changed if one of the values is not a number*/
+	delta = _LO_json_tpl_toDouble(slot, value) - _LO_json_tpl_toDouble(slot, slot->sent);
+	return !(fabs(delta) < slot->deadband);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static uint64_t _LO_json_tpl_monoMs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Append the value of a slot. Return the new end, or NULL if too small.*/
+static char * _LO_json_tpl_putValue(LO_json_tpl_slot_t *slot, char *pc, const char *end) {
+	if (slot->raw_sz == 0)
+		return _LO_json_tpl_putStr(pc, end, (const char *) slot->data_ptr->data_value);
+
+	/* Format the value only if it has changed*/
+	if ((!slot->raw_valid)
+			|| memcmp(slot->raw, slot->data_ptr->data_value, slot->raw_sz)) {
+		memcpy(slot->raw, slot->data_ptr->data_value, slot->raw_sz);
+		_LO_json_tpl_fmtValue(slot);
+		slot->raw_valid = 1;
+	}
+	if (pc + slot->val_len > end)
+		return NULL;
+	memcpy(pc, slot->val, slot->val_len);
+	return pc + slot->val_len;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Diff mode : the encoded values become the last sent ones.*/
+static void _LO_json_tpl_setSent(LO_json_tpl_t *tpl, uint8_t full) {
+	uint16_t i;
+	for (i = 0; i < tpl->slot_nb; i++) {
+		LO_json_tpl_slot_t *slot = &tpl->slots[i];
+		if ((!full) && (!slot->changed))
+			continue;
+		if (slot->raw_sz)
+			memcpy(slot->sent, slot->raw, slot->raw_sz);
+		else
+			slot->sent_hash = (full) ? _LO_json_tpl_hash((const char *) slot->data_ptr->data_value)
+					: slot->hash;
+		slot->sent_valid = 1;
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Diff mode : encode the changed fields only.*/
+static int _LO_json_tpl_encodeDiff(LO_json_tpl_t *tpl, char *buf, char *end) {
+	char *pc = buf;
+	uint16_t i, nb = 0;
+
+	for (i = 0; i < tpl->slot_nb; i++) {
+		LO_json_tpl_slot_t *slot = &tpl->slots[i];
+		slot->changed = _LO_json_tpl_changed(slot);
+		nb += slot->changed;
+	}
+	if (nb == 0) {
+		*buf = 0;
+		return 0;
+	}
+
+	if (pc + tpl->head_len > end)
+		return -1;
+	memcpy(pc, tpl->frags, tpl->head_len);
+	pc += tpl->head_len;
+	nb = 0;
+	for (i = 0; i < tpl->slot_nb; i++) {
+		LO_json_tpl_slot_t *slot = &tpl->slots[i];
+		/* Fragment without its "prefix{" or ","*/
+		uint16_t skip = (i == 0) ? tpl->head_len : 1;
+
+		if (!slot->changed)
+			continue;
+		if (pc + (nb != 0) + slot->frag_len - skip > end)
+			return -1;
+		if (nb++)
+			*pc++ = ',';
+		memcpy(pc, tpl->frags + slot->frag_off + skip, slot->frag_len - skip);
+		pc += slot->frag_len - skip;
+		pc = _LO_json_tpl_putValue(slot, pc, end);
+		if (pc == NULL)
+			return -1;
+	}
+
+	if (pc + tpl->tail_len > end)
+		return -1;
+	memcpy(pc, tpl->frags + tpl->tail_off, tpl->tail_len);
+	pc += tpl->tail_len;
+	*pc = 0;
+	_LO_json_tpl_setSent(tpl, 0);
+	return pc - buf;
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+LO_json_tpl_t *LO_json_tpl_create(const char *prefix,
+		const LiveObjectsD_Data_t *data_set, int32_t data_nb, const char *suffix) {
+	LO_json_tpl_t *tpl;
+	size_t frags_sz;
+	char *pc, *end;
+	int32_t i;
+
+	if ((data_set == NULL) && (data_nb > 0))
+		return NULL;
+	if (prefix == NULL)
+		prefix = "";
+	if (suffix == NULL)
+		suffix = "";
+
+	/* Size of all fragments : worst case for the escaped names*/
+	frags_sz = strlen(prefix) + strlen(suffix) + 3;
+	for (i = 0; i < data_nb; i++) {
+		if ((data_set[i].data_name == NULL) || (_LO_json_tpl_rawSize(&data_set[i]) < 0)) {
+			LOTRACE_ERR("LO_json_tpl_create: data[%" PRIi32 "] - unsupported type %d",
+					i, data_set[i].data_type);
+			return NULL;
+		}
+		frags_sz += 6 * strlen(data_set[i].data_name) + 4;
+	}
+	if (frags_sz > UINT16_MAX)
+		return NULL;
+
+	tpl = (LO_json_tpl_t *) calloc(1, sizeof(LO_json_tpl_t) + data_nb * sizeof(LO_json_tpl_slot_t));
+	if (tpl == NULL)
+		return NULL;
+	tpl->frags = (char *) malloc(frags_sz);
+	if (tpl->frags == NULL) {
+		free(tpl);
+		return NULL;
+	}
+
+	pc = tpl->frags;
+	end = tpl->frags + frags_sz;
+	pc += sprintf(pc, "%s{", prefix);
+	tpl->head_len = pc - tpl->frags;
+	for (i = 0; i < data_nb; i++) {
+		LO_json_tpl_slot_t *slot = &tpl->slots[i];
+		char *frag = (i == 0) ? tpl->frags : pc;
+		if (i)
+			*pc++ = ',';
+		pc = _LO_json_tpl_putStr(pc, end, data_set[i].data_name);
+		*pc++ = ':';
+		slot->data_ptr = &data_set[i];
+		slot->frag_off = frag - tpl->frags;
+		slot->frag_len = pc - frag;
+		slot->raw_sz = (uint8_t) _LO_json_tpl_rawSize(&data_set[i]);
+	}
+	tpl->tail_off = (data_nb) ? pc - tpl->frags : 0;
+	pc += sprintf(pc, "}%s", suffix);
+	tpl->tail_len = pc - tpl->frags - tpl->tail_off;
+	tpl->slot_nb = (uint16_t) data_nb;
+	return tpl;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_json_tpl_destroy(LO_json_tpl_t *tpl) {
+	if (tpl) {
+		free(tpl->frags);
+		free(tpl);
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_json_tpl_invalidate(LO_json_tpl_t *tpl) {
+	uint16_t i;
+	for (i = 0; i < tpl->slot_nb; i++) {
+		tpl->slots[i].raw_valid = 0;
+		tpl->slots[i].sent_valid = 0;
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_json_tpl_setDiff(LO_json_tpl_t *tpl, uint8_t enable, uint32_t refresh_ms) {
+	uint16_t i;
+	tpl->diff = enable;
+	tpl->refresh_ms = refresh_ms;
+	for (i = 0; i < tpl->slot_nb; i++)
+		tpl->slots[i].sent_valid = 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_json_tpl_setDeadband(LO_json_tpl_t *tpl, const LiveObjectsD_Data_t *data_ptr, double deadband) {
+	uint16_t i;
+	for (i = 0; i < tpl->slot_nb; i++) {
+		LO_json_tpl_slot_t *slot = &tpl->slots[i];
+		if (slot->data_ptr == data_ptr) {
+			if ((slot->raw_sz == 0) || (deadband < 0))
+				return -1;
+			slot->deadband = deadband;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_json_tpl_encode(LO_json_tpl_t *tpl, char *buf, int buf_sz) {
+	char *pc = buf;
+	char *end = buf + buf_sz - 1;  /* keep room for the final '\0'*/
+	uint16_t i;
+
+	uint64_t now_ms = 0;
+
+	if ((tpl == NULL) || (buf == NULL) || (buf_sz <= 0))
+		return -1;
+
+	if (tpl->diff) {
+		now_ms = _LO_json_tpl_monoMs();
+		if ((tpl->refresh_ms == 0) || (now_ms - tpl->refresh_last_ms < tpl->refresh_ms))
+			return _LO_json_tpl_encodeDiff(tpl, buf, end);
+	}
+
+	for (i = 0; i < tpl->slot_nb; i++) {
+		LO_json_tpl_slot_t *slot = &tpl->slots[i];
+
+		slot->changed = 1;
+		if (pc + slot->frag_len > end)
+			return -1;
+		memcpy(pc, tpl->frags + slot->frag_off, slot->frag_len);
+		pc += slot->frag_len;
+		pc = _LO_json_tpl_putValue(slot, pc, end);
+		if (pc == NULL)
+			return -1;
+	}
+
+	if (pc + tpl->tail_len > end)
+		return -1;
+	memcpy(pc, tpl->frags + tpl->tail_off, tpl->tail_len);
+	pc += tpl->tail_len;
+	*pc = 0;
+	if (tpl->diff) {
+		_LO_json_tpl_setSent(tpl, 1);
+		tpl->refresh_last_ms = now_ms;
+	}
+	return pc - buf;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int32_t LO_json_tpl_getChanged(const LO_json_tpl_t *tpl, LiveObjectsD_Data_t *data_set, int32_t data_max) {
+	int32_t nb = 0;
+	uint16_t i;
+
+	for (i = 0; i < tpl->slot_nb; i++) {
+		if (!tpl->slots[i].changed)
+			continue;
+		if (nb >= data_max)
+			return -1;
+		data_set[nb++] = *tpl->slots[i].data_ptr;
+	}
+	return nb;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_nameidx.c
+ * @brief Hashed index by name of an attached table.
+ */
+
+#include "liveobjects-sys/loc_nameidx.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "liveobjects-sys/loc_trace.h"
+
+typedef struct {
+	uint32_t hash;
+	uint32_t pos;                   /* Position in the table + 1 (0 : free slot)*/
+} LO_nameidx_slot_t;
+
+struct LO_nameidx_s {
+	const uint8_t *table;
+	uint32_t stride;
+	size_t name_off;
+	uint32_t mask;                  /* Number of slots - 1*/
+	LO_nameidx_slot_t slots[];
+};
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+/* FNV-1a*/
+static inline uint32_t _LO_nameidx_hash(const char *name, uint32_t len) {
+	uint32_t hash = 2166136261UL;
+	while (len--) {
+		hash ^= (uint8_t) *name++;
+		hash *= 16777619UL;
+	}
+	return hash;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static inline const char * _LO_nameidx_name(const LO_nameidx_t *idx, uint32_t pos) {
+	return *(const char * const *) (idx->table + (size_t) pos * idx->stride + idx->name_off);
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+LO_nameidx_t *LO_nameidx_create(const void *table, uint32_t nb, uint32_t stride, size_t name_off) {
+	LO_nameidx_t *idx;
+	uint32_t slot_nb = 2;
+	uint32_t i;
+
+	if ((table == NULL) && (nb))
+		return NULL;
+	while (slot_nb < 2 * nb)
+		slot_nb <<= 1;
+
+	idx = (LO_nameidx_t *) calloc(1, sizeof(LO_nameidx_t) + slot_nb * sizeof(LO_nameidx_slot_t));
+	if (idx == NULL)
+		return NULL;
+	idx->table = (const uint8_t *) table;
+	idx->stride = stride;
+	idx->name_off = name_off;
+	idx->mask = slot_nb - 1;
+
+	for (i = 0; i < nb; i++) {
+		const char *name = _LO_nameidx_name(idx, i);
+		uint32_t len, hash, n;
+
+		if (name == NULL)
+			continue;
+		len = strlen(name);
+		hash = _LO_nameidx_hash(name, len);
+		if (LO_nameidx_find(idx, name, len) >= 0) {
+			LOTRACE_WARN("LO_nameidx_create: entry %u - name '%s' already used", i, name);
+			continue;
+		}
+		for (n = hash & idx->mask; idx->slots[n].pos; n = (n + 1) & idx->mask)
+			;
+		idx->slots[n].hash = hash;
+		idx->slots[n].pos = i + 1;
+	}
+	return idx;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_nameidx_destroy(LO_nameidx_t *idx) {
+	free(idx);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int32_t LO_nameidx_find(const LO_nameidx_t *idx, const char *name, uint32_t len) {
+	uint32_t hash, n;
+
+	if ((idx == NULL) || (name == NULL))
+		return -1;
+	hash = _LO_nameidx_hash(name, len);
+	for (n = hash & idx->mask; idx->slots[n].pos; n = (n + 1) & idx->mask) {
+		if (idx->slots[n].hash == hash) {
+			uint32_t pos = idx->slots[n].pos - 1;
+			const char *entry = _LO_nameidx_name(idx, pos);
+			if ((strncmp(entry, name, len) == 0) && (entry[len] == 0))
+				return (int32_t) pos;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_numfmt.c
+ * @brief Number formatting for JSON payloads.
+ *
+ * The float formatting is the Grisu2 algorithm of Florian Loitsch
+ * ("Printing Floating-Point Numbers Quickly and Accurately with Integers",
+ * PLDI 2010): it always produces a round-trip string, and the shortest one
+ * in the vast majority of cases.
+ */
+
+#include "liveobjects-sys/loc_numfmt.h"
+
+#include <string.h>
+
+/* Significand and binary exponent of a floating point value : f * 2^e*/
+typedef struct {
+	uint64_t f;
+	int e;
+} LO_diyfp_t;
+
+static const char _numfmt_digits2[200] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const uint64_t _numfmt_pow10[20] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+	100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+	10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/* Normalized 10^k for k = -348, -340, ..., 340*/
+static const uint64_t _numfmt_cached_f[87] = {
+	0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76,
+	0xcf42894a5dce35ea, 0x9a6bb0aa55653b2d, 0xe61acf033d1a45df,
+	0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f, 0xbe5691ef416bd60c,
+	0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+	0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57,
+	0xc21094364dfb5637, 0x9096ea6f3848984f, 0xd77485cb25823ac7,
+	0xa086cfcd97bf97f4, 0xef340a98172aace5, 0xb23867fb2a35b28e,
+	0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+	0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126,
+	0xb5b5ada8aaff80b8, 0x87625f056c7c4a8b, 0xc9bcff6034c13053,
+	0x964e858c91ba2655, 0xdff9772470297ebd, 0xa6dfbd9fb8e5b88f,
+	0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+	0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06,
+	0xaa242499697392d3, 0xfd87b5f28300ca0e, 0xbce5086492111aeb,
+	0x8cbccc096f5088cc, 0xd1b71758e219652c, 0x9c40000000000000,
+	0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+	0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068,
+	0x9f4f2726179a2245, 0xed63a231d4c4fb27, 0xb0de65388cc8ada8,
+	0x83c7088e1aab65db, 0xc45d1df942711d9a, 0x924d692ca61be758,
+	0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+	0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d,
+	0x952ab45cfa97a0b3, 0xde469fbd99a05fe3, 0xa59bc234db398c25,
+	0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece, 0x88fcf317f22241e2,
+	0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+	0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410,
+	0x8bab8eefb6409c1a, 0xd01fef10a657842c, 0x9b10a4e5e9913129,
+	0xe7109bfba19c0c9d, 0xac2820d9623bf429, 0x80444b5e7aa7cf85,
+	0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+	0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b,
+};
+
+static const int16_t _numfmt_cached_e[87] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+	-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+	-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+	1013, 1039, 1066,
+};
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+/* Number of decimal digits of val (1 for 0).*/
+static inline int _LO_numfmt_digitNb(uint64_t val) {
+	int t = ((64 - __builtin_clzll(val | 1)) * 1233) >> 12;
+	return t - ((val | 1) < _numfmt_pow10[t]) + 1;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Write the len digits of val (len given by _LO_numfmt_digitNb).*/
+static void _LO_numfmt_putDigits(char *buf, uint64_t val, int len) {
+	char *pc = buf + len;
+	while (val >= 100) {
+		unsigned idx = (unsigned) (val % 100) * 2;
+		val /= 100;
+		*--pc = _numfmt_digits2[idx + 1];
+		*--pc = _numfmt_digits2[idx];
+	}
+	if (val >= 10) {
+		*--pc = _numfmt_digits2[val * 2 + 1];
+		*--pc = _numfmt_digits2[val * 2];
+	} else {
+		*--pc = (char) ('0' + val);
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static inline LO_diyfp_t _LO_diyfp_normalize(LO_diyfp_t v) {
+	int shift = __builtin_clzll(v.f);
+	v.f <<= shift;
+	v.e -= shift;
+	return v;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Product of two normalized values, rounded to 64 bits : high 64 bits of the*/
+/* four 32x32 partial products (no 128-bit type on 32-bit targets).*/
+static inline LO_diyfp_t _LO_diyfp_mul(LO_diyfp_t a, LO_diyfp_t b) {
+	const uint64_t M32 = 0xFFFFFFFFULL;
+	uint64_t ah = a.f >> 32, al = a.f & M32;
+	uint64_t bh = b.f >> 32, bl = b.f & M32;
+	uint64_t hh = ah * bh, hl = ah * bl, lh = al * bh, ll = al * bl;
+	uint64_t mid = (ll >> 32) + (hl & M32) + (lh & M32);
+	LO_diyfp_t r;
+
+	mid += 1ULL << 31; /* rounding*/
+	r.f = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+	r.e = a.e + b.e + 64;
+	return r;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Cached power c = 10^-K such that the product with a value of binary*/
+/* exponent e has its exponent in [-60, -32].*/
+static LO_diyfp_t _LO_diyfp_cachedPower(int e, int *K) {
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int) dk;
+	unsigned idx;
+	LO_diyfp_t c;
+
+	if (dk - k > 0.0)
+		k++;
+	idx = (unsigned) ((k >> 3) + 1);
+	*K = -(-348 + (int) (idx << 3));
+	c.f = _numfmt_cached_f[idx];
+	c.e = _numfmt_cached_e[idx];
+	return c;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_numfmt_grisuRound(char *buf, int len, uint64_t delta, uint64_t rest,
+		uint64_t ten_kappa, uint64_t wp_w) {
+	while ((rest < wp_w) && (delta - rest >= ten_kappa)
+			&& ((rest + ten_kappa < wp_w) || (wp_w - rest > rest + ten_kappa - wp_w))) {
+		buf[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Generate the shortest digits of W in the interval [Mp - delta, Mp].*/
+static int _LO_numfmt_digitGen(LO_diyfp_t W, LO_diyfp_t Mp, uint64_t delta, char *buf, int *K) {
+	const int shift = -Mp.e;
+	const uint64_t one = 1ULL << shift;
+	const uint64_t wp_w = Mp.f - W.f;
+	uint32_t p1 = (uint32_t) (Mp.f >> shift);
+	uint64_t p2 = Mp.f & (one - 1);
+	int kappa = _LO_numfmt_digitNb(p1);
+	int len = 0;
+
+	while (kappa > 0) {
+		uint32_t d = p1 / (uint32_t) _numfmt_pow10[kappa - 1];
+		p1 %= (uint32_t) _numfmt_pow10[kappa - 1];
+		if (d || len)
+			buf[len++] = (char) ('0' + d);
+		kappa--;
+		if ((((uint64_t) p1 << shift) + p2) <= delta) {
+			*K += kappa;
+			_LO_numfmt_grisuRound(buf, len, delta, ((uint64_t) p1 << shift) + p2,
+					_numfmt_pow10[kappa] << shift, wp_w);
+			return len;
+		}
+	}
+
+	for (;;) {
+		uint32_t d;
+		p2 *= 10;
+		delta *= 10;
+		d = (uint32_t) (p2 >> shift);
+		if (d || len)
+			buf[len++] = (char) ('0' + d);
+		p2 &= one - 1;
+		kappa--;
+		if (p2 < delta) {
+			*K += kappa;
+			_LO_numfmt_grisuRound(buf, len, delta, p2, one,
+					(-kappa < 20) ? wp_w * _numfmt_pow10[-kappa] : 0);
+			return len;
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Shortest digits of v = f * 2^e (lower_closer : v is a power of two whose*/
+/* lower neighbour is closer). Return the number of digits, v = digits * 10^K.*/
+static int _LO_numfmt_grisu2(uint64_t f, int e, int lower_closer, char *buf, int *K) {
+	LO_diyfp_t v = { f, e };
+	LO_diyfp_t w_p = { (f << 1) + 1, e - 1 };
+	LO_diyfp_t w_m, c_mk, W, Wp, Wm;
+
+	/* Boundaries of the interval rounding to v*/
+	w_p = _LO_diyfp_normalize(w_p);
+	if (lower_closer) {
+		w_m.f = (f << 2) - 1;
+		w_m.e = e - 2;
+	} else {
+		w_m.f = (f << 1) - 1;
+		w_m.e = e - 1;
+	}
+	w_m.f <<= w_m.e - w_p.e;
+	w_m.e = w_p.e;
+
+	c_mk = _LO_diyfp_cachedPower(w_p.e, K);
+	W = _LO_diyfp_mul(_LO_diyfp_normalize(v), c_mk);
+	Wp = _LO_diyfp_mul(w_p, c_mk);
+	Wm = _LO_diyfp_mul(w_m, c_mk);
+	Wm.f++;
+	Wp.f--;
+	return _LO_numfmt_digitGen(W, Wp, Wp.f - Wm.f, buf, K);
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Write the digits (value = digits * 10^K) in fixed or exponent notation.*/
+static int _LO_numfmt_prettify(char *buf, const char *digits, int len, int K) {
+	const int kk = len + K;       /* position of the decimal point*/
+	const int exp10 = kk - 1;
+	int fixed_len, exp_len;
+	char *pc = buf;
+
+	if (kk >= len)
+		fixed_len = kk;
+	else if (kk > 0)
+		fixed_len = len + 1;
+	else
+		fixed_len = len + 2 - kk;
+	exp_len = len + (len > 1) + 1 + (exp10 < 0)
+			+ _LO_numfmt_digitNb((uint64_t) ((exp10 < 0) ? -exp10 : exp10));
+
+	if (fixed_len <= exp_len) {
+		if (kk >= len) {
+			memcpy(pc, digits, len);
+			memset(pc + len, '0', kk - len);
+		} else if (kk > 0) {
+			memcpy(pc, digits, kk);
+			pc[kk] = '.';
+			memcpy(pc + kk + 1, digits + kk, len - kk);
+		} else {
+			pc[0] = '0';
+			pc[1] = '.';
+			memset(pc + 2, '0', -kk);
+			memcpy(pc + 2 - kk, digits, len);
+		}
+		pc += fixed_len;
+	} else {
+		*pc++ = digits[0];
+		if (len > 1) {
+			*pc++ = '.';
+			memcpy(pc, digits + 1, len - 1);
+			pc += len - 1;
+		}
+		*pc++ = 'e';
+		pc += LO_numfmt_i64(pc, exp10);
+	}
+	*pc = 0;
+	return pc - buf;
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+int LO_numfmt_u64(char *buf, uint64_t val) {
+	int len = _LO_numfmt_digitNb(val);
+	_LO_numfmt_putDigits(buf, val, len);
+	buf[len] = 0;
+	return len;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_numfmt_i64(char *buf, int64_t val) {
+	if (val < 0) {
+		*buf = '-';
+		return 1 + LO_numfmt_u64(buf + 1, 0 - (uint64_t) val);
+	}
+	return LO_numfmt_u64(buf, (uint64_t) val);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_numfmt_float(char *buf, float val) {
+	uint32_t bits;
+	uint32_t biased_e, f;
+	char digits[20];
+	int K, len, neg;
+
+	memcpy(&bits, &val, sizeof(bits));
+	biased_e = (bits >> 23) & 0xFF;
+	f = bits & 0x7FFFFF;
+	neg = bits >> 31;
+	if (biased_e == 0xFF)
+		return 0;
+	if (neg)
+		*buf++ = '-';
+	if ((biased_e == 0) && (f == 0)) {
+		buf[0] = '0';
+		buf[1] = 0;
+		return neg + 1;
+	}
+	if (biased_e)
+		len = _LO_numfmt_grisu2(f | 0x800000, (int) biased_e - 150,
+				(f == 0) && (biased_e > 1), digits, &K);
+	else
+		len = _LO_numfmt_grisu2(f, -149, 0, digits, &K);
+	return neg + _LO_numfmt_prettify(buf, digits, len, K);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_numfmt_double(char *buf, double val) {
+	uint64_t bits, f;
+	uint32_t biased_e;
+	char digits[20];
+	int K, len, neg;
+
+	memcpy(&bits, &val, sizeof(bits));
+	biased_e = (uint32_t) (bits >> 52) & 0x7FF;
+	f = bits & 0xFFFFFFFFFFFFFULL;
+	neg = (int) (bits >> 63);
+	if (biased_e == 0x7FF)
+		return 0;
+	if (neg)
+		*buf++ = '-';
+	if ((biased_e == 0) && (f == 0)) {
+		buf[0] = '0';
+		buf[1] = 0;
+		return neg + 1;
+	}
+	if (biased_e)
+		len = _LO_numfmt_grisu2(f | 0x10000000000000ULL, (int) biased_e - 1075,
+				(f == 0) && (biased_e > 1), digits, &K);
+	else
+		len = _LO_numfmt_grisu2(f, -1074, 0, digits, &K);
+	return neg + _LO_numfmt_prettify(buf, digits, len, K);
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_pubq.c
+ * @brief Lock-free MPSC publish queue.
+ *
+ * Bounded array of slots, each slot carrying a sequence number
+ * (D. Vyukov's bounded queue). Producers reserve a slot with a CAS on the
+ * enqueue position, the single consumer owns the dequeue position.
+ */
+
+#include "liveobjects-sys/loc_pubq.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+#include "liveobjects-client/LiveObjectsClient_Core.h"
+#include "liveobjects-sys/loc_aggr.h"
+#include "liveobjects-sys/loc_batch.h"
+#include "liveobjects-sys/loc_trace.h"
+#include "liveobjects-sys/loc_wakeup.h"
+#include "liveobjects-sys/loc_workers.h"
+
+#define LO_PUBQ_MASK        (LOC_PUBQ_SIZE - 1)
+#define LO_PUBQ_CACHE_LINE  64
+
+/* LOC_PUBQ_SIZE must be a power of 2*/
+typedef char _lo_pubq_size_check[((LOC_PUBQ_SIZE & LO_PUBQ_MASK) == 0) ? 1 : -1];
+
+typedef struct {
+	uint32_t seq;
+	LO_pubq_req_t req;
+} LO_pubq_slot_t;
+
+static struct {
+	uint32_t enq_pos __attribute__((aligned(LO_PUBQ_CACHE_LINE)));
+	uint32_t deq_pos __attribute__((aligned(LO_PUBQ_CACHE_LINE)));
+	uint8_t backpressure;
+	LO_pubq_drainNtfy_t ntfy;
+	void *ntfy_ctx;
+	LO_pubq_stats_t stats __attribute__((aligned(LO_PUBQ_CACHE_LINE)));
+	LO_pubq_slot_t slots[LOC_PUBQ_SIZE] __attribute__((aligned(LO_PUBQ_CACHE_LINE)));
+} _lo_pubq;
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_pubq_dispatch(const LO_pubq_req_t *req_ptr) {
+	switch (req_ptr->req_type) {
+	case LO_PUBQ_REQ_DATA:
+		LiveObjectsClient_PushData(req_ptr->req_hdl);
+		break;
+	case LO_PUBQ_REQ_STATUS:
+		LiveObjectsClient_PushStatus(req_ptr->req_hdl);
+		break;
+	default:
+		LOTRACE_WARN("LO_pubq: request type %u without handler", req_ptr->req_type);
+		break;
+	}
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+void LO_pubq_init(void) {
+	uint32_t i;
+	memset(&_lo_pubq, 0, sizeof(_lo_pubq));
+	for (i = 0; i < LOC_PUBQ_SIZE; i++)
+		_lo_pubq.slots[i].seq = i;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_pubq_setDrainNtfy(LO_pubq_drainNtfy_t ntfy, void *ctx) {
+	_lo_pubq.ntfy_ctx = ctx;
+	_lo_pubq.ntfy = ntfy;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+LO_pubq_ret_t LO_pubq_push(const LO_pubq_req_t *req_ptr) {
+	LO_pubq_slot_t *slot;
+	uint32_t pos, pending, max;
+
+	if (req_ptr == NULL)
+		return LO_PUBQ_ERR_PARAM;
+
+	pos = __atomic_load_n(&_lo_pubq.enq_pos, __ATOMIC_RELAXED);
+	while (1) {
+		int32_t dif;
+		slot = &_lo_pubq.slots[pos & LO_PUBQ_MASK];
+		dif = (int32_t) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+		if (dif == 0) {
+			/* Free slot : try to reserve it*/
+			if (__atomic_compare_exchange_n(&_lo_pubq.enq_pos, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			/* Slot not yet released by the consumer : the queue is full*/
+			__atomic_fetch_add(&_lo_pubq.stats.would_block, 1, __ATOMIC_RELAXED);
+			return LO_PUBQ_WOULD_BLOCK;
+		} else {
+			/* Reserved by another producer*/
+			pos = __atomic_load_n(&_lo_pubq.enq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->req = *req_ptr;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&_lo_pubq.stats.pushed, 1, __ATOMIC_RELAXED);
+
+	pending = pos + 1 - __atomic_load_n(&_lo_pubq.deq_pos, __ATOMIC_ACQUIRE);
+	max = __atomic_load_n(&_lo_pubq.stats.max_pending, __ATOMIC_RELAXED);
+	while ((pending > max)
+			&& !__atomic_compare_exchange_n(&_lo_pubq.stats.max_pending, &max,
+					pending, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+
+	if (pending <= 1) {
+		/* The queue was empty : the consumer may be sleeping*/
+		LO_wakeup_signal();
+	}
+
+	if (pending >= LOC_PUBQ_HIGH_WATERMARK) {
+		__atomic_store_n(&_lo_pubq.backpressure, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&_lo_pubq.stats.backpressure, 1, __ATOMIC_RELAXED);
+		return LO_PUBQ_BACKPRESSURE;
+	}
+	return LO_PUBQ_OK;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_pubq_pop(LO_pubq_req_t *req_ptr) {
+	LO_pubq_slot_t *slot;
+	uint32_t pos = _lo_pubq.deq_pos;
+
+	slot = &_lo_pubq.slots[pos & LO_PUBQ_MASK];
+	if ((int32_t) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos + 1)) < 0)
+		return 0; /* Empty, or the producer has not finished to write the slot*/
+
+	*req_ptr = slot->req;
+	__atomic_store_n(&slot->seq, pos + LOC_PUBQ_SIZE, __ATOMIC_RELEASE);
+	__atomic_store_n(&_lo_pubq.deq_pos, pos + 1, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&_lo_pubq.stats.popped, 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+uint32_t LO_pubq_drain(LO_pubq_handler_t handler) {
+	LO_pubq_req_t req;
+	uint32_t nb = 0;
+
+	if (handler == NULL)
+		handler = _LO_pubq_dispatch;
+
+	while (LO_pubq_pop(&req)) {
+		if ((req.req_type == LO_PUBQ_REQ_CMD_RSP) || (req.req_type == LO_PUBQ_REQ_PARAM_RSP))
+			LO_workers_respond(&req);
+		else if (req.req_type == LO_PUBQ_REQ_AGGR)
+			LO_aggr_publishReq(&req);
+		else if (req.req_type == LO_PUBQ_REQ_BATCH)
+			LO_batch_publishReq(&req);
+		else
+			handler(&req);
+		nb++;
+	}
+
+	if (__atomic_load_n(&_lo_pubq.backpressure, __ATOMIC_RELAXED)
+			&& (LO_pubq_pending() <= LOC_PUBQ_LOW_WATERMARK)) {
+		__atomic_store_n(&_lo_pubq.backpressure, 0, __ATOMIC_RELAXED);
+		if (_lo_pubq.ntfy)
+			_lo_pubq.ntfy(_lo_pubq.ntfy_ctx);
+	}
+	return nb;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+uint32_t LO_pubq_pending(void) {
+	return __atomic_load_n(&_lo_pubq.enq_pos, __ATOMIC_ACQUIRE)
+			- __atomic_load_n(&_lo_pubq.deq_pos, __ATOMIC_ACQUIRE);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_pubq_getStats(LO_pubq_stats_t *stats_ptr) {
+	if (stats_ptr == NULL)
+		return;
+	stats_ptr->pushed = __atomic_load_n(&_lo_pubq.stats.pushed, __ATOMIC_RELAXED);
+	stats_ptr->popped = __atomic_load_n(&_lo_pubq.stats.popped, __ATOMIC_RELAXED);
+	stats_ptr->would_block = __atomic_load_n(&_lo_pubq.stats.would_block, __ATOMIC_RELAXED);
+	stats_ptr->backpressure = __atomic_load_n(&_lo_pubq.stats.backpressure, __ATOMIC_RELAXED);
+	stats_ptr->max_pending = __atomic_load_n(&_lo_pubq.stats.max_pending, __ATOMIC_RELAXED);
+}
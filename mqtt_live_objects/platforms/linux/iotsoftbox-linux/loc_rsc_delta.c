@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_rsc_delta.c
+ * @brief Streaming application of a binary delta resource.
+ */
+
+#include "liveobjects-sys/loc_rsc_delta.h"
+
+#if LOC_FEATURE_RSC_DELTA
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "liveobjects-client/LiveObjectsClient_Core.h"
+#include "liveobjects-sys/loc_trace.h"
+
+#define LO_RSC_DELTA_MAGIC         "ENDSLEY/BSDIFF43"
+
+enum {
+	LO_RSC_DELTA_HEADER = 0,
+	LO_RSC_DELTA_CTRL,
+	LO_RSC_DELTA_DIFF,
+	LO_RSC_DELTA_EXTRA,
+	LO_RSC_DELTA_END,
+	LO_RSC_DELTA_ERROR
+};
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+/* Signed 64 bits integer of bsdiff (little endian, sign and magnitude).*/
+static int64_t _LO_rsc_delta_offtin(const uint8_t *buf) {
+	int64_t y = buf[7] & 0x7F;
+	int i;
+	for (i = 6; i >= 0; i--)
+		y = y * 256 + buf[i];
+	return (buf[7] & 0x80) ? -y : y;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Decompress up to len bytes of the delta. Return the number of bytes (0 when*/
+/* more input is needed, or at the end of the stream), or -1 on error.*/
+static int _LO_rsc_delta_inflate(LO_rsc_delta_t *delta, char *buf, uint32_t len) {
+	int ret;
+
+	if (delta->bz_end)
+		return 0;
+	delta->bz.next_out = buf;
+	delta->bz.avail_out = len;
+	ret = BZ2_bzDecompress(&delta->bz);
+	if (ret == BZ_STREAM_END) {
+		delta->bz_end = 1;
+	} else if (ret != BZ_OK) {
+		LOTRACE_ERR("LO_rsc_delta: bzip2 error %d", ret);
+		return -1;
+	}
+	return len - delta->bz.avail_out;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Parse the header : open the new image.*/
+static int _LO_rsc_delta_header(LO_rsc_delta_t *delta) {
+	int64_t size;
+
+	if (memcmp(delta->ctrl, LO_RSC_DELTA_MAGIC, 16)) {
+		LOTRACE_ERR("LO_rsc_delta: not a bsdiff 4.3 delta");
+		return -1;
+	}
+	size = _LO_rsc_delta_offtin(delta->ctrl + 16);
+	if ((size < 0) || (size > UINT32_MAX)) {
+		LOTRACE_ERR("LO_rsc_delta: invalid size %lld", (long long) size);
+		return -1;
+	}
+	if (delta->digest == LO_RSC_DIGEST_NONE) {
+		LOTRACE_ERR("LO_rsc_delta: %s - no digest of the new image", delta->path);
+		return -1;
+	}
+	if (LO_rsc_sink_open(&delta->sink, delta->path, (uint32_t) size, (LO_rsc_sinkMode_t) delta->mode))
+		return -1;
+	if (LO_rsc_sink_setDigest(&delta->sink, (LO_rsc_digest_t) delta->digest, delta->digest_hex))
+		return -1;
+	if (BZ2_bzDecompressInit(&delta->bz, 0, 0) != BZ_OK)
+		return -1;
+	LOTRACE_INF("LO_rsc_delta: %s - %u bytes from %u bytes", delta->path, (uint32_t) size,
+			delta->old_size);
+	delta->ctrl_len = 0;
+	delta->step = LO_RSC_DELTA_CTRL;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Parse a control triple : diff length, extra length, move in the old image.*/
+static int _LO_rsc_delta_ctrl(LO_rsc_delta_t *delta) {
+	int64_t diff_len = _LO_rsc_delta_offtin(delta->ctrl);
+	int64_t extra_len = _LO_rsc_delta_offtin(delta->ctrl + 8);
+	uint32_t left = delta->sink.size - delta->sink.written;
+
+	if ((diff_len < 0) || (extra_len < 0) || (diff_len > left) || (extra_len > left - diff_len)) {
+		LOTRACE_ERR("LO_rsc_delta: corrupted delta at %u", delta->sink.written);
+		return -1;
+	}
+	delta->diff_left = (uint32_t) diff_len;
+	delta->extra_left = (uint32_t) extra_len;
+	delta->seek = _LO_rsc_delta_offtin(delta->ctrl + 16);
+	delta->ctrl_len = 0;
+	delta->step = LO_RSC_DELTA_DIFF;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Reader of the sink : produce the next bytes of the new image.*/
+static int _LO_rsc_delta_produce(void *ctx, char *buf, uint32_t len) {
+	LO_rsc_delta_t *delta = (LO_rsc_delta_t *) ctx;
+	int n, i;
+
+	for (;;) {
+		switch (delta->step) {
+		case LO_RSC_DELTA_CTRL:
+			n = _LO_rsc_delta_inflate(delta, (char *) delta->ctrl + delta->ctrl_len,
+					sizeof(delta->ctrl) - delta->ctrl_len);
+			if (n < 0)
+				goto error;
+			delta->ctrl_len += n;
+			if (delta->ctrl_len < sizeof(delta->ctrl)) {
+				/* The stream must end between two blocks*/
+				if (delta->bz_end)
+					delta->step = (delta->ctrl_len) ? LO_RSC_DELTA_ERROR : LO_RSC_DELTA_END;
+				return 0;
+			}
+			if (_LO_rsc_delta_ctrl(delta))
+				goto error;
+			break;
+
+		case LO_RSC_DELTA_DIFF:
+			if (delta->diff_left == 0) {
+				delta->step = LO_RSC_DELTA_EXTRA;
+				break;
+			}
+			if (len > delta->diff_left)
+				len = delta->diff_left;
+			n = _LO_rsc_delta_inflate(delta, buf, len);
+			if (n <= 0)
+				goto none;
+			/* Add the old bytes (the diff may go beyond the old image)*/
+			for (i = 0; i < n; i++) {
+				int64_t pos = delta->old_pos + i;
+				if ((pos >= 0) && (pos < delta->old_size))
+					buf[i] += delta->old[pos];
+			}
+			delta->old_pos += n;
+			delta->diff_left -= n;
+			return n;
+
+		case LO_RSC_DELTA_EXTRA:
+			if (delta->extra_left == 0) {
+				delta->old_pos += delta->seek;
+				delta->step = LO_RSC_DELTA_CTRL;
+				break;
+			}
+			if (len > delta->extra_left)
+				len = delta->extra_left;
+			n = _LO_rsc_delta_inflate(delta, buf, len);
+			if (n <= 0)
+				goto none;
+			delta->extra_left -= n;
+			return n;
+
+		default:
+			return 0;
+		}
+	}
+
+none:
+	if (n == 0)
+		return 0;
+error:
+	delta->step = LO_RSC_DELTA_ERROR;
+	return -1;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Reader of LO_rsc_delta_read.*/
+static int _LO_rsc_delta_getChunck(void *ctx, char *buf, uint32_t len) {
+	return LiveObjectsClient_RscGetChunck((const LiveObjectsD_Resource_t *) ctx, buf, len);
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_delta_open(LO_rsc_delta_t *delta, const char *old_path, const char *path,
+		LO_rsc_sinkMode_t mode) {
+	struct stat st;
+	int fd;
+
+	if ((delta == NULL) || (old_path == NULL) || (path == NULL)
+			|| (strlen(path) >= sizeof(delta->path)))
+		return -1;
+
+	/* Previous transfer not closed : release the old image, the stream and the sink*/
+	if (delta->opened) {
+		LOTRACE_WARN("LO_rsc_delta_open: %s was not closed", delta->path);
+		LO_rsc_delta_close(delta, 0);
+	}
+
+	memset(delta, 0, sizeof(LO_rsc_delta_t) - sizeof(delta->in));
+	delta->sink.fd = -1;
+	delta->mode = (uint8_t) mode;
+	strcpy(delta->path, path);
+
+	fd = open(old_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		LOTRACE_ERR("LO_rsc_delta_open: open(%s) failed, errno=%d", old_path, errno);
+		return -1;
+	}
+	if ((fstat(fd, &st)) || (st.st_size > UINT32_MAX)) {
+		close(fd);
+		return -1;
+	}
+	if (st.st_size) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			LOTRACE_ERR("LO_rsc_delta_open: mmap failed, errno=%d", errno);
+			close(fd);
+			return -1;
+		}
+		delta->old = (const uint8_t *) map;
+		delta->old_size = (uint32_t) st.st_size;
+	}
+	close(fd);
+	delta->opened = 1;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_delta_setDigest(LO_rsc_delta_t *delta, LO_rsc_digest_t type, const char *hex) {
+	if ((delta == NULL) || (delta->step != LO_RSC_DELTA_HEADER) || (hex == NULL)
+			|| (strlen(hex) >= sizeof(delta->digest_hex)))
+		return -1;
+	delta->digest = (uint8_t) type;
+	strcpy(delta->digest_hex, hex);
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_delta_fill(LO_rsc_delta_t *delta, LO_rsc_sink_reader_t reader, void *ctx) {
+	int len, ret;
+	char *pc;
+
+	if ((delta == NULL) || (delta->step == LO_RSC_DELTA_ERROR))
+		return -1;
+
+	len = reader(ctx, delta->in, sizeof(delta->in));
+	if (len <= 0)
+		return len;
+	delta->received += len;
+	pc = delta->in;
+
+	if (delta->step == LO_RSC_DELTA_HEADER) {
+		uint32_t n = sizeof(delta->ctrl) - delta->ctrl_len;
+		if (n > (uint32_t) len)
+			n = len;
+		memcpy(delta->ctrl + delta->ctrl_len, pc, n);
+		delta->ctrl_len += n;
+		pc += n;
+		if (delta->ctrl_len < sizeof(delta->ctrl))
+			return len;
+		if (_LO_rsc_delta_header(delta)) {
+			delta->step = LO_RSC_DELTA_ERROR;
+			return -1;
+		}
+	}
+
+	/* Apply the chunk, up to the end of the bzip2 stream (trailing bytes are ignored)*/
+	delta->bz.next_in = pc;
+	delta->bz.avail_in = len - (pc - delta->in);
+	do {
+		ret = LO_rsc_sink_fill(&delta->sink, delta->sink.written, _LO_rsc_delta_produce, delta);
+	} while (ret > 0);
+	if (ret < 0)
+		return ret;
+	return len;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_delta_read(LO_rsc_delta_t *delta, const LiveObjectsD_Resource_t *rsc_ptr, uint32_t offset) {
+	if (delta == NULL)
+		return -1;
+	/* The delta is decoded as a stream : no gap, no rewind*/
+	if (offset != delta->received) {
+		LOTRACE_ERR("LO_rsc_delta_read: %s - offset %u, %u bytes read", delta->path, offset, delta->received);
+		delta->step = LO_RSC_DELTA_ERROR;
+		return -1;
+	}
+	return LO_rsc_delta_fill(delta, _LO_rsc_delta_getChunck, (void *) rsc_ptr);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_delta_close(LO_rsc_delta_t *delta, uint8_t commit) {
+	int ret = 0;
+
+	if (delta == NULL)
+		return -1;
+
+	if ((commit) && (delta->step != LO_RSC_DELTA_END)) {
+		LOTRACE_ERR("LO_rsc_delta_close: %s - incomplete or corrupted delta", delta->path);
+		commit = 0;
+		ret = -1;
+	}
+	if (delta->sink.opened) {
+		int sink_ret = LO_rsc_sink_close(&delta->sink, commit);
+		if (ret == 0)
+			ret = sink_ret;
+	}
+	if (delta->step > LO_RSC_DELTA_HEADER)
+		BZ2_bzDecompressEnd(&delta->bz);
+	if (delta->old)
+		munmap((void *) delta->old, delta->old_size);
+	delta->old = NULL;
+	delta->step = LO_RSC_DELTA_HEADER;
+	delta->ctrl_len = 0;
+	delta->opened = 0;
+	return ret;
+}
+
+#endif /* LOC_FEATURE_RSC_DELTA */
@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_rsc_sink.c
+ * @brief Streaming sink of a resource transfer into a file.
+ */
+
+#include "liveobjects-sys/loc_rsc_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "liveobjects-client/LiveObjectsClient_Core.h"
+#include "liveobjects-sys/loc_trace.h"
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_rsc_sink_partPath(const LO_rsc_sink_t *sink, char *part, size_t part_sz) {
+	snprintf(part, part_sz, "%s.part", sink->path);
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Reserve the blocks of the file (falls back to ftruncate when the file*/
+/* system does not support it).*/
+static int _LO_rsc_sink_alloc(int fd, uint32_t size) {
+	int ret;
+	if (size == 0)
+		return 0;
+	ret = posix_fallocate(fd, 0, size);
+	if ((ret == EOPNOTSUPP) || (ret == EINVAL))
+		return ftruncate(fd, size);
+	if (ret) {
+		errno = ret;
+		return -1;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static int _LO_rsc_sink_pwrite(LO_rsc_sink_t *sink, const uint8_t *data, uint32_t len, uint32_t offset) {
+	uint32_t done = 0;
+	while (done < len) {
+		ssize_t n = pwrite(sink->fd, data + done, len - done, offset + done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			LOTRACE_ERR("LO_rsc_sink_read: write error, errno=%d", errno);
+			return -1;
+		}
+		done += n;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Add the chunk to the digest, and check it after the last chunk.*/
+static int _LO_rsc_sink_digest(LO_rsc_sink_t *sink, const uint8_t *data, uint32_t len) {
+	uint8_t digest[32];
+
+	if ((sink->digest == LO_RSC_DIGEST_NONE) || (sink->digest_ok))
+		return sink->digest_ok;
+	if ((len) && (mbedtls_md_update(&sink->md, data, len)))
+		goto mismatch;
+	if (sink->written < sink->size)
+		return 0;
+
+	if ((mbedtls_md_finish(&sink->md, digest))
+			|| (memcmp(digest, sink->expected, sink->digest_len)))
+		goto mismatch;
+	LOTRACE_INF("LO_rsc_sink: %s digest OK", sink->path);
+	sink->digest_ok = 1;
+	return 1;
+
+mismatch:
+	LOTRACE_ERR("LO_rsc_sink: %s - invalid digest", sink->path);
+	sink->digest_ok = -1;
+	return -1;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Open the partial file : created and preallocated (written == 0), or*/
+/* reopened as left by a previous transfer (written > 0).*/
+static int _LO_rsc_sink_init(LO_rsc_sink_t *sink, const char *path, uint32_t size,
+		LO_rsc_sinkMode_t mode, uint32_t written) {
+	char part[LOC_RSC_SINK_PATH_SZ + 8];
+
+	if ((sink == NULL) || (path == NULL) || (strlen(path) >= sizeof(sink->path))
+			|| (written > size))
+		return -1;
+
+	/* Previous transfer not closed : release its file and mapping*/
+	if (sink->opened) {
+		LOTRACE_WARN("LO_rsc_sink_open: %s was not closed", sink->path);
+		LO_rsc_sink_close(sink, (written) ? LO_RSC_SINK_KEEP : 0);
+	}
+
+	sink->fd = -1;
+	sink->map = NULL;
+	sink->mode = (uint8_t) mode;
+	sink->size = size;
+	sink->written = written;
+	sink->digest = LO_RSC_DIGEST_NONE;
+	sink->digest_ok = 0;
+	strcpy(sink->path, path);
+	_LO_rsc_sink_partPath(sink, part, sizeof(part));
+
+	if (written) {
+		struct stat st;
+		sink->fd = open(part, O_RDWR | O_CLOEXEC);
+		if (sink->fd < 0) {
+			LOTRACE_ERR("LO_rsc_sink_reopen: open(%s) failed, errno=%d", part, errno);
+			return -1;
+		}
+		if ((fstat(sink->fd, &st)) || (st.st_size != (off_t) size)) {
+			LOTRACE_ERR("LO_rsc_sink_reopen: %s is not a partial file of %u bytes", part, size);
+			goto error;
+		}
+	} else {
+		sink->fd = open(part, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (sink->fd < 0) {
+			LOTRACE_ERR("LO_rsc_sink_open: open(%s) failed, errno=%d", part, errno);
+			return -1;
+		}
+		if (_LO_rsc_sink_alloc(sink->fd, size)) {
+			LOTRACE_ERR("LO_rsc_sink_open: cannot allocate %u bytes, errno=%d", size, errno);
+			goto error;
+		}
+	}
+	if ((mode == LO_RSC_SINK_MMAP) && (size)) {
+		void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, sink->fd, 0);
+		if (map == MAP_FAILED) {
+			LOTRACE_ERR("LO_rsc_sink_open: mmap failed, errno=%d", errno);
+			goto error;
+		}
+		/* Chunks are written once, in order*/
+		madvise(map, size, MADV_SEQUENTIAL);
+		sink->map = (uint8_t *) map;
+	}
+	LOTRACE_INF("LO_rsc_sink_open: %s (%u/%u bytes, %s)", part, written, size,
+			(sink->map) ? "mmap" : "file");
+	sink->opened = 1;
+	return 0;
+
+error:
+	close(sink->fd);
+	sink->fd = -1;
+	if (written == 0)
+		unlink(part);
+	return -1;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Add bytes already in the file to the digest (reopened file, or bytes*/
+/* written by LO_rsc_sink_fillAt).*/
+static int _LO_rsc_sink_digestFile(LO_rsc_sink_t *sink, uint32_t offset, uint32_t end) {
+	if (sink->map)
+		return mbedtls_md_update(&sink->md, sink->map + offset, end - offset) ? -1 : 0;
+	while (offset < end) {
+		uint32_t len = end - offset;
+		ssize_t n;
+		if (len > sizeof(sink->buf))
+			len = sizeof(sink->buf);
+		n = pread(sink->fd, sink->buf, len, offset);
+		if ((n < 0) && (errno == EINTR))
+			continue;
+		if ((n <= 0) || (mbedtls_md_update(&sink->md, sink->buf, n)))
+			return -1;
+		offset += n;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Reader of LO_rsc_sink_read.*/
+static int _LO_rsc_sink_getChunck(void *ctx, char *buf, uint32_t len) {
+	return LiveObjectsClient_RscGetChunck((const LiveObjectsD_Resource_t *) ctx, buf, len);
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_sink_open(LO_rsc_sink_t *sink, const char *path, uint32_t size, LO_rsc_sinkMode_t mode) {
+	return _LO_rsc_sink_init(sink, path, size, mode, 0);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_sink_reopen(LO_rsc_sink_t *sink, const char *path, uint32_t size,
+		LO_rsc_sinkMode_t mode, uint32_t written) {
+	if (written == 0)
+		return -1;
+	return _LO_rsc_sink_init(sink, path, size, mode, written);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_sink_setDigest(LO_rsc_sink_t *sink, LO_rsc_digest_t type, const char *hex) {
+	const mbedtls_md_info_t *info;
+	uint8_t len, i;
+
+	if ((sink == NULL) || (sink->fd < 0) || (hex == NULL))
+		return -1;
+	if (type == LO_RSC_DIGEST_MD5)
+		info = mbedtls_md_info_from_type(MBEDTLS_MD_MD5);
+	else if (type == LO_RSC_DIGEST_SHA256)
+		info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+	else
+		return -1;
+	if (info == NULL)
+		return -1;
+	len = mbedtls_md_get_size(info);
+	if ((len > sizeof(sink->expected)) || (strlen(hex) != 2U * len))
+		return -1;
+	for (i = 0; i < len; i++) {
+		unsigned int val;
+		if (sscanf(hex + 2 * i, "%2x", &val) != 1)
+			return -1;
+		sink->expected[i] = (uint8_t) val;
+	}
+
+	mbedtls_md_init(&sink->md);
+	if ((mbedtls_md_setup(&sink->md, info, 0)) || (mbedtls_md_starts(&sink->md))
+			|| ((sink->written) && (_LO_rsc_sink_digestFile(sink, 0, sink->written)))) {
+		mbedtls_md_free(&sink->md);
+		return -1;
+	}
+	sink->digest = (uint8_t) type;
+	sink->digest_len = len;
+	sink->digest_ok = 0;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_sink_fill(LO_rsc_sink_t *sink, uint32_t offset, LO_rsc_sink_reader_t reader, void *ctx) {
+	const uint8_t *data;
+	uint32_t len;
+	int ret;
+
+	if ((sink == NULL) || (sink->fd < 0) || (offset > sink->size)) {
+		LOTRACE_ERR("LO_rsc_sink_fill: offset %u out of the resource", offset);
+		return -1;
+	}
+	/* Appended only : a gap or an overlap would spoil the file and its digest*/
+	if (offset != sink->written) {
+		LOTRACE_ERR("LO_rsc_sink_fill: offset %u, but %u bytes received", offset, sink->written);
+		return -1;
+	}
+	len = sink->size - offset;
+
+	if (sink->map) {
+		data = sink->map + offset;
+		ret = reader(ctx, (char *) data, len);
+	} else {
+		data = sink->buf;
+		if (len > sizeof(sink->buf))
+			len = sizeof(sink->buf);
+		ret = reader(ctx, (char *) sink->buf, len);
+		if ((ret > 0) && (_LO_rsc_sink_pwrite(sink, sink->buf, ret, offset)))
+			return -1;
+	}
+	if (ret > 0) {
+		sink->written += ret;
+		if (_LO_rsc_sink_digest(sink, data, ret) < 0)
+			return LO_RSC_SINK_ERR_DIGEST;
+	}
+	return ret;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_sink_fillAt(LO_rsc_sink_t *sink, uint32_t offset, uint32_t len,
+		LO_rsc_sink_reader_t reader, void *ctx, uint8_t *buf) {
+	int ret;
+
+	if ((sink == NULL) || (sink->fd < 0) || (offset > sink->size) || (len > sink->size - offset)) {
+		LOTRACE_ERR("LO_rsc_sink_fillAt: %u bytes at %u out of the resource", len, offset);
+		return -1;
+	}
+	if (sink->map)
+		return reader(ctx, (char *) sink->map + offset, len);
+
+	if (len > LOC_RSC_SINK_BUF_SZ)
+		len = LOC_RSC_SINK_BUF_SZ;
+	ret = reader(ctx, (char *) buf, len);
+	if ((ret > 0) && (_LO_rsc_sink_pwrite(sink, buf, ret, offset)))
+		return -1;
+	return ret;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_sink_advance(LO_rsc_sink_t *sink, uint32_t written) {
+	if ((sink == NULL) || (sink->fd < 0) || (written < sink->written) || (written > sink->size))
+		return -1;
+	if ((sink->digest != LO_RSC_DIGEST_NONE) && (!sink->digest_ok)
+			&& (_LO_rsc_sink_digestFile(sink, sink->written, written))) {
+		sink->written = written;
+		LOTRACE_ERR("LO_rsc_sink: %s - digest read error", sink->path);
+		sink->digest_ok = -1;
+		return LO_RSC_SINK_ERR_DIGEST;
+	}
+	sink->written = written;
+	if (_LO_rsc_sink_digest(sink, NULL, 0) < 0)
+		return LO_RSC_SINK_ERR_DIGEST;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_sink_read(LO_rsc_sink_t *sink, const LiveObjectsD_Resource_t *rsc_ptr, uint32_t offset) {
+	return LO_rsc_sink_fill(sink, offset, _LO_rsc_sink_getChunck, (void *) rsc_ptr);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_sink_sync(LO_rsc_sink_t *sink) {
+	if ((sink == NULL) || (sink->fd < 0))
+		return -1;
+	if (sink->map)
+		return (sink->written) ? msync(sink->map, sink->written, MS_SYNC) : 0;
+	return fdatasync(sink->fd);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_rsc_sink_close(LO_rsc_sink_t *sink, uint8_t commit) {
+	char part[LOC_RSC_SINK_PATH_SZ + 8];
+	uint8_t keep = 0;
+	int ret = 0;
+
+	if ((sink == NULL) || (!sink->opened) || (sink->fd < 0))
+		return -1;
+	_LO_rsc_sink_partPath(sink, part, sizeof(part));
+	sink->opened = 0;
+
+	if (commit == LO_RSC_SINK_KEEP) {
+		/* Partial file kept for LO_rsc_sink_reopen*/
+		keep = 1;
+		commit = 0;
+		if (LO_rsc_sink_sync(sink))
+			ret = -1;
+		LOTRACE_INF("LO_rsc_sink_close: %s kept (%u/%u)", part, sink->written, sink->size);
+	}
+	if ((commit) && (sink->written != sink->size)) {
+		LOTRACE_ERR("LO_rsc_sink_close: %s incomplete (%u/%u)", part, sink->written, sink->size);
+		commit = 0;
+		ret = -1;
+	} else if ((commit) && (_LO_rsc_sink_digest(sink, NULL, 0) < 0)) {
+		commit = 0;
+		ret = LO_RSC_SINK_ERR_DIGEST;
+	}
+	if (sink->digest != LO_RSC_DIGEST_NONE) {
+		mbedtls_md_free(&sink->md);
+		sink->digest = LO_RSC_DIGEST_NONE;
+	}
+	if (sink->map) {
+		if ((commit) && (msync(sink->map, sink->size, MS_SYNC)))
+			ret = -1;
+		munmap(sink->map, sink->size);
+		sink->map = NULL;
+	}
+	if ((commit) && (ret == 0) && (fsync(sink->fd)))
+		ret = -1;
+	if (close(sink->fd))
+		ret = -1;
+	sink->fd = -1;
+
+	if ((commit) && (ret == 0)) {
+		if (rename(part, sink->path)) {
+			LOTRACE_ERR("LO_rsc_sink_close: rename(%s) failed, errno=%d", sink->path, errno);
+			ret = -1;
+		}
+	}
+	if (((!commit) || (ret)) && (!keep))
+		unlink(part);
+	return ret;
+}
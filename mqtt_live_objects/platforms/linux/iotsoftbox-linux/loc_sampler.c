@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_sampler.c
+ * @brief Periodic sampling thread, independent of the LiveObjects client loop.
+ */
+
+#include "liveobjects-sys/loc_sampler.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "liveobjects-sys/loc_trace.h"
+
+/* epoll identifier of the stop event*/
+#define SAMPLER_STOP_ID      LOC_SAMPLER_TASKS_MAX
+
+typedef struct {
+	uint8_t used;
+	uint8_t busy;                   /* Callbacks running (unlocked)*/
+	uint32_t generation;            /* Changed by each removal*/
+	int fd;                         /* timerfd*/
+	LO_sampler_task_t task;
+	uint64_t start_ns;              /* Time of the first expiration*/
+	uint64_t period_ns;
+	uint64_t ticks;                 /* Number of expirations*/
+	uint32_t samples;
+	uint32_t missed;
+	uint32_t late_min_ns;
+	uint32_t late_max_ns;
+	uint64_t late_sum_ns;
+	uint32_t run_max_ns;
+} LO_sampler_slot_t;
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t idle;            /* A task is not busy anymore*/
+	int epfd;
+	int stop_fd;
+	uint8_t running;
+	pthread_t thread;
+	LO_sampler_slot_t slots[LOC_SAMPLER_TASKS_MAX];
+} _lo_sampler = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, -1, -1 };
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+
+static uint64_t _LO_sampler_monoNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_sampler_resetStats(LO_sampler_slot_t *slot) {
+	slot->samples = 0;
+	slot->missed = 0;
+	slot->late_min_ns = UINT32_MAX;
+	slot->late_max_ns = 0;
+	slot->late_sum_ns = 0;
+	slot->run_max_ns = 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* (Re)start the periods of a task : first expiration one period from now.*/
+static int _LO_sampler_arm(LO_sampler_slot_t *slot) {
+	struct itimerspec its;
+
+	slot->start_ns = _LO_sampler_monoNs() + slot->period_ns;
+	slot->ticks = 0;
+	its.it_value.tv_sec = slot->start_ns / 1000000000;
+	its.it_value.tv_nsec = slot->start_ns % 1000000000;
+	its.it_interval.tv_sec = slot->period_ns / 1000000000;
+	its.it_interval.tv_nsec = slot->period_ns % 1000000000;
+	return timerfd_settime(slot->fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Count an expiration of a task (locked). Return 0 if a sample is to be taken.*/
+static int _LO_sampler_expired(LO_sampler_slot_t *slot, uint64_t now) {
+	uint64_t expirations, late;
+
+	/* The task may have been removed (or replaced) since epoll_wait*/
+	if ((!slot->used) || (read(slot->fd, &expirations, sizeof(expirations)) != sizeof(expirations)))
+		return -1;
+
+	slot->ticks += expirations;
+	slot->missed += (uint32_t) (expirations - 1);
+	late = now - (slot->start_ns + (slot->ticks - 1) * slot->period_ns);
+	if (late > UINT32_MAX)
+		late = UINT32_MAX;
+	if (late < slot->late_min_ns)
+		slot->late_min_ns = (uint32_t) late;
+	if (late > slot->late_max_ns)
+		slot->late_max_ns = (uint32_t) late;
+	slot->late_sum_ns += late;
+	slot->samples++;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Take the samples of an expired task. The callbacks run unlocked, on a copy of
+ * the task : they may call LO_sampler_add/remove, and do not hold up
+ * LO_sampler_getStats. LO_sampler_remove waits while the slot is busy.*/
+static void _LO_sampler_run(LO_sampler_slot_t *slot) {
+	LO_sampler_task_t task;
+	uint32_t generation;
+	uint64_t now = _LO_sampler_monoNs();
+
+	pthread_mutex_lock(&_lo_sampler.mutex);
+	if (_LO_sampler_expired(slot, now)) {
+		pthread_mutex_unlock(&_lo_sampler.mutex);
+		return;
+	}
+	task = slot->task;
+	generation = slot->generation;
+	slot->busy = 1;
+	pthread_mutex_unlock(&_lo_sampler.mutex);
+
+	if (task.sample_cb)
+		task.sample_cb(task.ctx);
+	if (task.aggr)
+		LO_aggr_add(task.aggr);
+	if (task.batch)
+		LO_batch_add(task.batch);
+	now = _LO_sampler_monoNs() - now;
+
+	pthread_mutex_lock(&_lo_sampler.mutex);
+	/* Statistics of a task removed meanwhile are not updated*/
+	if ((slot->generation == generation) && (now > slot->run_max_ns))
+		slot->run_max_ns = (now > UINT32_MAX) ? UINT32_MAX : (uint32_t) now;
+	slot->busy = 0;
+	pthread_cond_broadcast(&_lo_sampler.idle);
+	pthread_mutex_unlock(&_lo_sampler.mutex);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void * _LO_sampler_thread(void *arg) {
+	struct epoll_event evs[LOC_SAMPLER_TASKS_MAX + 1];
+	int i, n;
+
+	/* Wake up on time (the default slack of a normal thread is 50 us)*/
+	prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+
+	for (;;) {
+		n = epoll_wait(_lo_sampler.epfd, evs, LOC_SAMPLER_TASKS_MAX + 1, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			LOTRACE_ERR("LO_sampler: epoll_wait failed, errno=%d", errno);
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			if (evs[i].data.u32 == SAMPLER_STOP_ID)
+				return NULL;
+			_LO_sampler_run(&_lo_sampler.slots[evs[i].data.u32]);
+		}
+	}
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Create the epoll instance and the stop event (locked).*/
+static int _LO_sampler_init(void) {
+	struct epoll_event ev;
+
+	if (_lo_sampler.epfd >= 0)
+		return 0;
+	_lo_sampler.epfd = epoll_create1(EPOLL_CLOEXEC);
+	_lo_sampler.stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = SAMPLER_STOP_ID;
+	if ((_lo_sampler.epfd < 0) || (_lo_sampler.stop_fd < 0)
+			|| (epoll_ctl(_lo_sampler.epfd, EPOLL_CTL_ADD, _lo_sampler.stop_fd, &ev))) {
+		LOTRACE_ERR("LO_sampler: cannot create the epoll instance, errno=%d", errno);
+		if (_lo_sampler.epfd >= 0)
+			close(_lo_sampler.epfd);
+		if (_lo_sampler.stop_fd >= 0)
+			close(_lo_sampler.stop_fd);
+		_lo_sampler.epfd = -1;
+		_lo_sampler.stop_fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+int LO_sampler_start(int rt_priority) {
+	pthread_attr_t attr;
+	uint64_t val;
+	int i, ret;
+
+	pthread_mutex_lock(&_lo_sampler.mutex);
+	if ((_lo_sampler.running) || (_LO_sampler_init())) {
+		pthread_mutex_unlock(&_lo_sampler.mutex);
+		return -1;
+	}
+	/* Discard a previous stop event, and restart the periods*/
+	while (read(_lo_sampler.stop_fd, &val, sizeof(val)) > 0)
+		;
+	for (i = 0; i < LOC_SAMPLER_TASKS_MAX; i++) {
+		if (_lo_sampler.slots[i].used)
+			_LO_sampler_arm(&_lo_sampler.slots[i]);
+	}
+
+	ret = -1;
+	if (rt_priority > 0) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = rt_priority;
+		pthread_attr_init(&attr);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+		ret = pthread_create(&_lo_sampler.thread, &attr, _LO_sampler_thread, NULL);
+		pthread_attr_destroy(&attr);
+		if (ret)
+			LOTRACE_WARN("LO_sampler_start: SCHED_FIFO %d not permitted (%d), normal thread",
+					rt_priority, ret);
+	}
+	if (ret)
+		ret = pthread_create(&_lo_sampler.thread, NULL, _LO_sampler_thread, NULL);
+	_lo_sampler.running = (ret == 0);
+	pthread_mutex_unlock(&_lo_sampler.mutex);
+
+	if (ret) {
+		LOTRACE_ERR("LO_sampler_start: pthread_create failed (%d)", ret);
+		return -1;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_sampler_stop(void) {
+	uint64_t val = 1;
+	uint8_t running;
+	ssize_t ret = 0;
+
+	pthread_mutex_lock(&_lo_sampler.mutex);
+	running = _lo_sampler.running;
+	_lo_sampler.running = 0;
+	if (running) {
+		do {
+			ret = write(_lo_sampler.stop_fd, &val, sizeof(val));
+		} while ((ret < 0) && (errno == EINTR));
+	}
+	pthread_mutex_unlock(&_lo_sampler.mutex);
+
+	if (!running)
+		return;
+	/* EAGAIN : a stop event is already pending*/
+	if ((ret < 0) && (errno != EAGAIN)) {
+		/* The thread cannot be woken up : not waited for*/
+		LOTRACE_ERR("LO_sampler_stop: cannot stop the sampling thread, errno=%d", errno);
+		pthread_detach(_lo_sampler.thread);
+		return;
+	}
+	pthread_join(_lo_sampler.thread, NULL);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_sampler_add(const LO_sampler_task_t *task_ptr) {
+	struct epoll_event ev;
+	LO_sampler_slot_t *slot = NULL;
+	int i;
+
+	if ((task_ptr == NULL) || (task_ptr->period_us == 0))
+		return -1;
+
+	pthread_mutex_lock(&_lo_sampler.mutex);
+	if (_LO_sampler_init() == 0) {
+		for (i = 0; i < LOC_SAMPLER_TASKS_MAX; i++) {
+			if (!_lo_sampler.slots[i].used) {
+				slot = &_lo_sampler.slots[i];
+				break;
+			}
+		}
+	}
+	if (slot == NULL) {
+		pthread_mutex_unlock(&_lo_sampler.mutex);
+		LOTRACE_ERR("LO_sampler_add: no free task");
+		return -1;
+	}
+
+	slot->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	slot->task = *task_ptr;
+	slot->period_ns = (uint64_t) task_ptr->period_us * 1000;
+	_LO_sampler_resetStats(slot);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = i;
+	if ((slot->fd < 0) || (_LO_sampler_arm(slot))
+			|| (epoll_ctl(_lo_sampler.epfd, EPOLL_CTL_ADD, slot->fd, &ev))) {
+		LOTRACE_ERR("LO_sampler_add: timerfd error, errno=%d", errno);
+		if (slot->fd >= 0)
+			close(slot->fd);
+		pthread_mutex_unlock(&_lo_sampler.mutex);
+		return -1;
+	}
+	slot->used = 1;
+	pthread_mutex_unlock(&_lo_sampler.mutex);
+
+	LOTRACE_INF("LO_sampler_add: task %d, period %u us", i, task_ptr->period_us);
+	return i;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_sampler_remove(int id) {
+	LO_sampler_slot_t *slot;
+
+	if ((id < 0) || (id >= LOC_SAMPLER_TASKS_MAX))
+		return;
+	pthread_mutex_lock(&_lo_sampler.mutex);
+	slot = &_lo_sampler.slots[id];
+	if (slot->used) {
+		epoll_ctl(_lo_sampler.epfd, EPOLL_CTL_DEL, slot->fd, NULL);
+		close(slot->fd);
+		slot->used = 0;
+		slot->generation++;
+	}
+	/* Wait for the callbacks of the task, unless called by one of them*/
+	while ((slot->busy) && (!pthread_equal(pthread_self(), _lo_sampler.thread)))
+		pthread_cond_wait(&_lo_sampler.idle, &_lo_sampler.mutex);
+	pthread_mutex_unlock(&_lo_sampler.mutex);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_sampler_getStats(int id, LO_sampler_stats_t *stats_ptr, uint8_t reset) {
+	LO_sampler_slot_t *slot;
+
+	if ((id < 0) || (id >= LOC_SAMPLER_TASKS_MAX) || (stats_ptr == NULL))
+		return -1;
+	pthread_mutex_lock(&_lo_sampler.mutex);
+	slot = &_lo_sampler.slots[id];
+	if (!slot->used) {
+		pthread_mutex_unlock(&_lo_sampler.mutex);
+		return -1;
+	}
+	stats_ptr->samples = slot->samples;
+	stats_ptr->missed = slot->missed;
+	stats_ptr->late_min_ns = (slot->samples) ? slot->late_min_ns : 0;
+	stats_ptr->late_max_ns = slot->late_max_ns;
+	stats_ptr->late_mean_ns = (slot->samples) ? (uint32_t) (slot->late_sum_ns / slot->samples) : 0;
+	stats_ptr->run_max_ns = slot->run_max_ns;
+	if (reset)
+		_LO_sampler_resetStats(slot);
+	pthread_mutex_unlock(&_lo_sampler.mutex);
+	return 0;
+}
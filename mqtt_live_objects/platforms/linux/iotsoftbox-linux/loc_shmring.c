@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_shmring.c
+ * @brief Shared memory ring of samples, between acquisition processes and the client.
+ */
+
+#include "liveobjects-sys/loc_shmring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "liveobjects-sys/loc_trace.h"
+
+#define SHMRING_MAGIC        0x4C4F5352     /* "LOSR"*/
+#define SHMRING_VERSION      3
+
+/* Slot : sequence number, writer, timestamp, then the values*/
+#define SHMRING_SLOT_WRITER  sizeof(uint64_t)
+#define SHMRING_SLOT_TS      (2 * sizeof(uint64_t))
+
+/* Header of the shared memory, followed by the slots*/
+typedef struct {
+	uint32_t magic;                 /* Set last by the client*/
+	uint16_t version;
+	uint16_t field_nb;
+	uint32_t hdr_sz;
+	uint32_t capacity;
+	uint32_t slot_sz;               /* Sequence number, writer, timestamp and values*/
+	uint8_t types[LOC_SHMRING_FIELDS_MAX];
+	uint64_t head __attribute__((aligned(64)));  /* Next slot of the producers*/
+	uint64_t dropped;
+	uint64_t tail __attribute__((aligned(64)));  /* Next slot of the client*/
+	uint64_t drained;
+	uint64_t skipped;
+} LO_shmring_hdr_t;
+
+typedef struct {
+	void *value;
+	uint16_t off;                   /* In the slot*/
+	uint8_t size;
+} LO_shmring_field_t;
+
+struct LO_shmring_s {
+	LO_shmring_hdr_t *hdr;
+	uint8_t *slots;
+	size_t map_sz;
+	uint32_t slot_sz;
+	uint32_t mask;
+	char *name;                     /* Client only : removed by LO_shmring_close*/
+	uint64_t stuck_pos;             /* Client only : position + 1 of a slot reserved but not written*/
+	uint64_t stuck_ms;              /* Since when*/
+	LO_shmring_cfg_t cfg;
+	uint16_t field_nb;
+	uint8_t types[LOC_SHMRING_FIELDS_MAX];
+	LO_shmring_field_t fields[LOC_SHMRING_FIELDS_MAX];
+};
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+
+static uint8_t _LO_shmring_typeSize(LiveObjectsD_Type_t type) {
+	switch (type) {
+	case LOD_TYPE_INT8:
+	case LOD_TYPE_UINT8:
+	case LOD_TYPE_BOOL:
+		return 1;
+	case LOD_TYPE_INT16:
+	case LOD_TYPE_UINT16:
+		return 2;
+	case LOD_TYPE_INT32:
+	case LOD_TYPE_UINT32:
+	case LOD_TYPE_FLOAT:
+		return 4;
+	case LOD_TYPE_DOUBLE:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Binary layout of the numeric fields of a set.*/
+static int _LO_shmring_layout(LO_shmring_t *ring, const LiveObjectsD_Data_t *data_set, int32_t data_nb) {
+	uint32_t off = 3 * sizeof(uint64_t);    /* Sequence number, writer and timestamp*/
+	int32_t i;
+
+	for (i = 0; i < data_nb; i++) {
+		uint8_t size = _LO_shmring_typeSize(data_set[i].data_type);
+		if ((size == 0) || (data_set[i].data_value == NULL))
+			continue;
+		if (ring->field_nb == LOC_SHMRING_FIELDS_MAX) {
+			LOTRACE_ERR("LO_shmring: more than %d numeric fields", LOC_SHMRING_FIELDS_MAX);
+			return -1;
+		}
+		off = (off + size - 1) & ~(uint32_t) (size - 1);
+		ring->fields[ring->field_nb].value = data_set[i].data_value;
+		ring->fields[ring->field_nb].off = (uint16_t) off;
+		ring->fields[ring->field_nb].size = size;
+		ring->types[ring->field_nb] = (uint8_t) data_set[i].data_type;
+		ring->field_nb++;
+		off += size;
+	}
+	if (ring->field_nb == 0) {
+		LOTRACE_ERR("LO_shmring: no numeric field");
+		return -1;
+	}
+	ring->slot_sz = (off + 7) & ~7U;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Skip the slot of the client if it is reserved by a producer but still not*/
+/* written after LOC_SHMRING_STUCK_MS : the producer is considered as dead.*/
+/* Return 1 if the slot is skipped.*/
+static int _LO_shmring_skip(LO_shmring_t *ring, uint8_t *slot, uint64_t pos) {
+	uint64_t seq = pos;
+	uint64_t now;
+	struct timespec ts;
+
+	if (__atomic_load_n(&ring->hdr->head, __ATOMIC_RELAXED) <= pos)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	if (ring->stuck_pos != pos + 1) {
+		ring->stuck_pos = pos + 1;
+		ring->stuck_ms = now;
+		return 0;
+	}
+	/* Free for the producers, one turn later, unless written meanwhile*/
+	if ((now - ring->stuck_ms < LOC_SHMRING_STUCK_MS)
+			|| (!__atomic_compare_exchange_n((uint64_t *) slot, &seq, pos + ring->cfg.capacity, 0,
+					__ATOMIC_RELEASE, __ATOMIC_ACQUIRE)))
+		return 0;
+	LOTRACE_WARN("LO_shmring_drain: sample %llu not written after %u ms, skipped",
+			(unsigned long long) pos, LOC_SHMRING_STUCK_MS);
+	__atomic_store_n(&ring->hdr->skipped, ring->hdr->skipped + 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_shmring_free(LO_shmring_t *ring) {
+	if (ring->hdr)
+		munmap(ring->hdr, ring->map_sz);
+	free(ring->name);
+	free(ring);
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+LO_shmring_t *LO_shmring_create(const char *name, const LiveObjectsD_Data_t *data_set, int32_t data_nb,
+		const LO_shmring_cfg_t *cfg_ptr) {
+	LO_shmring_t *ring;
+	uint32_t capacity, i;
+	void *ptr;
+	int fd;
+
+	if ((name == NULL) || (data_set == NULL))
+		return NULL;
+	ring = (LO_shmring_t *) calloc(1, sizeof(LO_shmring_t));
+	if (ring == NULL)
+		return NULL;
+	if (cfg_ptr)
+		ring->cfg = *cfg_ptr;
+	ring->name = strdup(name);
+	if ((ring->name == NULL) || (_LO_shmring_layout(ring, data_set, data_nb))) {
+		_LO_shmring_free(ring);
+		return NULL;
+	}
+
+	capacity = (ring->cfg.capacity) ? ring->cfg.capacity : LOC_SHMRING_CAPACITY;
+	if (capacity > (1U << 24))
+		capacity = 1U << 24;
+	for (ring->cfg.capacity = 2; ring->cfg.capacity < capacity; ring->cfg.capacity <<= 1)
+		;
+	ring->mask = ring->cfg.capacity - 1;
+	ring->map_sz = sizeof(LO_shmring_hdr_t) + (size_t) ring->cfg.capacity * ring->slot_sz;
+
+	/* A new object : the producers of the previous ring keep their mapping*/
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0660);
+	if ((fd < 0) || (ftruncate(fd, ring->map_sz))) {
+		LOTRACE_ERR("LO_shmring_create: %s, errno=%d", name, errno);
+		if (fd >= 0) {
+			close(fd);
+			shm_unlink(name);
+		}
+		_LO_shmring_free(ring);
+		return NULL;
+	}
+	ptr = mmap(NULL, ring->map_sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		LOTRACE_ERR("LO_shmring_create: mmap failed, errno=%d", errno);
+		shm_unlink(name);
+		_LO_shmring_free(ring);
+		return NULL;
+	}
+	ring->hdr = (LO_shmring_hdr_t *) ptr;
+	ring->slots = (uint8_t *) ptr + sizeof(LO_shmring_hdr_t);
+
+	/* Object filled with zeros : only the non zero values*/
+	ring->hdr->version = SHMRING_VERSION;
+	ring->hdr->field_nb = ring->field_nb;
+	ring->hdr->hdr_sz = sizeof(LO_shmring_hdr_t);
+	ring->hdr->capacity = ring->cfg.capacity;
+	ring->hdr->slot_sz = ring->slot_sz;
+	memcpy(ring->hdr->types, ring->types, ring->field_nb);
+	for (i = 0; i < ring->cfg.capacity; i++)
+		*(uint64_t *) (ring->slots + (size_t) i * ring->slot_sz) = i;
+	__atomic_store_n(&ring->hdr->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+	LOTRACE_INF("LO_shmring_create: %s, %u samples of %u bytes", name, ring->cfg.capacity,
+			ring->slot_sz);
+	return ring;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+LO_shmring_t *LO_shmring_open(const char *name, const LiveObjectsD_Data_t *data_set, int32_t data_nb) {
+	LO_shmring_t *ring;
+	LO_shmring_hdr_t *hdr;
+	struct stat st;
+	void *ptr;
+	int fd;
+
+	if ((name == NULL) || (data_set == NULL))
+		return NULL;
+	ring = (LO_shmring_t *) calloc(1, sizeof(LO_shmring_t));
+	if ((ring == NULL) || (_LO_shmring_layout(ring, data_set, data_nb))) {
+		free(ring);
+		return NULL;
+	}
+
+	fd = shm_open(name, O_RDWR, 0);
+	if ((fd < 0) || (fstat(fd, &st)) || ((size_t) st.st_size < sizeof(LO_shmring_hdr_t))) {
+		LOTRACE_ERR("LO_shmring_open: %s, errno=%d", name, errno);
+		if (fd >= 0)
+			close(fd);
+		free(ring);
+		return NULL;
+	}
+	ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		LOTRACE_ERR("LO_shmring_open: mmap failed, errno=%d", errno);
+		free(ring);
+		return NULL;
+	}
+	ring->hdr = hdr = (LO_shmring_hdr_t *) ptr;
+	ring->map_sz = st.st_size;
+
+	if ((__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHMRING_MAGIC)
+			|| (hdr->version != SHMRING_VERSION) || (hdr->hdr_sz != sizeof(LO_shmring_hdr_t))
+			|| (hdr->field_nb != ring->field_nb) || (hdr->slot_sz != ring->slot_sz)
+			|| (memcmp(hdr->types, ring->types, ring->field_nb))
+			|| (hdr->capacity & (hdr->capacity - 1))
+			|| (ring->map_sz < sizeof(LO_shmring_hdr_t) + (size_t) hdr->capacity * hdr->slot_sz)) {
+		LOTRACE_ERR("LO_shmring_open: %s, not a ring of this set of data", name);
+		_LO_shmring_free(ring);
+		return NULL;
+	}
+	ring->slots = (uint8_t *) ptr + sizeof(LO_shmring_hdr_t);
+	ring->cfg.capacity = hdr->capacity;
+	ring->mask = hdr->capacity - 1;
+	return ring;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_shmring_close(LO_shmring_t *ring) {
+	if (ring) {
+		if (ring->name)
+			shm_unlink(ring->name);
+		_LO_shmring_free(ring);
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_shmring_push(LO_shmring_t *ring, uint64_t ts_ms) {
+	uint64_t pos, seq;
+	uint64_t *writer;
+	uint8_t *slot;
+	uint16_t i;
+
+	if (ts_ms == 0) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts_ms = (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	}
+
+	/* Reserve a slot : free when its sequence number is the position*/
+	pos = __atomic_load_n(&ring->hdr->head, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = ring->slots + (size_t) (pos & ring->mask) * ring->slot_sz;
+		seq = __atomic_load_n((uint64_t *) slot, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&ring->hdr->head, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if ((int64_t) (seq - pos) < 0) {
+			__atomic_fetch_add(&ring->hdr->dropped, 1, __ATOMIC_RELAXED);
+			return -1;
+		} else {
+			pos = __atomic_load_n(&ring->hdr->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	/* Position of the writer, set before and checked after the copy : a producer*/
+	/* too late (slot skipped by the client, then reused) is detected by both*/
+	writer = (uint64_t *) (slot + SHMRING_SLOT_WRITER);
+	__atomic_store_n(writer, pos, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n((uint64_t *) slot, __ATOMIC_SEQ_CST) != pos)
+		goto dropped;
+
+	memcpy(slot + SHMRING_SLOT_TS, &ts_ms, sizeof(ts_ms));
+	for (i = 0; i < ring->field_nb; i++)
+		memcpy(slot + ring->fields[i].off, ring->fields[i].value, ring->fields[i].size);
+	if (__atomic_exchange_n(writer, pos, __ATOMIC_SEQ_CST) != pos) {
+		/* Written meanwhile by a late producer : released, but ignored by the client*/
+		__atomic_store_n(writer, pos - 1, __ATOMIC_RELAXED);
+		seq = pos;
+		__atomic_compare_exchange_n((uint64_t *) slot, &seq, pos + 1, 0, __ATOMIC_RELEASE,
+				__ATOMIC_RELAXED);
+		goto dropped;
+	}
+	/* Ready for the client, unless it has skipped the slot (producer too late)*/
+	seq = pos;
+	if (!__atomic_compare_exchange_n((uint64_t *) slot, &seq, pos + 1, 0, __ATOMIC_RELEASE,
+			__ATOMIC_RELAXED))
+		goto dropped;
+	return 0;
+
+dropped:
+	__atomic_fetch_add(&ring->hdr->dropped, 1, __ATOMIC_RELAXED);
+	return -1;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+uint32_t LO_shmring_drain(LO_shmring_t *ring, uint32_t max) {
+	uint64_t pos = ring->hdr->tail;
+	uint32_t n = 0;
+	uint16_t i;
+
+	while ((max == 0) || (n < max)) {
+		uint8_t *slot = ring->slots + (size_t) (pos & ring->mask) * ring->slot_sz;
+		uint64_t buf[3 + LOC_SHMRING_FIELDS_MAX];    /* Copy of the slot*/
+		uint64_t ts_ms;
+		int spoiled;
+
+		if (__atomic_load_n((uint64_t *) slot, __ATOMIC_ACQUIRE) != pos + 1) {
+			if (!_LO_shmring_skip(ring, slot, pos))
+				break;
+			pos++;
+			continue;
+		}
+		memcpy(buf, slot, ring->slot_sz);
+		/* Still the writer of this turn after the copy, else the sample is spoiled*/
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		spoiled = (__atomic_load_n((uint64_t *) (slot + SHMRING_SLOT_WRITER), __ATOMIC_RELAXED) != pos);
+		/* Free for the producers, one turn later*/
+		__atomic_store_n((uint64_t *) slot, pos + ring->cfg.capacity, __ATOMIC_RELEASE);
+		pos++;
+		if (spoiled) {
+			LOTRACE_WARN("LO_shmring_drain: sample %llu overwritten by a late producer, skipped",
+					(unsigned long long) (pos - 1));
+			__atomic_store_n(&ring->hdr->skipped, ring->hdr->skipped + 1, __ATOMIC_RELAXED);
+			continue;
+		}
+		n++;
+		memcpy(&ts_ms, (uint8_t *) buf + SHMRING_SLOT_TS, sizeof(ts_ms));
+		for (i = 0; i < ring->field_nb; i++)
+			memcpy(ring->fields[i].value, (uint8_t *) buf + ring->fields[i].off, ring->fields[i].size);
+
+		if (ring->cfg.sample_cb)
+			ring->cfg.sample_cb(ring->cfg.ctx, ts_ms);
+		/* Timestamp of the producer*/
+		if (ring->cfg.aggr)
+			LO_aggr_addAt(ring->cfg.aggr, ts_ms);
+		if (ring->cfg.batch)
+			LO_batch_addAt(ring->cfg.batch, ts_ms);
+	}
+	__atomic_store_n(&ring->hdr->tail, pos, __ATOMIC_RELAXED);
+	__atomic_store_n(&ring->hdr->drained, ring->hdr->drained + n, __ATOMIC_RELAXED);
+	return n;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_shmring_getStats(LO_shmring_t *ring, LO_shmring_stats_t *stats_ptr) {
+	uint64_t tail = __atomic_load_n(&ring->hdr->tail, __ATOMIC_RELAXED);
+	uint64_t head = __atomic_load_n(&ring->hdr->head, __ATOMIC_RELAXED);
+
+	stats_ptr->capacity = ring->cfg.capacity;
+	stats_ptr->pending = (head > tail) ? (uint32_t) (head - tail) : 0;
+	stats_ptr->drained = __atomic_load_n(&ring->hdr->drained, __ATOMIC_RELAXED);
+	stats_ptr->dropped = __atomic_load_n(&ring->hdr->dropped, __ATOMIC_RELAXED);
+	stats_ptr->skipped = __atomic_load_n(&ring->hdr->skipped, __ATOMIC_RELAXED);
+}
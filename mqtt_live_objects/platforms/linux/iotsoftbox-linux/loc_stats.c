@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_stats.c
+ * @brief Statistics of the Linux platform layer.
+ */
+
+#include "liveobjects-sys/loc_stats.h"
+
+#include <stdint.h>
+
+#include "iotsoftbox-core/loc_sys.h"
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+#include "liveobjects-sys/LiveObjectsClient_Platform.h"
+#include "liveobjects-sys/loc_pubq.h"
+#include "liveobjects-sys/loc_sampler.h"
+#include "liveobjects-sys/loc_trace.h"
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+void LO_stats_dump(void) {
+	LO_pubq_stats_t pubq;
+	int id;
+
+#if LOC_FEATURE_MUTEX_STATS
+	int i;
+	for (i = 0; i < LO_SYS_MUTEX_NB; i++) {
+		LO_stats_mutex_t st;
+		if ((LO_sys_mutex_getStats(i, &st) == 0) && (st.acquisitions)) {
+			LOTRACE_NOTICE("STATS mutex[%d]: acq=%"PRIu32" contended=%"PRIu32
+					" wait_total=%"PRIu64"us wait_max=%"PRIu32"us hold_max=%"PRIu32"us",
+					i, st.acquisitions, st.contended, st.wait_total_us,
+					st.wait_max_us, st.hold_max_us);
+		}
+	}
+#endif
+
+	LO_pubq_getStats(&pubq);
+	LOTRACE_NOTICE("STATS pubq: pushed=%"PRIu32" popped=%"PRIu32" would_block=%"PRIu32
+			" backpressure=%"PRIu32" max_pending=%"PRIu32,
+			pubq.pushed, pubq.popped, pubq.would_block, pubq.backpressure,
+			pubq.max_pending);
+
+	for (id = 0; id < LOC_SAMPLER_TASKS_MAX; id++) {
+		LO_sampler_stats_t st;
+		if ((LO_sampler_getStats(id, &st, 0) == 0) && (st.samples)) {
+			LOTRACE_NOTICE("STATS sampler[%d]: samples=%"PRIu32" missed=%"PRIu32
+					" late_min=%"PRIu32"ns late_mean=%"PRIu32"ns late_max=%"PRIu32"ns run_max=%"PRIu32"ns",
+					id, st.samples, st.missed, st.late_min_ns, st.late_mean_ns,
+					st.late_max_ns, st.run_max_ns);
+		}
+	}
+
+	LOTRACE_NOTICE("STATS trace: dropped=%"PRIu32, lo_trace_dropped());
+}
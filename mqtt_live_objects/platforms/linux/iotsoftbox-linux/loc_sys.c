@@ -15,12 +15,17 @@
 
 #include "iotsoftbox-core/loc_sys.h"
 
+#include <errno.h>
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
 
 #include "liveobjects-client/LiveObjectsClient_Config.h"
 #include "liveobjects-client/LiveObjectsClient_Core.h"
+#include "liveobjects-sys/loc_pubq.h"
+#include "liveobjects-sys/loc_stats.h"
 #include "liveobjects-sys/loc_trace.h"
+#include "liveobjects-sys/loc_wakeup.h"
 #include "liveobjects-sys/socket_defs.h"
 
 static pthread_t _lo_sys_thread_id = 0;
@@ -30,6 +35,10 @@ static uint32_t _lo_sys_thread_max = 0;
 static struct {
 	pthread_mutex_t mutex;
 	pthread_t mutex_id;
+#if LOC_FEATURE_MUTEX_STATS
+	LO_stats_mutex_t stats;
+	uint64_t locked_us;
+#endif
 } _lo_sys_mutex[LO_SYS_MUTEX_NB];
 
 /*=================================================================================*/
@@ -44,6 +53,14 @@ static void * _LO_sys_threadExec(void *argument) {
 	LOTRACE_WARN(" _LO_sys_threadExec: EXIT");
 }
 
+#if LOC_FEATURE_MUTEX_STATS
+static uint64_t _LO_sys_now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+#endif
+
 /*=================================================================================*/
 /* Public Functions*/
 /*---------------------------------------------------------------------------------*/
@@ -59,6 +76,12 @@ void LO_sys_init(void) {
 		pthread_mutex_init(&_lo_sys_mutex[i].mutex, NULL);
 		/* TODO Think to do something if the initialization goes wrong*/
 	}
+
+	LO_pubq_init();
+
+	if (LO_wakeup_init()) {
+		LOTRACE_WARN("LO_sys_init: no wakeup event, pushed data will wait for the next cycle");
+	}
 }
 /*=================================================================================*/
 /* MUTEX*/
@@ -68,7 +91,29 @@ uint8_t LO_sys_mutex_lock(uint8_t idx) {
 	if (idx)
 		LOTRACE_DBG1(" => LO_sys_mutex_lock(%u)", idx);
 	if (idx < LO_SYS_MUTEX_NB) {
+#if LOC_FEATURE_MUTEX_STATS
+		uint64_t t_wait = 0;
+		int ret = pthread_mutex_trylock(&_lo_sys_mutex[idx].mutex);
+		if (ret == EBUSY) {
+			t_wait = _LO_sys_now_us();
+			ret = pthread_mutex_lock(&_lo_sys_mutex[idx].mutex);
+		}
+		if (ret == 0) {
+			/* Statistics are only updated by the owner of the mutex*/
+			LO_stats_mutex_t *st = &_lo_sys_mutex[idx].stats;
+			_lo_sys_mutex[idx].locked_us = _LO_sys_now_us();
+			st->acquisitions++;
+			if (t_wait) {
+				uint32_t dt = (uint32_t) (_lo_sys_mutex[idx].locked_us - t_wait);
+				st->contended++;
+				st->wait_total_us += dt;
+				if (st->wait_max_us < dt)
+					st->wait_max_us = dt;
+			}
+		}
+#else
 		int ret = pthread_mutex_lock(&_lo_sys_mutex[idx].mutex);
+#endif
 		if (ret != 0) {
 			LOTRACE_ERR(" !!!! LO_sys_mutex_lock(%u): ERROR %x", idx, ret);
 		}
@@ -80,8 +125,41 @@ uint8_t LO_sys_mutex_lock(uint8_t idx) {
 void LO_sys_mutex_unlock(uint8_t idx) {
 	if (idx)
 		LOTRACE_DBG1(" <= LO_sys_mutex_unlock(%u)", idx);
-	if (idx < LO_SYS_MUTEX_NB)
+	if (idx < LO_SYS_MUTEX_NB) {
+#if LOC_FEATURE_MUTEX_STATS
+		uint32_t dt = (uint32_t) (_LO_sys_now_us() - _lo_sys_mutex[idx].locked_us);
+		if (_lo_sys_mutex[idx].stats.hold_max_us < dt)
+			_lo_sys_mutex[idx].stats.hold_max_us = dt;
+#endif
 		pthread_mutex_unlock(&_lo_sys_mutex[idx].mutex);
+		/* Shared data updated by an user thread (push, ...) :*/
+		/* wake up the LiveObjects client loop to process it immediately*/
+		/* (ignored when called by the loop thread itself)*/
+		LO_wakeup_signal();
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_sys_mutex_getStats(uint8_t idx, LO_stats_mutex_t *stats_ptr) {
+#if LOC_FEATURE_MUTEX_STATS
+	if ((idx < LO_SYS_MUTEX_NB) && (stats_ptr)) {
+		/* Copy without locking (the caller may hold this mutex) :*/
+		/* values can be slightly out of date*/
+		*stats_ptr = _lo_sys_mutex[idx].stats;
+		return 0;
+	}
+#endif
+	return -1;
+}
+
+void LO_sys_mutex_resetStats(void) {
+#if LOC_FEATURE_MUTEX_STATS
+	int i;
+	for (i = 0; i < LO_SYS_MUTEX_NB; i++) {
+		memset(&_lo_sys_mutex[i].stats, 0, sizeof(_lo_sys_mutex[i].stats));
+	}
+#endif
 }
 
 /*=================================================================================*/
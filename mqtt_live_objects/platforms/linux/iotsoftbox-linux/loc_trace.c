@@ -11,54 +11,366 @@
 /**
  * @file loc_trace.c
  * @brief Trace/Log Interface.
+ *
+ * Each thread formats its traces in its own buffer, then copies them into a
+ * lock-free ring buffer. A background writer thread drains the ring buffer
+ * and writes the traces by batch (one writev on stdout, or syslog).
+ * When the ring buffer is full, the trace is dropped and counted : a thread
+ * never waits for the output.
  */
 
 #include "config/liveobjects_dev_params.h"
 #include "liveobjects-sys/loc_trace.h"
-#include <math.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <time.h>
+#include <unistd.h>
 
 #if SYSLOG
 #include <syslog.h>
 #endif
 
-#define LOGP_STACK_CHECK
-#define LOGP_MSG_TAG 0x5A
-
 #define TACE_LEVELS_MAX 4
 #define LOGP_MAX_MSG_SIZE 500
 #define LOGP_TAIL_MSG_SIZE 5
 
+/* Number of traces in the ring buffer (must be a power of 2)*/
+#ifndef LOC_TRACE_RING_SIZE
+#define LOC_TRACE_RING_SIZE 128
+#endif
+
+/* Maximum number of traces written by one flush*/
+#define LOGP_IOV_MAX 32
+
+#define LOGP_RING_MASK (LOC_TRACE_RING_SIZE - 1)
+
+typedef char _trace_ring_size_check[((LOC_TRACE_RING_SIZE & LOGP_RING_MASK) == 0) ? 1 : -1];
+
+typedef struct {
+	uint32_t seq;
+	int priority;
+	uint32_t len;
+	char str[LOGP_MAX_MSG_SIZE + LOGP_TAIL_MSG_SIZE];
+} _trace_slot_t;
+
 static uint32_t _trace_max_msg_size = 0;
 static uint32_t _trace_index = 0;
-static int _trace_level_current = TACE_LEVELS_MAX;
-static char _trace_str[LOGP_MAX_MSG_SIZE + LOGP_TAIL_MSG_SIZE];
+int lo_trace_level_current = TACE_LEVELS_MAX;
 static const char _trace_TraceLib[TACE_LEVELS_MAX + 2] = "-EWID";
 
+/* Per thread : formatting buffer and cached date (updated once per second)*/
+static __thread char _trace_str[LOGP_MAX_MSG_SIZE + LOGP_TAIL_MSG_SIZE];
+static __thread time_t _trace_date_sec = -1;
+static __thread char _trace_date[26];
+
+/* Ring buffer and writer thread*/
+static struct {
+	uint32_t enq_pos __attribute__((aligned(64)));
+	uint32_t deq_pos __attribute__((aligned(64)));
+	uint32_t dropped;
+	uint32_t dropped_total;
+	int evt_fd;
+	uint8_t running;
+	uint8_t stopping;
+	pthread_t writer;
+	_trace_slot_t slots[LOC_TRACE_RING_SIZE];
+} _trace_ring = { .evt_fd = -1 };
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+
+/* One writev of the batch, with stdout locked and flushed first : a batch of*/
+/* traces is never mixed with the output of the application (printf, ...).*/
+static void _lo_trace_write_all(struct iovec *iov, int iov_nb) {
+	int fd = fileno(stdout);
+	flockfile(stdout);
+	fflush(stdout);
+	while (iov_nb > 0) {
+		ssize_t ret = writev(fd, iov, iov_nb);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		/* Partial write*/
+		while ((iov_nb > 0) && (ret >= (ssize_t) iov->iov_len)) {
+			ret -= iov->iov_len;
+			iov++;
+			iov_nb--;
+		}
+		if (iov_nb > 0) {
+			iov->iov_base = (char *) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+	funlockfile(stdout);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _lo_trace_output(int priority, char *str, uint32_t len) {
+#if SYSLOG
+	syslog(priority, "%s", str);
+#else
+	struct iovec iov = { str, len };
+	_lo_trace_write_all(&iov, 1);
+#endif
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Writer thread : write all the ready traces, LOGP_IOV_MAX at a time.*/
+static void _lo_trace_drain(void) {
+	while (1) {
+		struct iovec iov[LOGP_IOV_MAX + 1];
+		char drop_str[64];
+		uint32_t pos = _trace_ring.deq_pos;
+		uint32_t dropped;
+		int nb = 0;
+		int i;
+
+		dropped = __atomic_exchange_n(&_trace_ring.dropped, 0, __ATOMIC_RELAXED);
+		if (dropped) {
+			iov[0].iov_base = drop_str;
+			iov[0].iov_len = snprintf(drop_str, sizeof(drop_str),
+					"---- %u trace(s) dropped ----\n", dropped);
+#if SYSLOG
+			syslog(LOG_WARNING, "%s", drop_str);
+#else
+			nb = 1;
+#endif
+		}
+
+		for (i = 0; i < LOGP_IOV_MAX; i++) {
+			_trace_slot_t *slot = &_trace_ring.slots[(pos + i) & LOGP_RING_MASK];
+			if ((int32_t) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE)
+					- (pos + i + 1)) < 0)
+				break;
+#if SYSLOG
+			syslog(slot->priority, "%s", slot->str);
+#else
+			iov[nb].iov_base = slot->str;
+			iov[nb].iov_len = slot->len;
+			nb++;
+#endif
+		}
+		if ((i == 0) && (nb == 0))
+			return;
+
+		if (nb)
+			_lo_trace_write_all(iov, nb);
+
+		/* Release the slots to the producers*/
+		while (i-- > 0) {
+			_trace_slot_t *slot = &_trace_ring.slots[pos & LOGP_RING_MASK];
+			__atomic_store_n(&slot->seq, pos + LOC_TRACE_RING_SIZE, __ATOMIC_RELEASE);
+			pos++;
+		}
+		__atomic_store_n(&_trace_ring.deq_pos, pos, __ATOMIC_RELEASE);
+		/* Store deq_pos before reading the next slot (see _lo_trace_post) :*/
+		/* either this read sees the new trace, or the producer sees deq_pos*/
+		/* and wakes up the writer*/
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void * _lo_trace_writer(void *argument) {
+	uint64_t cnt;
+	while (!__atomic_load_n(&_trace_ring.stopping, __ATOMIC_ACQUIRE)) {
+		/* Blocking read : wait for the first trace put in an empty ring*/
+		if ((read(_trace_ring.evt_fd, &cnt, sizeof(cnt)) < 0) && (errno != EINTR))
+			break;
+		_lo_trace_drain();
+	}
+	_lo_trace_drain();
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _lo_trace_stop(void) {
+	uint64_t one = 1;
+	if (_trace_ring.running) {
+		__atomic_store_n(&_trace_ring.stopping, 1, __ATOMIC_RELEASE);
+		if (write(_trace_ring.evt_fd, &one, sizeof(one)) == sizeof(one))
+			pthread_join(_trace_ring.writer, NULL);
+		_trace_ring.running = 0;
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _lo_trace_start(void);
+
+/* fork() : the child has no writer thread, and shares the eventfd of the parent.*/
+/* Its ring is emptied (the traces already posted are written by the parent) and*/
+/* it starts its own writer.*/
+static void _lo_trace_atfork_child(void) {
+	if (_trace_ring.running) {
+		_trace_ring.running = 0;
+		_trace_ring.dropped = 0;
+		close(_trace_ring.evt_fd);
+		_trace_ring.evt_fd = -1;
+		_lo_trace_start();
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _lo_trace_start(void) {
+	uint32_t i;
+
+	if (_trace_ring.running)
+		return;
+
+	for (i = 0; i < LOC_TRACE_RING_SIZE; i++)
+		_trace_ring.slots[i].seq = i;
+	_trace_ring.enq_pos = 0;
+	_trace_ring.deq_pos = 0;
+	_trace_ring.stopping = 0;
+
+	if (_trace_ring.evt_fd < 0)
+		_trace_ring.evt_fd = eventfd(0, EFD_CLOEXEC);
+	if (_trace_ring.evt_fd < 0)
+		return;
+
+	if (pthread_create(&_trace_ring.writer, NULL, _lo_trace_writer, NULL) == 0) {
+		static uint8_t atexit_done = 0;
+		_trace_ring.running = 1;
+		/* Write the pending traces when the process exits*/
+		if (!atexit_done) {
+			atexit(_lo_trace_stop);
+			pthread_atfork(NULL, NULL, _lo_trace_atfork_child);
+		}
+		atexit_done = 1;
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Copy a formatted trace into the ring buffer (or write it directly if the*/
+/* writer thread is not running).*/
+static void _lo_trace_post(int priority, char *str, uint32_t len) {
+	_trace_slot_t *slot;
+	uint32_t pos;
+
+	if (!_trace_ring.running) {
+		_lo_trace_output(priority, str, len);
+		return;
+	}
+
+	pos = __atomic_load_n(&_trace_ring.enq_pos, __ATOMIC_RELAXED);
+	while (1) {
+		int32_t dif;
+		slot = &_trace_ring.slots[pos & LOGP_RING_MASK];
+		dif = (int32_t) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&_trace_ring.enq_pos, &pos, pos + 1,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			/* Full : never wait for the output*/
+			__atomic_fetch_add(&_trace_ring.dropped, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&_trace_ring.dropped_total, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&_trace_ring.enq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	memcpy(slot->str, str, len + 1);
+	slot->len = len;
+	slot->priority = priority;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	/* Publish the slot before reading deq_pos (pairs with the fence of*/
+	/* _lo_trace_drain) : otherwise both sides can miss the other's store and*/
+	/* the writer sleeps with a trace in the ring*/
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (pos == __atomic_load_n(&_trace_ring.deq_pos, __ATOMIC_ACQUIRE)) {
+		/* The ring was empty : wake up the writer*/
+		uint64_t one = 1;
+		if (write(_trace_ring.evt_fd, &one, sizeof(one)) < 0) {
+			/* Nothing to do : a wakeup is already pending*/
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Terminate the trace (truncated, '\n') and post it.*/
+static void _lo_trace_end(int priority, char *pt_str, char *end_str) {
+	uint32_t msg_size;
+
+	if (pt_str >= end_str) {
+		/* Truncated message*/
+		pt_str = end_str - 1;
+	}
+	/* Store the size of the biggest trace*/
+	msg_size = pt_str - _trace_str;
+	if (_trace_max_msg_size < msg_size) {
+		_trace_max_msg_size = msg_size;
+	}
+
+	if ((pt_str == _trace_str) || (*(pt_str - 1) != '\n'))
+		*pt_str++ = '\n';
+	*pt_str = 0;
+
+	_lo_trace_post(priority, _trace_str, pt_str - _trace_str);
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
 void lo_trace_init(int level) {
-	_trace_level_current = level;
+	lo_trace_level_current = level;
 
 #if SYSLOG
 	//TODO CHANGE THE NAME
 	openlog("main", LOG_CONS | LOG_PID | LOG_NDELAY, LOG_LOCAL1);
 #endif
+
+#if LOC_FEATURE_TRACE_ASYNC
+	_lo_trace_start();
+#endif
 }
+
 void lo_trace_level(int level) {
-	_trace_level_current = level;
+	lo_trace_level_current = level;
+}
+
+void lo_trace_flush(void) {
+#if LOC_FEATURE_TRACE_BINARY
+	lo_trace_bin_flush();
+#endif
+	if (_trace_ring.running && !pthread_equal(pthread_self(), _trace_ring.writer)) {
+		const struct timespec tmo = { 0, 1000000 };
+		uint32_t pos = __atomic_load_n(&_trace_ring.enq_pos, __ATOMIC_ACQUIRE);
+		/* Wait until the writer has written all the traces posted before*/
+		while ((int32_t) (__atomic_load_n(&_trace_ring.deq_pos, __ATOMIC_ACQUIRE) - pos) < 0)
+			nanosleep(&tmo, NULL);
+	}
+}
+
+uint32_t lo_trace_dropped(void) {
+	return __atomic_load_n(&_trace_ring.dropped_total, __ATOMIC_RELAXED);
 }
 
 void lo_trace(int level, const char *file, unsigned int line,
 		const char *function, char const *format, ...) {
 
 	if (level > 0) {
-#if SYSLOG
 		int priority = 0;
+#if SYSLOG
 		switch (level) {
 		case 1:
 			priority = LOG_ERR;
@@ -80,67 +392,33 @@ void lo_trace(int level, const char *file, unsigned int line,
 			break;
 		}
 #endif
-		va_list ap;
-		va_start(ap, format);
 		if (level > TACE_LEVELS_MAX)
 			level = TACE_LEVELS_MAX;
-		if (level <= _trace_level_current) {
-#if 0
-			struct tm timestamp;
-#endif
+		if (level <= lo_trace_level_current) {
+			va_list ap;
 			char *pt_str = _trace_str;
 			char *end_str = _trace_str + LOGP_MAX_MSG_SIZE;
 
-#ifdef LOGP_STACK_CHECK
-			char *end_buf = pt_str + sizeof(_trace_str);
-			char *pc = end_str;
-			while (pc < end_buf)
-				*pc++ = LOGP_MSG_TAG;
-#endif
-			*end_str = LOGP_MSG_TAG;
-
 			pt_str += snprintf(pt_str, end_str - pt_str, "%04u",
-					++_trace_index);
-
-#if 0
-			if (pt_str < end_str) {
-				/*Get timestamp*/
-				tb_getTime(&timestamp);
+					__atomic_add_fetch(&_trace_index, 1, __ATOMIC_RELAXED));
 
-				/*Convert timestamp into date string in YearDay-HH:MM:SS format*/
-				pt_str += tb_convertTimeToDateString(&timestamp, pt_str, end_str-pt_str);
-			}
-#endif
-
-#if 1
-			/*Add  milliseconds since the program started */
+			/*Add date and milliseconds*/
 			if (pt_str < end_str) {
-				char buffer[26];
-				int millisec;
-				struct tm *tm_info;
 				struct timeval tv;
 
 				gettimeofday(&tv, NULL);
 
-				millisec = lrint(tv.tv_usec / 1000.0); /* Round to nearest millisec*/
-				if (millisec >= 1000) { /* Allow for rounding up to nearest second*/
-					millisec -= 1000;
-					tv.tv_sec++;
+				/* localtime + strftime only once per second*/
+				if (tv.tv_sec != _trace_date_sec) {
+					struct tm tm_info;
+					localtime_r(&tv.tv_sec, &tm_info);
+					strftime(_trace_date, sizeof(_trace_date),
+							"%Y-%m-%d %H:%M:%S", &tm_info);
+					_trace_date_sec = tv.tv_sec;
 				}
-
-				tm_info = localtime(&tv.tv_sec);
-
-				strftime(buffer, 26, "%Y-%m-%d %H:%M:%S", tm_info);
-				pt_str += snprintf(pt_str, end_str - pt_str, ":%s.%03d", buffer,
-						millisec);
-			}
-#endif
-#if 0
-			/* And add Task Id (tid)*/
-			if (pt_str < end_str) {
-				pt_str += snprintf(pt_str, end_str-pt_str, ":t%02d", os_tsk_self());
+				pt_str += snprintf(pt_str, end_str - pt_str, ":%s.%03d",
+						_trace_date, (int) (tv.tv_usec / 1000));
 			}
-#endif
 
 			/*Add debug level to log*/
 			if (pt_str < end_str)
@@ -165,95 +443,30 @@ void lo_trace(int level, const char *file, unsigned int line,
 
 			if (pt_str < end_str) {
 				/* add user data*/
+				va_start(ap, format);
 				pt_str += vsnprintf(pt_str, end_str - pt_str, format, ap);
-				/* Store the size of the biggest trace*/
-				uint32_t msg_size = pt_str - _trace_str;
-				if (_trace_max_msg_size < msg_size) {
-					_trace_max_msg_size = msg_size;
-				}
-			}
-
-			if (pt_str >= end_str) {
-				/* Truncated message*/
-				pt_str = end_str - 1;
-#ifdef LOGP_STACK_CHECK
-				if (*pt_str) {
-					/* LogBug(0);*/
-				}
-				pc = end_str;
-				while (pc < end_buf) {
-					if (*pc != LOGP_MSG_TAG) {
-						/* LogBug(1);*/
-					}
-					pc++;
-				}
-#endif
-				*pt_str = 0;
-			}
-
-			if (*end_str != LOGP_MSG_TAG) {
-#if 0
-				fprintf(stderr, "\nLogRecord: Corrupted stack end_ptr=%p 0x%X != 0x%X", end_str, *end_str, LOGP_MSG_TAG);
-#endif
-				/* CATCH_SOFT_EXCEPTION(EXCEPTION_CODE_LOG_OVERLOAD); // Don't LOG
-				 * Macro*/
-				/* because it calls  LOG_... function !!*/
 				va_end(ap);
-				return;
-			}
-
-			if (*(pt_str - 1) != '\n') {
-				*pt_str++ = '\n';
-				*pt_str = 0;
-			} else if ((*(pt_str) != 0)) {
-				*pt_str = 0;
 			}
 
-#if SYSLOG
-			syslog(priority, _trace_str);
-#else
-			printf("%s\n", _trace_str);
-#endif
-
+			_lo_trace_end(priority, pt_str, end_str);
 		}
 	}
 }
 
 void lo_trace_printf(char const *format, ...) {
 	va_list ap;
-	va_start(ap, format);
-
 	char *pt_str = _trace_str;
 	char *end_str = _trace_str + LOGP_MAX_MSG_SIZE;
+	int priority = 0;
 
-	*end_str = LOGP_MSG_TAG;
+#if SYSLOG
+	priority = LOG_NOTICE;
+#endif
 
 	/* add user data*/
+	va_start(ap, format);
 	pt_str += vsnprintf(pt_str, end_str - pt_str, format, ap);
-	/* Store the size of the biggest trace*/
-	uint32_t msg_size = pt_str - _trace_str;
-	if (_trace_max_msg_size < msg_size) {
-		_trace_max_msg_size = msg_size;
-	}
-	if (pt_str >= end_str) {
-		/* Truncated message*/
-		pt_str = end_str - 1;
-		*pt_str = 0;
-	}
-
-	if (*end_str != LOGP_MSG_TAG) {
-#if 0
-		fprintf(stderr, "\nLogRecord: Corrupted stack end_ptr=%p 0x%X != 0x%X", end_str, *end_str, LOGP_MSG_TAG);
-#endif
-		/* CATCH_SOFT_EXCEPTION(EXCEPTION_CODE_LOG_OVERLOAD); Don't LOG Macro
-		 because it calls  LOG_... function !!*/
-		va_end(ap);
-		return;
-	}
-#if SYSLOG
-	syslog(LOG_NOTICE, _trace_str);
-#else
-	printf("%s\n", _trace_str);
-#endif
+	va_end(ap);
 
+	_lo_trace_end(priority, pt_str, end_str);
 }
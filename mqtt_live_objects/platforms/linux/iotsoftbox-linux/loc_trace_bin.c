@@ -0,0 +1,435 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file loc_trace_bin.c
+ * @brief Binary (deferred format) traces.
+ *
+ * Enabled with LOC_FEATURE_TRACE_BINARY. A trace is recorded as the identifier
+ * of its format string and its raw arguments, in a buffer of the calling
+ * thread. The buffer is written into LOC_TRACE_BIN_FILE when it is full, on
+ * error traces, on lo_trace_flush() and when the thread exits.
+ * The format string is parsed only once, when the call site is registered :
+ * a dictionary record (identifier, level, file, line, function, format) is
+ * then written into the file.
+ *
+ * Use script/lo_trace_decode.py to convert the file into text.
+ *
+ * The file is appended by each run, and shared with the forked processes : the
+ * identifiers are only valid in the process which registered them. So every
+ * write starts with the pid of the writer, and a run record is written when a
+ * process opens the file or is forked (the child inherits the dictionary of its
+ * parent).
+ *
+ * File format (native byte order, see LOTB_ENDIAN_TAG) :
+ *  - header : "LOTB", u8 version, u8 0, u16 LOTB_ENDIAN_TAG
+ *  - pid : u8 LOTB_REC_PID, u32 pid, at the start of each write : the next
+ *          records belong to this process
+ *  - run : u8 LOTB_REC_RUN, u32 pid, u32 parent pid (0 when the file is
+ *          opened), u64 time (us)
+ *  - dictionary : u8 LOTB_REC_DICT, u16 id, u8 level, u32 line, u8 nargs,
+ *                 nargs x char arg type, then file, function and format
+ *                 strings (u16 length + bytes)
+ *  - event : u8 LOTB_REC_EVENT, u16 id, u32 index, u64 time (us), then the
+ *            arguments : 'i' int32, 'l' int64, 'd' or 'D' double, 'p' u64,
+ *            's' u16 length + bytes
+ */
+
+#include "liveobjects-sys/loc_trace.h"
+
+#if LOC_FEATURE_TRACE_BINARY
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOTB_VERSION         2
+#define LOTB_ENDIAN_TAG      0x0102
+#define LOTB_REC_DICT        0x01
+#define LOTB_REC_EVENT       0x02
+#define LOTB_REC_RUN         0x03
+#define LOTB_REC_PID         0x04
+
+/* Maximum number of bytes recorded for a string argument*/
+#define LOTB_STR_MAX         64
+
+/* Size of the per thread buffer*/
+#ifndef LOC_TRACE_BIN_BUF_SZ
+#define LOC_TRACE_BIN_BUF_SZ 4096
+#endif
+
+/* Maximum size of an event record*/
+#define LOTB_EVENT_MAX       (1 + 2 + 4 + 8 + 15 * (2 + LOTB_STR_MAX))
+
+typedef char _lotb_buf_size_check[(LOC_TRACE_BIN_BUF_SZ > LOTB_EVENT_MAX) ? 1 : -1];
+
+static int _lotb_fd = -1;
+static uint32_t _lotb_pid = 0;
+static uint16_t _lotb_id_last = 0;
+static uint32_t _lotb_index = 0;
+static pthread_mutex_t _lotb_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t _lotb_once = PTHREAD_ONCE_INIT;
+static pthread_key_t _lotb_key;
+
+static __thread struct {
+	uint8_t started;
+	uint32_t len;
+	uint8_t buf[LOC_TRACE_BIN_BUF_SZ];
+} _lotb;
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+
+/* Write records, after the pid of the writer (one writev : O_APPEND, the*/
+/* records of several threads or processes are not mixed)*/
+static void _lotb_write(const uint8_t *buf, uint32_t len) {
+	uint8_t pid[1 + 4] = { LOTB_REC_PID };
+	struct iovec iov[2];
+	int iov_nb = 2;
+
+	memcpy(&pid[1], &_lotb_pid, sizeof(_lotb_pid));
+	iov[0].iov_base = pid;
+	iov[0].iov_len = sizeof(pid);
+	iov[1].iov_base = (void *) buf;
+	iov[1].iov_len = len;
+
+	while ((iov_nb > 0) && (_lotb_fd >= 0)) {
+		ssize_t ret = writev(_lotb_fd, &iov[2 - iov_nb], iov_nb);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		/* Partial write*/
+		while ((iov_nb > 0) && (ret >= (ssize_t) iov[2 - iov_nb].iov_len)) {
+			ret -= iov[2 - iov_nb].iov_len;
+			iov_nb--;
+		}
+		if (iov_nb > 0) {
+			iov[2 - iov_nb].iov_base = (uint8_t *) iov[2 - iov_nb].iov_base + ret;
+			iov[2 - iov_nb].iov_len -= ret;
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Start of the records of this process (ppid : parent after a fork)*/
+static void _lotb_run(uint32_t ppid) {
+	uint8_t rec[1 + 4 + 4 + 8] = { LOTB_REC_RUN };
+	struct timespec ts;
+	uint64_t t_us;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	t_us = (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	memcpy(&rec[1], &_lotb_pid, sizeof(_lotb_pid));
+	memcpy(&rec[5], &ppid, sizeof(ppid));
+	memcpy(&rec[9], &t_us, sizeof(t_us));
+	_lotb_write(rec, sizeof(rec));
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _lotb_flush(void) {
+	if (_lotb.len) {
+		_lotb_write(_lotb.buf, _lotb.len);
+		_lotb.len = 0;
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Called when a thread exits*/
+static void _lotb_thread_exit(void *arg) {
+	_lotb_flush();
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _lotb_exit(void) {
+	_lotb_flush();
+}
+
+/*---------------------------------------------------------------------------------*/
+/* fork() : the events of the calling thread are written by the parent only, and*/
+/* no registration is in progress*/
+static void _lotb_atfork_prepare(void) {
+	pthread_mutex_lock(&_lotb_mutex);
+	_lotb_flush();
+}
+
+static void _lotb_atfork_parent(void) {
+	pthread_mutex_unlock(&_lotb_mutex);
+}
+
+static void _lotb_atfork_child(void) {
+	uint32_t ppid = _lotb_pid;
+	_lotb_pid = (uint32_t) getpid();
+	pthread_mutex_unlock(&_lotb_mutex);
+	_lotb_run(ppid);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _lotb_open(void) {
+	pthread_key_create(&_lotb_key, _lotb_thread_exit);
+	atexit(_lotb_exit);
+	pthread_atfork(_lotb_atfork_prepare, _lotb_atfork_parent, _lotb_atfork_child);
+
+	_lotb_pid = (uint32_t) getpid();
+	_lotb_fd = open(LOC_TRACE_BIN_FILE, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (_lotb_fd < 0)
+		return;
+	if (lseek(_lotb_fd, 0, SEEK_END) == 0) {
+		uint8_t hdr[8] = { 'L', 'O', 'T', 'B', LOTB_VERSION, 0 };
+		uint16_t tag = LOTB_ENDIAN_TAG;
+		memcpy(&hdr[6], &tag, sizeof(tag));
+		if (write(_lotb_fd, hdr, sizeof(hdr)) != sizeof(hdr)) {
+			close(_lotb_fd);
+			_lotb_fd = -1;
+			return;
+		}
+	}
+	_lotb_run(0);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static uint8_t * _lotb_put_str(uint8_t *pc, const char *str, uint16_t max) {
+	uint16_t len;
+	if (str == NULL)
+		str = "(null)";
+	len = strnlen(str, max);
+	memcpy(pc, &len, sizeof(len));
+	memcpy(pc + sizeof(len), str, len);
+	return pc + sizeof(len) + len;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Get the type of each argument of a printf format.*/
+static uint8_t _lotb_parse(const char *format, char *args, uint8_t max) {
+	uint8_t nb = 0;
+	const char *pc = format;
+
+#define LOTB_ADD_ARG(t)   do { if (nb < max) args[nb++] = (t); } while (0)
+
+	while (*pc) {
+		int lng = 0;
+		if (*pc++ != '%')
+			continue;
+		if (*pc == '%') {
+			pc++;
+			continue;
+		}
+		while ((*pc) && strchr("-+ #0'", *pc))
+			pc++;
+		if (*pc == '*') {
+			LOTB_ADD_ARG('i');
+			pc++;
+		}
+		while ((*pc >= '0') && (*pc <= '9'))
+			pc++;
+		if (*pc == '.') {
+			pc++;
+			if (*pc == '*') {
+				LOTB_ADD_ARG('i');
+				pc++;
+			}
+			while ((*pc >= '0') && (*pc <= '9'))
+				pc++;
+		}
+		/* Length modifier : size in bytes of an integer argument*/
+		while ((*pc) && strchr("hlLqjzt", *pc)) {
+			switch (*pc) {
+			case 'l':
+				lng = (lng == 0) ? sizeof(long) : sizeof(long long);
+				break;
+			case 'L':
+				lng = sizeof(long double);
+				break;
+			case 'q':
+			case 'j':
+				lng = sizeof(long long);
+				break;
+			case 'z':
+			case 't':
+				lng = sizeof(size_t);
+				break;
+			}
+			pc++;
+		}
+		switch (*pc) {
+		case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+			LOTB_ADD_ARG((lng == 8) ? 'l' : 'i');
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			LOTB_ADD_ARG((lng == sizeof(long double)) ? 'D' : 'd');
+			break;
+		case 's':
+			LOTB_ADD_ARG('s');
+			break;
+		case 'p':
+		case 'n':
+			LOTB_ADD_ARG('p');
+			break;
+		case 0:
+			return nb;
+		}
+		pc++;
+	}
+#undef LOTB_ADD_ARG
+	return nb;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Assign an identifier to a call site, and write its dictionary record.*/
+static void _lotb_register(lo_trace_fmt_t *fmt_ptr, int level, const char *file,
+		unsigned int line, const char *function, const char *format) {
+	uint8_t rec[1 + 2 + 1 + 4 + 1 + sizeof(fmt_ptr->args) + 3 * 2 + 2 * 255 + 1024];
+	uint8_t *pc = rec;
+	const char *name;
+	uint32_t line32 = line;
+	uint16_t id;
+
+	pthread_mutex_lock(&_lotb_mutex);
+	if (fmt_ptr->id == 0) {
+		fmt_ptr->nargs = _lotb_parse(format, fmt_ptr->args, sizeof(fmt_ptr->args));
+		id = ++_lotb_id_last;
+
+		name = strrchr(file, '/');
+		name = (name) ? name + 1 : file;
+
+		*pc++ = LOTB_REC_DICT;
+		memcpy(pc, &id, sizeof(id));
+		pc += sizeof(id);
+		*pc++ = (uint8_t) level;
+		memcpy(pc, &line32, sizeof(line32));
+		pc += sizeof(line32);
+		*pc++ = fmt_ptr->nargs;
+		memcpy(pc, fmt_ptr->args, fmt_ptr->nargs);
+		pc += fmt_ptr->nargs;
+		pc = _lotb_put_str(pc, name, 255);
+		pc = _lotb_put_str(pc, function, 255);
+		pc = _lotb_put_str(pc, format, 1024);
+		_lotb_write(rec, pc - rec);
+
+		__atomic_store_n(&fmt_ptr->id, id, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&_lotb_mutex);
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+void lo_trace_bin(lo_trace_fmt_t *fmt_ptr, int level, const char *file,
+		unsigned int line, const char *function, char const *format, ...) {
+	struct timespec ts;
+	uint8_t *pc;
+	uint16_t id;
+	uint32_t index;
+	uint64_t t_us;
+	va_list ap;
+	int i;
+
+	pthread_once(&_lotb_once, _lotb_open);
+	if (_lotb_fd < 0)
+		return;
+
+	if (!_lotb.started) {
+		/* To flush the buffer when the thread exits*/
+		pthread_setspecific(_lotb_key, &_lotb);
+		_lotb.started = 1;
+	}
+
+	id = __atomic_load_n(&fmt_ptr->id, __ATOMIC_ACQUIRE);
+	if (id == 0) {
+		_lotb_register(fmt_ptr, level, file, line, function, format);
+		id = fmt_ptr->id;
+	}
+
+	if ((_lotb.len + LOTB_EVENT_MAX) > sizeof(_lotb.buf))
+		_lotb_flush();
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	t_us = (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	index = __atomic_add_fetch(&_lotb_index, 1, __ATOMIC_RELAXED);
+
+	pc = &_lotb.buf[_lotb.len];
+	*pc++ = LOTB_REC_EVENT;
+	memcpy(pc, &id, sizeof(id));
+	pc += sizeof(id);
+	memcpy(pc, &index, sizeof(index));
+	pc += sizeof(index);
+	memcpy(pc, &t_us, sizeof(t_us));
+	pc += sizeof(t_us);
+
+	va_start(ap, format);
+	for (i = 0; i < fmt_ptr->nargs; i++) {
+		switch (fmt_ptr->args[i]) {
+		case 'i': {
+			int32_t v = va_arg(ap, int);
+			memcpy(pc, &v, sizeof(v));
+			pc += sizeof(v);
+			break;
+		}
+		case 'l': {
+			int64_t v = va_arg(ap, long long);
+			memcpy(pc, &v, sizeof(v));
+			pc += sizeof(v);
+			break;
+		}
+		case 'd': {
+			double v = va_arg(ap, double);
+			memcpy(pc, &v, sizeof(v));
+			pc += sizeof(v);
+			break;
+		}
+		case 'D': {
+			/* long double : recorded as a double*/
+			double v = (double) va_arg(ap, long double);
+			memcpy(pc, &v, sizeof(v));
+			pc += sizeof(v);
+			break;
+		}
+		case 'p': {
+			uint64_t v = (uintptr_t) va_arg(ap, void *);
+			memcpy(pc, &v, sizeof(v));
+			pc += sizeof(v);
+			break;
+		}
+		case 's':
+			pc = _lotb_put_str(pc, va_arg(ap, const char *), LOTB_STR_MAX);
+			break;
+		}
+	}
+	va_end(ap);
+
+	_lotb.len = pc - _lotb.buf;
+
+	/* Don't lose the errors if the process crashes*/
+	if (level <= 1)
+		_lotb_flush();
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void lo_trace_bin_flush(void) {
+	if (_lotb_fd >= 0)
+		_lotb_flush();
+}
+
+#endif /* LOC_FEATURE_TRACE_BINARY */
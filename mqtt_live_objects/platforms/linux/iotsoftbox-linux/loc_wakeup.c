@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_wakeup.c
+ * @brief Wake up the LiveObjects client loop (eventfd + poll).
+ */
+
+#include "liveobjects-sys/loc_wakeup.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "liveobjects-sys/loc_trace.h"
+
+static int _lo_wakeup_fd = -1;
+
+/* Only used by the client loop thread*/
+static int _lo_wakeup_armed = 1;
+
+/* Identifier of the client loop thread (the last one in LO_wakeup_wait), 0 :*/
+/* none. Atomic : read by the other threads*/
+static uint32_t _lo_wakeup_owner = 0;
+static uint32_t _lo_wakeup_ids = 0;
+static __thread uint32_t _lo_wakeup_id = 0;
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+/* Identifier of the calling thread (never 0).*/
+static uint32_t _LO_wakeup_self(void) {
+	if (_lo_wakeup_id == 0)
+		_lo_wakeup_id = __atomic_add_fetch(&_lo_wakeup_ids, 1, __ATOMIC_RELAXED);
+	return _lo_wakeup_id;
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+int LO_wakeup_init(void) {
+	if (_lo_wakeup_fd >= 0)
+		return 0;
+
+	_lo_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (_lo_wakeup_fd < 0) {
+		LOTRACE_ERR("LO_wakeup_init: eventfd ERROR (errno=%d)", errno);
+		return -1;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_wakeup_close(void) {
+	if (_lo_wakeup_fd >= 0)
+		close(_lo_wakeup_fd);
+	_lo_wakeup_fd = -1;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_wakeup_arm(void) {
+	_lo_wakeup_armed = 1;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_wakeup_signal(void) {
+	uint64_t one = 1;
+	/* The loop thread does not wait while it signals (push in a callback, ...)*/
+	if (__atomic_load_n(&_lo_wakeup_owner, __ATOMIC_RELAXED) == _LO_wakeup_self())
+		return;
+	if (_lo_wakeup_fd >= 0) {
+		/* EAGAIN only if the counter overflows: a wakeup is already pending*/
+		if (write(_lo_wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+			LOTRACE_ERR("LO_wakeup_signal: ERROR (errno=%d)", errno);
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_wakeup_wait(int sock_fd, uint32_t timeout_ms) {
+	struct pollfd fds[2];
+	nfds_t nfds = 0;
+	int idx_sock = -1;
+	int idx_evt = -1;
+	int ret;
+
+	__atomic_store_n(&_lo_wakeup_owner, _LO_wakeup_self(), __ATOMIC_RELAXED);
+
+	/* Not armed : a packet may be in progress, only the socket can end the*/
+	/* wait. If no byte comes within LOC_WAKEUP_IDLE_MS, the peer is not sending*/
+	/* a packet : the loop is idle, armed again for the rest of the timeout*/
+	if ((!_lo_wakeup_armed) && (sock_fd >= 0) && (_lo_wakeup_fd >= 0)) {
+		uint32_t tmo = (timeout_ms < LOC_WAKEUP_IDLE_MS) ? timeout_ms : LOC_WAKEUP_IDLE_MS;
+		fds[0].fd = sock_fd;
+		fds[0].events = POLLIN;
+		ret = poll(fds, 1, (int) tmo);
+		if (ret > 0)
+			return LO_WAKEUP_SOCKET;
+		if ((ret < 0) || (tmo == timeout_ms)) {
+			if (ret == 0)
+				_lo_wakeup_armed = 1;
+			return ret;
+		}
+		_lo_wakeup_armed = 1;
+		if (timeout_ms != LO_WAKEUP_TMO_INFINITE)
+			timeout_ms -= tmo;
+	}
+
+	if (sock_fd >= 0) {
+		fds[nfds].fd = sock_fd;
+		fds[nfds].events = POLLIN;
+		idx_sock = nfds++;
+	}
+	if ((_lo_wakeup_fd >= 0) && (_lo_wakeup_armed)) {
+		fds[nfds].fd = _lo_wakeup_fd;
+		fds[nfds].events = POLLIN;
+		idx_evt = nfds++;
+	}
+
+	ret = poll(fds, nfds,
+			(timeout_ms == LO_WAKEUP_TMO_INFINITE) ? -1 : (int) timeout_ms);
+	if (ret <= 0) {
+		/* Timeout : nothing is being read, the loop is idle again*/
+		if (ret == 0)
+			_lo_wakeup_armed = 1;
+		return ret;
+	}
+
+	ret = 0;
+	if ((idx_sock >= 0) && (fds[idx_sock].revents)) {
+		/* POLLHUP/POLLERR are reported as readable : recv() gives the error.*/
+		/* A packet may be in progress : the pending signals are kept until*/
+		/* the loop is idle again.*/
+		_lo_wakeup_armed = 0;
+		return LO_WAKEUP_SOCKET;
+	}
+	if ((idx_evt >= 0) && (fds[idx_evt].revents & POLLIN)) {
+		uint64_t cnt;
+		/* Consume all the pending signals at once*/
+		if (read(_lo_wakeup_fd, &cnt, sizeof(cnt)) > 0)
+			ret |= LO_WAKEUP_EVENT;
+	}
+	return ret;
+}
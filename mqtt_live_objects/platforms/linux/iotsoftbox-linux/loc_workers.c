@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_workers.c
+ * @brief Worker pool running the command and parameter callbacks.
+ */
+
+#include "liveobjects-sys/loc_workers.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liveobjects-sys/loc_nameidx.h"
+#include "liveobjects-sys/loc_trace.h"
+
+typedef struct {
+	uint8_t type;                   /* LO_PUBQ_REQ_CMD_RSP or LO_PUBQ_REQ_PARAM_RSP*/
+	union {
+		struct {
+			LO_workers_cmdHandler_t handler;
+			LiveObjectsD_CommandRequestBlock_t blk;
+		} cmd;
+		struct {
+			LO_workers_paramHandler_t handler;
+			const LiveObjectsD_Param_t *param_ptr;
+			int len;
+		} param;
+	} u;
+	char data[] __attribute__((aligned(8)));   /* Copy of the strings / value*/
+} LO_workers_job_t;
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint8_t running;
+	uint8_t nb;
+	pthread_t threads[LOC_WORKERS_MAX];
+	uint32_t head;
+	uint32_t count;
+	LO_workers_job_t *jobs[LOC_WORKERS_QUEUE_SIZE];
+	LO_pubq_handler_t responder;
+	const LO_workers_cmd_t *cmd_table;
+	LO_nameidx_t *cmd_idx;
+} _lo_workers = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+/*=================================================================================*/
+/* Private Functions*/
+/*---------------------------------------------------------------------------------*/
+
+static int _LO_workers_post(int16_t hdl, int32_t val, uint8_t type, void *ctx) {
+	LO_pubq_req_t req;
+	req.req_type = type;
+	req.req_hdl = hdl;
+	req.req_val = val;
+	req.req_ctx = ctx;
+	if (LO_pubq_push(&req) < 0) {
+		LOTRACE_ERR("LO_workers: response type %u (hdl %d) lost, publish queue full", type, hdl);
+		return -1;
+	}
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void _LO_workers_run(LO_workers_job_t *job) {
+	int ret;
+
+	if (job->type == LO_PUBQ_REQ_CMD_RSP) {
+		int16_t cid = job->u.cmd.blk.hd.cmd_cid;
+		ret = job->u.cmd.handler(&job->u.cmd.blk);
+		if (ret != 0)
+			LO_workers_complete(cid, ret);
+	} else {
+		ret = job->u.param.handler(job->u.param.param_ptr, job->data, job->u.param.len);
+		_LO_workers_post(0, ret, LO_PUBQ_REQ_PARAM_RSP, (void *) job->u.param.param_ptr);
+	}
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static void *_LO_workers_thread(void *arg) {
+	pthread_mutex_lock(&_lo_workers.mutex);
+	while (1) {
+		LO_workers_job_t *job;
+
+		while ((_lo_workers.running) && (_lo_workers.count == 0))
+			pthread_cond_wait(&_lo_workers.cond, &_lo_workers.mutex);
+		if (!_lo_workers.running)
+			break;
+
+		job = _lo_workers.jobs[_lo_workers.head];
+		_lo_workers.head = (_lo_workers.head + 1) % LOC_WORKERS_QUEUE_SIZE;
+		_lo_workers.count--;
+		pthread_mutex_unlock(&_lo_workers.mutex);
+
+		_LO_workers_run(job);
+		free(job);
+
+		pthread_mutex_lock(&_lo_workers.mutex);
+	}
+	pthread_mutex_unlock(&_lo_workers.mutex);
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+static int _LO_workers_queue(LO_workers_job_t *job) {
+	pthread_mutex_lock(&_lo_workers.mutex);
+	if ((!_lo_workers.running) || (_lo_workers.count >= LOC_WORKERS_QUEUE_SIZE)) {
+		pthread_mutex_unlock(&_lo_workers.mutex);
+		LOTRACE_ERR("LO_workers: request refused (%s)", (_lo_workers.running) ? "busy" : "not started");
+		free(job);
+		return -1;
+	}
+	_lo_workers.jobs[(_lo_workers.head + _lo_workers.count) % LOC_WORKERS_QUEUE_SIZE] = job;
+	_lo_workers.count++;
+	pthread_cond_signal(&_lo_workers.cond);
+	pthread_mutex_unlock(&_lo_workers.mutex);
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+/* Copy a string into the job data.*/
+static const char * _LO_workers_strCopy(char **pc, const char *str) {
+	const char *copy = *pc;
+	size_t len;
+	if (str == NULL)
+		return NULL;
+	len = strlen(str) + 1;
+	memcpy(*pc, str, len);
+	*pc += len;
+	return copy;
+}
+
+/*=================================================================================*/
+/* Public Functions*/
+/*---------------------------------------------------------------------------------*/
+
+int LO_workers_start(uint8_t nb) {
+	uint8_t i;
+
+	if ((nb == 0) || (nb > LOC_WORKERS_MAX))
+		return -1;
+
+	pthread_mutex_lock(&_lo_workers.mutex);
+	if (_lo_workers.running) {
+		pthread_mutex_unlock(&_lo_workers.mutex);
+		return -1;
+	}
+	_lo_workers.running = 1;
+	_lo_workers.head = 0;
+	_lo_workers.count = 0;
+	for (i = 0; i < nb; i++) {
+		if (pthread_create(&_lo_workers.threads[i], NULL, _LO_workers_thread, NULL))
+			break;
+	}
+	_lo_workers.nb = i;
+	pthread_mutex_unlock(&_lo_workers.mutex);
+
+	if (i < nb) {
+		LOTRACE_ERR("LO_workers_start: only %u/%u threads created", i, nb);
+		LO_workers_stop();
+		return -1;
+	}
+	LOTRACE_INF("LO_workers_start: %u threads", nb);
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_workers_stop(void) {
+	uint8_t i, nb;
+
+	pthread_mutex_lock(&_lo_workers.mutex);
+	_lo_workers.running = 0;
+	nb = _lo_workers.nb;
+	_lo_workers.nb = 0;
+	pthread_cond_broadcast(&_lo_workers.cond);
+	pthread_mutex_unlock(&_lo_workers.mutex);
+
+	for (i = 0; i < nb; i++)
+		pthread_join(_lo_workers.threads[i], NULL);
+
+	pthread_mutex_lock(&_lo_workers.mutex);
+	while (_lo_workers.count) {
+		free(_lo_workers.jobs[_lo_workers.head]);
+		_lo_workers.head = (_lo_workers.head + 1) % LOC_WORKERS_QUEUE_SIZE;
+		_lo_workers.count--;
+	}
+	pthread_mutex_unlock(&_lo_workers.mutex);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_workers_setResponder(LO_pubq_handler_t responder) {
+	_lo_workers.responder = responder;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+void LO_workers_respond(const LO_pubq_req_t *req_ptr) {
+	if (_lo_workers.responder)
+		_lo_workers.responder(req_ptr);
+	else
+		LOTRACE_WARN("LO_workers: response type %u (hdl %d, result %d) without responder",
+				req_ptr->req_type, req_ptr->req_hdl, req_ptr->req_val);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_workers_command(const LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk, LO_workers_cmdHandler_t handler) {
+	LO_workers_job_t *job;
+	size_t sz = 0;
+	char *pc;
+	uint8_t i, nb;
+
+	if ((pCmdReqBlk == NULL) || (handler == NULL))
+		return -1;
+	nb = pCmdReqBlk->hd.cmd_args_nb;
+	if (nb > sizeof(pCmdReqBlk->args_array) / sizeof(pCmdReqBlk->args_array[0]))
+		return -1;
+
+	for (i = 0; i < nb; i++) {
+		const LiveObjectsD_CommandArg_t *arg = &pCmdReqBlk->args_array[i];
+		sz += (arg->arg_name) ? strlen(arg->arg_name) + 1 : 0;
+		sz += (arg->arg_value) ? strlen(arg->arg_value) + 1 : 0;
+	}
+	job = (LO_workers_job_t *) malloc(sizeof(LO_workers_job_t) + sz);
+	if (job == NULL)
+		return -1;
+
+	job->type = LO_PUBQ_REQ_CMD_RSP;
+	job->u.cmd.handler = handler;
+	job->u.cmd.blk = *pCmdReqBlk;
+	pc = job->data;
+	for (i = 0; i < nb; i++) {
+		LiveObjectsD_CommandArg_t *arg = &job->u.cmd.blk.args_array[i];
+		arg->arg_name = _LO_workers_strCopy(&pc, arg->arg_name);
+		arg->arg_value = _LO_workers_strCopy(&pc, arg->arg_value);
+	}
+	return _LO_workers_queue(job);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_workers_setCommands(const LO_workers_cmd_t *table, uint32_t nb) {
+	LO_nameidx_t *idx = NULL;
+
+	if ((table) && (nb)) {
+		idx = LO_nameidx_create(table, nb, sizeof(LO_workers_cmd_t), offsetof(LO_workers_cmd_t, cmd_name));
+		if (idx == NULL)
+			return -1;
+	}
+	LO_nameidx_destroy(_lo_workers.cmd_idx);
+	_lo_workers.cmd_idx = idx;
+	_lo_workers.cmd_table = table;
+	return 0;
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_workers_dispatch(LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk) {
+	const char *name;
+	int32_t pos = -1;
+
+	if ((pCmdReqBlk == NULL) || (pCmdReqBlk->hd.cmd_ptr == NULL))
+		return -1;
+	name = pCmdReqBlk->hd.cmd_ptr->cmd_name;
+	if ((_lo_workers.cmd_idx) && (name))
+		pos = LO_nameidx_find(_lo_workers.cmd_idx, name, strlen(name));
+	if (pos < 0) {
+		LOTRACE_ERR("LO_workers_dispatch: no handler for the command '%s'", (name) ? name : "");
+		return -4;
+	}
+	return LO_workers_command(pCmdReqBlk, _lo_workers.cmd_table[pos].handler);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_workers_param(const LiveObjectsD_Param_t *param_ptr, const void *value, int len,
+		LO_workers_paramHandler_t check, LO_workers_paramHandler_t apply) {
+	LO_workers_job_t *job;
+	int ret;
+
+	if ((param_ptr == NULL) || (apply == NULL) || (len < 0) || ((value == NULL) && (len)))
+		return -1;
+	/* Refused before the client sets the parameter*/
+	if ((check) && ((ret = check(param_ptr, value, len)) != 0))
+		return ret;
+	/* + 1 : strings are null terminated*/
+	job = (LO_workers_job_t *) malloc(sizeof(LO_workers_job_t) + len + 1);
+	if (job == NULL)
+		return -1;
+
+	job->type = LO_PUBQ_REQ_PARAM_RSP;
+	job->u.param.handler = apply;
+	job->u.param.param_ptr = param_ptr;
+	job->u.param.len = len;
+	if (len)
+		memcpy(job->data, value, len);
+	job->data[len] = 0;
+	return _LO_workers_queue(job);
+}
+
+/*---------------------------------------------------------------------------------*/
+
+int LO_workers_complete(int16_t cid, int result) {
+	if (cid == 0)
+		return -1;
+	return _LO_workers_post(cid, result, LO_PUBQ_REQ_CMD_RSP, NULL);
+}
@@ -33,6 +33,7 @@
 #include "liveobjects-sys/LiveObjectsClient_Platform.h"
 #include "liveobjects-sys/MQTTLinux.h"
 #include "liveobjects-sys/loc_trace.h"
+#include "liveobjects-sys/loc_wakeup.h"
 
 #include "mbedtls/net_sockets.h"
 #include "mbedtls/ssl.h"
@@ -136,8 +137,6 @@ int f_netw_sock_recv(void *pNetwork, unsigned char *buf, size_t len) {
 int f_netw_sock_recv_timeout(void *pNetwork, unsigned char *buf, size_t len,
 		uint32_t timeout) {
 	int ret;
-	struct timeval tv;
-	fd_set read_fds;
 
 	LOTRACE_DBG_VERBOSE("(pNetwork=%p _netw_socket=%d buf=%p len=%d tmo=%u)...",
 			pNetwork, _netw_socket, buf, len, timeout);
@@ -147,16 +146,8 @@ int f_netw_sock_recv_timeout(void *pNetwork, unsigned char *buf, size_t len,
 		return (MBEDTLS_ERR_NET_INVALID_CONTEXT);
 	}
 
-	FD_ZERO(&read_fds);
-	FD_SET(_netw_socket, &read_fds);
-
-	tv.tv_sec = timeout / 1000;
-	tv.tv_usec = (timeout % 1000) * 1000;
-
-	struct timeval tv_const = tv;
-
-	ret = select(_netw_socket + 1, &read_fds, NULL, NULL,
-			timeout == ((uint32_t) -1) ? NULL : &tv_const);
+	/* Block on the socket, the wakeup event and the timeout (next deadline)*/
+	ret = LO_wakeup_wait(_netw_socket, timeout);
 	/* Zero fds ready means we timed out */
 	if (ret == 0) {
 		LOTRACE_DBG_VERBOSE("TIMEOUT (sock=%d len=%d tmo=%u) => x%x!",
@@ -166,15 +157,25 @@ int f_netw_sock_recv_timeout(void *pNetwork, unsigned char *buf, size_t len,
 
 	if (ret < 0) {
 		if (errno == EINTR) {
-			LOTRACE_WARN("SELECT INTERRUPT (sock=%d tmo=%u) %d !", _netw_socket,
+			LOTRACE_WARN("POLL INTERRUPT (sock=%d tmo=%u) %d !", _netw_socket,
 					timeout, ret);
 			return (MBEDTLS_ERR_SSL_WANT_READ);
 		}
-		LOTRACE_WARN("SELECT ERR (sock=%d tmo=%u) %d !", _netw_socket, timeout,
+		LOTRACE_WARN("POLL ERR (sock=%d tmo=%u) %d !", _netw_socket, timeout,
 				ret);
 		return (MBEDTLS_ERR_NET_RECV_FAILED);
 	}
 
+	if (!(ret & LO_WAKEUP_SOCKET)) {
+		/* Woken up by another thread (data pushed, ...) while idle in the*/
+		/* top-level wait (never in the middle of a packet, see LO_wakeup_arm) :*/
+		/* give the hand back to the LiveObjects client loop as if the timeout*/
+		/* was reached*/
+		LOTRACE_DBG_VERBOSE("WAKEUP (sock=%d len=%d tmo=%u) => x%x!",
+				_netw_socket, len, timeout, MBEDTLS_ERR_SSL_TIMEOUT);
+		return (MBEDTLS_ERR_SSL_TIMEOUT);
+	}
+
 	/* This call will not block */
 	return (f_netw_sock_recv(pNetwork, buf, len));
 }
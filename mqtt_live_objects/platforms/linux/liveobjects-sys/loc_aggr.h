@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_aggr.h
+ * @brief Windowed aggregation of a set of data.
+ *
+ * Each LO_aggr_add() adds the current values of the numeric fields of the
+ * set to fixed accumulators (min, max, sum, count and last value, no
+ * allocation per sample). At the end of each tumbling time window, one
+ * summary is given to the publish callback :
+ *
+ *   prefix{"temp":{"min":19.5,"max":21,"mean":20.2,"count":50,"last":20.5},...}suffix
+ *
+ * The fields which are not numeric are ignored, as well as the NaN values
+ * (a sample without any other value is not counted). A window without any
+ * sample is not published.
+ *
+ * In the deferred mode, the summaries are not published by the thread which
+ * ends the window (e.g. the sampling thread of loc_sampler) but posted to the
+ * publish queue : the publish callback is called by LO_pubq_drain, in the
+ * LiveObjects client thread.
+ */
+
+#ifndef __loc_aggr_H_
+#define __loc_aggr_H_
+
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+#include "liveobjects-client/LiveObjectsClient_Defs.h"
+#include "liveobjects-sys/loc_pubq.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Default duration of a window (milliseconds). */
+#ifndef LOC_AGGR_WINDOW_MS
+#define LOC_AGGR_WINDOW_MS         60000
+#endif
+
+/**
+ * Publish callback : publish the summary of a window. Called by the thread
+ * which ends the window, once the aggregation is unlocked (the next samples
+ * can be added meanwhile), or by LO_pubq_drain in the deferred mode (even
+ * after LO_aggr_destroy). The summary is dropped if the callback fails.
+ */
+typedef int (*LO_aggr_publishCb_t)(void *ctx, const char *msg, uint32_t msg_len, uint32_t samples);
+
+/** Aggregation configuration (0 or NULL : default value). */
+typedef struct {
+	uint32_t window_ms;            /*!< Duration of a window */
+	const char *prefix;            /*!< Text before the summary (default "") */
+	const char *suffix;            /*!< Text after the summary (default "") */
+	uint8_t deferred;              /*!< Post the summaries to the publish queue (LO_pubq_drain) */
+} LO_aggr_cfg_t;
+
+typedef struct LO_aggr_s LO_aggr_t;
+
+/**
+ * @brief Create an aggregation for a set of data. The first window starts now.
+ *
+ * @param data_set     Set of data (kept by the aggregation, as by LiveObjectsClient_AttachData).
+ * @param data_nb      Number of data in the set.
+ * @param cfg_ptr      Configuration, or NULL for the default values.
+ * @param publish_cb   Publish callback.
+ * @param publish_ctx  Context given to the publish callback.
+ *
+ * @return The aggregation, or NULL on error (no numeric field).
+ */
+LO_aggr_t *LO_aggr_create(const LiveObjectsD_Data_t *data_set, int32_t data_nb,
+		const LO_aggr_cfg_t *cfg_ptr, LO_aggr_publishCb_t publish_cb, void *publish_ctx);
+
+/**
+ * @brief Publish the current window and release an aggregation.
+ */
+void LO_aggr_destroy(LO_aggr_t *aggr);
+
+/**
+ * @brief Add a sample of the current values. Publish the previous window
+ *        first if it is elapsed. Can be called from any thread.
+ *
+ * @return Number of samples in the current window.
+ */
+int LO_aggr_add(LO_aggr_t *aggr);
+
+/**
+ * @brief Add a sample taken at a given time (e.g. by another process, see
+ *        loc_shmring.h) : it ends the previous window only if it was elapsed
+ *        at that time. A sample older than the current window is added to it.
+ *
+ * @param aggr   Aggregation.
+ * @param ts_ms  Time of the sample (ms since epoch), or 0 : now.
+ *
+ * @return Number of samples in the current window.
+ */
+int LO_aggr_addAt(LO_aggr_t *aggr, uint64_t ts_ms);
+
+/**
+ * @brief Publish the window if it is elapsed. To be called periodically
+ *        (e.g. from the LiveObjects client loop).
+ *
+ * @return Time (ms) before the end of the current window.
+ */
+int32_t LO_aggr_poll(LO_aggr_t *aggr);
+
+/**
+ * @brief Publish the current window now, and start a new one.
+ *
+ * @return 0 on success (or empty window), -1 if the publish callback failed
+ *         (deferred mode : if the publish queue is full).
+ */
+int LO_aggr_flush(LO_aggr_t *aggr);
+
+/**
+ * @brief Publish a summary posted in the deferred mode (called by LO_pubq_drain).
+ */
+void LO_aggr_publishReq(const LO_pubq_req_t *req_ptr);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_aggr_H_ */
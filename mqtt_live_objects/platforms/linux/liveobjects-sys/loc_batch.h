@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_batch.h
+ * @brief Batched publishing of a set of data.
+ *
+ * Each LO_batch_add() takes a timestamped snapshot of the values of the
+ * set, appended to the current batch. The batch is given to the flush
+ * callback as one JSON message (one MQTT PUBLISH) when it reaches the
+ * maximum number of samples, its maximum size or its maximum age :
+ *
+ *   prefix{"ts":"2017-07-24T10:00:00.010Z","v":{...}},{"ts":...,"v":{...}}suffix
+ *
+ * With a CBOR encoding (see loc_cbor.h), the message is a CBOR array of
+ * {"ts": milliseconds since the epoch, "v": {...}} maps, without prefix
+ * and suffix.
+ *
+ * In the deferred mode, a full batch is not given to the flush callback by
+ * the thread which adds the sample (e.g. the sampling thread of loc_sampler)
+ * but posted to the publish queue : the flush callback is called by
+ * LO_pubq_drain, in the LiveObjects client thread, and the next samples are
+ * added meanwhile into a new buffer.
+ */
+
+#ifndef __loc_batch_H_
+#define __loc_batch_H_
+
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+#include "liveobjects-client/LiveObjectsClient_Defs.h"
+#include "liveobjects-sys/loc_cbor.h"
+#include "liveobjects-sys/loc_pubq.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Default maximum number of samples in a batch. */
+#ifndef LOC_BATCH_MAX_SAMPLES
+#define LOC_BATCH_MAX_SAMPLES      32
+#endif
+
+/** Default maximum size of a batch message (bytes). */
+#ifndef LOC_BATCH_MAX_BYTES
+#define LOC_BATCH_MAX_BYTES        4096
+#endif
+
+/** Default maximum age of the first sample of a batch (milliseconds). */
+#ifndef LOC_BATCH_MAX_AGE_MS
+#define LOC_BATCH_MAX_AGE_MS       1000
+#endif
+
+/**
+ * Flush callback : publish a batch message (msg_len bytes, null terminated
+ * in JSON). Called with the batch locked
+ * (the callback must not call the LO_batch functions on the same batch).
+ * Return 0 if the message is published, otherwise the samples are kept.
+ * In the deferred mode, called by LO_pubq_drain without any lock (even after
+ * LO_batch_destroy) : the samples are dropped if the callback fails.
+ */
+typedef int (*LO_batch_flushCb_t)(void *ctx, const char *msg, uint32_t msg_len, uint32_t samples);
+
+/** Batch configuration (0 or NULL : default value). */
+typedef struct {
+	uint32_t max_samples;          /*!< Flush when this number of samples is reached */
+	uint32_t max_bytes;            /*!< Maximum size of a message */
+	uint32_t max_age_ms;           /*!< Flush when the first sample is older */
+	const char *prefix;            /*!< Text before the samples (default "[") */
+	const char *suffix;            /*!< Text after the samples (default "]") */
+	LO_payload_enc_t encoding;     /*!< Encoding of the messages (default LO_PAYLOAD_JSON) */
+	uint8_t deferred;              /*!< Post the full batches to the publish queue (LO_pubq_drain) */
+} LO_batch_cfg_t;
+
+/** Filling of the current batch. */
+typedef struct {
+	uint32_t samples;              /*!< Number of samples */
+	uint32_t bytes;                /*!< Size of the message */
+	uint32_t age_ms;               /*!< Age of the first sample */
+	uint8_t percent;               /*!< Filling (maximum of the samples, bytes and age ratios) */
+} LO_batch_fill_t;
+
+typedef struct LO_batch_s LO_batch_t;
+
+/**
+ * @brief Create a batch for a set of data.
+ *
+ * @param data_set  Set of data (kept by the batch, as by LiveObjectsClient_AttachData).
+ * @param data_nb   Number of data in the set.
+ * @param cfg_ptr   Configuration, or NULL for the default values.
+ * @param flush_cb  Flush callback.
+ * @param flush_ctx Context given to the flush callback.
+ *
+ * @return The batch, or NULL on error.
+ */
+LO_batch_t *LO_batch_create(const LiveObjectsD_Data_t *data_set, int32_t data_nb,
+		const LO_batch_cfg_t *cfg_ptr, LO_batch_flushCb_t flush_cb, void *flush_ctx);
+
+/**
+ * @brief Flush and release a batch.
+ */
+void LO_batch_destroy(LO_batch_t *batch);
+
+/**
+ * @brief Add a snapshot of the current values (timestamped now). Flush the
+ *        batch first if the sample does not fit, and after if a threshold
+ *        is reached. Can be called from any thread.
+ *
+ * @return Number of samples in the batch, or -1 if the sample is lost.
+ */
+int LO_batch_add(LO_batch_t *batch);
+
+/**
+ * @brief Add a snapshot of the current values, with the time at which they
+ *        were taken (e.g. by another process, see loc_shmring.h). The maximum
+ *        age of the batch is still counted from the first LO_batch_addAt.
+ *
+ * @param batch  Batch.
+ * @param ts_ms  Time of the sample (ms since epoch), or 0 : now.
+ *
+ * @return Number of samples in the batch, or -1 if the sample is lost.
+ */
+int LO_batch_addAt(LO_batch_t *batch, uint64_t ts_ms);
+
+/**
+ * @brief Flush the batch if its first sample is too old. To be called
+ *        periodically (e.g. from the LiveObjects client loop).
+ *
+ * @return Time (ms) before the next age flush, or -1 if the batch is empty.
+ */
+int32_t LO_batch_poll(LO_batch_t *batch);
+
+/**
+ * @brief Flush the batch now.
+ *
+ * @return 0 on success (or empty batch), -1 if the flush callback failed
+ *         (deferred mode : if the publish queue is full).
+ */
+int LO_batch_flush(LO_batch_t *batch);
+
+/**
+ * @brief Get the filling of the current batch.
+ */
+void LO_batch_getFill(LO_batch_t *batch, LO_batch_fill_t *fill_ptr);
+
+/**
+ * @brief Flush a batch posted in the deferred mode (called by LO_pubq_drain).
+ */
+void LO_batch_publishReq(const LO_pubq_req_t *req_ptr);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_batch_H_ */
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_cbor.h
+ * @brief Streaming CBOR encoder (RFC 7049) for binary data payloads.
+ *
+ * Alternative to the JSON encoding for data streams published on topics
+ * which accept binary payloads. The encoder writes into a buffer; when a
+ * write callback is given, the buffer is flushed to it each time it is full,
+ * so that a payload larger than the buffer can be streamed.
+ */
+
+#ifndef __loc_cbor_H_
+#define __loc_cbor_H_
+
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Defs.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Payload encoding of a data stream. */
+typedef enum {
+	LO_PAYLOAD_JSON = 0,           /*!< JSON text (default) */
+	LO_PAYLOAD_CBOR,               /*!< CBOR map, keys are the data names */
+	LO_PAYLOAD_CBOR_IDX            /*!< CBOR map, keys are the data indexes in the set */
+} LO_payload_enc_t;
+
+/**
+ * Write callback : called with the encoded bytes when the buffer is full
+ * and by LO_cbor_finish. Return 0 on success.
+ */
+typedef int (*LO_cbor_writeCb_t)(void *ctx, const uint8_t *data, uint32_t len);
+
+/** Encoder state. */
+typedef struct {
+	uint8_t *buf;                  /*!< Output buffer */
+	uint32_t buf_sz;               /*!< Size of the output buffer */
+	uint32_t len;                  /*!< Number of bytes in the buffer */
+	uint32_t flushed;              /*!< Number of bytes given to write_cb */
+	LO_cbor_writeCb_t write_cb;    /*!< Write callback (or NULL) */
+	void *write_ctx;               /*!< Context of the write callback */
+	int err;                       /*!< Error (buffer too small, write error) */
+} LO_cbor_enc_t;
+
+/**
+ * @brief Initialize an encoder.
+ *
+ * @param enc       Encoder.
+ * @param buf       Output buffer.
+ * @param buf_sz    Size of the output buffer (at least 9 bytes with a write callback).
+ * @param write_cb  Write callback, or NULL to encode into the buffer only.
+ * @param write_ctx Context given to write_cb.
+ */
+void LO_cbor_init(LO_cbor_enc_t *enc, uint8_t *buf, uint32_t buf_sz,
+		LO_cbor_writeCb_t write_cb, void *write_ctx);
+
+void LO_cbor_putUint(LO_cbor_enc_t *enc, uint64_t val);
+void LO_cbor_putInt(LO_cbor_enc_t *enc, int64_t val);
+void LO_cbor_putBool(LO_cbor_enc_t *enc, uint8_t val);
+void LO_cbor_putNull(LO_cbor_enc_t *enc);
+
+/**
+ * @brief Encode a floating point value, as a half, single or double
+ *        precision float : the smallest one which keeps the exact value.
+ */
+void LO_cbor_putDouble(LO_cbor_enc_t *enc, double val);
+
+void LO_cbor_putText(LO_cbor_enc_t *enc, const char *str, uint32_t len);
+void LO_cbor_putBytes(LO_cbor_enc_t *enc, const void *data, uint32_t len);
+
+/** @brief Start an array of nb items. */
+void LO_cbor_putArray(LO_cbor_enc_t *enc, uint32_t nb);
+
+/** @brief Start a map of nb (key, value) pairs. */
+void LO_cbor_putMap(LO_cbor_enc_t *enc, uint32_t nb);
+
+/**
+ * @brief Encode the current values of a set of data as a CBOR map.
+ *
+ * @param enc       Encoder.
+ * @param data_set  Set of data.
+ * @param data_nb   Number of data in the set.
+ * @param enc_type  LO_PAYLOAD_CBOR (keys are the names) or LO_PAYLOAD_CBOR_IDX (keys are
+ *                  the indexes, the receiver knows the set).
+ */
+void LO_cbor_putDataSet(LO_cbor_enc_t *enc, const LiveObjectsD_Data_t *data_set,
+		int32_t data_nb, LO_payload_enc_t enc_type);
+
+/**
+ * @brief Flush the buffer to the write callback (if any).
+ *
+ * @return Total length of the encoded payload, or -1 on error.
+ */
+int LO_cbor_finish(LO_cbor_enc_t *enc);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_cbor_H_ */
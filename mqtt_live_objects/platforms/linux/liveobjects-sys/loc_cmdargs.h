@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_cmdargs.h
+ * @brief Zero-copy parsing of the arguments of a LiveObjects command.
+ *
+ * A command message { "req":"LED", "arg":{"ticks":3, "on":true}, "cid":12 }
+ * is scanned in place : each argument is returned as a view (name and
+ * value slices pointing into the receive buffer, and its JSON type), with
+ * no copy and no limit on the number of arguments. The typed accessors
+ * convert a value only when the handler asks for it.
+ *
+ *     LO_cmdargs_t it;
+ *     LO_cmdarg_t arg;
+ *     int32_t ticks;
+ *     if (LO_cmdargs_init(&it, msg, msg_len, "arg") == 0)
+ *         while (LO_cmdargs_next(&it, &arg) > 0)
+ *             if (LO_cmdarg_nameIs(&arg, "ticks") && (LO_cmdarg_toInt(&arg, &ticks) == 0))
+ *                 ...
+ */
+
+#ifndef __loc_cmdargs_H_
+#define __loc_cmdargs_H_
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** JSON type of an argument value. */
+typedef enum {
+	LO_CMDARG_NULL = 0,
+	LO_CMDARG_BOOL,
+	LO_CMDARG_INT,                 /*!< Number without fraction nor exponent */
+	LO_CMDARG_FLOAT,               /*!< Other number */
+	LO_CMDARG_STRING,
+	LO_CMDARG_OBJECT,
+	LO_CMDARG_ARRAY
+} LO_cmdargType_t;
+
+/** Part of the receive buffer. */
+typedef struct {
+	const char *ptr;
+	uint32_t len;
+} LO_json_slice_t;
+
+/** View of one argument. */
+typedef struct {
+	LO_json_slice_t name;          /*!< Name, without the quotes (still escaped) */
+	LO_json_slice_t value;         /*!< Value text (string : without the quotes, still escaped) */
+	uint8_t type;                  /*!< LO_cmdargType_t */
+	uint8_t escaped;               /*!< The string value contains escape sequences */
+} LO_cmdarg_t;
+
+/** Iterator over the members of a JSON object. */
+typedef struct {
+	const char *pc;
+	const char *end;
+	uint8_t first;
+} LO_cmdargs_t;
+
+/**
+ * @brief Start the iteration of the arguments.
+ *
+ * @param it    Iterator.
+ * @param json  Command message (not necessarily null terminated).
+ * @param len   Length of the message.
+ * @param key   Member of the message holding the arguments ("arg"), or NULL
+ *              if the message is the object of arguments.
+ *
+ * @return 0, or -1 if the message is invalid or has no such object.
+ */
+int LO_cmdargs_init(LO_cmdargs_t *it, const char *json, uint32_t len, const char *key);
+
+/**
+ * @brief Get the next argument.
+ *
+ * @return 1 if an argument is returned, 0 at the end, -1 if the JSON is invalid.
+ */
+int LO_cmdargs_next(LO_cmdargs_t *it, LO_cmdarg_t *arg_ptr);
+
+/**
+ * @brief Find an argument by name, from the current position of the iterator
+ *        (the first argument after LO_cmdargs_init). The iterator is not moved.
+ *
+ * @return 1 if found, 0 if not found, -1 if the JSON is invalid.
+ */
+int LO_cmdargs_find(const LO_cmdargs_t *it, const char *name, LO_cmdarg_t *arg_ptr);
+
+/**
+ * @brief View of an argument already split by the LiveObjects client (the
+ *        arg_name / arg_value strings of a LiveObjectsD_CommandArg_t). The
+ *        type is given by the value text : a JSON number, true, false, null
+ *        or quoted string, otherwise a string (the whole text).
+ *
+ * @return 0, or -1 if a parameter is NULL.
+ */
+int LO_cmdarg_fromText(LO_cmdarg_t *arg_ptr, const char *name, const char *value);
+
+/** @brief Compare the name of an argument. @return 1 if equal. */
+int LO_cmdarg_nameIs(const LO_cmdarg_t *arg_ptr, const char *name);
+
+/** @brief Integer value (LO_CMDARG_INT in the int32 range, or LO_CMDARG_BOOL). @return 0 or -1. */
+int LO_cmdarg_toInt(const LO_cmdarg_t *arg_ptr, int32_t *val_ptr);
+
+/** @brief Integer value (LO_CMDARG_INT in the int64 range). @return 0 or -1. */
+int LO_cmdarg_toInt64(const LO_cmdarg_t *arg_ptr, int64_t *val_ptr);
+
+/** @brief Numeric value (LO_CMDARG_INT or LO_CMDARG_FLOAT). @return 0 or -1. */
+int LO_cmdarg_toDouble(const LO_cmdarg_t *arg_ptr, double *val_ptr);
+
+/** @brief Boolean value (LO_CMDARG_BOOL, or a LO_CMDARG_INT : 0 or not). @return 0 or -1. */
+int LO_cmdarg_toBool(const LO_cmdarg_t *arg_ptr, uint8_t *val_ptr);
+
+/**
+ * @brief Copy a string value (unescaped, null terminated), when a C string is needed.
+ *
+ * @return Length of the string, or -1 if not a string or the buffer is too small.
+ */
+int LO_cmdarg_toStr(const LO_cmdarg_t *arg_ptr, char *buf, uint32_t buf_sz);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_cmdargs_H_ */
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_ftrace.h
+ * @brief Function tracer for the MQTTPacket library (StackTrace hooks).
+ *
+ * When enabled, each StackTrace_entry/StackTrace_exit call records a
+ * timestamped event into a ring buffer of the calling thread (the oldest
+ * events are overwritten). The rings are exported in the Chrome trace-event
+ * JSON format, to be opened with chrome://tracing or https://ui.perfetto.dev
+ */
+
+#ifndef __loc_ftrace_H_
+#define __loc_ftrace_H_
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Number of events kept per thread. */
+#ifndef LOC_FTRACE_RING_SZ
+#define LOC_FTRACE_RING_SZ        4096
+#endif
+
+/**
+ * @brief Start (1) or stop (0) the recording. Stopped by default.
+ */
+void LO_ftrace_enable(uint8_t enable);
+
+/**
+ * @brief Discard all the recorded events.
+ */
+void LO_ftrace_clear(void);
+
+/**
+ * @brief Write the recorded events into a file (Chrome trace-event JSON).
+ *
+ * @param path  Path of the JSON file.
+ *
+ * @return Number of exported events, or -1 on error.
+ */
+int LO_ftrace_export(const char *path);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_ftrace_H_ */
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_http_dl.h
+ * @brief Resumable HTTP download of a resource into a file.
+ *
+ * The resource is written by a sink (see loc_rsc_sink.h) into path + ".part".
+ * The progress of the download (url, size, number of bytes received and the
+ * ETag / Last-Modified validators given by the server) is saved periodically
+ * into path + ".state", after the received bytes are flushed to the storage.
+ *
+ * When the connection is lost, LO_http_dl_get returns -1 and keeps both
+ * files : the next call with the same url (after a reconnection, or even
+ * after a restart of the application) asks only the missing bytes with a
+ * "Range" request. The "If-Range" validator ensures that the server sends
+ * the whole resource again if it has changed in the meantime (a resource
+ * without any validator is always downloaded from the beginning).
+ *
+ * The connections are kept alive : after a download, the connection is kept
+ * idle (up to LOC_HTTP_DL_CONN_MAX connections) and reused by the next
+ * download from the same server. The body is received into a large buffer
+ * of the connection, or directly into the destination for the large reads
+ * (mapped file, or LOC_RSC_SINK_BUF_SZ chunks).
+ *
+ * A large resource can also be split into segments fetched concurrently,
+ * each one on its own connection and thread (LO_http_dl_opt_t.segments),
+ * when the server supports range requests. The segments are written at
+ * their offsets, then the file is verified as a whole. If a segment fails,
+ * the bytes received up to the first missing one are kept for a next call.
+ *
+ * Several resources can be downloaded at once : LO_http_dl_start runs the
+ * download in the background, up to LOC_HTTP_DL_ACTIVE_MAX downloads at the
+ * same time (the next ones wait for a free slot), and calls a completion
+ * callback with its own context.
+ *
+ * With LOC_FEATURE_HTTP_GZIP (zlib), a download can accept a compressed
+ * body (Accept-Encoding: gzip) : the body is inflated as it is received,
+ * in constant memory, so that the sink and its digest see the decoded
+ * resource. The size of the decoded resource must be known (as notified
+ * by LiveObjects), and the server must give a Content-Length (resources
+ * compressed in advance). An interrupted compressed download is resumed
+ * with a range request of the decoded resource, validated by its
+ * Last-Modified date only (the ETag is the one of the gzip representation).
+ */
+
+#ifndef __loc_http_dl_H_
+#define __loc_http_dl_H_
+
+#include <stdint.h>
+
+#include "config/liveobjects_dev_params.h"
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+#include "liveobjects-sys/loc_rsc_sink.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Size of the receive buffer of a connection (also the maximum size of the headers of a response). */
+#ifndef LOC_HTTP_DL_BUF_SZ
+#define LOC_HTTP_DL_BUF_SZ         (64 * 1024)
+#endif
+
+/** Number of idle connections kept for the next downloads (0 : one connection per download). */
+#ifndef LOC_HTTP_DL_CONN_MAX
+#define LOC_HTTP_DL_CONN_MAX       4
+#endif
+
+/** The download state is saved each time this number of bytes is received. */
+#ifndef LOC_HTTP_DL_SAVE_SZ
+#define LOC_HTTP_DL_SAVE_SZ        (256 * 1024)
+#endif
+
+/** Receive timeout (seconds) : a silent connection is considered as lost. */
+#ifndef LOC_HTTP_DL_TIMEOUT_S
+#define LOC_HTTP_DL_TIMEOUT_S      30
+#endif
+
+/** Maximum number of segments of a download. */
+#ifndef LOC_HTTP_DL_SEG_MAX
+#define LOC_HTTP_DL_SEG_MAX        8
+#endif
+
+/** Minimum size of a segment. */
+#ifndef LOC_HTTP_DL_SEG_MIN_SZ
+#define LOC_HTTP_DL_SEG_MIN_SZ     (256 * 1024)
+#endif
+
+/** Decoding of the compressed bodies (needs zlib). */
+#ifndef LOC_FEATURE_HTTP_GZIP
+#define LOC_FEATURE_HTTP_GZIP      0
+#endif
+
+/** Maximum number of downloads in progress at the same time (LO_http_dl_start). */
+#ifndef LOC_HTTP_DL_ACTIVE_MAX
+#define LOC_HTTP_DL_ACTIVE_MAX     4
+#endif
+
+/** Maximum length of the url and of the validators. */
+#define LO_HTTP_DL_URL_SZ          256
+#define LO_HTTP_DL_TAG_SZ          80
+
+/** Download options. */
+typedef struct {
+	LO_rsc_sinkMode_t mode;        /*!< How the file is written */
+	LO_rsc_digest_t digest;        /*!< Digest to verify (or LO_RSC_DIGEST_NONE) */
+	const char *digest_hex;        /*!< Expected digest, in hexadecimal */
+	uint8_t segments;              /*!< Number of concurrent range requests (0 or 1 : a single stream) */
+	uint8_t gzip;                  /*!< Accept a compressed body (LOC_FEATURE_HTTP_GZIP, needs size) */
+	uint32_t size;                 /*!< Size of the resource, 0 : unknown */
+} LO_http_dl_opt_t;
+
+/** Download state, as saved into path + ".state". */
+typedef struct {
+	char url[LO_HTTP_DL_URL_SZ];           /*!< Url of the resource */
+	uint32_t size;                         /*!< Size of the resource */
+	uint32_t offset;                       /*!< Number of bytes in the partial file */
+	char etag[LO_HTTP_DL_TAG_SZ];          /*!< ETag of the resource (or empty) */
+	char last_modified[LO_HTTP_DL_TAG_SZ]; /*!< Last-Modified date of the resource (or empty) */
+} LO_http_dl_state_t;
+
+/**
+ * Completion callback of LO_http_dl_start (called by the download thread).
+ *
+ * @param ctx   Context given to LO_http_dl_start.
+ * @param path  Final path of the file.
+ * @param ret   Result of the download (see LO_http_dl_get).
+ */
+typedef void (*LO_http_dl_done_t)(void *ctx, const char *path, int ret);
+
+/**
+ * @brief Download (or continue the download of) a resource.
+ *
+ * @param url   Url of the resource ("http://host[:port]/path").
+ * @param path  Final path of the file.
+ * @param opt   Options (or NULL : LO_RSC_SINK_FILE, no digest, a single stream).
+ *
+ * @return 0 when the file is completed, -1 on error (the download can be continued
+ *         by a next call), or LO_RSC_SINK_ERR_DIGEST (the file is removed).
+ */
+int LO_http_dl_get(const char *url, const char *path, const LO_http_dl_opt_t *opt);
+
+/**
+ * @brief Start the download of a resource in the background.
+ *
+ * @param url      Url of the resource.
+ * @param path     Final path of the file (one download at a time per file).
+ * @param opt      Options (copied), or NULL.
+ * @param done_cb  Completion callback (or NULL).
+ * @param ctx      Context of the callback.
+ *
+ * @return 0 if the download is started or waiting for a free slot, -1 on error.
+ */
+int LO_http_dl_start(const char *url, const char *path, const LO_http_dl_opt_t *opt,
+		LO_http_dl_done_t done_cb, void *ctx);
+
+/**
+ * @brief Wait for the end of all the downloads started by LO_http_dl_start.
+ */
+void LO_http_dl_wait(void);
+
+/**
+ * @brief Close the idle connections.
+ */
+void LO_http_dl_disconnect(void);
+
+/**
+ * @brief Read the saved state of a download (to report its progress).
+ *
+ * @param path   Final path of the file.
+ * @param state  State.
+ *
+ * @return 0, or -1 if there is no download in progress for this file.
+ */
+int LO_http_dl_getState(const char *path, LO_http_dl_state_t *state);
+
+/**
+ * @brief Abort a download : remove its partial file and its state.
+ *
+ * @param path  Final path of the file.
+ */
+void LO_http_dl_cancel(const char *path);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_http_dl_H_ */
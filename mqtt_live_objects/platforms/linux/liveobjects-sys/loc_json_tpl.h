@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_json_tpl.h
+ * @brief Precompiled JSON templates for a set of LiveObjects data.
+ *
+ * A set of data (LiveObjectsD_Data_t array, as given to
+ * LiveObjectsClient_AttachData or LiveObjectsClient_AttachStatus) is compiled
+ * once into constant JSON fragments ("prefix{"name1":", ","name2":", ...)
+ * and value slots. Encoding then only copies the fragments and formats the
+ * values which have changed since the previous encoding.
+ *
+ * In diff mode (LO_json_tpl_setDiff), the template keeps the last encoded
+ * snapshot and encodes only the fields which have changed since then, with
+ * a full encoding at a given period. A numeric field can also be given a
+ * deadband (LO_json_tpl_setDeadband) : it is considered as changed only when
+ * it moves further than the deadband from its last encoded value.
+ */
+
+#ifndef __loc_json_tpl_H_
+#define __loc_json_tpl_H_
+
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Defs.h"
+#include "liveobjects-sys/loc_numfmt.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Maximum size of a formatted numeric value. */
+#define LO_JSON_TPL_VAL_SZ    LO_NUMFMT_BUF_SZ
+
+/** Value slot of a template. */
+typedef struct {
+	const LiveObjectsD_Data_t *data_ptr;   /*!< Attached data */
+	uint8_t raw[8];                        /*!< Value formatted in val (aligned) */
+	uint8_t sent[8];                       /*!< Last encoded value (diff mode, aligned) */
+	uint16_t frag_off;                     /*!< Offset of the constant fragment before the value */
+	uint16_t frag_len;                     /*!< Length of the constant fragment */
+	uint8_t raw_sz;                        /*!< Size of the numeric value (0 : string) */
+	uint8_t raw_valid;                     /*!< raw and val are up to date */
+	uint8_t val_len;                       /*!< Length of the formatted value */
+	char val[LO_JSON_TPL_VAL_SZ];          /*!< Formatted value */
+	uint8_t sent_valid;                    /*!< sent / sent_hash are up to date (diff mode) */
+	uint8_t changed;                       /*!< Field of the last encoding */
+	uint32_t sent_hash;                    /*!< Hash of the last encoded string (diff mode) */
+	uint32_t hash;                         /*!< Hash of the string being encoded */
+	double deadband;                       /*!< Minimum change of a numeric value (diff mode) */
+} LO_json_tpl_slot_t;
+
+/** Compiled template. */
+typedef struct {
+	uint16_t slot_nb;                      /*!< Number of value slots */
+	uint16_t tail_off;                     /*!< Offset of the last fragment ("}" + suffix) */
+	uint16_t tail_len;                     /*!< Length of the last fragment */
+	uint16_t head_len;                     /*!< Length of prefix + "{" */
+	uint8_t diff;                          /*!< Diff mode */
+	uint32_t refresh_ms;                   /*!< Period of the full encodings (diff mode, 0 : never) */
+	uint64_t refresh_last_ms;              /*!< Time of the last full encoding */
+	char *frags;                           /*!< All the constant fragments */
+	LO_json_tpl_slot_t slots[];            /*!< Value slots */
+} LO_json_tpl_t;
+
+/**
+ * @brief Compile a set of data into a template.
+ *
+ * @param prefix   Constant text before the JSON object of values (or NULL).
+ * @param data_set Set of data (kept by the template, as by the LiveObjects client).
+ * @param data_nb  Number of data in the set.
+ * @param suffix   Constant text after the JSON object of values (or NULL).
+ *
+ * @return The template, or NULL on error (unsupported type, no memory).
+ */
+LO_json_tpl_t *LO_json_tpl_create(const char *prefix,
+		const LiveObjectsD_Data_t *data_set, int32_t data_nb, const char *suffix);
+
+/**
+ * @brief Release a template.
+ */
+void LO_json_tpl_destroy(LO_json_tpl_t *tpl);
+
+/**
+ * @brief Mark all the values as changed (to be formatted again, and fully
+ *        encoded by the next diff encoding, e.g. after a failed publish).
+ */
+void LO_json_tpl_invalidate(LO_json_tpl_t *tpl);
+
+/**
+ * @brief Enable or disable the diff mode.
+ *
+ * @param tpl         Template.
+ * @param enable      1 : encode only the changed fields.
+ * @param refresh_ms  Period of the full encodings (0 : only the first one).
+ */
+void LO_json_tpl_setDiff(LO_json_tpl_t *tpl, uint8_t enable, uint32_t refresh_ms);
+
+/**
+ * @brief Set the deadband of a numeric field (diff mode).
+ *
+ * @param tpl       Template.
+ * @param data_ptr  Entry of the set of data given to LO_json_tpl_create.
+ * @param deadband  Minimum change (absolute value) to encode the field again, 0 : any change.
+ *
+ * @return 0, or -1 if the entry is not a numeric field of the template.
+ */
+int LO_json_tpl_setDeadband(LO_json_tpl_t *tpl, const LiveObjectsD_Data_t *data_ptr, double deadband);
+
+/**
+ * @brief Encode the current values of the set.
+ *
+ * In diff mode, only the fields which have changed since the previous
+ * encoding are encoded (all of them for the first one, after
+ * LO_json_tpl_invalidate, or when the refresh period is elapsed).
+ *
+ * @param tpl     Template.
+ * @param buf     Output buffer (null terminated).
+ * @param buf_sz  Size of the output buffer.
+ *
+ * @return Length of the JSON document, 0 in diff mode if no field has changed
+ *         (nothing to publish), or -1 if the buffer is too small.
+ */
+int LO_json_tpl_encode(LO_json_tpl_t *tpl, char *buf, int buf_sz);
+
+/**
+ * @brief Get the entries of the fields of the last encoding (the changed
+ *        ones in diff mode), e.g. to attach the set of data to publish.
+ * @param tpl       Template.
+ * @param data_set  Output : copies of the entries of the set given to LO_json_tpl_create.
+ * @param data_max  Size of data_set.
+ * @return Number of entries, or -1 if data_set is too small.
+ */
+int32_t LO_json_tpl_getChanged(const LO_json_tpl_t *tpl, LiveObjectsD_Data_t *data_set, int32_t data_max);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_json_tpl_H_ */
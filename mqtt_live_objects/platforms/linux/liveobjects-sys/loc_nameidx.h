@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_nameidx.h
+ * @brief Hashed index by name of an attached table (commands, configuration
+ *        parameters, resources).
+ *
+ * The index is built once when the table is attached (open addressing,
+ * load factor <= 1/2) and then gives the entry of a name in constant time,
+ * whatever the size of the table. The table must not change afterwards.
+ */
+
+#ifndef __loc_nameidx_H_
+#define __loc_nameidx_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Defs.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct LO_nameidx_s LO_nameidx_t;
+
+/**
+ * @brief Build the index of a table of structures holding a name.
+ *
+ * @param table     First entry of the table.
+ * @param nb        Number of entries.
+ * @param stride    Size of an entry.
+ * @param name_off  Offset of the name (const char *) in an entry.
+ *
+ * @return The index, or NULL on error. When a name is repeated, the first
+ *         entry is found.
+ */
+LO_nameidx_t *LO_nameidx_create(const void *table, uint32_t nb, uint32_t stride, size_t name_off);
+
+/** @brief Index of a set of commands (LiveObjectsClient_AttachCommands). */
+#define LO_nameidx_createCommands(set, nb) \
+	LO_nameidx_create(set, nb, sizeof(LiveObjectsD_Command_t), offsetof(LiveObjectsD_Command_t, cmd_name))
+
+/** @brief Index of a set of configuration parameters (LiveObjectsClient_AttachCfgParams). */
+#define LO_nameidx_createParams(set, nb) \
+	LO_nameidx_create(set, nb, sizeof(LiveObjectsD_Param_t), offsetof(LiveObjectsD_Param_t, parm_data.data_name))
+
+/** @brief Index of a set of resources (LiveObjectsClient_AttachResources). */
+#define LO_nameidx_createResources(set, nb) \
+	LO_nameidx_create(set, nb, sizeof(LiveObjectsD_Resource_t), offsetof(LiveObjectsD_Resource_t, rsc_name))
+
+/**
+ * @brief Release an index.
+ */
+void LO_nameidx_destroy(LO_nameidx_t *idx);
+
+/**
+ * @brief Find an entry by name.
+ *
+ * @param idx   Index.
+ * @param name  Name (not necessarily null terminated, e.g. a slice of the
+ *              received message).
+ * @param len   Length of the name.
+ *
+ * @return Position of the entry in the table, or -1 if not found.
+ */
+int32_t LO_nameidx_find(const LO_nameidx_t *idx, const char *name, uint32_t len);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_nameidx_H_ */
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_numfmt.h
+ * @brief Number formatting for JSON payloads (locale independent).
+ *
+ * Integers are written two digits at a time from a lookup table.
+ * Floating point values are written with the shortest digit string that
+ * reads back to the same value (Grisu2 algorithm, on the float or double
+ * precision), in fixed or exponent notation, whichever is shorter.
+ */
+
+#ifndef __loc_numfmt_H_
+#define __loc_numfmt_H_
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Buffer size large enough for any formatted value (with the final '\0'). */
+#define LO_NUMFMT_BUF_SZ     32
+
+/**
+ * @brief Format an unsigned integer.
+ *
+ * @param buf  Output buffer (LO_NUMFMT_BUF_SZ bytes, null terminated).
+ * @param val  Value.
+ *
+ * @return Number of written characters.
+ */
+int LO_numfmt_u64(char *buf, uint64_t val);
+
+/**
+ * @brief Format a signed integer.
+ */
+int LO_numfmt_i64(char *buf, int64_t val);
+
+/**
+ * @brief Format a float with the shortest round-trip representation.
+ *
+ * @return Number of written characters, or 0 if the value is not finite.
+ */
+int LO_numfmt_float(char *buf, float val);
+
+/**
+ * @brief Format a double with the shortest round-trip representation.
+ *
+ * @return Number of written characters, or 0 if the value is not finite.
+ */
+int LO_numfmt_double(char *buf, double val);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_numfmt_H_ */
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_pubq.h
+ * @brief Lock-free publish queue between user threads and the LiveObjects
+ *        client thread.
+ *
+ * Bounded multi-producer / single-consumer queue of publish requests.
+ * User threads post requests with LO_pubq_push() (never blocks), and the
+ * LiveObjects client thread processes them with LO_pubq_drain(), called by
+ * the client loop next to LiveObjectsClient_Cycle. The client mutexes are
+ * then only taken by the client thread (LiveObjectsClient_PushData, ...).
+ */
+
+#ifndef __loc_pubq_H_
+#define __loc_pubq_H_
+
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Number of slots in the queue (must be a power of 2). */
+#ifndef LOC_PUBQ_SIZE
+#define LOC_PUBQ_SIZE              64
+#endif
+
+/** Number of pending requests from which LO_pubq_push returns LO_PUBQ_BACKPRESSURE. */
+#ifndef LOC_PUBQ_HIGH_WATERMARK
+#define LOC_PUBQ_HIGH_WATERMARK    ((LOC_PUBQ_SIZE * 3) / 4)
+#endif
+
+/** Number of pending requests under which the drain callback is called. */
+#ifndef LOC_PUBQ_LOW_WATERMARK
+#define LOC_PUBQ_LOW_WATERMARK     (LOC_PUBQ_SIZE / 4)
+#endif
+
+/** Kind of publish request. */
+typedef enum {
+	LO_PUBQ_REQ_DATA = 1,          /*!< LiveObjectsClient_PushData(req_hdl) */
+	LO_PUBQ_REQ_STATUS,            /*!< LiveObjectsClient_PushStatus(req_hdl) */
+	LO_PUBQ_REQ_USER,              /*!< Processed by the user handler only */
+	LO_PUBQ_REQ_CMD_RSP,           /*!< Command response (req_hdl : cid, req_val : result), see loc_workers.h */
+	LO_PUBQ_REQ_PARAM_RSP,         /*!< Parameter update result (req_ctx : parameter, req_val : result) */
+	LO_PUBQ_REQ_AGGR,              /*!< Summary of a window (req_ctx), deferred mode of loc_aggr.h */
+	LO_PUBQ_REQ_BATCH              /*!< Full batch (req_ctx), deferred mode of loc_batch.h */
+} LO_pubq_reqType_t;
+
+/** Publish request. */
+typedef struct {
+	uint8_t req_type;              /*!< LO_pubq_reqType_t */
+	int16_t req_hdl;               /*!< Handle returned by LiveObjectsClient_AttachXxx */
+	int32_t req_val;               /*!< User value (cid, result, ...) */
+	void *req_ctx;                 /*!< User context */
+} LO_pubq_req_t;
+
+/** Result of LO_pubq_push. */
+typedef enum {
+	LO_PUBQ_OK = 0,                /*!< Queued */
+	LO_PUBQ_BACKPRESSURE = 1,      /*!< Queued, but the queue is nearly full : slow down */
+	LO_PUBQ_WOULD_BLOCK = -1,      /*!< Not queued : the queue is full */
+	LO_PUBQ_ERR_PARAM = -2         /*!< Not queued : invalid parameter */
+} LO_pubq_ret_t;
+
+/**
+ * Handler called by LO_pubq_drain for each request.
+ */
+typedef void (*LO_pubq_handler_t)(const LO_pubq_req_t *req_ptr);
+
+/**
+ * Called by LO_pubq_drain (in the LiveObjects client thread) when the queue
+ * goes back under LOC_PUBQ_LOW_WATERMARK after a LO_PUBQ_BACKPRESSURE.
+ */
+typedef void (*LO_pubq_drainNtfy_t)(void *ctx);
+
+/** Queue counters. */
+typedef struct {
+	uint32_t pushed;               /*!< Number of queued requests */
+	uint32_t popped;               /*!< Number of processed requests */
+	uint32_t would_block;          /*!< Number of requests refused (queue full) */
+	uint32_t backpressure;         /*!< Number of LO_PUBQ_BACKPRESSURE results */
+	uint32_t max_pending;          /*!< Maximum of pending requests */
+} LO_pubq_stats_t;
+
+/**
+ * @brief Reset the queue (called by LO_sys_init).
+ */
+void LO_pubq_init(void);
+
+/**
+ * @brief Set the drain notification.
+ */
+void LO_pubq_setDrainNtfy(LO_pubq_drainNtfy_t ntfy, void *ctx);
+
+/**
+ * @brief Post a request. Lock-free, never blocks, can be called from any thread.
+ *        The LiveObjects client thread is woken up if the queue was empty.
+ */
+LO_pubq_ret_t LO_pubq_push(const LO_pubq_req_t *req_ptr);
+
+/**
+ * @brief Get the oldest request. Only called by the consumer thread.
+ * @return 1 if a request is returned, 0 if the queue is empty.
+ */
+int LO_pubq_pop(LO_pubq_req_t *req_ptr);
+
+/**
+ * @brief Process all pending requests (LiveObjects client thread only).
+ *
+ * @param handler  User handler, or NULL to call LiveObjectsClient_PushData /
+ *                 LiveObjectsClient_PushStatus according to the request type.
+ *                 The responses posted by the workers are always given to the
+ *                 responder set by LO_workers_setResponder, and the summaries
+ *                 and batches posted by loc_aggr / loc_batch to their callback.
+ *
+ * @return Number of processed requests.
+ */
+uint32_t LO_pubq_drain(LO_pubq_handler_t handler);
+
+/**
+ * @brief Number of pending requests (approximate when producers are running).
+ */
+uint32_t LO_pubq_pending(void);
+
+/**
+ * @brief Get a copy of the counters.
+ */
+void LO_pubq_getStats(LO_pubq_stats_t *stats_ptr);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_pubq_H_ */
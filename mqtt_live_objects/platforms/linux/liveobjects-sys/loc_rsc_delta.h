@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_rsc_delta.h
+ * @brief Streaming application of a binary delta resource.
+ *
+ * Instead of a whole new image, the resource is a binary delta against the
+ * image currently installed (the one named by the version of the resource).
+ * The delta uses the bsdiff 4.3 format ("ENDSLEY/BSDIFF43" header, size of
+ * the new image, then a single bzip2 stream of control triples, each one
+ * followed by its diff and extra bytes), as produced by the bsdiff tool of
+ * https://github.com/mendsley/bsdiff
+ *
+ * The delta is decoded as the chunks are received : each diff block is added
+ * to the (mapped) old image and written with the extra blocks in order into
+ * a sink (see loc_rsc_sink.h), so that neither the delta nor the new image
+ * is kept in memory. The new image is renamed to its final path only when
+ * the delta is completed, and its digest can be verified on the fly.
+ *
+ * The digest of the new image is mandatory : a delta applied to another
+ * image than the one it was made from gives a wrong image without any
+ * decoding error.
+ *
+ * In the resource notification callback (state START) : LO_rsc_delta_open
+ * and LO_rsc_delta_setDigest,
+ * in the resource data callback : LO_rsc_delta_read,
+ * in the resource notification callback (state COMPLETED) : LO_rsc_delta_close.
+ *
+ * Needs LOC_FEATURE_RSC_DELTA (libbz2).
+ */
+
+#ifndef __loc_rsc_delta_H_
+#define __loc_rsc_delta_H_
+
+#include <stdint.h>
+
+#include "config/liveobjects_dev_params.h"
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+#include "liveobjects-sys/loc_rsc_sink.h"
+
+#ifndef LOC_FEATURE_RSC_DELTA
+#define LOC_FEATURE_RSC_DELTA      0
+#endif
+
+#if LOC_FEATURE_RSC_DELTA
+#include <bzlib.h>
+#endif
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Size of the buffer of the received delta chunks. */
+#ifndef LOC_RSC_DELTA_BUF_SZ
+#define LOC_RSC_DELTA_BUF_SZ       (16 * 1024)
+#endif
+
+/** Delta state. */
+typedef struct {
+	LO_rsc_sink_t sink;            /*!< New image */
+	const uint8_t *old;            /*!< Mapped old image */
+	uint32_t old_size;             /*!< Size of the old image */
+	int64_t old_pos;               /*!< Position in the old image */
+	uint32_t diff_left;            /*!< Bytes of the current diff block */
+	uint32_t extra_left;           /*!< Bytes of the current extra block */
+	int64_t seek;                  /*!< Move in the old image after the extra block */
+	uint8_t opened;                /*!< Open (0 in a zeroed delta state) */
+	uint32_t received;             /*!< Bytes of the delta read */
+	uint8_t step;                  /*!< Header, control, diff, extra, end */
+	uint8_t mode;                  /*!< LO_rsc_sinkMode_t of the new image */
+	uint8_t bz_end;                /*!< End of the bzip2 stream */
+	uint8_t ctrl_len;              /*!< Bytes received in ctrl */
+	uint8_t ctrl[24];              /*!< Header, then current control triple */
+	uint8_t digest;                /*!< Digest of the new image, set when the header is received */
+	char digest_hex[65];
+	char path[LOC_RSC_SINK_PATH_SZ];  /*!< Final path of the new image */
+#if LOC_FEATURE_RSC_DELTA
+	bz_stream bz;                  /*!< Decompression of the delta */
+#endif
+	char in[LOC_RSC_DELTA_BUF_SZ]; /*!< Received chunk */
+} LO_rsc_delta_t;
+
+/**
+ * @brief Prepare the application of a delta.
+ *
+ * The delta state must be zeroed before its first use (static, or memset).
+ * If it is still open, it is closed first (new image removed).
+ *
+ * @param delta     Delta state.
+ * @param old_path  Path of the installed image.
+ * @param path      Final path of the new image.
+ * @param mode      How the new image is written (LO_RSC_SINK_FILE or LO_RSC_SINK_MMAP).
+ *
+ * @return 0, or -1 on error (no old image : the transfer should be refused).
+ */
+int LO_rsc_delta_open(LO_rsc_delta_t *delta, const char *old_path, const char *path,
+		LO_rsc_sinkMode_t mode);
+
+/**
+ * @brief Set the expected digest of the new image (before the first LO_rsc_delta_read).
+ *        Mandatory : without digest, the delta is refused at its header.
+ *
+ * @return 0, or -1 on error (invalid digest).
+ */
+int LO_rsc_delta_setDigest(LO_rsc_delta_t *delta, LO_rsc_digest_t type, const char *hex);
+
+/**
+ * @brief Read the available data of the delta, and apply it.
+ *
+ * @param delta    Delta state.
+ * @param rsc_ptr  Resource (as given to the data callback).
+ * @param offset   Offset (as given to the data callback) : must be the number of
+ *                 bytes of the delta already read.
+ *
+ * @return Number of bytes of the delta read (to be returned by the data callback),
+ *         -1 on error (corrupted delta, unexpected offset), or LO_RSC_SINK_ERR_DIGEST.
+ */
+int LO_rsc_delta_read(LO_rsc_delta_t *delta, const LiveObjectsD_Resource_t *rsc_ptr, uint32_t offset);
+
+/**
+ * @brief Same as LO_rsc_delta_read, the delta being given by a reader.
+ *
+ * @return Number of bytes of the delta read, 0 if the reader has no more data,
+ *         -1 on error, or LO_RSC_SINK_ERR_DIGEST.
+ */
+int LO_rsc_delta_fill(LO_rsc_delta_t *delta, LO_rsc_sink_reader_t reader, void *ctx);
+
+/**
+ * @brief End the application of the delta.
+ *
+ * @param delta   Delta state.
+ * @param commit  1 : the transfer is completed, rename the new image to its final path;
+ *                0 : remove it.
+ *
+ * @return 0, LO_RSC_SINK_ERR_DIGEST (invalid new image), or -1 on error
+ *         (incomplete or corrupted delta).
+ */
+int LO_rsc_delta_close(LO_rsc_delta_t *delta, uint8_t commit);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_rsc_delta_H_ */
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_rsc_sink.h
+ * @brief Streaming sink of a resource transfer into a file.
+ *
+ * The file is created (as path + ".part") and preallocated when the
+ * transfer is accepted. Each chunk given by LiveObjectsClient_RscGetChunck
+ * is then written at its offset as it arrives, so that a resource of any
+ * size is received in constant memory. The file is renamed to its final
+ * path only when the transfer is completed.
+ *
+ * A digest (MD5 or SHA-256) of the resource can be computed on the fly, as
+ * the chunks are received : the last LO_rsc_sink_read fails if it does not
+ * match the expected checksum, without a second pass over the file.
+ *
+ * In the resource notification callback (state START) : LO_rsc_sink_open
+ * (and LO_rsc_sink_setDigest),
+ * in the resource data callback : LO_rsc_sink_read,
+ * in the resource notification callback (state COMPLETED) : LO_rsc_sink_close.
+ *
+ * An interrupted transfer can keep its partial file (LO_rsc_sink_close with
+ * LO_RSC_SINK_KEEP) and be continued later with LO_rsc_sink_reopen, the data
+ * being then given by any reader (LO_rsc_sink_fill), see loc_http_dl.h
+ *
+ * Several threads can also write segments of the file at any offset
+ * (LO_rsc_sink_fillAt), the bytes being then accounted and added to the
+ * digest by LO_rsc_sink_advance, in order.
+ */
+
+#ifndef __loc_rsc_sink_H_
+#define __loc_rsc_sink_H_
+
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+#include "liveobjects-client/LiveObjectsClient_Defs.h"
+#include "mbedtls/md.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Size of the buffer used by the LO_RSC_SINK_FILE mode. */
+#ifndef LOC_RSC_SINK_BUF_SZ
+#define LOC_RSC_SINK_BUF_SZ        (64 * 1024)
+#endif
+
+/** Maximum length of the file path. */
+#ifndef LOC_RSC_SINK_PATH_SZ
+#define LOC_RSC_SINK_PATH_SZ       256
+#endif
+
+/** How the chunks are written. */
+typedef enum {
+	LO_RSC_SINK_FILE = 0,          /*!< Read into a small buffer, then pwrite at the offset */
+	LO_RSC_SINK_MMAP               /*!< Read directly into the mapped file */
+} LO_rsc_sinkMode_t;
+
+/** Digest verified on the fly. */
+typedef enum {
+	LO_RSC_DIGEST_NONE = 0,
+	LO_RSC_DIGEST_MD5,
+	LO_RSC_DIGEST_SHA256
+} LO_rsc_digest_t;
+
+/** Error returned by LO_rsc_sink_read / LO_rsc_sink_close when the digest does not match. */
+#define LO_RSC_SINK_ERR_DIGEST     (-2)
+
+/** LO_rsc_sink_close : keep the partial file, to be continued with LO_rsc_sink_reopen. */
+#define LO_RSC_SINK_KEEP           2
+
+/**
+ * Reader of LO_rsc_sink_fill : copy up to len bytes of the resource into buf.
+ * Return the number of bytes, 0 at the end of the data, or -1 on error.
+ */
+typedef int (*LO_rsc_sink_reader_t)(void *ctx, char *buf, uint32_t len);
+
+/** Sink state. */
+typedef struct {
+	int fd;                        /*!< File descriptor (-1 : closed) */
+	uint8_t opened;                /*!< Open (0 in a zeroed sink) */
+	uint8_t mode;                  /*!< LO_rsc_sinkMode_t */
+	uint8_t *map;                  /*!< Mapped file (LO_RSC_SINK_MMAP) */
+	uint32_t size;                 /*!< Size of the resource */
+	uint32_t written;              /*!< Number of bytes received */
+	uint8_t digest;                /*!< LO_rsc_digest_t */
+	int8_t digest_ok;              /*!< 1 : match, 0 : not yet computed, -1 : mismatch */
+	uint8_t digest_len;            /*!< Size of the expected digest */
+	uint8_t expected[32];          /*!< Expected digest */
+	mbedtls_md_context_t md;       /*!< Digest computation */
+	char path[LOC_RSC_SINK_PATH_SZ];  /*!< Final path */
+	uint8_t buf[LOC_RSC_SINK_BUF_SZ]; /*!< Buffer (LO_RSC_SINK_FILE) */
+} LO_rsc_sink_t;
+
+/**
+ * @brief Create and preallocate the file of a resource.
+ *
+ * The sink must be zeroed before its first use (static, or memset). If it
+ * is still open (transfer restarted without LO_rsc_sink_close), it is
+ * closed first and its partial file removed.
+ *
+ * @param sink  Sink.
+ * @param path  Final path of the file.
+ * @param size  Size of the resource (as given to the notification callback).
+ * @param mode  LO_RSC_SINK_FILE or LO_RSC_SINK_MMAP.
+ *
+ * @return 0, or -1 on error (the transfer should be refused).
+ */
+int LO_rsc_sink_open(LO_rsc_sink_t *sink, const char *path, uint32_t size, LO_rsc_sinkMode_t mode);
+
+/**
+ * @brief Reopen the partial file of an interrupted transfer.
+ *
+ * If the sink is still open, it is closed first (its partial file kept).
+ *
+ * @param sink     Sink.
+ * @param path     Final path of the file.
+ * @param size     Size of the resource.
+ * @param mode     LO_RSC_SINK_FILE or LO_RSC_SINK_MMAP.
+ * @param written  Number of bytes already in the file (at least one, as saved by the caller
+ *                 after a successful LO_rsc_sink_sync).
+ *
+ * @return 0, or -1 if there is no partial file of this size.
+ */
+int LO_rsc_sink_reopen(LO_rsc_sink_t *sink, const char *path, uint32_t size,
+		LO_rsc_sinkMode_t mode, uint32_t written);
+
+/**
+ * @brief Set the expected digest of the resource (after LO_rsc_sink_open
+ *        or LO_rsc_sink_reopen, before the next LO_rsc_sink_read).
+ *
+ * After LO_rsc_sink_reopen, the bytes already in the file are read once to
+ * be added to the digest.
+ *
+ * @param sink  Sink.
+ * @param type  LO_RSC_DIGEST_MD5 or LO_RSC_DIGEST_SHA256.
+ * @param hex   Expected digest, in hexadecimal (as published with the resource).
+ *
+ * @return 0, or -1 on error (invalid digest).
+ */
+int LO_rsc_sink_setDigest(LO_rsc_sink_t *sink, LO_rsc_digest_t type, const char *hex);
+
+/**
+ * @brief Read the available data of the resource into the file.
+ *
+ * @param sink     Sink.
+ * @param rsc_ptr  Resource (as given to the data callback).
+ * @param offset   Offset (as given to the data callback), the number of bytes already
+ *                 received.
+ *
+ * @return Number of bytes read (to be returned by the data callback), -1 on error
+ *         (or an offset which is not the number of bytes received),
+ *         or LO_RSC_SINK_ERR_DIGEST when the last chunk is read and the digest does not match.
+ */
+int LO_rsc_sink_read(LO_rsc_sink_t *sink, const LiveObjectsD_Resource_t *rsc_ptr, uint32_t offset);
+
+/**
+ * @brief Same as LO_rsc_sink_read, the data being given by a reader.
+ *
+ * @param sink    Sink.
+ * @param offset  Offset of the data (the number of bytes already received).
+ * @param reader  Reader, called once with the free space at the offset.
+ * @param ctx     Context of the reader.
+ *
+ * @return Number of bytes read, 0 if the reader has no more data, -1 on error
+ *         (or another offset), or LO_RSC_SINK_ERR_DIGEST.
+ */
+int LO_rsc_sink_fill(LO_rsc_sink_t *sink, uint32_t offset, LO_rsc_sink_reader_t reader, void *ctx);
+
+/**
+ * @brief Read data at any offset of the file, without accounting it
+ *        (can be called by several threads, for distinct segments).
+ *
+ * @param sink    Sink.
+ * @param offset  Offset of the data.
+ * @param len     Maximum number of bytes (up to the end of the segment).
+ * @param reader  Reader.
+ * @param ctx     Context of the reader.
+ * @param buf     Buffer of LOC_RSC_SINK_BUF_SZ bytes owned by the caller
+ *                (LO_RSC_SINK_FILE mode), or NULL (LO_RSC_SINK_MMAP mode).
+ *
+ * @return Number of bytes read, 0 if the reader has no more data, or -1 on error.
+ */
+int LO_rsc_sink_fillAt(LO_rsc_sink_t *sink, uint32_t offset, uint32_t len,
+		LO_rsc_sink_reader_t reader, void *ctx, uint8_t *buf);
+
+/**
+ * @brief Account the bytes written by LO_rsc_sink_fillAt : the first
+ *        written bytes of the file are now received.
+ *
+ * The new bytes are read once to be added to the digest, which is
+ * verified when the file is completed.
+ *
+ * @param sink     Sink.
+ * @param written  Number of bytes received from the beginning of the file.
+ *
+ * @return 0, -1 on error, or LO_RSC_SINK_ERR_DIGEST.
+ */
+int LO_rsc_sink_advance(LO_rsc_sink_t *sink, uint32_t written);
+
+/**
+ * @brief Flush the received bytes to the storage (before saving the offset of the transfer).
+ *
+ * @return 0, or -1 on error.
+ */
+int LO_rsc_sink_sync(LO_rsc_sink_t *sink);
+
+/**
+ * @brief Close the file.
+ *
+ * @param sink    Sink.
+ * @param commit  1 : the transfer is completed, rename the file to its final
+ *                path; 0 : remove the partial file; LO_RSC_SINK_KEEP : keep
+ *                the partial file.
+ *
+ * @return 0, LO_RSC_SINK_ERR_DIGEST (invalid checksum), or -1 on error
+ *         (incomplete file, write error).
+ */
+int LO_rsc_sink_close(LO_rsc_sink_t *sink, uint8_t commit);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_rsc_sink_H_ */
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_sampler.h
+ * @brief Periodic sampling thread, independent of the LiveObjects client loop.
+ *
+ * Each sampling task has its own timerfd (absolute periods on the monotonic
+ * clock), watched by a dedicated thread (optionally real-time, with a minimal
+ * timer slack). At each period, the thread calls the sample callback of the
+ * task, which updates the values of a data set, then takes a snapshot of
+ * the set into an aggregation (loc_aggr) and/or a batch (loc_batch).
+ * The accuracy of the sampling does not depend on the network anymore : the
+ * client loop only publishes what the sampler has produced.
+ *
+ * The callbacks are not called under the lock of the sampler : they may add or
+ * remove tasks. With an aggregation or a batch in the deferred mode (see
+ * LO_aggr_cfg_t, LO_batch_cfg_t), the sampling thread never publishes : the
+ * ended windows and the full batches are posted to the publish queue.
+ *
+ * The lateness of each sample (wakeup time - theoretical time) is measured,
+ * as well as the missed periods and the duration of the callbacks
+ * (LO_sampler_getStats, LO_stats_dump).
+ */
+
+#ifndef __loc_sampler_H_
+#define __loc_sampler_H_
+
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+#include "liveobjects-sys/loc_aggr.h"
+#include "liveobjects-sys/loc_batch.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Maximum number of sampling tasks. */
+#ifndef LOC_SAMPLER_TASKS_MAX
+#define LOC_SAMPLER_TASKS_MAX      8
+#endif
+
+/** Sample callback : update the values of the data set (called by the sampling thread). */
+typedef void (*LO_sampler_cb_t)(void *ctx);
+
+/** Sampling task. */
+typedef struct {
+	uint32_t period_us;            /*!< Period (microseconds) */
+	LO_sampler_cb_t sample_cb;     /*!< Sample callback (or NULL) */
+	void *ctx;                     /*!< Context of the callback */
+	LO_aggr_t *aggr;               /*!< Aggregation fed after the callback (or NULL) */
+	LO_batch_t *batch;             /*!< Batch fed after the callback (or NULL) */
+} LO_sampler_task_t;
+
+/** Statistics of a sampling task. */
+typedef struct {
+	uint32_t samples;              /*!< Number of samples */
+	uint32_t missed;               /*!< Number of missed periods (thread too late) */
+	uint32_t late_min_ns;          /*!< Minimum lateness of a sample */
+	uint32_t late_max_ns;          /*!< Maximum lateness of a sample */
+	uint32_t late_mean_ns;         /*!< Mean lateness of the samples */
+	uint32_t run_max_ns;           /*!< Maximum duration of a sample (callback and snapshots) */
+} LO_sampler_stats_t;
+
+/**
+ * @brief Start the sampling thread.
+ *
+ * @param rt_priority  SCHED_FIFO priority (1 .. 99), or 0 : normal thread.
+ *                     Falls back to a normal thread if not permitted.
+ *
+ * @return 0, or -1 on error.
+ */
+int LO_sampler_start(int rt_priority);
+
+/**
+ * @brief Stop the sampling thread (the tasks are kept).
+ */
+void LO_sampler_stop(void);
+
+/**
+ * @brief Add a sampling task (before or after LO_sampler_start). The first
+ *        sample is taken one period later.
+ *
+ * @param task_ptr  Task (copied).
+ *
+ * @return Task identifier (>= 0), or -1 on error (no free task, invalid period).
+ */
+int LO_sampler_add(const LO_sampler_task_t *task_ptr);
+
+/**
+ * @brief Remove a sampling task. When it returns, the callback of the task is not running
+ *        (except when called by a callback of the sampler, which is not waited for).
+ */
+void LO_sampler_remove(int id);
+
+/**
+ * @brief Get (and optionally reset) the statistics of a task.
+ *
+ * @return 0, or -1 if the identifier is invalid.
+ */
+int LO_sampler_getStats(int id, LO_sampler_stats_t *stats_ptr, uint8_t reset);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_sampler_H_ */
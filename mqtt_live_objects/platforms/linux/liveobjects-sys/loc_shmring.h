@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_shmring.h
+ * @brief Shared memory ring of samples, between acquisition processes and the client.
+ *
+ * The client creates a ring for a set of data (LO_shmring_create) in a POSIX
+ * shared memory object (/dev/shm). The acquisition processes open it with a
+ * set of data of the same types (LO_shmring_open), update their values and
+ * push them (LO_shmring_push). The client drains the ring from its loop
+ * (LO_shmring_drain) : the values of each sample are written into its set,
+ * then given to the sample callback, a loc_aggr and/or a loc_batch (with the
+ * timestamp of the producer, LO_aggr_addAt / LO_batch_addAt).
+ *
+ * The ring is a bounded multi-producers / single-consumer queue (a sequence
+ * number per slot, atomic operations only) : no lock, and no system call per
+ * sample, on both sides. A producer only needs loc_shmring.c (and loc_trace.c).
+ *
+ * Binary layout of a sample : the timestamp (uint64_t, ms since epoch), then
+ * the values of the numeric fields of the set (LOD_TYPE_INT8 .. LOD_TYPE_BOOL)
+ * in order, each one aligned on its size. The other fields are ignored. The
+ * types of the fields are recorded in the shared memory, and checked by
+ * LO_shmring_open.
+ *
+ * A sample is lost (counted) when the ring is full. A producer killed while
+ * writing a sample (between the reservation of its slot and its publication)
+ * holds up the client for LOC_SHMRING_STUCK_MS, then the slot is skipped
+ * (counted). A producer suspended for longer while writing loses its sample.
+ * Its late copy may overlap the next sample written in the same slot : the
+ * writer of a slot is recorded before the copy and checked after it, by the
+ * producer and then by the client, and a sample overwritten meanwhile is
+ * skipped (counted). Only a late copy still running after the check of the
+ * client is not detected.
+ */
+
+#ifndef __loc_shmring_H_
+#define __loc_shmring_H_
+
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+#include "liveobjects-client/LiveObjectsClient_Defs.h"
+#include "liveobjects-sys/loc_aggr.h"
+#include "liveobjects-sys/loc_batch.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Default number of samples of a ring (rounded up to a power of 2). */
+#ifndef LOC_SHMRING_CAPACITY
+#define LOC_SHMRING_CAPACITY       1024
+#endif
+
+/** Maximum number of numeric fields of a set. */
+#ifndef LOC_SHMRING_FIELDS_MAX
+#define LOC_SHMRING_FIELDS_MAX     32
+#endif
+
+/** Time after which a slot reserved but not written is skipped by the client (milliseconds). */
+#ifndef LOC_SHMRING_STUCK_MS
+#define LOC_SHMRING_STUCK_MS       1000
+#endif
+
+/** Sample callback : the values of the sample are in the set of data (called by LO_shmring_drain). */
+typedef void (*LO_shmring_cb_t)(void *ctx, uint64_t ts_ms);
+
+/** Ring configuration of the client (0 or NULL : default value). */
+typedef struct {
+	uint32_t capacity;             /*!< Number of samples */
+	LO_shmring_cb_t sample_cb;     /*!< Sample callback (or NULL) */
+	void *ctx;                     /*!< Context of the callback */
+	LO_aggr_t *aggr;               /*!< Aggregation fed after the callback (or NULL) */
+	LO_batch_t *batch;             /*!< Batch fed after the callback (or NULL) */
+} LO_shmring_cfg_t;
+
+/** Ring statistics. */
+typedef struct {
+	uint32_t capacity;             /*!< Number of samples of the ring */
+	uint32_t pending;              /*!< Samples waiting in the ring */
+	uint64_t drained;              /*!< Samples drained by the client */
+	uint64_t dropped;              /*!< Samples lost (ring full, slot skipped) */
+	uint64_t skipped;              /*!< Slots skipped by the client (producer dead while writing, sample overwritten) */
+} LO_shmring_stats_t;
+
+typedef struct LO_shmring_s LO_shmring_t;
+
+/**
+ * @brief Create the ring of a set of data (client side). A previous ring of
+ *        the same name is replaced.
+ *
+ * @param name      Name of the shared memory object ("/name").
+ * @param data_set  Set of data written by LO_shmring_drain.
+ * @param data_nb   Number of data in the set.
+ * @param cfg_ptr   Configuration, or NULL for the default values.
+ *
+ * @return The ring, or NULL on error (no numeric field, shared memory error).
+ */
+LO_shmring_t *LO_shmring_create(const char *name, const LiveObjectsD_Data_t *data_set, int32_t data_nb,
+		const LO_shmring_cfg_t *cfg_ptr);
+
+/**
+ * @brief Open an existing ring (producer side).
+ *
+ * @param name      Name of the shared memory object.
+ * @param data_set  Set of data read by LO_shmring_push (same types as the set of the client).
+ * @param data_nb   Number of data in the set.
+ *
+ * @return The ring, or NULL on error (no ring, different types).
+ */
+LO_shmring_t *LO_shmring_open(const char *name, const LiveObjectsD_Data_t *data_set, int32_t data_nb);
+
+/**
+ * @brief Release a ring. The shared memory object is removed by the client.
+ */
+void LO_shmring_close(LO_shmring_t *ring);
+
+/**
+ * @brief Push a sample of the current values of the set (producer side).
+ *        Can be called from several threads and processes.
+ *
+ * @param ring   Ring.
+ * @param ts_ms  Timestamp of the sample (ms since epoch), or 0 : now.
+ *
+ * @return 0, or -1 if the ring is full (sample lost).
+ */
+int LO_shmring_push(LO_shmring_t *ring, uint64_t ts_ms);
+
+/**
+ * @brief Drain the samples of the ring (client side, single thread).
+ *
+ * @param ring  Ring.
+ * @param max   Maximum number of samples, or 0 : all.
+ *
+ * @return Number of samples drained.
+ */
+uint32_t LO_shmring_drain(LO_shmring_t *ring, uint32_t max);
+
+/**
+ * @brief Get the statistics of a ring.
+ */
+void LO_shmring_getStats(LO_shmring_t *ring, LO_shmring_stats_t *stats_ptr);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_shmring_H_ */
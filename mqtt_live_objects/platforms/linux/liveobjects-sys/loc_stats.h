@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_stats.h
+ * @brief Statistics of the Linux platform layer (mutex, queues, ...).
+ */
+
+#ifndef __loc_stats_H_
+#define __loc_stats_H_
+
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Set to 1 to collect contention statistics in LO_sys_mutex_lock/unlock. */
+#ifndef LOC_FEATURE_MUTEX_STATS
+#define LOC_FEATURE_MUTEX_STATS    0
+#endif
+
+/** Contention statistics of one mutex (LO_sys_mutex_lock index). */
+typedef struct {
+	uint32_t acquisitions;         /*!< Number of LO_sys_mutex_lock */
+	uint32_t contended;            /*!< Number of LO_sys_mutex_lock which had to wait */
+	uint64_t wait_total_us;        /*!< Total time spent waiting for the mutex */
+	uint32_t wait_max_us;          /*!< Maximum time spent waiting for the mutex */
+	uint32_t hold_max_us;          /*!< Maximum time the mutex has been held */
+} LO_stats_mutex_t;
+
+/**
+ * @brief Get the contention statistics of a mutex.
+ *
+ * @param idx        Mutex index (as given to LO_sys_mutex_lock).
+ * @param stats_ptr  Filled with the statistics.
+ *
+ * @return 0 if successful, -1 if the index is invalid or the feature is disabled.
+ */
+int LO_sys_mutex_getStats(uint8_t idx, LO_stats_mutex_t *stats_ptr);
+
+/**
+ * @brief Reset the contention statistics of all mutexes.
+ */
+void LO_sys_mutex_resetStats(void);
+
+/**
+ * @brief Trace (LOTRACE_NOTICE) all the platform statistics.
+ */
+void LO_stats_dump(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_stats_H_ */
@@ -13,21 +13,70 @@
 #ifndef __loc_trace_H_
 #define __loc_trace_H_
 
+#include <stdint.h>
+
+#include "config/liveobjects_dev_params.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* 1 -> traces are written by a background thread (see lo_trace_init), 0 -> synchronous output */
+#ifndef LOC_FEATURE_TRACE_ASYNC
+#define LOC_FEATURE_TRACE_ASYNC       1
+#endif
+
+/* 1 -> traces are recorded in binary (format identifier + raw arguments) */
+/*      into LOC_TRACE_BIN_FILE, to be decoded by script/lo_trace_decode.py */
+#ifndef LOC_FEATURE_TRACE_BINARY
+#define LOC_FEATURE_TRACE_BINARY      0
+#endif
+
+#ifndef LOC_TRACE_BIN_FILE
+#define LOC_TRACE_BIN_FILE            "lo_trace.bin"
+#endif
+
+/* Traces with a level greater than this floor are removed at compile time */
+/* (1: error, 2: warning, 3: notice, 4: info, 5: debug, 6: debug verbose) */
+#ifndef LOC_TRACE_LEVEL_FLOOR
+#define LOC_TRACE_LEVEL_FLOOR         6
+#endif
+
+/* Current (run-time) trace level : the arguments are not evaluated if the trace is filtered */
+extern int lo_trace_level_current;
+
+#define LOTRACE_ENABLED(level)        (((level) <= LOC_TRACE_LEVEL_FLOOR) \
+                                      && ((((level) > 4) ? 4 : (level)) <= lo_trace_level_current))
+
+#if LOC_FEATURE_TRACE_BINARY
+/* Format descriptor, registered (identifier assigned) at the first call */
+typedef struct {
+	uint16_t id;
+	uint8_t nargs;
+	char args[15];
+} lo_trace_fmt_t;
+
+/* An expression in both modes (GNU statement expression for the descriptor) */
+#define LOTRACE_(level, ...)          ((LOTRACE_ENABLED(level)) ? ({ \
+                                          static lo_trace_fmt_t _lo_trace_fmt; \
+                                          lo_trace_bin(&_lo_trace_fmt, level, __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__); \
+                                      }) : (void)0)
+#else
+#define LOTRACE_(level, ...)          ((LOTRACE_ENABLED(level)) \
+                                      ? lo_trace(level, __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__) : (void)0)
+#endif
+
 #define LOTRACE_INIT(level)           lo_trace_init(level)
 
 #define LOTRACE_LEVEL(level)          lo_trace_level(level)
 
-#define LOTRACE_ERR_I(...)            lo_trace(1, __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
-#define LOTRACE_ERR(...)              lo_trace(1, __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
-#define LOTRACE_WARN(...)             lo_trace(2, __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
-#define LOTRACE_NOTICE(...)           lo_trace(3, __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
-#define LOTRACE_INF(...)              lo_trace(4, __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
-#define LOTRACE_DBG1(...)             lo_trace(5, __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
-#define LOTRACE_DBG2(...)             lo_trace(6, __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+#define LOTRACE_ERR_I(...)            LOTRACE_(1, __VA_ARGS__)
+#define LOTRACE_ERR(...)              LOTRACE_(1, __VA_ARGS__)
+#define LOTRACE_WARN(...)             LOTRACE_(2, __VA_ARGS__)
+#define LOTRACE_NOTICE(...)           LOTRACE_(3, __VA_ARGS__)
+#define LOTRACE_INF(...)              LOTRACE_(4, __VA_ARGS__)
+#define LOTRACE_DBG1(...)             LOTRACE_(5, __VA_ARGS__)
+#define LOTRACE_DBG2(...)             LOTRACE_(6, __VA_ARGS__)
 #define LOTRACE_DBG_VERBOSE(...)      ((void)0)
 
 #define LOTRACE_PRINTF                lo_trace_printf
@@ -41,6 +90,17 @@ void lo_trace(int level, const char *file, unsigned int line,
 
 void lo_trace_printf(char const *format, ...);
 
+#if LOC_FEATURE_TRACE_BINARY
+void lo_trace_bin(lo_trace_fmt_t *fmt_ptr, int level, const char *file,
+		unsigned int line, const char *function, char const *format, ...);
+
+void lo_trace_bin_flush(void);
+#endif
+
+void lo_trace_flush(void);
+
+uint32_t lo_trace_dropped(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_wakeup.h
+ * @brief Wake up the LiveObjects client loop (eventfd based).
+ *
+ * The LiveObjects client thread blocks on the MQTT socket, an eventfd and the
+ * timeout given by the core (i.e. the next timer deadline).
+ * Any thread can call LO_wakeup_signal() (for instance just after a
+ * LiveObjectsClient_PushData) to unblock it immediately, so that the pending
+ * message is sent at once instead of on the next cycle.
+ *
+ * A wakeup only cuts the wait of an idle loop : the wakeup is disarmed as
+ * soon as data is received on the socket, so that a packet being read is not
+ * aborted. It is armed again when no data is received for LOC_WAKEUP_IDLE_MS
+ * (or when a wait ends by its timeout), whatever loop runs the client
+ * (LiveObjectsClient_Cycle, LiveObjectsClient_Run, LO_sys_threadRun). A loop
+ * can also arm it at once before its top-level wait (LO_wakeup_arm, before
+ * each LiveObjectsClient_Cycle). The signals of the loop thread itself are
+ * ignored.
+ */
+
+#ifndef __loc_wakeup_H_
+#define __loc_wakeup_H_
+
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Time without data on the socket after which a wait can be woken up again (milliseconds). */
+#ifndef LOC_WAKEUP_IDLE_MS
+#define LOC_WAKEUP_IDLE_MS         50
+#endif
+
+/** Infinite timeout : no periodic wakeup, only socket or event. */
+#define LO_WAKEUP_TMO_INFINITE    ((uint32_t)-1)
+
+/** Bit returned by LO_wakeup_wait when the socket is readable. */
+#define LO_WAKEUP_SOCKET          0x01
+
+/** Bit returned by LO_wakeup_wait when LO_wakeup_signal has been called. */
+#define LO_WAKEUP_EVENT           0x02
+
+/**
+ * @brief Create the eventfd (called by LO_sys_init).
+ * @return 0 if successful, -1 otherwise.
+ */
+int LO_wakeup_init(void);
+
+/**
+ * @brief Close the eventfd.
+ */
+void LO_wakeup_close(void);
+
+/**
+ * @brief Arm the wakeup at once : the client loop is idle, about to enter its
+ *        top-level wait (optional, call it just before LiveObjectsClient_Cycle).
+ */
+void LO_wakeup_arm(void);
+
+/**
+ * @brief Wake up the LiveObjects client loop. Can be called from any thread
+ *        (not from a signal handler).
+ */
+void LO_wakeup_signal(void);
+
+/**
+ * @brief Wait for data on a socket, a wakeup signal (only if armed) or the
+ *        timeout. Called by the client loop thread.
+ *
+ * @param sock_fd     Socket to watch (ignored if negative).
+ * @param timeout_ms  Timeout in milliseconds, or LO_WAKEUP_TMO_INFINITE.
+ *
+ * @return 0 on timeout, a mask of LO_WAKEUP_SOCKET / LO_WAKEUP_EVENT,
+ *         or -1 on error (errno is set).
+ */
+int LO_wakeup_wait(int sock_fd, uint32_t timeout_ms);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_wakeup_H_ */
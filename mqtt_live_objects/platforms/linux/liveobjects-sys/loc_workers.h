@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_workers.h
+ * @brief Worker pool running the command and parameter callbacks out of the
+ *        LiveObjects client thread.
+ *
+ * The command (or parameter) callback given to the LiveObjects client only
+ * posts the request to the pool with LO_workers_command (LO_workers_param)
+ * and returns. A worker thread runs the application handler, and its result
+ * is posted back to the client thread through the publish queue (loc_pubq),
+ * where LO_pubq_drain gives it to the responder. A handler which finishes
+ * later (returns 0) completes with LO_workers_complete.
+ * A new parameter value is checked in the parameter callback itself : only
+ * its application is run by a worker.
+ *
+ * LO_workers_dispatch can be given as the command callback : the handler of
+ * the command is found by name (loc_nameidx) in the table given to
+ * LO_workers_setCommands.
+ */
+
+#ifndef __loc_workers_H_
+#define __loc_workers_H_
+
+#include <stdint.h>
+
+#include "liveobjects-client/LiveObjectsClient_Config.h"
+#include "liveobjects-client/LiveObjectsClient_Defs.h"
+#include "liveobjects-sys/loc_pubq.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Maximum number of worker threads. */
+#ifndef LOC_WORKERS_MAX
+#define LOC_WORKERS_MAX            8
+#endif
+
+/** Maximum number of requests waiting for a worker. */
+#ifndef LOC_WORKERS_QUEUE_SIZE
+#define LOC_WORKERS_QUEUE_SIZE     32
+#endif
+
+/** Application command handler : > 0 OK, 0 pending (see LO_workers_complete), < 0 error. */
+typedef int (*LO_workers_cmdHandler_t)(LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk);
+
+/** Application parameter handler : check (0 if the new value is accepted), or apply. */
+typedef int (*LO_workers_paramHandler_t)(const LiveObjectsD_Param_t *param_ptr, const void *value, int len);
+
+/** Handler of a command (LO_workers_setCommands). */
+typedef struct {
+	const char *cmd_name;              /*!< Name of the command (LiveObjectsD_Command_t) */
+	LO_workers_cmdHandler_t handler;   /*!< Handler run by a worker */
+} LO_workers_cmd_t;
+
+/**
+ * @brief Start the worker threads.
+ *
+ * @param nb  Number of threads (1 .. LOC_WORKERS_MAX).
+ *
+ * @return 0, or -1 on error.
+ */
+int LO_workers_start(uint8_t nb);
+
+/**
+ * @brief Stop the worker threads (the queued requests are discarded).
+ */
+void LO_workers_stop(void);
+
+/**
+ * @brief Set the function sending the responses (called in the LiveObjects
+ *        client thread, by LO_pubq_drain, with LO_PUBQ_REQ_CMD_RSP and
+ *        LO_PUBQ_REQ_PARAM_RSP requests).
+ */
+void LO_workers_setResponder(LO_pubq_handler_t responder);
+
+/**
+ * @brief Give a response to the responder (called by LO_pubq_drain).
+ */
+void LO_workers_respond(const LO_pubq_req_t *req_ptr);
+
+/**
+ * @brief Post a command request to the pool (from the command callback).
+ *        The request block is copied.
+ *
+ * @return 0 (response pending) to be returned by the command callback,
+ *         or -1 if the request cannot be posted (pool stopped or busy).
+ */
+int LO_workers_command(const LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk, LO_workers_cmdHandler_t handler);
+
+/**
+ * @brief Set the handlers of the commands, found by name by LO_workers_dispatch.
+ *        To be called before the commands are attached. The table is not copied.
+ *
+ * @return 0, or -1 on error.
+ */
+int LO_workers_setCommands(const LO_workers_cmd_t *table, uint32_t nb);
+
+/**
+ * @brief Command callback (LiveObjectsClient_AttachCommands) : post the request
+ *        to the handler of the command name.
+ *
+ * @return 0 (response pending), -1 if the request cannot be posted,
+ *         or -4 if the command has no handler.
+ */
+int LO_workers_dispatch(LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk);
+
+/**
+ * @brief Parameter callback : check the new value, then post its application
+ *        to the pool. The client sets the parameter as soon as the callback
+ *        returns 0, so the check runs in the calling thread. The value is
+ *        copied. The result of apply is posted as LO_PUBQ_REQ_PARAM_RSP.
+ *
+ * @param check  Handler run by the caller, NULL : any value is accepted.
+ * @param apply  Handler run by a worker (the value is already accepted).
+ *
+ * @return 0 if posted, the non zero result of check (value refused), or -1.
+ */
+int LO_workers_param(const LiveObjectsD_Param_t *param_ptr, const void *value, int len,
+		LO_workers_paramHandler_t check, LO_workers_paramHandler_t apply);
+
+/**
+ * @brief Complete a pending command (from any thread) : the response is
+ *        posted to the LiveObjects client thread.
+ *
+ * @param cid     Command identifier (pCmdReqBlk->hd.cmd_cid).
+ * @param result  > 0 : OK, < 0 : error.
+ *
+ * @return 0, or -1 if the response cannot be posted (publish queue full).
+ */
+int LO_workers_complete(int16_t cid, int result);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* __loc_workers_H_ */
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2016 Orange
+#
+# This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+# license which can be found in the file 'LICENSE.txt' in this package distribution
+# or at 'https://opensource.org/licenses/BSD-3-Clause'.
+#
+# Decode a binary trace file written with LOC_FEATURE_TRACE_BINARY
+# (see mqtt_live_objects/platforms/linux/iotsoftbox-linux/loc_trace_bin.c).
+#
+# Usage: lo_trace_decode.py [lo_trace.bin] > lo_trace.txt
+
+import re
+import struct
+import sys
+import time
+
+REC_DICT = 0x01
+REC_EVENT = 0x02
+REC_RUN = 0x03
+REC_PID = 0x04
+LEVELS = "-EWIDD"
+
+SPEC = re.compile(r"%([-+ #0']*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|L|q|j|z|t)?([diouxXeEfFgGaAcspn%])")
+
+
+def read_str(data, pos, end):
+    (n,) = struct.unpack_from(end + "H", data, pos)
+    pos += 2
+    return data[pos:pos + n].decode("utf-8", "replace"), pos + n
+
+
+def format_msg(fmt, args, sizes):
+    """Apply a C printf format to the recorded arguments."""
+    it = iter(zip(args, sizes))
+
+    def sub(m):
+        flags, width, prec, _, conv = m.groups()
+        if conv == "%":
+            return "%"
+        try:
+            if width == "*":
+                width = str(next(it)[0])
+            if prec == "*":
+                prec = str(next(it)[0])
+            val, size = next(it)
+        except StopIteration:
+            return m.group(0)
+        spec = "%" + flags.replace("'", "") + (width or "") + ("." + prec if prec is not None else "")
+        if conv in "uoxX" and val < 0:
+            val &= (1 << (8 * size)) - 1
+        if conv in "diu":
+            return (spec + "d") % val
+        if conv == "c":
+            return (spec + "c") % chr(val & 0xFF)
+        if conv == "p" or conv == "n":
+            return "0x%x" % val
+        return (spec + conv) % val
+
+    return SPEC.sub(sub, fmt)
+
+
+def read_args(data, pos, end, types):
+    """Read the arguments of an event. Return (args, sizes, next position)."""
+    args, sizes = [], []
+    for t in types:
+        if t == "i":
+            args.append(struct.unpack_from(end + "i", data, pos)[0])
+            sizes.append(4)
+            pos += 4
+        elif t == "l":
+            args.append(struct.unpack_from(end + "q", data, pos)[0])
+            sizes.append(8)
+            pos += 8
+        elif t in "dD":
+            args.append(struct.unpack_from(end + "d", data, pos)[0])
+            sizes.append(8)
+            pos += 8
+        elif t == "p":
+            args.append(struct.unpack_from(end + "Q", data, pos)[0])
+            sizes.append(8)
+            pos += 8
+        elif t == "s":
+            s, pos = read_str(data, pos, end)
+            args.append(s)
+            sizes.append(0)
+    return args, sizes, pos
+
+
+def date_str(t_us):
+    return "%s.%03d" % (time.strftime("%Y-%m-%d %H:%M:%S", time.localtime(t_us // 1000000)),
+                        (t_us // 1000) % 1000)
+
+
+def decode(data, out):
+    if data[0:4] != b"LOTB":
+        raise ValueError("not a LiveObjects binary trace file")
+    (tag,) = struct.unpack_from("<H", data, 6)
+    end = "<" if tag == 0x0102 else ">"
+
+    # The file is appended by each run and by the forked processes, and the
+    # format identifiers are only valid in the process which registered them.
+    # So there is a dictionary per process: each write starts with the pid of
+    # the writer, a run record starts a process (a forked child inherits the
+    # dictionary of its parent), and an event is decoded with the dictionary in
+    # effect at its position in the file (its dictionary record precedes it).
+    procs = {}
+    dicts = procs.setdefault(None, {})
+    pos = 8
+    while pos < len(data):
+        rec = data[pos]
+        pos += 1
+        if rec == REC_PID:
+            (pid,) = struct.unpack_from(end + "I", data, pos)
+            pos += 4
+            dicts = procs.setdefault(pid, {})
+        elif rec == REC_RUN:
+            pid, ppid, t_us = struct.unpack_from(end + "IIQ", data, pos)
+            pos += 16
+            dicts = procs[pid] = dict(procs.get(ppid, {})) if ppid else {}
+            if ppid:
+                out.write("---- %s: process %u forked by %u\n" % (date_str(t_us), pid, ppid))
+            else:
+                out.write("---- %s: process %u started\n" % (date_str(t_us), pid))
+        elif rec == REC_DICT:
+            fid, level, line, nargs = struct.unpack_from(end + "HBIB", data, pos)
+            pos += 8
+            types = data[pos:pos + nargs].decode("ascii")
+            pos += nargs
+            fname, pos = read_str(data, pos, end)
+            func, pos = read_str(data, pos, end)
+            fmt, pos = read_str(data, pos, end)
+            dicts[fid] = (level, line, types, fname, func, fmt)
+        elif rec == REC_EVENT:
+            fid, index, t_us = struct.unpack_from(end + "HIQ", data, pos)
+            if fid not in dicts:
+                sys.stderr.write("unknown format id %d at offset %d\n" % (fid, pos))
+                return
+            pos += 14
+            level, line, types, fname, func, fmt = dicts[fid]
+            args, sizes, pos = read_args(data, pos, end, types)
+            lvl = LEVELS[min(level, 4)]
+            msg = format_msg(fmt, args, sizes).rstrip("\n")
+            out.write("%04u:%s:%s:%s:%u:%s:%s\n"
+                      % (index, date_str(t_us), lvl, fname, line, func, msg))
+        else:
+            sys.stderr.write("corrupted record at offset %d\n" % (pos - 1))
+            return
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else "lo_trace.bin"
+    with open(path, "rb") as f:
+        data = f.read()
+    decode(data, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
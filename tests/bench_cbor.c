@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  bench_cbor.c
+ * @brief Payload of a set of data : JSON (loc_json_tpl) versus CBOR with the
+ *        names or the indexes as keys (loc_cbor). Reports the time of an
+ *        encoding and the size of the payload.
+ *
+ * Usage : bench_cbor [encodings]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "liveobjects-sys/loc_cbor.h"
+#include "liveobjects-sys/loc_json_tpl.h"
+
+#include "loc_test.h"
+
+#define BENCH_BUF_SZ  512
+
+static uint32_t bench_counter;
+static int32_t bench_temp;
+static float bench_volt;
+static double bench_lat;
+static double bench_lon;
+static uint8_t bench_alarm;
+static int16_t bench_rssi;
+static char bench_state[16] = "RUNNING";
+
+static const LiveObjectsD_Data_t bench_set[] = {
+		{ LOD_TYPE_UINT32, "counter", &bench_counter, 1 },
+		{ LOD_TYPE_INT32, "temperature", &bench_temp, 1 },
+		{ LOD_TYPE_FLOAT, "battery_level", &bench_volt, 1 },
+		{ LOD_TYPE_DOUBLE, "latitude", &bench_lat, 1 },
+		{ LOD_TYPE_DOUBLE, "longitude", &bench_lon, 1 },
+		{ LOD_TYPE_BOOL, "alarm", &bench_alarm, 1 },
+		{ LOD_TYPE_INT16, "rssi", &bench_rssi, 1 },
+		{ LOD_TYPE_STRING_C, "state", bench_state, 1 }
+};
+#define BENCH_SET_NB  (sizeof(bench_set) / sizeof(LiveObjectsD_Data_t))
+
+static uint8_t bench_buf[BENCH_BUF_SZ];
+static volatile int bench_sink;
+
+/* Change all the values (step i)*/
+static void bench_update(uint32_t i) {
+	bench_counter = i;
+	bench_temp = (int32_t) (i % 40) - 10;
+	bench_volt = 3.0f + (i % 8) * 0.25f;
+	bench_lat = 48.8 + (i % 1000) * 1e-6;
+	bench_lon = 2.3 + (i % 1000) * 1e-6;
+	bench_alarm = i & 1;
+	bench_rssi = -(int16_t) (i % 90);
+}
+
+static void bench_runCbor(const char *name, LO_payload_enc_t enc_type, uint32_t encodings, uint64_t t_json) {
+	LO_cbor_enc_t enc;
+	uint64_t t0, dt;
+	uint32_t i;
+
+	t0 = loc_test_now_ns();
+	for (i = 0; i < encodings; i++) {
+		bench_update(i);
+		LO_cbor_init(&enc, bench_buf, sizeof(bench_buf), NULL, NULL);
+		LO_cbor_putDataSet(&enc, bench_set, BENCH_SET_NB, enc_type);
+		bench_sink = LO_cbor_finish(&enc);
+	}
+	dt = loc_test_now_ns() - t0;
+	printf("%-9s %7.1f ns/encoding (x%.1f), %3d bytes\n", name, (double) dt / encodings,
+			(double) t_json / dt, bench_sink);
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t encodings = (argc > 1) ? (uint32_t) atoi(argv[1]) : 500000;
+	LO_json_tpl_t *tpl;
+	uint64_t t0, t_json;
+	uint32_t i;
+
+	tpl = LO_json_tpl_create(NULL, bench_set, BENCH_SET_NB, NULL);
+	if (tpl == NULL) {
+		fprintf(stderr, "LO_json_tpl_create failed\n");
+		return 1;
+	}
+
+	t0 = loc_test_now_ns();
+	for (i = 0; i < encodings; i++) {
+		bench_update(i);
+		bench_sink = LO_json_tpl_encode(tpl, (char *) bench_buf, sizeof(bench_buf));
+	}
+	t_json = loc_test_now_ns() - t0;
+	printf("%-9s %7.1f ns/encoding,        %3d bytes\n", "json", (double) t_json / encodings, bench_sink);
+
+	bench_runCbor("cbor", LO_PAYLOAD_CBOR, encodings, t_json);
+	bench_runCbor("cbor_idx", LO_PAYLOAD_CBOR_IDX, encodings, t_json);
+	LO_json_tpl_destroy(tpl);
+	return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  bench_http_dl.c
+ * @brief Downloads of loc_http_dl from a local stand-in server.
+ *
+ *  - large    : throughput of a large resource, written through the sink
+ *               buffer (file) or received into the mapped file (mmap).
+ *  - small    : time of a download of a small resource, on a new connection
+ *               each time, then on the idle connection kept alive.
+ *
+ * Usage : bench_http_dl [size_kb [downloads]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "liveobjects-sys/loc_http_dl.h"
+
+#include "loc_test.h"
+#include "loc_test_httpd.h"
+
+#define BENCH_SMALL_SZ  (64 * 1024)
+#define BENCH_SMALL_NB  200
+
+static char bench_dir[] = "/tmp/bench_http_dl.XXXXXX";
+static char bench_url[64];
+static char bench_path[128];
+
+/* Time of nb downloads (ns), or 0 on error*/
+static uint64_t bench_run(uint32_t nb, LO_rsc_sinkMode_t mode, uint8_t reuse) {
+	LO_http_dl_opt_t opt = { mode, LO_RSC_DIGEST_NONE, NULL, 0, 0, 0 };
+	uint64_t t0 = loc_test_now_ns();
+	uint32_t i;
+
+	for (i = 0; i < nb; i++) {
+		if (!reuse)
+			LO_http_dl_disconnect();
+		if (LO_http_dl_get(bench_url, bench_path, &opt)) {
+			fprintf(stderr, "LO_http_dl_get failed\n");
+			return 0;
+		}
+	}
+	return loc_test_now_ns() - t0;
+}
+
+static void bench_large(const char *name, uint32_t size, uint32_t nb, LO_rsc_sinkMode_t mode) {
+	uint64_t dt = bench_run(nb, mode, 1);
+	if (dt)
+		printf("large %-5s %8.1f MB/s (%u KB x %u)\n", name, (double) size * nb * 1000 / dt, size / 1024, nb);
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t size = ((argc > 1) ? (uint32_t) atoi(argv[1]) : 16 * 1024) * 1024;
+	uint32_t nb = (argc > 2) ? (uint32_t) atoi(argv[2]) : 20;
+	uint64_t t_new, t_reuse;
+	uint8_t *body;
+	uint16_t port;
+	uint32_t i;
+
+	body = (uint8_t *) malloc((size > BENCH_SMALL_SZ) ? size : BENCH_SMALL_SZ);
+	port = loc_test_httpd_start();
+	if ((body == NULL) || (port == 0) || (mkdtemp(bench_dir) == NULL)) {
+		fprintf(stderr, "cannot start the server\n");
+		return 1;
+	}
+	for (i = 0; (i < size) || (i < BENCH_SMALL_SZ); i++)
+		body[i] = (uint8_t) (i * 7 + (i >> 11));
+	snprintf(bench_url, sizeof(bench_url), "http://127.0.0.1:%u/resource.bin", port);
+	snprintf(bench_path, sizeof(bench_path), "%s/resource.bin", bench_dir);
+	loc_test_httpd.body = body;
+	loc_test_httpd.etag = "\"v1\"";
+
+	loc_test_httpd.size = size;
+	bench_large("file", size, nb, LO_RSC_SINK_FILE);
+	bench_large("mmap", size, nb, LO_RSC_SINK_MMAP);
+
+	loc_test_httpd.size = BENCH_SMALL_SZ;
+	t_new = bench_run(BENCH_SMALL_NB, LO_RSC_SINK_FILE, 0);
+	t_reuse = bench_run(BENCH_SMALL_NB, LO_RSC_SINK_FILE, 1);
+	if ((t_new) && (t_reuse))
+		printf("small new   %8.1f us/download (%u KB)\nsmall reuse %8.1f us/download (x%.1f)\n",
+				(double) t_new / BENCH_SMALL_NB / 1000, BENCH_SMALL_SZ / 1024,
+				(double) t_reuse / BENCH_SMALL_NB / 1000, (double) t_new / t_reuse);
+
+	LO_http_dl_disconnect();
+	unlink(bench_path);
+	rmdir(bench_dir);
+	free(body);
+	return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  bench_json_tpl.c
+ * @brief Encoding of a set of data : snprintf of each name and value (as a
+ *        generic JSON encoder does) versus loc_json_tpl.
+ *
+ *  - snprintf  : the whole message is formatted at each encoding.
+ *  - tpl       : precompiled template, all the values change at each encoding.
+ *  - tpl same  : precompiled template, the values do not change.
+ *  - tpl diff  : diff mode, one value of the set changes at each encoding.
+ *
+ * Usage : bench_json_tpl [encodings]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liveobjects-sys/loc_json_tpl.h"
+
+#include "loc_test.h"
+
+#define BENCH_BUF_SZ  512
+
+static uint32_t bench_counter;
+static int32_t bench_temp;
+static float bench_volt;
+static double bench_lat;
+static double bench_lon;
+static uint8_t bench_alarm;
+static int16_t bench_rssi;
+static char bench_state[16] = "RUNNING";
+
+static const LiveObjectsD_Data_t bench_set[] = {
+		{ LOD_TYPE_UINT32, "counter", &bench_counter, 1 },
+		{ LOD_TYPE_INT32, "temperature", &bench_temp, 1 },
+		{ LOD_TYPE_FLOAT, "battery_level", &bench_volt, 1 },
+		{ LOD_TYPE_DOUBLE, "latitude", &bench_lat, 1 },
+		{ LOD_TYPE_DOUBLE, "longitude", &bench_lon, 1 },
+		{ LOD_TYPE_BOOL, "alarm", &bench_alarm, 1 },
+		{ LOD_TYPE_INT16, "rssi", &bench_rssi, 1 },
+		{ LOD_TYPE_STRING_C, "state", bench_state, 1 }
+};
+#define BENCH_SET_NB  (sizeof(bench_set) / sizeof(LiveObjectsD_Data_t))
+
+static char bench_buf[BENCH_BUF_SZ];
+static volatile int bench_sink;
+
+/* Encoding of the whole message by snprintf*/
+static int bench_snprintf(char *buf, int buf_sz) {
+	int len = snprintf(buf, buf_sz, "\"value\":{");
+	uint32_t i;
+
+	for (i = 0; i < BENCH_SET_NB; i++) {
+		const LiveObjectsD_Data_t *data_ptr = &bench_set[i];
+		const char *sep = (i) ? "," : "";
+		switch (data_ptr->data_type) {
+		case LOD_TYPE_UINT32:
+			len += snprintf(buf + len, buf_sz - len, "%s\"%s\":%" PRIu32, sep, data_ptr->data_name,
+					*(const uint32_t *) data_ptr->data_value);
+			break;
+		case LOD_TYPE_INT32:
+			len += snprintf(buf + len, buf_sz - len, "%s\"%s\":%" PRIi32, sep, data_ptr->data_name,
+					*(const int32_t *) data_ptr->data_value);
+			break;
+		case LOD_TYPE_INT16:
+			len += snprintf(buf + len, buf_sz - len, "%s\"%s\":%d", sep, data_ptr->data_name,
+					*(const int16_t *) data_ptr->data_value);
+			break;
+		case LOD_TYPE_FLOAT:
+			len += snprintf(buf + len, buf_sz - len, "%s\"%s\":%.9g", sep, data_ptr->data_name,
+					*(const float *) data_ptr->data_value);
+			break;
+		case LOD_TYPE_DOUBLE:
+			len += snprintf(buf + len, buf_sz - len, "%s\"%s\":%.17g", sep, data_ptr->data_name,
+					*(const double *) data_ptr->data_value);
+			break;
+		case LOD_TYPE_BOOL:
+			len += snprintf(buf + len, buf_sz - len, "%s\"%s\":%s", sep, data_ptr->data_name,
+					(*(const uint8_t *) data_ptr->data_value) ? "true" : "false");
+			break;
+		case LOD_TYPE_STRING_C:
+			len += snprintf(buf + len, buf_sz - len, "%s\"%s\":\"%s\"", sep, data_ptr->data_name,
+					(const char *) data_ptr->data_value);
+			break;
+		default:
+			break;
+		}
+	}
+	len += snprintf(buf + len, buf_sz - len, "}");
+	return len;
+}
+
+/* Change all the values (step i)*/
+static void bench_update(uint32_t i) {
+	bench_counter = i;
+	bench_temp = (int32_t) (i % 40) - 10;
+	bench_volt = 3.0f + (i % 100) * 0.01f;
+	bench_lat = 48.8 + (i % 1000) * 1e-6;
+	bench_lon = 2.3 + (i % 1000) * 1e-6;
+	bench_alarm = i & 1;
+	bench_rssi = -(int16_t) (i % 90);
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t encodings = (argc > 1) ? (uint32_t) atoi(argv[1]) : 500000;
+	LO_json_tpl_t *tpl;
+	uint64_t t0, t_snprintf, t_tpl, t_same, t_diff;
+	int len_snprintf, len_tpl;
+	uint32_t i;
+
+	tpl = LO_json_tpl_create("\"value\":", bench_set, BENCH_SET_NB, NULL);
+	if (tpl == NULL) {
+		fprintf(stderr, "LO_json_tpl_create failed\n");
+		return 1;
+	}
+
+	t0 = loc_test_now_ns();
+	for (i = 0; i < encodings; i++) {
+		bench_update(i);
+		bench_sink = bench_snprintf(bench_buf, sizeof(bench_buf));
+	}
+	t_snprintf = loc_test_now_ns() - t0;
+	len_snprintf = bench_sink;
+
+	t0 = loc_test_now_ns();
+	for (i = 0; i < encodings; i++) {
+		bench_update(i);
+		bench_sink = LO_json_tpl_encode(tpl, bench_buf, sizeof(bench_buf));
+	}
+	t_tpl = loc_test_now_ns() - t0;
+	len_tpl = bench_sink;
+
+	t0 = loc_test_now_ns();
+	for (i = 0; i < encodings; i++)
+		bench_sink = LO_json_tpl_encode(tpl, bench_buf, sizeof(bench_buf));
+	t_same = loc_test_now_ns() - t0;
+
+	LO_json_tpl_setDiff(tpl, 1, 0);
+	LO_json_tpl_encode(tpl, bench_buf, sizeof(bench_buf));
+	t0 = loc_test_now_ns();
+	for (i = 0; i < encodings; i++) {
+		bench_counter++;
+		bench_sink = LO_json_tpl_encode(tpl, bench_buf, sizeof(bench_buf));
+	}
+	t_diff = loc_test_now_ns() - t0;
+
+	printf("fields=%u message=%d/%d bytes\n", (unsigned) BENCH_SET_NB, len_snprintf, len_tpl);
+	printf("snprintf %7.1f ns/encoding\n", (double) t_snprintf / encodings);
+	printf("tpl      %7.1f ns/encoding (x%.1f)\n", (double) t_tpl / encodings, (double) t_snprintf / t_tpl);
+	printf("tpl same %7.1f ns/encoding (x%.1f)\n", (double) t_same / encodings, (double) t_snprintf / t_same);
+	printf("tpl diff %7.1f ns/encoding (x%.1f), %d bytes\n", (double) t_diff / encodings,
+			(double) t_snprintf / t_diff, bench_sink);
+	LO_json_tpl_destroy(tpl);
+	return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  bench_nameidx.c
+ * @brief Lookup of a command by name : linear scan of the table (strcmp)
+ *        versus loc_nameidx, for several table sizes.
+ *
+ * Usage : bench_nameidx [lookups]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liveobjects-sys/loc_nameidx.h"
+
+#include "loc_test.h"
+
+#define BENCH_TABLE_MAX  1024
+
+static LiveObjectsD_Command_t bench_table[BENCH_TABLE_MAX];
+static char bench_names[BENCH_TABLE_MAX][24];
+static volatile int32_t bench_sink;
+
+static int32_t bench_scan(const char *name, uint32_t nb) {
+	uint32_t i;
+	for (i = 0; i < nb; i++) {
+		if (!strcmp(bench_table[i].cmd_name, name))
+			return i;
+	}
+	return -1;
+}
+
+static void bench_run(uint32_t nb, uint32_t lookups) {
+	LO_nameidx_t *idx;
+	uint64_t t0, t_scan, t_idx;
+	uint32_t i;
+
+	for (i = 0; i < nb; i++) {
+		/* Names sharing a long prefix, as the commands of a device often do*/
+		snprintf(bench_names[i], sizeof(bench_names[i]), "device_command_%u", i);
+		bench_table[i].cmd_uref = i + 1;
+		bench_table[i].cmd_name = bench_names[i];
+	}
+	idx = LO_nameidx_createCommands(bench_table, nb);
+	if (idx == NULL) {
+		fprintf(stderr, "LO_nameidx_create(%u) failed\n", nb);
+		exit(1);
+	}
+
+	/* Same sequence of names (found, and 1 of 8 unknown) for both*/
+	t0 = loc_test_now_ns();
+	for (i = 0; i < lookups; i++) {
+		const char *name = (i & 7) ? bench_names[(i * 2654435761u) % nb] : "device_command_unknown";
+		bench_sink = bench_scan(name, nb);
+	}
+	t_scan = loc_test_now_ns() - t0;
+
+	t0 = loc_test_now_ns();
+	for (i = 0; i < lookups; i++) {
+		const char *name = (i & 7) ? bench_names[(i * 2654435761u) % nb] : "device_command_unknown";
+		bench_sink = LO_nameidx_find(idx, name, strlen(name));
+	}
+	t_idx = loc_test_now_ns() - t0;
+
+	printf("entries=%4u : scan %7.1f ns/lookup, nameidx %5.1f ns/lookup (x%.1f)\n", nb,
+			(double) t_scan / lookups, (double) t_idx / lookups, (double) t_scan / t_idx);
+	LO_nameidx_destroy(idx);
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t lookups = (argc > 1) ? (uint32_t) atoi(argv[1]) : 1000000;
+	uint32_t nb;
+
+	for (nb = 4; nb <= BENCH_TABLE_MAX; nb *= 4)
+		bench_run(nb, lookups);
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  bench_pubq.c
+ * @brief Contention of the publish path : client mutex versus loc_pubq.
+ *
+ * N producer threads publish while a client thread processes the requests
+ * (a little work per request, under the client mutex as the core does).
+ *  - mutex : each producer takes the client mutex to flag its data, as
+ *            LiveObjectsClient_PushData does.
+ *  - pubq  : each producer posts a request with LO_pubq_push, the client
+ *            thread drains the queue.
+ * Reports the throughput and the time spent by the producers in a push.
+ *
+ * Usage : bench_pubq [producers [pushes_per_producer]]
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotsoftbox-core/loc_sys.h"
+#include "liveobjects-sys/loc_pubq.h"
+#include "liveobjects-sys/loc_wakeup.h"
+
+#include "loc_test.h"
+
+/* Mutex of the client taken by the publish functions*/
+#define BENCH_MUTEX          1
+/* Work of the client thread per request (encoding, ...)*/
+#define BENCH_WORK_LOOPS     200
+#define BENCH_PRODUCERS_MAX  16
+
+typedef struct {
+	pthread_t thread;
+	uint32_t pushes;
+	uint64_t push_ns;
+	uint64_t push_max_ns;
+	uint32_t retries;
+} bench_producer_t;
+
+static int bench_use_pubq;
+static volatile int bench_stop;
+static uint32_t bench_flagged;       /* mutex mode : requests flagged, under the mutex*/
+static uint64_t bench_processed;
+static volatile uint32_t bench_sink;
+
+static void bench_work(void) {
+	int i;
+	for (i = 0; i < BENCH_WORK_LOOPS; i++)
+		bench_sink += i;
+}
+
+static void bench_handler(const LO_pubq_req_t *req_ptr) {
+	LO_sys_mutex_lock(BENCH_MUTEX);
+	bench_work();
+	bench_processed++;
+	LO_sys_mutex_unlock(BENCH_MUTEX);
+}
+
+static void *bench_client(void *arg) {
+	while (1) {
+		int stop = bench_stop;
+		LO_wakeup_arm();
+		LO_wakeup_wait(-1, 10);
+		if (bench_use_pubq) {
+			LO_pubq_drain(bench_handler);
+		} else {
+			LO_sys_mutex_lock(BENCH_MUTEX);
+			while (bench_flagged) {
+				bench_flagged--;
+				bench_work();
+				bench_processed++;
+			}
+			LO_sys_mutex_unlock(BENCH_MUTEX);
+		}
+		if ((stop) && (bench_use_pubq ? (LO_pubq_pending() == 0) : (bench_flagged == 0)))
+			break;
+	}
+	return NULL;
+}
+
+static void *bench_producer(void *arg) {
+	bench_producer_t *p = (bench_producer_t *) arg;
+	LO_pubq_req_t req = { LO_PUBQ_REQ_USER, 0, 0, NULL };
+	uint32_t i;
+
+	for (i = 0; i < p->pushes; i++) {
+		uint64_t t0 = loc_test_now_ns();
+		uint64_t dt;
+		if (bench_use_pubq) {
+			while (LO_pubq_push(&req) == LO_PUBQ_WOULD_BLOCK) {
+				p->retries++;
+				sched_yield();
+			}
+		} else {
+			LO_sys_mutex_lock(BENCH_MUTEX);
+			bench_flagged++;
+			LO_sys_mutex_unlock(BENCH_MUTEX);
+		}
+		dt = loc_test_now_ns() - t0;
+		p->push_ns += dt;
+		if (p->push_max_ns < dt)
+			p->push_max_ns = dt;
+	}
+	return NULL;
+}
+
+static void bench_run(int use_pubq, int nb, uint32_t pushes) {
+	bench_producer_t prod[BENCH_PRODUCERS_MAX];
+	pthread_t client;
+	uint64_t t0, dt, push_ns = 0, push_max_ns = 0;
+	uint32_t retries = 0;
+	int i;
+
+	LO_sys_init();
+	bench_use_pubq = use_pubq;
+	bench_stop = 0;
+	bench_flagged = 0;
+	bench_processed = 0;
+	memset(prod, 0, sizeof(prod));
+
+	pthread_create(&client, NULL, bench_client, NULL);
+	t0 = loc_test_now_ns();
+	for (i = 0; i < nb; i++) {
+		prod[i].pushes = pushes;
+		pthread_create(&prod[i].thread, NULL, bench_producer, &prod[i]);
+	}
+	for (i = 0; i < nb; i++) {
+		pthread_join(prod[i].thread, NULL);
+		push_ns += prod[i].push_ns;
+		retries += prod[i].retries;
+		if (push_max_ns < prod[i].push_max_ns)
+			push_max_ns = prod[i].push_max_ns;
+	}
+	bench_stop = 1;
+	LO_wakeup_signal();
+	pthread_join(client, NULL);
+	dt = loc_test_now_ns() - t0;
+
+	printf("%-6s producers=%d pushes=%u processed=%llu : %.3f s, %.0f push/s, push avg %.0f ns max %.0f us, retries %u\n",
+			use_pubq ? "pubq" : "mutex", nb, nb * pushes, (unsigned long long) bench_processed, dt / 1e9,
+			(nb * (double) pushes) / (dt / 1e9), (double) push_ns / (nb * (double) pushes), push_max_ns / 1e3,
+			retries);
+	LO_wakeup_close();
+}
+
+int main(int argc, char *argv[]) {
+	int nb = (argc > 1) ? atoi(argv[1]) : 4;
+	uint32_t pushes = (argc > 2) ? (uint32_t) atoi(argv[2]) : 100000;
+
+	if ((nb <= 0) || (nb > BENCH_PRODUCERS_MAX)) {
+		fprintf(stderr, "producers : 1 .. %d\n", BENCH_PRODUCERS_MAX);
+		return 1;
+	}
+	bench_run(0, nb, pushes);
+	bench_run(1, nb, pushes);
+	return 0;
+}
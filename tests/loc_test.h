@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_test.h
+ * @brief Minimal checks and timing helpers for the tests and benchmarks.
+ *
+ * A test is an executable returning 0 when all its checks pass (ctest).
+ */
+
+#ifndef __loc_test_H_
+#define __loc_test_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/** Number of failed checks. */
+static int loc_test_failed __attribute__((unused)) = 0;
+
+/** Check a condition, report it and go on. */
+#define LOC_TEST_CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: CHECK FAILED: %s\n", __FILE__, __LINE__, #cond); \
+			loc_test_failed++; \
+		} \
+	} while (0)
+
+/** Check that two integers are equal. */
+#define LOC_TEST_CHECK_EQ(a, b) \
+	do { \
+		long long _a = (long long) (a); \
+		long long _b = (long long) (b); \
+		if (_a != _b) { \
+			fprintf(stderr, "%s:%d: CHECK FAILED: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, \
+					#a, #b, _a, _b); \
+			loc_test_failed++; \
+		} \
+	} while (0)
+
+/** Result of the test (exit code). */
+#define LOC_TEST_RESULT() \
+	((loc_test_failed) ? (fprintf(stderr, "%d check(s) failed\n", loc_test_failed), 1) \
+			: (printf("OK\n"), 0))
+
+/** Monotonic time in nanoseconds. */
+static inline uint64_t loc_test_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#endif /* __loc_test_H_ */
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  loc_test_httpd.h
+ * @brief Local HTTP/1.1 stand-in server for the tests and benchmarks of the
+ *        downloads (loc_http_dl).
+ *
+ * The server listens on 127.0.0.1 (port chosen by the system) and serves a
+ * single resource from memory, whatever the requested path, with one thread
+ * per connection. It honours "Range" (one range) and "If-Range", keeps the
+ * connections alive, and can be told to cut a response, to send a wrong
+ * Content-Range total, or to send a gzip representation of the resource.
+ */
+
+#ifndef __loc_test_httpd_H_
+#define __loc_test_httpd_H_
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/** Resource served, and behaviour of the server (set while no download is running). */
+typedef struct {
+	const uint8_t *body;           /*!< Resource */
+	uint32_t size;
+	const uint8_t *gz_body;        /*!< gzip representation, sent for "Accept-Encoding: gzip" (or NULL) */
+	uint32_t gz_size;
+	const char *etag;              /*!< ETag of the resource (or NULL) */
+	const char *gz_etag;           /*!< ETag of the gzip representation (or NULL) */
+	const char *last_modified;     /*!< Last-Modified (or NULL) */
+	int64_t cut_at;                /*!< Close the connection after this number of body bytes, once (-1 : never) */
+	int32_t total_delta;           /*!< Added to the total of the Content-Range */
+	/* Last request*/
+	char range[64];                /*!< Range asked (or empty) */
+	char if_range[96];             /*!< If-Range given (or empty) */
+	uint8_t accept_gzip;
+	/* Counters*/
+	uint32_t requests;
+	uint32_t connections;
+	uint32_t active;               /*!< Responses being sent */
+	uint32_t active_max;           /*!< Maximum of active */
+} loc_test_httpd_t;
+
+static loc_test_httpd_t loc_test_httpd __attribute__((unused));
+
+/* Value of a header of the request (copied into val), or 0 if not given*/
+static int loc_test_httpd_header(const char *req, const char *name, char *val, size_t val_sz) {
+	size_t name_len = strlen(name);
+	const char *line = strstr(req, "\r\n");
+
+	while ((line) && (line[2] != '\r')) {
+		const char *end;
+		line += 2;
+		end = strstr(line, "\r\n");
+		if ((end) && (!strncasecmp(line, name, name_len)) && (line[name_len] == ':')) {
+			const char *pc = line + name_len + 1;
+			size_t len;
+			pc += strspn(pc, " \t");
+			len = end - pc;
+			if (len >= val_sz)
+				len = val_sz - 1;
+			memcpy(val, pc, len);
+			val[len] = 0;
+			return 1;
+		}
+		line = end;
+	}
+	return 0;
+}
+
+static int loc_test_httpd_send(int fd, const void *buf, size_t len) {
+	const char *pc = (const char *) buf;
+	while (len) {
+		ssize_t n = send(fd, pc, len, MSG_NOSIGNAL);
+		if (n <= 0)
+			return -1;
+		pc += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Answer one request. Return 0, or -1 to close the connection*/
+static int loc_test_httpd_respond(int fd, const char *req) {
+	loc_test_httpd_t *srv = &loc_test_httpd;
+	char range[64] = "", if_range[96] = "", encoding[64] = "";
+	char hdr[512];
+	const uint8_t *body = srv->body;
+	const char *etag = srv->etag;
+	uint32_t size = srv->size;
+	uint32_t start = 0, last;
+	int64_t cut_at;
+	int partial = 0;
+	int len;
+
+	loc_test_httpd_header(req, "Range", range, sizeof(range));
+	loc_test_httpd_header(req, "If-Range", if_range, sizeof(if_range));
+	loc_test_httpd_header(req, "Accept-Encoding", encoding, sizeof(encoding));
+	strcpy(srv->range, range);
+	strcpy(srv->if_range, if_range);
+	srv->accept_gzip = (strstr(encoding, "gzip") != NULL);
+	__sync_fetch_and_add(&srv->requests, 1);
+
+	if ((srv->accept_gzip) && (srv->gz_body)) {
+		body = srv->gz_body;
+		size = srv->gz_size;
+		etag = srv->gz_etag;
+	}
+	last = size - 1;
+	if ((range[0]) && (body == srv->body)) {
+		unsigned long long a, b;
+		int nb = sscanf(range, "bytes=%llu-%llu", &a, &b);
+		/* A strong validator only, compared as is*/
+		partial = (nb >= 1) && (a < size) && ((if_range[0] == 0)
+				|| ((etag) && (strncmp(etag, "W/", 2)) && (!strcmp(if_range, etag)))
+				|| ((srv->last_modified) && (!strcmp(if_range, srv->last_modified))));
+		if (partial) {
+			start = (uint32_t) a;
+			if ((nb == 2) && (b < last))
+				last = (uint32_t) b;
+		}
+	}
+
+	len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 %s\r\nContent-Length: %u\r\n",
+			(partial) ? "206 Partial Content" : "200 OK", last + 1 - start);
+	if (partial)
+		len += snprintf(hdr + len, sizeof(hdr) - len, "Content-Range: bytes %u-%u/%lld\r\n", start, last,
+				(long long) size + srv->total_delta);
+	if (etag)
+		len += snprintf(hdr + len, sizeof(hdr) - len, "ETag: %s\r\n", etag);
+	if (srv->last_modified)
+		len += snprintf(hdr + len, sizeof(hdr) - len, "Last-Modified: %s\r\n", srv->last_modified);
+	if (body != srv->body)
+		len += snprintf(hdr + len, sizeof(hdr) - len, "Content-Encoding: gzip\r\n");
+	len += snprintf(hdr + len, sizeof(hdr) - len, "Connection: keep-alive\r\n\r\n");
+	if (loc_test_httpd_send(fd, hdr, len))
+		return -1;
+
+	cut_at = __sync_lock_test_and_set(&srv->cut_at, -1);
+	if ((cut_at >= 0) && (cut_at < last + 1 - start)) {
+		loc_test_httpd_send(fd, body + start, (size_t) cut_at);
+		return -1;
+	}
+	if (cut_at >= 0)
+		srv->cut_at = cut_at;
+	return loc_test_httpd_send(fd, body + start, last + 1 - start);
+}
+
+static int loc_test_httpd_answer(int fd, const char *req) {
+	uint32_t active = __sync_add_and_fetch(&loc_test_httpd.active, 1);
+	uint32_t active_max = loc_test_httpd.active_max;
+	int ret;
+
+	while ((active > active_max)
+			&& (!__sync_bool_compare_and_swap(&loc_test_httpd.active_max, active_max, active)))
+		active_max = loc_test_httpd.active_max;
+	ret = loc_test_httpd_respond(fd, req);
+	__sync_fetch_and_sub(&loc_test_httpd.active, 1);
+	return ret;
+}
+
+static void * loc_test_httpd_conn(void *arg) {
+	int fd = (int) (intptr_t) arg;
+	char req[4096];
+	size_t len = 0;
+
+	while (1) {
+		char *end;
+		ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+		if (n <= 0)
+			break;
+		len += n;
+		req[len] = 0;
+		while ((end = strstr(req, "\r\n\r\n")) != NULL) {
+			size_t req_len = end + 4 - req;
+			end[2] = 0;
+			if (loc_test_httpd_answer(fd, req))
+				goto exit;
+			memmove(req, req + req_len, len - req_len + 1);
+			len -= req_len;
+		}
+		if (len >= sizeof(req) - 1)
+			break;
+	}
+exit:
+	close(fd);
+	return NULL;
+}
+
+static void * loc_test_httpd_accept(void *arg) {
+	int lfd = (int) (intptr_t) arg;
+	while (1) {
+		pthread_t thread;
+		int fd = accept(lfd, NULL, NULL);
+		if (fd < 0)
+			continue;
+		__sync_fetch_and_add(&loc_test_httpd.connections, 1);
+		if (pthread_create(&thread, NULL, loc_test_httpd_conn, (void *) (intptr_t) fd))
+			close(fd);
+		else
+			pthread_detach(thread);
+	}
+	return NULL;
+}
+
+/** Start the server (until the end of the process). Return its port, or 0 on error. */
+static uint16_t __attribute__((unused)) loc_test_httpd_start(void) {
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	pthread_t thread;
+	int lfd;
+
+	loc_test_httpd.cut_at = -1;
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		return 0;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((bind(lfd, (struct sockaddr *) &addr, sizeof(addr))) || (listen(lfd, 16))
+			|| (getsockname(lfd, (struct sockaddr *) &addr, &addr_len))
+			|| (pthread_create(&thread, NULL, loc_test_httpd_accept, (void *) (intptr_t) lfd))) {
+		close(lfd);
+		return 0;
+	}
+	pthread_detach(thread);
+	return ntohs(addr.sin_port);
+}
+
+#endif /* __loc_test_httpd_H_ */
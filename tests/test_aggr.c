@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  test_aggr.c
+ * @brief Summaries of a loc_aggr aggregation : NaN values and samples
+ *        without any value, and publish callback adding a sample.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "liveobjects-sys/loc_aggr.h"
+
+#include "loc_test.h"
+
+static float test_temp;
+static float test_hum;
+
+static const LiveObjectsD_Data_t test_set[] = {
+		{ LOD_TYPE_FLOAT, "temp", &test_temp, 1 },
+		{ LOD_TYPE_FLOAT, "hum", &test_hum, 1 },
+		{ LOD_TYPE_STRING_C, "state", "ON", 1 }
+};
+#define TEST_SET_NB  (sizeof(test_set) / sizeof(LiveObjectsD_Data_t))
+
+static char test_msg[512];
+static uint32_t test_samples;
+static int test_published;
+static LO_aggr_t *test_reenter;
+
+static int test_publish(void *ctx, const char *msg, uint32_t msg_len, uint32_t samples) {
+	if (msg_len < sizeof(test_msg)) {
+		memcpy(test_msg, msg, msg_len);
+		test_msg[msg_len] = 0;
+	}
+	test_samples = samples;
+	test_published++;
+	/* The aggregation is not locked during the callback*/
+	if (test_reenter)
+		LOC_TEST_CHECK_EQ(LO_aggr_add(test_reenter), 1);
+	return 0;
+}
+
+static void test_add(LO_aggr_t *aggr, float temp, float hum, int expected) {
+	test_temp = temp;
+	test_hum = hum;
+	LOC_TEST_CHECK_EQ(LO_aggr_add(aggr), expected);
+}
+
+int main(void) {
+	LO_aggr_cfg_t cfg = { 3600 * 1000, "\"value\":", NULL };
+	LO_aggr_t *aggr;
+
+	aggr = LO_aggr_create(test_set, TEST_SET_NB, &cfg, test_publish, NULL);
+	LOC_TEST_CHECK(aggr != NULL);
+	if (aggr == NULL)
+		return LOC_TEST_RESULT();
+
+	/* Only NaN values : nothing counted, nothing published*/
+	test_add(aggr, NAN, NAN, 0);
+	test_add(aggr, NAN, NAN, 0);
+	LOC_TEST_CHECK_EQ(LO_aggr_flush(aggr), 0);
+	LOC_TEST_CHECK_EQ(test_published, 0);
+
+	/* A NaN value is skipped, the sample is counted for the other field*/
+	test_add(aggr, 20.0f, 50.0f, 1);
+	test_add(aggr, NAN, 60.0f, 2);
+	test_add(aggr, NAN, NAN, 2);
+	test_add(aggr, 22.0f, NAN, 3);
+	LOC_TEST_CHECK_EQ(LO_aggr_flush(aggr), 0);
+	LOC_TEST_CHECK_EQ(test_published, 1);
+	LOC_TEST_CHECK_EQ(test_samples, 3);
+	LOC_TEST_CHECK(!strcmp(test_msg, "\"value\":{\"temp\":{\"min\":20,\"max\":22,\"mean\":21,\"count\":2,\"last\":22},"
+			"\"hum\":{\"min\":50,\"max\":60,\"mean\":55,\"count\":2,\"last\":60}}"));
+
+	/* The publish callback adds the first sample of the next window*/
+	test_add(aggr, 1.0f, 2.0f, 1);
+	test_reenter = aggr;
+	LOC_TEST_CHECK_EQ(LO_aggr_flush(aggr), 0);
+	test_reenter = NULL;
+	LOC_TEST_CHECK_EQ(test_published, 2);
+	LOC_TEST_CHECK_EQ(LO_aggr_flush(aggr), 0);
+	LOC_TEST_CHECK_EQ(test_published, 3);
+	LOC_TEST_CHECK_EQ(test_samples, 1);
+
+	LO_aggr_destroy(aggr);
+	LOC_TEST_CHECK_EQ(test_published, 3);
+	return LOC_TEST_RESULT();
+}
@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  test_cbor.c
+ * @brief Round trip of the loc_cbor encodings through a minimal decoder :
+ *        half/single/double selection of the floats, integers, data sets,
+ *        streaming, and the CBOR messages of loc_batch.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "liveobjects-sys/loc_batch.h"
+#include "liveobjects-sys/loc_cbor.h"
+
+#include "loc_test.h"
+
+/* Minimal decoder*/
+typedef struct {
+	const uint8_t *pc;
+	const uint8_t *end;
+	int err;
+} test_dec_t;
+
+/* Head of an item : major type (0..7), argument (or simple value / float size)*/
+static uint8_t test_head(test_dec_t *dec, uint64_t *arg) {
+	uint8_t ib, ai, n, i;
+
+	if (dec->pc >= dec->end) {
+		dec->err = 1;
+		return 0xFF;
+	}
+	ib = *dec->pc++;
+	ai = ib & 0x1F;
+	*arg = ai;
+	if (ai >= 24) {
+		n = (ai == 24) ? 1 : (ai == 25) ? 2 : (ai == 26) ? 4 : 8;
+		if ((ai > 27) || (dec->pc + n > dec->end)) {
+			dec->err = 1;
+			return 0xFF;
+		}
+		*arg = 0;
+		for (i = 0; i < n; i++)
+			*arg = (*arg << 8) | *dec->pc++;
+	}
+	return ib >> 5;
+}
+
+/* Float item : value and size of the encoding (2, 4 or 8), 0 if not a float*/
+static int test_float(test_dec_t *dec, double *val) {
+	const uint8_t *pc = dec->pc;
+	uint64_t arg;
+	uint8_t ai = (pc < dec->end) ? (*pc & 0x1F) : 0;
+
+	if ((test_head(dec, &arg) != 7) || (ai < 25) || (ai > 27))
+		return 0;
+	if (ai == 25) {
+		int exp = (int) ((arg >> 10) & 0x1F);
+		int mant = (int) (arg & 0x3FF);
+		if (exp == 0)
+			*val = ldexp(mant, -24);
+		else if (exp == 31)
+			*val = (mant) ? NAN : INFINITY;
+		else
+			*val = ldexp(mant + 1024, exp - 25);
+		if (arg & 0x8000)
+			*val = -*val;
+		return 2;
+	}
+	if (ai == 26) {
+		uint32_t bits = (uint32_t) arg;
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		*val = f;
+		return 4;
+	}
+	memcpy(val, &arg, sizeof(*val));
+	return 8;
+}
+
+/* Encode a double and check the size of its encoding and the decoded value*/
+static int test_double(double val, int size) {
+	uint8_t buf[16];
+	LO_cbor_enc_t enc;
+	test_dec_t dec;
+	double out = 0;
+	int len;
+
+	LO_cbor_init(&enc, buf, sizeof(buf), NULL, NULL);
+	LO_cbor_putDouble(&enc, val);
+	len = LO_cbor_finish(&enc);
+	dec.pc = buf;
+	dec.end = buf + len;
+	dec.err = 0;
+	if ((len != size + 1) || (test_float(&dec, &out) != size) || (dec.pc != dec.end))
+		return 0;
+	if (val != val)
+		return (out != out);
+	/* Same value, and same sign for the zeros*/
+	return (out == val) && (signbit(out) == signbit(val));
+}
+
+/* Check a text item*/
+static int test_text(test_dec_t *dec, const char *str) {
+	uint64_t len;
+	if ((test_head(dec, &len) != 3) || (len != strlen(str)) || (dec->pc + len > dec->end))
+		return 0;
+	dec->pc += len;
+	return !memcmp(dec->pc - len, str, len);
+}
+
+/* Check an integer item*/
+static int test_int(test_dec_t *dec, int64_t val) {
+	uint64_t arg;
+	uint8_t major = test_head(dec, &arg);
+	if (major == 0)
+		return (val >= 0) && (arg == (uint64_t) val);
+	if (major == 1)
+		return (val < 0) && (arg == (uint64_t) (-1 - val));
+	return 0;
+}
+
+/* Encoding through a write callback*/
+static uint8_t test_stream[256];
+static uint32_t test_stream_len;
+static uint32_t test_stream_calls;
+
+static int test_write(void *ctx, const uint8_t *data, uint32_t len) {
+	if (test_stream_len + len > sizeof(test_stream))
+		return -1;
+	memcpy(test_stream + test_stream_len, data, len);
+	test_stream_len += len;
+	test_stream_calls++;
+	return 0;
+}
+
+/* Messages of the batch*/
+static uint8_t test_msg[512];
+static uint32_t test_msg_len;
+static uint32_t test_msg_samples;
+
+static int test_flush(void *ctx, const char *msg, uint32_t msg_len, uint32_t samples) {
+	if (msg_len <= sizeof(test_msg)) {
+		memcpy(test_msg, msg, msg_len);
+		test_msg_len = msg_len;
+		test_msg_samples = samples;
+	}
+	return 0;
+}
+
+static int32_t test_temp = -12;
+static uint32_t test_counter = 1000;
+static float test_volt = 4.5f;
+static double test_lat = 48.8566;
+static uint8_t test_alarm = 1;
+static char test_state[8] = "OK";
+
+static const LiveObjectsD_Data_t test_set[] = {
+		{ LOD_TYPE_INT32, "temperature", &test_temp, 1 },
+		{ LOD_TYPE_UINT32, "counter", &test_counter, 1 },
+		{ LOD_TYPE_FLOAT, "volt", &test_volt, 1 },
+		{ LOD_TYPE_DOUBLE, "lat", &test_lat, 1 },
+		{ LOD_TYPE_BOOL, "alarm", &test_alarm, 1 },
+		{ LOD_TYPE_STRING_C, "state", test_state, 1 }
+};
+#define TEST_SET_NB  (sizeof(test_set) / sizeof(LiveObjectsD_Data_t))
+
+int main(void) {
+	uint8_t buf[64];
+	uint8_t small[9];
+	LO_cbor_enc_t enc;
+	test_dec_t dec;
+	LO_batch_cfg_t cfg;
+	LO_batch_t *batch;
+	uint64_t arg;
+	double val;
+	int len, i;
+
+	/* Floats : smallest encoding keeping the exact value*/
+	LOC_TEST_CHECK(test_double(0.0, 2));
+	LOC_TEST_CHECK(test_double(-0.0, 2));
+	LOC_TEST_CHECK(test_double(1.0, 2));
+	LOC_TEST_CHECK(test_double(-1.5, 2));
+	LOC_TEST_CHECK(test_double(65504.0, 2));          /* Largest half*/
+	LOC_TEST_CHECK(test_double(ldexp(1, -14), 2));    /* Smallest normal half*/
+	LOC_TEST_CHECK(test_double(ldexp(1, -24), 2));    /* Smallest subnormal half*/
+	LOC_TEST_CHECK(test_double(ldexp(3, -24), 2));
+	LOC_TEST_CHECK(test_double(INFINITY, 2));
+	LOC_TEST_CHECK(test_double(-INFINITY, 2));
+	LOC_TEST_CHECK(test_double(NAN, 2));
+	LOC_TEST_CHECK(test_double(65505.0, 4));
+	LOC_TEST_CHECK(test_double(1.0 + ldexp(1, -11), 4));  /* 1 bit more than a half*/
+	LOC_TEST_CHECK(test_double(ldexp(1, -25), 4));    /* Under the half subnormals*/
+	LOC_TEST_CHECK(test_double(ldexp(3, -25), 4));
+	LOC_TEST_CHECK(test_double(100000.0, 4));
+	LOC_TEST_CHECK(test_double(0.1f, 4));
+	LOC_TEST_CHECK(test_double(3.4e38f, 4));
+	LOC_TEST_CHECK(test_double(0.1, 8));
+	LOC_TEST_CHECK(test_double(1e300, 8));
+	LOC_TEST_CHECK(test_double(1.0 + ldexp(1, -24), 8));  /* 1 bit more than a single*/
+	LOC_TEST_CHECK(test_double(ldexp(1, -1074), 8));
+
+	/* Integers : shortest head*/
+	LO_cbor_init(&enc, buf, sizeof(buf), NULL, NULL);
+	LO_cbor_putInt(&enc, 23);
+	LO_cbor_putInt(&enc, 24);
+	LO_cbor_putInt(&enc, -24);
+	LO_cbor_putInt(&enc, -25);
+	LO_cbor_putUint(&enc, 65536);
+	LO_cbor_putInt(&enc, INT64_MIN);
+	len = LO_cbor_finish(&enc);
+	LOC_TEST_CHECK_EQ(len, 1 + 2 + 1 + 2 + 5 + 9);
+	dec.pc = buf;
+	dec.end = buf + len;
+	dec.err = 0;
+	LOC_TEST_CHECK(test_int(&dec, 23));
+	LOC_TEST_CHECK(test_int(&dec, 24));
+	LOC_TEST_CHECK(test_int(&dec, -24));
+	LOC_TEST_CHECK(test_int(&dec, -25));
+	LOC_TEST_CHECK(test_int(&dec, 65536));
+	LOC_TEST_CHECK(test_int(&dec, INT64_MIN));
+	LOC_TEST_CHECK(!dec.err);
+
+	/* Buffer too small*/
+	LO_cbor_init(&enc, small, 4, NULL, NULL);
+	LO_cbor_putText(&enc, "temperature", 11);
+	LOC_TEST_CHECK_EQ(LO_cbor_finish(&enc), -1);
+
+	/* Data set, names then indexes as keys*/
+	for (i = 0; i < 2; i++) {
+		LO_payload_enc_t enc_type = (i) ? LO_PAYLOAD_CBOR_IDX : LO_PAYLOAD_CBOR;
+		LO_cbor_init(&enc, buf, sizeof(buf), NULL, NULL);
+		LO_cbor_putDataSet(&enc, test_set, TEST_SET_NB, enc_type);
+		len = LO_cbor_finish(&enc);
+		LOC_TEST_CHECK(len > 0);
+		dec.pc = buf;
+		dec.end = buf + len;
+		dec.err = 0;
+		LOC_TEST_CHECK((test_head(&dec, &arg) == 5) && (arg == TEST_SET_NB));
+		LOC_TEST_CHECK((enc_type == LO_PAYLOAD_CBOR) ? test_text(&dec, "temperature") : test_int(&dec, 0));
+		LOC_TEST_CHECK(test_int(&dec, -12));
+		LOC_TEST_CHECK((enc_type == LO_PAYLOAD_CBOR) ? test_text(&dec, "counter") : test_int(&dec, 1));
+		LOC_TEST_CHECK(test_int(&dec, 1000));
+		LOC_TEST_CHECK((enc_type == LO_PAYLOAD_CBOR) ? test_text(&dec, "volt") : test_int(&dec, 2));
+		LOC_TEST_CHECK((test_float(&dec, &val) == 2) && (val == 4.5));
+		LOC_TEST_CHECK((enc_type == LO_PAYLOAD_CBOR) ? test_text(&dec, "lat") : test_int(&dec, 3));
+		LOC_TEST_CHECK((test_float(&dec, &val) == 8) && (val == 48.8566));
+		LOC_TEST_CHECK((enc_type == LO_PAYLOAD_CBOR) ? test_text(&dec, "alarm") : test_int(&dec, 4));
+		LOC_TEST_CHECK((test_head(&dec, &arg) == 7) && (arg == 21));
+		LOC_TEST_CHECK((enc_type == LO_PAYLOAD_CBOR) ? test_text(&dec, "state") : test_int(&dec, 5));
+		LOC_TEST_CHECK(test_text(&dec, "OK"));
+		LOC_TEST_CHECK((!dec.err) && (dec.pc == dec.end));
+	}
+
+	/* Streaming through a buffer of 9 bytes*/
+	test_stream_len = 0;
+	LO_cbor_init(&enc, small, sizeof(small), test_write, NULL);
+	LO_cbor_putDataSet(&enc, test_set, TEST_SET_NB, LO_PAYLOAD_CBOR);
+	LOC_TEST_CHECK_EQ(LO_cbor_finish(&enc), (int) test_stream_len);
+	LO_cbor_init(&enc, buf, sizeof(buf), NULL, NULL);
+	LO_cbor_putDataSet(&enc, test_set, TEST_SET_NB, LO_PAYLOAD_CBOR);
+	len = LO_cbor_finish(&enc);
+	LOC_TEST_CHECK_EQ((int) test_stream_len, len);
+	LOC_TEST_CHECK(!memcmp(test_stream, buf, len));
+	LOC_TEST_CHECK(test_stream_calls > 1);
+
+	/* Batch of 3 samples, CBOR with indexes*/
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.max_samples = 3;
+	cfg.max_age_ms = 60000;
+	cfg.encoding = LO_PAYLOAD_CBOR_IDX;
+	batch = LO_batch_create(test_set, TEST_SET_NB, &cfg, test_flush, NULL);
+	LOC_TEST_CHECK(batch != NULL);
+	if (batch) {
+		for (i = 0; i < 3; i++) {
+			test_counter = 1000 + i;
+			LO_batch_add(batch);
+		}
+		LOC_TEST_CHECK_EQ(test_msg_samples, 3);
+		dec.pc = test_msg;
+		dec.end = test_msg + test_msg_len;
+		dec.err = 0;
+		LOC_TEST_CHECK((test_head(&dec, &arg) == 4) && (arg == 3));
+		for (i = 0; i < 3; i++) {
+			LOC_TEST_CHECK((test_head(&dec, &arg) == 5) && (arg == 2));
+			LOC_TEST_CHECK(test_text(&dec, "ts"));
+			/* Milliseconds since the epoch, after 2017*/
+			LOC_TEST_CHECK((test_head(&dec, &arg) == 0) && (arg > 1500000000000ULL));
+			LOC_TEST_CHECK(test_text(&dec, "v"));
+			LOC_TEST_CHECK((test_head(&dec, &arg) == 5) && (arg == TEST_SET_NB));
+			LOC_TEST_CHECK(test_int(&dec, 0) && test_int(&dec, -12));
+			LOC_TEST_CHECK(test_int(&dec, 1) && test_int(&dec, 1000 + i));
+			LOC_TEST_CHECK(test_int(&dec, 2) && (test_float(&dec, &val) == 2));
+			LOC_TEST_CHECK(test_int(&dec, 3) && (test_float(&dec, &val) == 8));
+			LOC_TEST_CHECK(test_int(&dec, 4) && (test_head(&dec, &arg) == 7));
+			LOC_TEST_CHECK(test_int(&dec, 5) && test_text(&dec, "OK"));
+		}
+		LOC_TEST_CHECK((!dec.err) && (dec.pc == dec.end));
+		LO_batch_destroy(batch);
+	}
+	return LOC_TEST_RESULT();
+}
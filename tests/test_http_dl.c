@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  test_http_dl.c
+ * @brief Downloads of loc_http_dl from a local stand-in server : resume
+ *        after a cut, resource changed (If-Range answered by a 200), weak
+ *        ETag, Content-Range total not matching the saved state,
+ *        concurrent downloads (LO_http_dl_start), resume of a gzip
+ *        download (LOC_FEATURE_HTTP_GZIP), and offsets of the sink.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "liveobjects-sys/loc_http_dl.h"
+
+#if LOC_FEATURE_HTTP_GZIP
+#include <zlib.h>
+#endif
+
+#include "loc_test.h"
+#include "loc_test_httpd.h"
+
+#define TEST_SIZE  (300 * 1024)
+#define TEST_CUT   (100 * 1024 + 17)
+#define TEST_JOBS  6
+
+static uint8_t test_body[TEST_SIZE];
+static uint8_t test_body2[TEST_SIZE];
+static char test_dir[] = "/tmp/test_http_dl.XXXXXX";
+static char test_url[64];
+static char test_path[128];
+
+/* Context of a download started by LO_http_dl_start*/
+typedef struct {
+	char path[128];
+	int ret;
+	int done;
+} test_job_t;
+
+/* The downloaded file is the expected resource*/
+static int test_file(const uint8_t *expected, uint32_t size) {
+	static uint8_t buf[TEST_SIZE + 1];
+	FILE *fp = fopen(test_path, "rb");
+	size_t len;
+
+	if (fp == NULL)
+		return 0;
+	len = fread(buf, 1, sizeof(buf), fp);
+	fclose(fp);
+	return (len == size) && (!memcmp(buf, expected, size));
+}
+
+/* Serve body, with the given validators*/
+static void test_serve(const uint8_t *body, const char *etag, const char *last_modified) {
+	loc_test_httpd.body = body;
+	loc_test_httpd.size = TEST_SIZE;
+	loc_test_httpd.etag = etag;
+	loc_test_httpd.last_modified = last_modified;
+	loc_test_httpd.total_delta = 0;
+	loc_test_httpd.cut_at = -1;
+}
+
+/* Download cut after TEST_CUT bytes : the partial file is kept*/
+static void test_cut(LO_rsc_sinkMode_t mode) {
+	LO_http_dl_opt_t opt = { mode, LO_RSC_DIGEST_NONE, NULL, 0, 0, 0 };
+	LO_http_dl_state_t state;
+
+	loc_test_httpd.cut_at = TEST_CUT;
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, &opt), -1);
+	LOC_TEST_CHECK_EQ(LO_http_dl_getState(test_path, &state), 0);
+	LOC_TEST_CHECK_EQ(state.offset, TEST_CUT);
+	LOC_TEST_CHECK_EQ(state.size, TEST_SIZE);
+	LOC_TEST_CHECK(!strcmp(state.url, test_url));
+}
+
+static void test_resume(LO_rsc_sinkMode_t mode) {
+	LO_http_dl_opt_t opt = { mode, LO_RSC_DIGEST_NONE, NULL, 0, 0, 0 };
+	LO_http_dl_state_t state;
+	char range[64];
+
+	test_serve(test_body, "\"v1\"", "Mon, 19 Oct 2026 08:00:00 GMT");
+	test_cut(mode);
+
+	/* Only the missing bytes, if the ETag still matches*/
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, &opt), 0);
+	snprintf(range, sizeof(range), "bytes=%u-", TEST_CUT);
+	LOC_TEST_CHECK(!strcmp(loc_test_httpd.range, range));
+	LOC_TEST_CHECK(!strcmp(loc_test_httpd.if_range, "\"v1\""));
+	LOC_TEST_CHECK(test_file(test_body, TEST_SIZE));
+	LOC_TEST_CHECK_EQ(LO_http_dl_getState(test_path, &state), -1);
+	unlink(test_path);
+}
+
+/* The resource changes between the cut and the resume : the If-Range does*/
+/* not match, the server sends the whole new resource (200)*/
+static void test_changed(void) {
+	test_serve(test_body, "\"v1\"", NULL);
+	test_cut(LO_RSC_SINK_FILE);
+
+	test_serve(test_body2, "\"v2\"", NULL);
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, NULL), 0);
+	LOC_TEST_CHECK(!strcmp(loc_test_httpd.if_range, "\"v1\""));
+	LOC_TEST_CHECK(test_file(test_body2, TEST_SIZE));
+	unlink(test_path);
+}
+
+/* A weak ETag cannot validate a range : Last-Modified is used instead, or*/
+/* nothing is kept without it*/
+static void test_weak(void) {
+	LO_http_dl_state_t state;
+	char range[64];
+
+	test_serve(test_body, "W/\"v1\"", "Mon, 19 Oct 2026 08:00:00 GMT");
+	test_cut(LO_RSC_SINK_FILE);
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, NULL), 0);
+	snprintf(range, sizeof(range), "bytes=%u-", TEST_CUT);
+	LOC_TEST_CHECK(!strcmp(loc_test_httpd.range, range));
+	LOC_TEST_CHECK(!strcmp(loc_test_httpd.if_range, "Mon, 19 Oct 2026 08:00:00 GMT"));
+	LOC_TEST_CHECK(test_file(test_body, TEST_SIZE));
+	unlink(test_path);
+
+	test_serve(test_body, "W/\"v1\"", NULL);
+	loc_test_httpd.cut_at = TEST_CUT;
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, NULL), -1);
+	LOC_TEST_CHECK_EQ(LO_http_dl_getState(test_path, &state), -1);
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, NULL), 0);
+	LOC_TEST_CHECK(loc_test_httpd.range[0] == 0);
+	LOC_TEST_CHECK(test_file(test_body, TEST_SIZE));
+	unlink(test_path);
+}
+
+/* The total of the Content-Range does not match the saved size : the partial*/
+/* file is dropped, and the next call downloads the whole resource*/
+static void test_total(void) {
+	LO_http_dl_state_t state;
+	char part[160];
+
+	test_serve(test_body, "\"v1\"", NULL);
+	test_cut(LO_RSC_SINK_FILE);
+	loc_test_httpd.total_delta = 1;
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, NULL), -1);
+	LOC_TEST_CHECK_EQ(LO_http_dl_getState(test_path, &state), -1);
+	snprintf(part, sizeof(part), "%s.part", test_path);
+	LOC_TEST_CHECK(access(part, F_OK) != 0);
+	LOC_TEST_CHECK(access(test_path, F_OK) != 0);
+
+	loc_test_httpd.total_delta = 0;
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, NULL), 0);
+	LOC_TEST_CHECK(loc_test_httpd.range[0] == 0);
+	LOC_TEST_CHECK(test_file(test_body, TEST_SIZE));
+	unlink(test_path);
+}
+
+static void test_done(void *ctx, const char *path, int ret) {
+	test_job_t *job = (test_job_t *) ctx;
+	job->ret = ret;
+	job->done = (!strcmp(path, job->path)) ? 1 : -1;
+}
+
+/* Reader of the sink : 1000 bytes of test_body at each call*/
+static int test_reader(void *ctx, char *buf, uint32_t len) {
+	uint32_t *offset = (uint32_t *) ctx;
+	if (len > 1000)
+		len = 1000;
+	memcpy(buf, test_body + *offset, len);
+	*offset += len;
+	return (int) len;
+}
+
+/* The data is only appended to the sink : a gap or an overlap is refused*/
+static void test_sinkOffset(LO_rsc_sinkMode_t mode) {
+	LO_rsc_sink_t sink;
+	uint32_t offset = 0;
+
+	memset(&sink, 0, sizeof(sink));
+	LOC_TEST_CHECK_EQ(LO_rsc_sink_open(&sink, test_path, TEST_SIZE, mode), 0);
+	LOC_TEST_CHECK_EQ(LO_rsc_sink_fill(&sink, 0, test_reader, &offset), 1000);
+	LOC_TEST_CHECK_EQ(LO_rsc_sink_fill(&sink, 500, test_reader, &offset), -1);
+	LOC_TEST_CHECK_EQ(LO_rsc_sink_fill(&sink, 2000, test_reader, &offset), -1);
+	LOC_TEST_CHECK_EQ(sink.written, 1000);
+	while ((sink.written < TEST_SIZE) && (LO_rsc_sink_fill(&sink, sink.written, test_reader, &offset) > 0))
+		;
+	LOC_TEST_CHECK_EQ(LO_rsc_sink_close(&sink, 1), 0);
+	LOC_TEST_CHECK(test_file(test_body, TEST_SIZE));
+	unlink(test_path);
+}
+
+/* Several downloads at once, each one with its own context, up to*/
+/* LOC_HTTP_DL_ACTIVE_MAX at the same time*/
+static void test_concurrent(void) {
+	static test_job_t jobs[TEST_JOBS];
+	int i;
+
+	test_serve(test_body, "\"v1\"", NULL);
+	loc_test_httpd.active_max = 0;
+	for (i = 0; i < TEST_JOBS; i++) {
+		snprintf(jobs[i].path, sizeof(jobs[i].path), "%s/asset%d.bin", test_dir, i);
+		LOC_TEST_CHECK_EQ(LO_http_dl_start(test_url, jobs[i].path, NULL, test_done, &jobs[i]), 0);
+	}
+	/* One download at a time per file*/
+	LOC_TEST_CHECK_EQ(LO_http_dl_start(test_url, jobs[0].path, NULL, test_done, &jobs[0]), -1);
+	LO_http_dl_wait();
+
+	for (i = 0; i < TEST_JOBS; i++) {
+		LOC_TEST_CHECK_EQ(jobs[i].done, 1);
+		LOC_TEST_CHECK_EQ(jobs[i].ret, 0);
+		strcpy(test_path, jobs[i].path);
+		LOC_TEST_CHECK(test_file(test_body, TEST_SIZE));
+		unlink(jobs[i].path);
+	}
+	LOC_TEST_CHECK(loc_test_httpd.active_max <= LOC_HTTP_DL_ACTIVE_MAX);
+}
+
+#if LOC_FEATURE_HTTP_GZIP
+/* gzip representation of test_body (length), or NULL*/
+static uint8_t * test_gzip(uint32_t *len) {
+	uint8_t *buf = (uint8_t *) malloc(TEST_SIZE + 1024);
+	z_stream zs;
+
+	memset(&zs, 0, sizeof(zs));
+	if ((buf == NULL) || (deflateInit2(&zs, 6, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)) {
+		free(buf);
+		return NULL;
+	}
+	zs.next_in = test_body;
+	zs.avail_in = TEST_SIZE;
+	zs.next_out = buf;
+	zs.avail_out = TEST_SIZE + 1024;
+	if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+		deflateEnd(&zs);
+		free(buf);
+		return NULL;
+	}
+	*len = (uint32_t) zs.total_out;
+	deflateEnd(&zs);
+	return buf;
+}
+
+/* A gzip download cut in the middle : its ETag is the one of the gzip*/
+/* representation, so that it is resumed (not compressed) with Last-Modified,*/
+/* or not kept without it*/
+static void test_gzipEtag(void) {
+	LO_http_dl_opt_t opt = { LO_RSC_SINK_FILE, LO_RSC_DIGEST_NONE, NULL, 0, 1, TEST_SIZE };
+	LO_http_dl_state_t state;
+	char range[64];
+	uint32_t gz_size = 0;
+	uint8_t *gz_body = test_gzip(&gz_size);
+
+	LOC_TEST_CHECK(gz_body != NULL);
+	if (gz_body == NULL)
+		return;
+	test_serve(test_body, "\"v1\"", "Mon, 19 Oct 2026 08:00:00 GMT");
+	loc_test_httpd.gz_body = gz_body;
+	loc_test_httpd.gz_size = gz_size;
+	loc_test_httpd.gz_etag = "\"v1-gzip\"";
+
+	/* Complete download, decoded*/
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, &opt), 0);
+	LOC_TEST_CHECK(loc_test_httpd.accept_gzip);
+	LOC_TEST_CHECK(test_file(test_body, TEST_SIZE));
+	unlink(test_path);
+
+	loc_test_httpd.cut_at = gz_size / 2;
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, &opt), -1);
+	LOC_TEST_CHECK_EQ(LO_http_dl_getState(test_path, &state), 0);
+	LOC_TEST_CHECK(state.etag[0] == 0);
+	LOC_TEST_CHECK(!strcmp(state.last_modified, "Mon, 19 Oct 2026 08:00:00 GMT"));
+	LOC_TEST_CHECK((state.offset > 0) && (state.offset < TEST_SIZE));
+
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, &opt), 0);
+	snprintf(range, sizeof(range), "bytes=%u-", state.offset);
+	LOC_TEST_CHECK(!strcmp(loc_test_httpd.range, range));
+	LOC_TEST_CHECK(!strcmp(loc_test_httpd.if_range, "Mon, 19 Oct 2026 08:00:00 GMT"));
+	LOC_TEST_CHECK(!loc_test_httpd.accept_gzip);
+	LOC_TEST_CHECK(test_file(test_body, TEST_SIZE));
+	unlink(test_path);
+
+	test_serve(test_body, "\"v1\"", NULL);
+	loc_test_httpd.cut_at = gz_size / 2;
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, &opt), -1);
+	LOC_TEST_CHECK_EQ(LO_http_dl_getState(test_path, &state), -1);
+	LOC_TEST_CHECK_EQ(LO_http_dl_get(test_url, test_path, &opt), 0);
+	LOC_TEST_CHECK(loc_test_httpd.range[0] == 0);
+	LOC_TEST_CHECK(test_file(test_body, TEST_SIZE));
+	unlink(test_path);
+
+	loc_test_httpd.gz_body = NULL;
+	free(gz_body);
+}
+#endif
+
+int main(void) {
+	uint16_t port;
+	uint32_t i;
+
+	for (i = 0; i < TEST_SIZE; i++) {
+		test_body[i] = (uint8_t) (i * 7 + (i >> 11));
+		test_body2[i] = (uint8_t) (i * 13 + 1);
+	}
+	port = loc_test_httpd_start();
+	if ((port == 0) || (mkdtemp(test_dir) == NULL)) {
+		fprintf(stderr, "cannot start the server\n");
+		return 1;
+	}
+	snprintf(test_url, sizeof(test_url), "http://127.0.0.1:%u/firmware.bin", port);
+	snprintf(test_path, sizeof(test_path), "%s/firmware.bin", test_dir);
+
+	test_resume(LO_RSC_SINK_FILE);
+	test_resume(LO_RSC_SINK_MMAP);
+	test_changed();
+	test_weak();
+	test_total();
+	LO_http_dl_cancel(test_path);
+	test_concurrent();
+	test_sinkOffset(LO_RSC_SINK_FILE);
+	test_sinkOffset(LO_RSC_SINK_MMAP);
+#if LOC_FEATURE_HTTP_GZIP
+	test_gzipEtag();
+#endif
+
+	LO_http_dl_disconnect();
+	rmdir(test_dir);
+	return LOC_TEST_RESULT();
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  test_json_tpl.c
+ * @brief Encodings of a loc_json_tpl template : full, diff mode, deadband,
+ *        and the entries of the changed fields.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "liveobjects-sys/loc_json_tpl.h"
+
+#include "loc_test.h"
+
+static int32_t test_counter = 1;
+static float test_volt = 5.0f;
+static uint8_t test_alarm = 0;
+static char test_message[32] = "READY";
+
+static const LiveObjectsD_Data_t test_set[] = {
+		{ LOD_TYPE_INT32, "counter", &test_counter, 1 },
+		{ LOD_TYPE_FLOAT, "volt", &test_volt, 1 },
+		{ LOD_TYPE_BOOL, "alarm", &test_alarm, 1 },
+		{ LOD_TYPE_STRING_C, "message", test_message, 1 }
+};
+#define TEST_SET_NB  (sizeof(test_set) / sizeof(LiveObjectsD_Data_t))
+
+static char test_buf[256];
+
+/* Encode and compare with the expected text (NULL : nothing to publish)*/
+static int test_encode(LO_json_tpl_t *tpl, const char *expected) {
+	int len = LO_json_tpl_encode(tpl, test_buf, sizeof(test_buf));
+	if (expected == NULL)
+		return (len == 0);
+	return (len == (int) strlen(expected)) && (!strcmp(test_buf, expected));
+}
+
+int main(void) {
+	LiveObjectsD_Data_t changed[TEST_SET_NB];
+	LO_json_tpl_t *tpl;
+	char small[8];
+
+	tpl = LO_json_tpl_create("\"value\":", test_set, TEST_SET_NB, NULL);
+	LOC_TEST_CHECK(tpl != NULL);
+	if (tpl == NULL)
+		return LOC_TEST_RESULT();
+
+	/* Full encodings*/
+	LOC_TEST_CHECK(test_encode(tpl, "\"value\":{\"counter\":1,\"volt\":5,\"alarm\":false,\"message\":\"READY\"}"));
+	test_counter = -12;
+	test_volt = 4.5f;
+	strcpy(test_message, "say \"hi\"");
+	LOC_TEST_CHECK(test_encode(tpl, "\"value\":{\"counter\":-12,\"volt\":4.5,\"alarm\":false,\"message\":\"say \\\"hi\\\"\"}"));
+	LOC_TEST_CHECK_EQ(LO_json_tpl_getChanged(tpl, changed, TEST_SET_NB), (int32_t) TEST_SET_NB);
+	LOC_TEST_CHECK_EQ(LO_json_tpl_encode(tpl, small, sizeof(small)), -1);
+
+	/* Diff mode : first encoding is full, then only the changed fields*/
+	LO_json_tpl_setDiff(tpl, 1, 0);
+	LOC_TEST_CHECK(test_encode(tpl, "\"value\":{\"counter\":-12,\"volt\":4.5,\"alarm\":false,\"message\":\"say \\\"hi\\\"\"}"));
+	LOC_TEST_CHECK(test_encode(tpl, NULL));
+	LOC_TEST_CHECK_EQ(LO_json_tpl_getChanged(tpl, changed, TEST_SET_NB), 0);
+
+	test_alarm = 1;
+	LOC_TEST_CHECK(test_encode(tpl, "\"value\":{\"alarm\":true}"));
+	LOC_TEST_CHECK_EQ(LO_json_tpl_getChanged(tpl, changed, TEST_SET_NB), 1);
+	LOC_TEST_CHECK(changed[0].data_value == &test_alarm);
+	LOC_TEST_CHECK(test_encode(tpl, NULL));
+
+	test_counter = 7;
+	strcpy(test_message, "DONE");
+	LOC_TEST_CHECK(test_encode(tpl, "\"value\":{\"counter\":7,\"message\":\"DONE\"}"));
+	LOC_TEST_CHECK_EQ(LO_json_tpl_getChanged(tpl, changed, TEST_SET_NB), 2);
+	LOC_TEST_CHECK(!strcmp(changed[0].data_name, "counter"));
+	LOC_TEST_CHECK(!strcmp(changed[1].data_name, "message"));
+	LOC_TEST_CHECK_EQ(LO_json_tpl_getChanged(tpl, changed, 1), -1);
+
+	/* Same string value, rewritten*/
+	strcpy(test_message, "DONE");
+	LOC_TEST_CHECK(test_encode(tpl, NULL));
+
+	/* Deadband : changed only beyond 0.5 from the last encoded value*/
+	LOC_TEST_CHECK_EQ(LO_json_tpl_setDeadband(tpl, &test_set[1], 0.5), 0);
+	LOC_TEST_CHECK_EQ(LO_json_tpl_setDeadband(tpl, &test_set[3], 0.5), -1);
+	test_volt = 4.25f;
+	LOC_TEST_CHECK(test_encode(tpl, NULL));
+	test_volt = 4.75f;
+	LOC_TEST_CHECK(test_encode(tpl, NULL));
+	test_volt = 5.0f;
+	LOC_TEST_CHECK(test_encode(tpl, "\"value\":{\"volt\":5}"));
+	test_volt = 4.75f;
+	LOC_TEST_CHECK(test_encode(tpl, NULL));
+
+	/* After a failed publish, everything is encoded again*/
+	LO_json_tpl_invalidate(tpl);
+	LOC_TEST_CHECK(test_encode(tpl, "\"value\":{\"counter\":7,\"volt\":4.75,\"alarm\":true,\"message\":\"DONE\"}"));
+	LOC_TEST_CHECK(test_encode(tpl, NULL));
+
+	/* Periodic full encoding*/
+	LO_json_tpl_setDiff(tpl, 1, 10);
+	LOC_TEST_CHECK(test_encode(tpl, "\"value\":{\"counter\":7,\"volt\":4.75,\"alarm\":true,\"message\":\"DONE\"}"));
+	LOC_TEST_CHECK(test_encode(tpl, NULL));
+	usleep(20000);
+	LOC_TEST_CHECK(test_encode(tpl, "\"value\":{\"counter\":7,\"volt\":4.75,\"alarm\":true,\"message\":\"DONE\"}"));
+	LOC_TEST_CHECK_EQ(LO_json_tpl_getChanged(tpl, changed, TEST_SET_NB), (int32_t) TEST_SET_NB);
+
+	LO_json_tpl_destroy(tpl);
+	return LOC_TEST_RESULT();
+}
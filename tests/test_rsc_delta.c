@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  test_rsc_delta.c
+ * @brief Binary delta resources of loc_rsc_delta (LOC_FEATURE_RSC_DELTA) :
+ *        valid delta received in small chunks, digest mismatch, truncated
+ *        header, invalid control lengths, diff block beyond the old image,
+ *        blocks beyond the new image, and corrupted bzip2 stream.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "liveobjects-sys/loc_rsc_delta.h"
+
+#include "loc_test.h"
+
+#if LOC_FEATURE_RSC_DELTA
+
+#define TEST_OLD_SIZE   4096
+#define TEST_NEW_SIZE   5000
+#define TEST_DELTA_MAX  (64 * 1024)
+
+/* Control triple of a delta*/
+typedef struct {
+	int64_t diff_len;
+	int64_t extra_len;
+	int64_t seek;
+} test_ctrl_t;
+
+/* Delta given by chunks to LO_rsc_delta_fill*/
+typedef struct {
+	const uint8_t *data;
+	uint32_t len;
+	uint32_t pos;
+	uint32_t chunk;
+} test_src_t;
+
+static uint8_t test_old[TEST_OLD_SIZE];
+static uint8_t test_new[TEST_NEW_SIZE];
+static uint8_t test_delta[TEST_DELTA_MAX];
+static LO_rsc_delta_t test_state;
+static char test_dir[] = "/tmp/test_rsc_delta.XXXXXX";
+static char test_old_path[128];
+static char test_path[128];
+static char test_digest[65];
+
+/* Signed 64 bits integer of bsdiff (little endian, sign and magnitude)*/
+static void test_offtout(int64_t x, uint8_t *buf) {
+	uint64_t y = (x < 0) ? -x : x;
+	int i;
+	for (i = 0; i < 8; i++, y >>= 8)
+		buf[i] = (uint8_t) y;
+	if (x < 0)
+		buf[7] |= 0x80;
+}
+
+/* Build a bsdiff 4.3 delta from the old image to new_size bytes of test_new,*/
+/* following the control triples. Return its length, or 0*/
+static uint32_t test_make(const test_ctrl_t *ctrl, int nb, int64_t new_size) {
+	static uint8_t raw[TEST_DELTA_MAX];
+	unsigned int len = TEST_DELTA_MAX - 24;
+	uint32_t raw_len = 0;
+	int64_t old_pos = 0, new_pos = 0, k;
+	int i;
+
+	memcpy(test_delta, "ENDSLEY/BSDIFF43", 16);
+	test_offtout(new_size, test_delta + 16);
+	for (i = 0; i < nb; i++) {
+		test_offtout(ctrl[i].diff_len, raw + raw_len);
+		test_offtout(ctrl[i].extra_len, raw + raw_len + 8);
+		test_offtout(ctrl[i].seek, raw + raw_len + 16);
+		raw_len += 24;
+		/* Diff block : new - old (the old bytes beyond the old image are 0)*/
+		for (k = 0; (k < ctrl[i].diff_len) && (raw_len < sizeof(raw)); k++) {
+			uint8_t old = ((old_pos + k >= 0) && (old_pos + k < TEST_OLD_SIZE)) ? test_old[old_pos + k] : 0;
+			raw[raw_len++] = test_new[(new_pos + k) % TEST_NEW_SIZE] - old;
+		}
+		old_pos += k;
+		new_pos += k;
+		for (k = 0; (k < ctrl[i].extra_len) && (raw_len < sizeof(raw)); k++)
+			raw[raw_len++] = test_new[(new_pos + k) % TEST_NEW_SIZE];
+		new_pos += k;
+		old_pos += ctrl[i].seek;
+	}
+	if (BZ2_bzBuffToBuffCompress((char *) test_delta + 24, &len, (char *) raw, raw_len, 9, 0, 0) != BZ_OK)
+		return 0;
+	return 24 + len;
+}
+
+/* Reader : at most chunk bytes at a time*/
+static int test_reader(void *ctx, char *buf, uint32_t len) {
+	test_src_t *src = (test_src_t *) ctx;
+	uint32_t n = src->len - src->pos;
+
+	if (n > src->chunk)
+		n = src->chunk;
+	if (n > len)
+		n = len;
+	memcpy(buf, src->data + src->pos, n);
+	src->pos += n;
+	return (int) n;
+}
+
+/* Apply a delta given by chunks, then close it. Return the first error of*/
+/* LO_rsc_delta_fill, else the result of LO_rsc_delta_close*/
+static int test_apply(uint32_t len, uint32_t chunk, const char *digest) {
+	test_src_t src = { test_delta, len, 0, chunk };
+	int ret, close_ret;
+
+	if (LO_rsc_delta_open(&test_state, test_old_path, test_path, LO_RSC_SINK_FILE))
+		return -100;
+	if ((digest) && (LO_rsc_delta_setDigest(&test_state, LO_RSC_DIGEST_SHA256, digest)))
+		return -101;
+	do {
+		ret = LO_rsc_delta_fill(&test_state, test_reader, &src);
+	} while (ret > 0);
+	close_ret = LO_rsc_delta_close(&test_state, 1);
+	return (ret < 0) ? ret : close_ret;
+}
+
+/* The new image is the first size bytes of test_new*/
+static int test_file(uint32_t size) {
+	static uint8_t buf[TEST_NEW_SIZE + 1];
+	FILE *fp = fopen(test_path, "rb");
+	size_t len;
+
+	if (fp == NULL)
+		return 0;
+	len = fread(buf, 1, sizeof(buf), fp);
+	fclose(fp);
+	return (len == size) && (!memcmp(buf, test_new, size));
+}
+
+/* SHA-256 of the first size bytes of test_new, in hexadecimal*/
+static void test_hash(uint32_t size) {
+	uint8_t md[32];
+	int i;
+
+	mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), test_new, size, md);
+	for (i = 0; i < 32; i++)
+		sprintf(test_digest + 2 * i, "%02x", md[i]);
+}
+
+static void test_valid(void) {
+	/* Copy with changes, extra bytes, a jump back, and a diff block running*/
+	/* beyond the end of the old image*/
+	const test_ctrl_t ctrl[] = {
+			{ 1000, 200, 500 },
+			{ 1500, 0, -2100 },
+			{ 800, 100, 1800 },
+			{ 1400, 0, 0 }
+	};
+	uint32_t len = test_make(ctrl, 4, TEST_NEW_SIZE);
+	char bad[65];
+
+	LOC_TEST_CHECK(len > 0);
+	test_hash(TEST_NEW_SIZE);
+
+	/* Header split between chunks, and the whole delta at once*/
+	LOC_TEST_CHECK_EQ(test_apply(len, 7, test_digest), 0);
+	LOC_TEST_CHECK(test_file(TEST_NEW_SIZE));
+	unlink(test_path);
+	LOC_TEST_CHECK_EQ(test_apply(len, len, test_digest), 0);
+	LOC_TEST_CHECK(test_file(TEST_NEW_SIZE));
+	unlink(test_path);
+
+	/* Digest of another image*/
+	strcpy(bad, test_digest);
+	bad[0] = (bad[0] == '0') ? '1' : '0';
+	LOC_TEST_CHECK_EQ(test_apply(len, 100, bad), LO_RSC_SINK_ERR_DIGEST);
+	LOC_TEST_CHECK(access(test_path, F_OK) != 0);
+
+	/* No digest : refused at the header*/
+	LOC_TEST_CHECK_EQ(test_apply(len, 100, NULL), -1);
+	LOC_TEST_CHECK(access(test_path, F_OK) != 0);
+}
+
+static void test_truncated(void) {
+	const test_ctrl_t ctrl[] = { { TEST_OLD_SIZE, 0, 0 } };
+	uint32_t len = test_make(ctrl, 1, TEST_OLD_SIZE);
+
+	test_hash(TEST_OLD_SIZE);
+	/* Header only partly received*/
+	LOC_TEST_CHECK_EQ(test_apply(20, 7, test_digest), -1);
+	LOC_TEST_CHECK(access(test_path, F_OK) != 0);
+	/* bzip2 stream cut*/
+	LOC_TEST_CHECK_EQ(test_apply(len - 10, 100, test_digest), -1);
+	LOC_TEST_CHECK(access(test_path, F_OK) != 0);
+	/* Not a bsdiff 4.3 delta*/
+	test_delta[7] = 'X';
+	LOC_TEST_CHECK_EQ(test_apply(len, 100, test_digest), -1);
+	LOC_TEST_CHECK(access(test_path, F_OK) != 0);
+}
+
+/* A delta refused while it is applied*/
+static void test_refused(const test_ctrl_t *ctrl, int nb, int64_t new_size) {
+	uint32_t len = test_make(ctrl, nb, new_size);
+
+	LOC_TEST_CHECK(len > 0);
+	LOC_TEST_CHECK_EQ(test_apply(len, 100, test_digest), -1);
+	LOC_TEST_CHECK(access(test_path, F_OK) != 0);
+}
+
+static void test_lengths(void) {
+	const test_ctrl_t neg_diff[] = { { -1, 0, 0 } };
+	const test_ctrl_t neg_extra[] = { { 10, -5, 0 } };
+	const test_ctrl_t big_diff[] = { { TEST_NEW_SIZE + 1, 0, 0 } };
+	const test_ctrl_t big_extra[] = { { 1000, TEST_NEW_SIZE - 999, 0 } };
+	const test_ctrl_t huge[] = { { INT64_MAX, 0, 0 } };
+	const test_ctrl_t past_end[] = { { 3000, 1000, 0 }, { 1000, 1, 0 } };
+	const test_ctrl_t short_new[] = { { 3000, 0, 0 } };
+
+	test_hash(TEST_NEW_SIZE);
+	test_refused(neg_diff, 1, TEST_NEW_SIZE);
+	test_refused(neg_extra, 1, TEST_NEW_SIZE);
+	test_refused(big_diff, 1, TEST_NEW_SIZE);
+	test_refused(big_extra, 1, TEST_NEW_SIZE);
+	test_refused(huge, 1, TEST_NEW_SIZE);
+	/* The last block runs past the size of the new image*/
+	test_refused(past_end, 2, TEST_NEW_SIZE);
+	/* The stream ends before the size of the new image*/
+	test_refused(short_new, 1, TEST_NEW_SIZE);
+	/* Size of the new image out of range*/
+	test_refused(short_new, 1, -1);
+	test_refused(short_new, 1, (int64_t) UINT32_MAX + 1);
+}
+
+static void test_corrupted(void) {
+	const test_ctrl_t ctrl[] = { { 2000, 1000, 0 }, { 2000, 0, 0 } };
+	uint32_t len = test_make(ctrl, 2, TEST_NEW_SIZE);
+
+	test_hash(TEST_NEW_SIZE);
+	/* Not a bzip2 stream*/
+	test_delta[24] = 'X';
+	LOC_TEST_CHECK_EQ(test_apply(len, 100, test_digest), -1);
+	LOC_TEST_CHECK(access(test_path, F_OK) != 0);
+
+	/* Block of the bzip2 stream altered (CRC)*/
+	len = test_make(ctrl, 2, TEST_NEW_SIZE);
+	test_delta[24 + len / 2] ^= 0x55;
+	LOC_TEST_CHECK(test_apply(len, 100, test_digest) < 0);
+	LOC_TEST_CHECK(access(test_path, F_OK) != 0);
+}
+
+#endif /* LOC_FEATURE_RSC_DELTA */
+
+int main(void) {
+#if LOC_FEATURE_RSC_DELTA
+	FILE *fp;
+	uint32_t i;
+
+	for (i = 0; i < TEST_OLD_SIZE; i++)
+		test_old[i] = (uint8_t) (i * 7 + (i >> 9));
+	for (i = 0; i < TEST_NEW_SIZE; i++)
+		test_new[i] = (uint8_t) ((i < TEST_OLD_SIZE) ? test_old[i] + ((i % 97) == 0) : i * 13 + 1);
+	if (mkdtemp(test_dir) == NULL) {
+		fprintf(stderr, "cannot create %s\n", test_dir);
+		return 1;
+	}
+	snprintf(test_old_path, sizeof(test_old_path), "%s/old.bin", test_dir);
+	snprintf(test_path, sizeof(test_path), "%s/new.bin", test_dir);
+	fp = fopen(test_old_path, "wb");
+	LOC_TEST_CHECK(fp != NULL);
+	if (fp == NULL)
+		return LOC_TEST_RESULT();
+	LOC_TEST_CHECK_EQ(fwrite(test_old, 1, TEST_OLD_SIZE, fp), TEST_OLD_SIZE);
+	fclose(fp);
+
+	test_valid();
+	test_truncated();
+	test_lengths();
+	test_corrupted();
+
+	unlink(test_old_path);
+	rmdir(test_dir);
+#endif
+	return LOC_TEST_RESULT();
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  test_sampler.c
+ * @brief Sampling tasks of loc_sampler : callbacks calling the sampler, removal
+ *        of a running task, and deferred aggregation / batch published by
+ *        LO_pubq_drain.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "liveobjects-sys/loc_pubq.h"
+#include "liveobjects-sys/loc_sampler.h"
+
+#include "loc_test.h"
+
+#define TEST_PERIOD_US     2000
+#define TEST_SAMPLES       5
+
+static int32_t test_value;
+static const LiveObjectsD_Data_t test_set[] = {
+		{ LOD_TYPE_INT32, "value", &test_value, 1 }
+};
+
+static pthread_t test_client;
+static int test_id = -1;
+static int test_sampled;
+static int test_stats_ok;
+static int test_slow_running;
+static int test_flushed;
+static uint32_t test_flushed_samples;
+static int test_published;
+static uint32_t test_published_samples;
+static int test_in_client = 1;
+
+/* Sample callback : remove its own task after TEST_SAMPLES samples*/
+static void test_sample(void *ctx) {
+	LO_sampler_stats_t stats;
+
+	test_value++;
+	if (test_sampled + 1 == TEST_SAMPLES) {
+		/* The sampler is not locked during the callback*/
+		test_stats_ok = (LO_sampler_getStats(test_id, &stats, 0) == 0) && (stats.samples == TEST_SAMPLES);
+		LO_sampler_remove(test_id);
+	}
+	__atomic_store_n(&test_sampled, test_sampled + 1, __ATOMIC_SEQ_CST);
+}
+
+static void test_slow(void *ctx) {
+	__atomic_store_n(&test_slow_running, 1, __ATOMIC_SEQ_CST);
+	usleep(20000);
+	__atomic_store_n(&test_slow_running, 0, __ATOMIC_SEQ_CST);
+}
+
+/* Deferred callbacks : LiveObjects client thread (LO_pubq_drain)*/
+static int test_flush(void *ctx, const char *msg, uint32_t msg_len, uint32_t samples) {
+	if (!pthread_equal(pthread_self(), test_client))
+		test_in_client = 0;
+	test_flushed++;
+	test_flushed_samples += samples;
+	return 0;
+}
+
+static int test_publish(void *ctx, const char *msg, uint32_t msg_len, uint32_t samples) {
+	if (!pthread_equal(pthread_self(), test_client))
+		test_in_client = 0;
+	test_published++;
+	test_published_samples += samples;
+	return 0;
+}
+
+static void test_handler(const LO_pubq_req_t *req_ptr) {
+	LOC_TEST_CHECK(0);
+}
+
+/* Wait for a flag set by the sampling thread (at most 2 s)*/
+static int test_wait(int *flag, int val) {
+	int i;
+	for (i = 0; (i < 2000) && (__atomic_load_n(flag, __ATOMIC_SEQ_CST) < val); i++)
+		usleep(1000);
+	return __atomic_load_n(flag, __ATOMIC_SEQ_CST) >= val;
+}
+
+int main(void) {
+	LO_aggr_cfg_t aggr_cfg = { 3600 * 1000, NULL, NULL, 1 };
+	LO_batch_cfg_t batch_cfg;
+	LO_sampler_task_t task;
+	LO_aggr_t *aggr;
+	LO_batch_t *batch;
+	int id;
+
+	test_client = pthread_self();
+	LO_pubq_init();
+	memset(&batch_cfg, 0, sizeof(batch_cfg));
+	batch_cfg.max_samples = 2;
+	batch_cfg.max_age_ms = 3600 * 1000;
+	batch_cfg.deferred = 1;
+	aggr = LO_aggr_create(test_set, 1, &aggr_cfg, test_publish, NULL);
+	batch = LO_batch_create(test_set, 1, &batch_cfg, test_flush, NULL);
+	LOC_TEST_CHECK((aggr != NULL) && (batch != NULL));
+	if ((aggr == NULL) || (batch == NULL))
+		return LOC_TEST_RESULT();
+
+	/* A task removing itself from its callback*/
+	memset(&task, 0, sizeof(task));
+	task.period_us = TEST_PERIOD_US;
+	task.sample_cb = test_sample;
+	task.aggr = aggr;
+	task.batch = batch;
+	test_id = LO_sampler_add(&task);
+	LOC_TEST_CHECK(test_id >= 0);
+	LOC_TEST_CHECK_EQ(LO_sampler_start(0), 0);
+	LOC_TEST_CHECK(test_wait(&test_sampled, TEST_SAMPLES));
+	usleep(10 * TEST_PERIOD_US);
+	LOC_TEST_CHECK_EQ(__atomic_load_n(&test_sampled, __ATOMIC_SEQ_CST), TEST_SAMPLES);
+	LOC_TEST_CHECK(test_stats_ok);
+
+	/* Two full batches posted, published by the client thread only*/
+	LOC_TEST_CHECK_EQ(test_flushed, 0);
+	LOC_TEST_CHECK_EQ(LO_pubq_drain(test_handler), 2);
+	LOC_TEST_CHECK_EQ(test_flushed, 2);
+	LOC_TEST_CHECK_EQ(test_flushed_samples, 4);
+
+	/* The window and the rest of the batch, posted even by destroy*/
+	LOC_TEST_CHECK_EQ(LO_aggr_flush(aggr), 0);
+	LO_batch_destroy(batch);
+	LO_aggr_destroy(aggr);
+	LOC_TEST_CHECK_EQ(test_published, 0);
+	LOC_TEST_CHECK_EQ(LO_pubq_drain(test_handler), 2);
+	LOC_TEST_CHECK_EQ(test_published, 1);
+	LOC_TEST_CHECK_EQ(test_published_samples, TEST_SAMPLES);
+	LOC_TEST_CHECK_EQ(test_flushed, 3);
+	LOC_TEST_CHECK_EQ(test_flushed_samples, TEST_SAMPLES);
+	LOC_TEST_CHECK(test_in_client);
+
+	/* Removal of a task while its callback is running : waited for*/
+	memset(&task, 0, sizeof(task));
+	task.period_us = TEST_PERIOD_US;
+	task.sample_cb = test_slow;
+	id = LO_sampler_add(&task);
+	LOC_TEST_CHECK(id >= 0);
+	LOC_TEST_CHECK(test_wait(&test_slow_running, 1));
+	LO_sampler_remove(id);
+	LOC_TEST_CHECK_EQ(__atomic_load_n(&test_slow_running, __ATOMIC_SEQ_CST), 0);
+
+	LO_sampler_stop();
+	return LOC_TEST_RESULT();
+}
@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  test_shmring.c
+ * @brief Shared memory ring of loc_shmring fed by forked producer processes :
+ *        order and timestamps of the samples, slot skipped after the death
+ *        of a producer while writing, and sample overwritten by a late producer.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "liveobjects-sys/loc_shmring.h"
+
+#include "loc_test.h"
+
+#define TEST_PRODUCERS     3
+#define TEST_PUSHES        2000
+#define TEST_TS0           1500000000000ULL     /* 2017-07-14T02:40:00.000Z*/
+
+static int32_t test_id;
+static uint32_t test_seq;
+static float test_val;
+
+static LiveObjectsD_Data_t test_set[] = {
+		{ LOD_TYPE_INT32, "id", &test_id, 1 },
+		{ LOD_TYPE_UINT32, "seq", &test_seq, 1 },
+		{ LOD_TYPE_FLOAT, "val", &test_val, 1 },
+		{ LOD_TYPE_STRING_C, "state", "ON", 1 }
+};
+#define TEST_SET_NB  (sizeof(test_set) / sizeof(LiveObjectsD_Data_t))
+
+static char test_name[64];
+static int test_pipes[2][2];            /* Late producer : stopped, then resumed*/
+static void *test_page;
+static uint32_t test_next[TEST_PRODUCERS + 1];
+static uint32_t test_total;
+static uint32_t test_errors;
+static uint32_t test_aggr_samples;
+static uint32_t test_batch_samples;
+static int test_ts_found;
+
+/* Client : the values of the sample are in test_set*/
+static void test_sample(void *ctx, uint64_t ts_ms) {
+	if ((test_id < 0) || (test_id > TEST_PRODUCERS) || (test_seq != test_next[test_id])
+			|| (ts_ms != TEST_TS0 + test_seq) || (test_val != test_seq * 0.5f)) {
+		if (test_errors++ == 0)
+			fprintf(stderr, "sample id=%d seq=%u ts=%llu val=%g unexpected\n", test_id, test_seq,
+					(unsigned long long) ts_ms, test_val);
+		return;
+	}
+	test_next[test_id]++;
+	test_total++;
+}
+
+static int test_publish(void *ctx, const char *msg, uint32_t msg_len, uint32_t samples) {
+	test_aggr_samples += samples;
+	return 0;
+}
+
+static int test_flush(void *ctx, const char *msg, uint32_t msg_len, uint32_t samples) {
+	/* Timestamp of the producer, not of the drain*/
+	if (strstr(msg, "{\"ts\":\"2017-07-14T02:40:00.000Z\","))
+		test_ts_found = 1;
+	test_batch_samples += samples;
+	return 0;
+}
+
+/* Producer process : push TEST_PUSHES samples, waiting while the ring is full*/
+static void test_producer(int32_t id) {
+	LO_shmring_t *ring = LO_shmring_open(test_name, test_set, TEST_SET_NB);
+	uint32_t seq;
+
+	if (ring == NULL)
+		_exit(1);
+	test_id = id;
+	for (seq = 0; seq < TEST_PUSHES; seq++) {
+		test_seq = seq;
+		test_val = seq * 0.5f;
+		while (LO_shmring_push(ring, TEST_TS0 + seq))
+			usleep(100);
+	}
+	LO_shmring_close(ring);
+	_exit(0);
+}
+
+static void test_crashed(int sig) {
+	_exit(0);
+}
+
+/* Producer process dying between the reservation of a slot and its publication*/
+static void test_dying(int32_t id) {
+	LiveObjectsD_Data_t set[TEST_SET_NB];
+	LO_shmring_t *ring;
+	void *page;
+
+	/* The value of "val" is read from a page which cannot be read*/
+	memcpy(set, test_set, sizeof(set));
+	page = mmap(NULL, 4096, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	set[2].data_value = page;
+	ring = LO_shmring_open(test_name, set, TEST_SET_NB);
+	if ((ring == NULL) || (page == MAP_FAILED))
+		_exit(1);
+	signal(SIGSEGV, test_crashed);
+	LO_shmring_push(ring, 0);
+	_exit(1);
+}
+
+static void test_resume(int sig) {
+	char cc = 0;
+	if ((write(test_pipes[0][1], &cc, 1) != 1) || (read(test_pipes[1][0], &cc, 1) != 1))
+		_exit(1);
+	mprotect(test_page, 4096, PROT_READ);
+}
+
+/* Producer process stopped while writing, until the slot is skipped and written again*/
+static void test_late(int32_t id) {
+	LiveObjectsD_Data_t set[TEST_SET_NB];
+	LO_shmring_t *ring;
+
+	/* The value of "val" is read from a page which cannot be read yet*/
+	memcpy(set, test_set, sizeof(set));
+	test_page = mmap(NULL, 4096, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	set[2].data_value = test_page;
+	ring = LO_shmring_open(test_name, set, TEST_SET_NB);
+	if ((ring == NULL) || (test_page == MAP_FAILED))
+		_exit(1);
+	signal(SIGSEGV, test_resume);
+	test_id = id;
+	_exit(LO_shmring_push(ring, 0) == -1 ? 0 : 1);
+}
+
+/* Fork a process running fn(id). Return its pid, or -1*/
+static pid_t test_fork(void (*fn)(int32_t), int32_t id) {
+	pid_t pid = fork();
+	if (pid == 0)
+		fn(id);
+	return pid;
+}
+
+/* Drain until nb samples are received (at most 10 s)*/
+static void test_drain(LO_shmring_t *ring, uint32_t nb) {
+	uint64_t t0 = loc_test_now_ns();
+	while ((test_total < nb) && (loc_test_now_ns() - t0 < 10000000000ULL)) {
+		if (LO_shmring_drain(ring, 0) == 0)
+			usleep(200);
+	}
+}
+
+static int test_exited(pid_t pid) {
+	int status;
+	return (pid > 0) && (waitpid(pid, &status, 0) == pid) && (WIFEXITED(status))
+			&& (WEXITSTATUS(status) == 0);
+}
+
+int main(void) {
+	LO_aggr_cfg_t aggr_cfg = { 3600 * 1000, NULL, NULL, 0 };
+	LO_batch_cfg_t batch_cfg;
+	LO_shmring_cfg_t cfg;
+	LO_shmring_stats_t stats;
+	LO_shmring_t *ring, *producer;
+	pid_t pids[TEST_PRODUCERS];
+	pid_t pid;
+	uint64_t t0;
+	int32_t i;
+	char cc = 0;
+
+	snprintf(test_name, sizeof(test_name), "/loc_test_shmring.%d", (int) getpid());
+	memset(&batch_cfg, 0, sizeof(batch_cfg));
+	batch_cfg.max_samples = 16;
+	batch_cfg.max_age_ms = 3600 * 1000;
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.capacity = 64;
+	cfg.sample_cb = test_sample;
+	cfg.aggr = LO_aggr_create(test_set, TEST_SET_NB, &aggr_cfg, test_publish, NULL);
+	cfg.batch = LO_batch_create(test_set, TEST_SET_NB, &batch_cfg, test_flush, NULL);
+	ring = LO_shmring_create(test_name, test_set, TEST_SET_NB, &cfg);
+	LOC_TEST_CHECK((ring != NULL) && (cfg.aggr != NULL) && (cfg.batch != NULL));
+	if ((ring == NULL) || (cfg.aggr == NULL) || (cfg.batch == NULL))
+		return LOC_TEST_RESULT();
+
+	/* Producers in other processes, faster than the client (ring of 64 samples)*/
+	for (i = 0; i < TEST_PRODUCERS; i++)
+		pids[i] = test_fork(test_producer, i);
+	test_drain(ring, TEST_PRODUCERS * TEST_PUSHES);
+	for (i = 0; i < TEST_PRODUCERS; i++) {
+		LOC_TEST_CHECK(test_exited(pids[i]));
+		LOC_TEST_CHECK_EQ(test_next[i], TEST_PUSHES);
+	}
+	LOC_TEST_CHECK_EQ(test_errors, 0);
+	LOC_TEST_CHECK_EQ(test_total, TEST_PRODUCERS * TEST_PUSHES);
+
+	LOC_TEST_CHECK_EQ(LO_aggr_flush(cfg.aggr), 0);
+	LOC_TEST_CHECK_EQ(LO_batch_flush(cfg.batch), 0);
+	LOC_TEST_CHECK_EQ(test_aggr_samples, TEST_PRODUCERS * TEST_PUSHES);
+	LOC_TEST_CHECK_EQ(test_batch_samples, TEST_PRODUCERS * TEST_PUSHES);
+	LOC_TEST_CHECK(test_ts_found);
+
+	/* A producer dies while writing : its slot holds up the next sample, then is skipped*/
+	LOC_TEST_CHECK(test_exited(test_fork(test_dying, 0)));
+	producer = LO_shmring_open(test_name, test_set, TEST_SET_NB);
+	LOC_TEST_CHECK(producer != NULL);
+	if (producer) {
+		test_id = TEST_PRODUCERS;
+		test_seq = 0;
+		test_val = 0;
+		LOC_TEST_CHECK_EQ(LO_shmring_push(producer, TEST_TS0), 0);
+		LOC_TEST_CHECK_EQ(LO_shmring_drain(ring, 0), 0);
+		t0 = loc_test_now_ns();
+		test_drain(ring, TEST_PRODUCERS * TEST_PUSHES + 1);
+		LOC_TEST_CHECK(loc_test_now_ns() - t0 >= (LOC_SHMRING_STUCK_MS - 10) * 1000000ULL);
+		LOC_TEST_CHECK_EQ(test_next[TEST_PRODUCERS], 1);
+		LO_shmring_close(producer);
+	}
+	LO_shmring_getStats(ring, &stats);
+	LOC_TEST_CHECK_EQ(stats.skipped, 1);
+	LOC_TEST_CHECK_EQ(stats.drained, TEST_PRODUCERS * TEST_PUSHES + 1);
+	LOC_TEST_CHECK_EQ(stats.pending, 0);
+
+	/* A producer stopped while writing : its slot is skipped, then written one turn*/
+	/* later, and overwritten by the producer resumed : this sample is skipped too*/
+	LOC_TEST_CHECK((pipe(test_pipes[0]) == 0) && (pipe(test_pipes[1]) == 0));
+	pid = test_fork(test_late, TEST_PRODUCERS);
+	LOC_TEST_CHECK_EQ(read(test_pipes[0][0], &cc, 1), 1);
+	producer = LO_shmring_open(test_name, test_set, TEST_SET_NB);
+	LOC_TEST_CHECK(producer != NULL);
+	if (producer) {
+		test_id = TEST_PRODUCERS;
+		for (test_seq = 1; test_seq < cfg.capacity; test_seq++) {
+			test_val = test_seq * 0.5f;
+			LOC_TEST_CHECK_EQ(LO_shmring_push(producer, TEST_TS0 + test_seq), 0);
+			test_drain(ring, TEST_PRODUCERS * TEST_PUSHES + 1 + test_seq);
+		}
+		test_val = test_seq * 0.5f;
+		LOC_TEST_CHECK_EQ(LO_shmring_push(producer, TEST_TS0 + test_seq), 0);
+		LOC_TEST_CHECK_EQ(write(test_pipes[1][1], &cc, 1), 1);
+		LOC_TEST_CHECK(test_exited(pid));
+		LOC_TEST_CHECK_EQ(LO_shmring_drain(ring, 0), 0);
+		/* And the ring goes on*/
+		LOC_TEST_CHECK_EQ(LO_shmring_push(producer, TEST_TS0 + test_seq), 0);
+		LOC_TEST_CHECK_EQ(LO_shmring_drain(ring, 0), 1);
+		LOC_TEST_CHECK_EQ(test_next[TEST_PRODUCERS], cfg.capacity + 1);
+		LO_shmring_close(producer);
+	}
+	LO_shmring_getStats(ring, &stats);
+	LOC_TEST_CHECK_EQ(stats.skipped, 3);
+	LOC_TEST_CHECK_EQ(test_errors, 0);
+
+	LO_shmring_close(ring);
+	LO_batch_destroy(cfg.batch);
+	LO_aggr_destroy(cfg.aggr);
+	return LOC_TEST_RESULT();
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  test_wakeup.c
+ * @brief Wakeup of the client loop by loc_wakeup : signals of another thread
+ *        while a packet is read, then while the loop is idle, without
+ *        LO_wakeup_arm.
+ */
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "liveobjects-sys/loc_wakeup.h"
+
+#include "loc_test.h"
+
+static void *test_signal(void *arg) {
+	LO_wakeup_signal();
+	return NULL;
+}
+
+/* Signal from another thread*/
+static void test_signalOther(void) {
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, test_signal, NULL) == 0)
+		pthread_join(thread, NULL);
+}
+
+int main(void) {
+	uint64_t t0;
+	char cc;
+	int sv[2];
+
+	LOC_TEST_CHECK_EQ(LO_wakeup_init(), 0);
+	LOC_TEST_CHECK_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+	/* Signals of the loop thread itself are ignored*/
+	LOC_TEST_CHECK_EQ(LO_wakeup_wait(sv[0], 0), 0);
+	LO_wakeup_signal();
+	LOC_TEST_CHECK_EQ(LO_wakeup_wait(sv[0], 10), 0);
+
+	/* Data received : disarmed, a signal does not cut the next read*/
+	LOC_TEST_CHECK_EQ(write(sv[1], "ab", 2), 2);
+	LOC_TEST_CHECK_EQ(LO_wakeup_wait(sv[0], LO_WAKEUP_TMO_INFINITE), LO_WAKEUP_SOCKET);
+	LOC_TEST_CHECK_EQ(read(sv[0], &cc, 1), 1);
+	test_signalOther();
+	LOC_TEST_CHECK_EQ(LO_wakeup_wait(sv[0], LO_WAKEUP_TMO_INFINITE), LO_WAKEUP_SOCKET);
+	LOC_TEST_CHECK_EQ(read(sv[0], &cc, 1), 1);
+
+	/* No more data : armed again after LOC_WAKEUP_IDLE_MS, the pending signal*/
+	/* ends an infinite wait (no LO_wakeup_arm)*/
+	t0 = loc_test_now_ns();
+	LOC_TEST_CHECK_EQ(LO_wakeup_wait(sv[0], LO_WAKEUP_TMO_INFINITE), LO_WAKEUP_EVENT);
+	LOC_TEST_CHECK(loc_test_now_ns() - t0 >= (LOC_WAKEUP_IDLE_MS - 5) * 1000000ULL);
+
+	/* Idle loop : woken up at once*/
+	test_signalOther();
+	t0 = loc_test_now_ns();
+	LOC_TEST_CHECK_EQ(LO_wakeup_wait(sv[0], LO_WAKEUP_TMO_INFINITE), LO_WAKEUP_EVENT);
+	LOC_TEST_CHECK(loc_test_now_ns() - t0 < LOC_WAKEUP_IDLE_MS * 1000000ULL);
+
+	close(sv[0]);
+	close(sv[1]);
+	LO_wakeup_close();
+	return LOC_TEST_RESULT();
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2016 Orange
+ *
+ * This software is distributed under the terms and conditions of the
+ * 'BSD-3-Clause'
+ * license which can be found in the file 'LICENSE.txt' in this package
+ * distribution
+ * or at 'https://opensource.org/licenses/BSD-3-Clause'.
+ */
+
+/**
+ * @file  test_workers.c
+ * @brief Commands and parameters run by loc_workers, from the request to the
+ *        response given to the responder by LO_pubq_drain.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "liveobjects-sys/loc_pubq.h"
+#include "liveobjects-sys/loc_wakeup.h"
+#include "liveobjects-sys/loc_workers.h"
+
+#include "loc_test.h"
+
+#define TEST_CID_OK       11
+#define TEST_CID_ERROR    12
+#define TEST_CID_PENDING  13
+#define TEST_CID_BYNAME   14
+#define TEST_RSP_MAX      8
+
+static LiveObjectsD_Command_t test_cmd = { 1, "TEST", 0 };
+static LiveObjectsD_Command_t test_cmd_unknown = { 2, "UNKNOWN", 0 };
+static LiveObjectsD_Param_t test_param = { 1, { LOD_TYPE_STRING_C, "name", NULL, 1 } };
+
+static LO_pubq_req_t test_rsp[TEST_RSP_MAX];
+static int test_rsp_nb = 0;
+static pthread_t test_client;
+static int test_handler_in_client = 0;
+static int test_check_in_worker = 0;
+static char test_arg_value[16];
+static char test_param_value[16];
+
+/* Responder : LiveObjects client thread*/
+static void test_responder(const LO_pubq_req_t *req_ptr) {
+	if (test_rsp_nb < TEST_RSP_MAX)
+		test_rsp[test_rsp_nb] = *req_ptr;
+	test_rsp_nb++;
+}
+
+static const LO_pubq_req_t *test_findRsp(uint8_t type, int16_t hdl) {
+	int i;
+	for (i = 0; (i < test_rsp_nb) && (i < TEST_RSP_MAX); i++) {
+		if ((test_rsp[i].req_type == type) && (test_rsp[i].req_hdl == hdl))
+			return &test_rsp[i];
+	}
+	return NULL;
+}
+
+static void *test_completer(void *arg) {
+	usleep(20000);
+	LO_workers_complete(TEST_CID_PENDING, 1);
+	return NULL;
+}
+
+/* Command handler : worker thread*/
+static int test_doCommand(LiveObjectsD_CommandRequestBlock_t *pCmdReqBlk) {
+	pthread_t th;
+
+	if (pthread_equal(pthread_self(), test_client))
+		test_handler_in_client = 1;
+
+	switch (pCmdReqBlk->hd.cmd_cid) {
+	case TEST_CID_OK:
+		/* The arguments are a copy of the request*/
+		if ((pCmdReqBlk->hd.cmd_args_nb == 1) && (!strcmp(pCmdReqBlk->args_array[0].arg_name, "ticks")))
+			strncpy(test_arg_value, pCmdReqBlk->args_array[0].arg_value, sizeof(test_arg_value) - 1);
+		return 1;
+	case TEST_CID_PENDING:
+		/* Completed later, by another thread*/
+		pthread_create(&th, NULL, test_completer, NULL);
+		pthread_detach(th);
+		return 0;
+	case TEST_CID_BYNAME:
+		return 2;
+	default:
+		return -3;
+	}
+}
+
+/* Parameter check : client thread*/
+static int test_checkParam(const LiveObjectsD_Param_t *param_ptr, const void *value, int len) {
+	if (!pthread_equal(pthread_self(), test_client))
+		test_check_in_worker = 1;
+	return (strcmp((const char *) value, "BAD")) ? 0 : -2;
+}
+
+/* Parameter handler : worker thread*/
+static int test_doParam(const LiveObjectsD_Param_t *param_ptr, const void *value, int len) {
+	if (len < (int) sizeof(test_param_value))
+		memcpy(test_param_value, value, len + 1);
+	return 0;
+}
+
+static const LO_workers_cmd_t test_commands[] = {
+		{ "OTHER", NULL },
+		{ "TEST", test_doCommand }
+};
+
+/* As a command callback : returns 0 (response pending) if posted*/
+static int test_post(int16_t cid, const char *arg_value) {
+	LiveObjectsD_CommandRequestBlock_t blk;
+	int ret;
+	char name[8] = "ticks";
+	char value[16];
+
+	memset(&blk, 0, sizeof(blk));
+	blk.hd.cmd_ptr = &test_cmd;
+	blk.hd.cmd_cid = cid;
+	if (arg_value) {
+		strcpy(value, arg_value);
+		blk.hd.cmd_args_nb = 1;
+		blk.args_array[0].arg_name = name;
+		blk.args_array[0].arg_value = value;
+	}
+	ret = LO_workers_command(&blk, test_doCommand);
+	/* The receive buffer is reused by the client*/
+	memset(name, 'x', sizeof(name) - 1);
+	memset(value, 'x', sizeof(value) - 1);
+	return ret;
+}
+
+int main(void) {
+	LiveObjectsD_CommandRequestBlock_t blk_byname;
+	char value[] = "TICTAC";
+	uint64_t t_end;
+
+	memset(&blk_byname, 0, sizeof(blk_byname));
+
+	test_client = pthread_self();
+	LO_pubq_init();
+	LO_wakeup_init();
+	LO_workers_setResponder(test_responder);
+	LOC_TEST_CHECK_EQ(LO_workers_setCommands(test_commands, 2), 0);
+
+	/* Not started*/
+	LOC_TEST_CHECK_EQ(test_post(TEST_CID_OK, NULL), -1);
+
+	LOC_TEST_CHECK_EQ(LO_workers_start(2), 0);
+
+	LOC_TEST_CHECK_EQ(test_post(TEST_CID_OK, "3"), 0);
+	LOC_TEST_CHECK_EQ(test_post(TEST_CID_ERROR, NULL), 0);
+	LOC_TEST_CHECK_EQ(test_post(TEST_CID_PENDING, NULL), 0);
+	/* Handler found by name*/
+	blk_byname.hd.cmd_ptr = &test_cmd;
+	blk_byname.hd.cmd_cid = TEST_CID_BYNAME;
+	LOC_TEST_CHECK_EQ(LO_workers_dispatch(&blk_byname), 0);
+	blk_byname.hd.cmd_ptr = &test_cmd_unknown;
+	LOC_TEST_CHECK_EQ(LO_workers_dispatch(&blk_byname), -4);
+	LOC_TEST_CHECK_EQ(LO_workers_param(&test_param, value, strlen(value), test_checkParam, test_doParam), 0);
+	/* Refused by the check, not posted*/
+	LOC_TEST_CHECK_EQ(LO_workers_param(&test_param, "BAD", 3, test_checkParam, test_doParam), -2);
+	memset(value, 0, sizeof(value));
+
+	/* Client loop : wait for the wakeups and drain the publish queue*/
+	t_end = loc_test_now_ns() + 5000000000ull;
+	while ((test_rsp_nb < 5) && (loc_test_now_ns() < t_end)) {
+		LO_wakeup_arm();
+		LO_wakeup_wait(-1, 1000);
+		LO_pubq_drain(NULL);
+	}
+
+	LOC_TEST_CHECK_EQ(test_rsp_nb, 5);
+	LOC_TEST_CHECK(!test_handler_in_client);
+	LOC_TEST_CHECK(!test_check_in_worker);
+	LOC_TEST_CHECK(test_findRsp(LO_PUBQ_REQ_CMD_RSP, TEST_CID_OK) != NULL);
+	if (test_findRsp(LO_PUBQ_REQ_CMD_RSP, TEST_CID_OK))
+		LOC_TEST_CHECK_EQ(test_findRsp(LO_PUBQ_REQ_CMD_RSP, TEST_CID_OK)->req_val, 1);
+	LOC_TEST_CHECK(!strcmp(test_arg_value, "3"));
+	LOC_TEST_CHECK(test_findRsp(LO_PUBQ_REQ_CMD_RSP, TEST_CID_ERROR) != NULL);
+	if (test_findRsp(LO_PUBQ_REQ_CMD_RSP, TEST_CID_ERROR))
+		LOC_TEST_CHECK_EQ(test_findRsp(LO_PUBQ_REQ_CMD_RSP, TEST_CID_ERROR)->req_val, -3);
+	LOC_TEST_CHECK(test_findRsp(LO_PUBQ_REQ_CMD_RSP, TEST_CID_PENDING) != NULL);
+	if (test_findRsp(LO_PUBQ_REQ_CMD_RSP, TEST_CID_PENDING))
+		LOC_TEST_CHECK_EQ(test_findRsp(LO_PUBQ_REQ_CMD_RSP, TEST_CID_PENDING)->req_val, 1);
+	LOC_TEST_CHECK(test_findRsp(LO_PUBQ_REQ_CMD_RSP, TEST_CID_BYNAME) != NULL);
+	LOC_TEST_CHECK(test_findRsp(LO_PUBQ_REQ_PARAM_RSP, 0) != NULL);
+	if (test_findRsp(LO_PUBQ_REQ_PARAM_RSP, 0)) {
+		LOC_TEST_CHECK(test_findRsp(LO_PUBQ_REQ_PARAM_RSP, 0)->req_ctx == &test_param);
+		LOC_TEST_CHECK_EQ(test_findRsp(LO_PUBQ_REQ_PARAM_RSP, 0)->req_val, 0);
+	}
+	LOC_TEST_CHECK(!strcmp(test_param_value, "TICTAC"));
+
+	/* A command without identifier cannot be completed*/
+	LOC_TEST_CHECK_EQ(LO_workers_complete(0, 1), -1);
+
+	LO_workers_stop();
+	LO_wakeup_close();
+	return LOC_TEST_RESULT();
+}